@@ -0,0 +1,1322 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <foundation.h>
+#define FDN_IMPLEMENTATION
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// --- Allocation Counting ---
+// Every heap call made by the code under benchmark (including the arena and
+// the writer in the foundation library) goes through these counters. They are
+// installed before the unity build includes below.
+
+static uint64_t bench_heap_calls = 0;
+
+static void *bench_malloc(size_t size) {
+    bench_heap_calls++;
+    return malloc(size);
+}
+
+static void *bench_realloc(void *ptr, size_t size) {
+    bench_heap_calls++;
+    return realloc(ptr, size);
+}
+
+#define malloc(size) bench_malloc(size)
+#define realloc(ptr, size) bench_realloc(ptr, size)
+
+// --- Project Includes (Unity Build Style) ---
+// Same as the test runner: the .c files are included directly so that the
+// benchmarks can reach static functions and tables.
+#include "json/lexer.c"
+#include "json/parser.c"
+#include "json/writer.c"
+#include "lsp/cache.c"
+#include "lsp/completion.c"
+#include "lsp/dispatcher.c"
+#include "lsp/documents.c"
+#include "lsp/imports.c"
+#include "lsp/references.c"
+#include "lsp/server.c"
+#include "lsp/symbols.c"
+#include "lsp/transport.c"
+#include "lsp/workspace.c"
+#include "solidity/lexer.c"
+#include "solidity/parser.c"
+
+// ==============================================================================
+// 1. THE BENCHMARK FRAMEWORK
+// ==============================================================================
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Keeps the optimizer from removing the benchmarked work.
+static volatile uintptr_t bench_sink;
+
+#define RUN_BENCH(func) \
+    do { \
+        printf("--- Running: %s ---\n", #func); \
+        func(); \
+        printf("\n"); \
+    } while (0)
+
+// ==============================================================================
+// 2. THE BENCHMARKS
+// ==============================================================================
+
+// The client -> server methods of the LSP 3.17 specification.
+static const char *lsp_methods[] = {
+    "initialize", "initialized", "shutdown", "exit", "$/cancelRequest",
+    "$/setTrace", "$/progress", "window/workDoneProgress/cancel",
+    "workspace/didChangeConfiguration", "workspace/didChangeWatchedFiles",
+    "workspace/didChangeWorkspaceFolders", "workspace/symbol",
+    "workspaceSymbol/resolve", "workspace/executeCommand",
+    "workspace/willCreateFiles", "workspace/didCreateFiles",
+    "workspace/willRenameFiles", "workspace/didRenameFiles",
+    "workspace/willDeleteFiles", "workspace/didDeleteFiles",
+    "workspace/diagnostic", "textDocument/didOpen", "textDocument/didChange",
+    "textDocument/willSave", "textDocument/willSaveWaitUntil",
+    "textDocument/didSave", "textDocument/didClose", "textDocument/completion",
+    "completionItem/resolve", "textDocument/hover", "textDocument/signatureHelp",
+    "textDocument/declaration", "textDocument/definition",
+    "textDocument/typeDefinition", "textDocument/implementation",
+    "textDocument/references", "textDocument/documentHighlight",
+    "textDocument/documentSymbol", "textDocument/codeAction",
+    "codeAction/resolve", "textDocument/codeLens", "codeLens/resolve",
+    "textDocument/documentLink", "documentLink/resolve",
+    "textDocument/documentColor", "textDocument/colorPresentation",
+    "textDocument/formatting", "textDocument/rangeFormatting",
+    "textDocument/onTypeFormatting", "textDocument/rename",
+    "textDocument/prepareRename", "textDocument/foldingRange",
+    "textDocument/selectionRange", "textDocument/prepareCallHierarchy",
+    "callHierarchy/incomingCalls", "callHierarchy/outgoingCalls",
+    "textDocument/semanticTokens/full", "textDocument/semanticTokens/full/delta",
+    "textDocument/semanticTokens/range", "textDocument/linkedEditingRange",
+    "textDocument/moniker", "textDocument/prepareTypeHierarchy",
+    "typeHierarchy/supertypes", "typeHierarchy/subtypes",
+    "textDocument/inlineValue", "textDocument/inlayHint", "inlayHint/resolve",
+    "textDocument/diagnostic",
+};
+
+#define LSP_METHOD_COUNT (sizeof(lsp_methods) / sizeof(lsp_methods[0]))
+#define DISPATCH_ITERATIONS 200000
+
+// Compares a perfect hash over the full LSP method set with the linear
+// `strcmp` chain the dispatcher used before. Lookups are timed per method, so
+// the cost of a method late in the table is visible.
+void bench_dispatch_lookup(void) {
+    fdn_string methods[LSP_METHOD_COUNT];
+    for (size_t i = 0; i < LSP_METHOD_COUNT; i++) {
+        methods[i] = fdn_string_create_view(lsp_methods[i], strlen(lsp_methods[i]));
+    }
+
+    static uint16_t slots[1024];
+    fdn_perfect_hash hash;
+    if (!fdn_perfect_hash_build(&hash, methods, LSP_METHOD_COUNT, slots, 1024)) {
+        printf("    failed to build the perfect hash\n");
+        return;
+    }
+
+    double hash_min = 1e9, hash_max = 0, linear_min = 1e9, linear_max = 0;
+
+    for (size_t m = 0; m < LSP_METHOD_COUNT; m++) {
+        double start = now_seconds();
+        for (int i = 0; i < DISPATCH_ITERATIONS; i++) {
+            uint32_t index = fdn_perfect_hash_find(&hash, methods[m]);
+            bench_sink += fdn_string_is_eq(methods[index], methods[m]);
+        }
+        double hash_ns = (now_seconds() - start) * 1e9 / DISPATCH_ITERATIONS;
+
+        start = now_seconds();
+        for (int i = 0; i < DISPATCH_ITERATIONS; i++) {
+            for (size_t j = 0; j < LSP_METHOD_COUNT; j++) {
+                if (fdn_string_is_eq_c_str(methods[m], lsp_methods[j])) {
+                    bench_sink += j;
+                    break;
+                }
+            }
+        }
+        double linear_ns = (now_seconds() - start) * 1e9 / DISPATCH_ITERATIONS;
+
+        hash_min = hash_ns < hash_min ? hash_ns : hash_min;
+        hash_max = hash_ns > hash_max ? hash_ns : hash_max;
+        linear_min = linear_ns < linear_min ? linear_ns : linear_min;
+        linear_max = linear_ns > linear_max ? linear_ns : linear_max;
+    }
+
+    printf("    %zu methods\n", LSP_METHOD_COUNT);
+    printf("    perfect hash: %6.1f .. %6.1f ns/lookup\n", hash_min, hash_max);
+    printf("    linear scan:  %6.1f .. %6.1f ns/lookup\n", linear_min, linear_max);
+
+    // The dispatcher itself, hits and misses.
+    fdn_arena arena;
+    fdn_arena_init(&arena, 4096);
+    dispatcher_init(&arena);
+
+    double start = now_seconds();
+    for (int i = 0; i < DISPATCH_ITERATIONS; i++) {
+        for (size_t m = 0; m < LSP_METHOD_COUNT; m++) {
+            bench_sink += (uintptr_t)dispatch_lookup(methods[m]);
+        }
+    }
+    double ns = (now_seconds() - start) * 1e9 / (DISPATCH_ITERATIONS * (double)LSP_METHOD_COUNT);
+    printf("    dispatch_lookup: %6.1f ns/lookup (all methods, hits and misses)\n", ns);
+
+    fdn_arena_free(&arena);
+}
+
+// ------------------------------------------------------------------------------
+// Corpus: realistic shapes of the traffic an editor sends.
+// ------------------------------------------------------------------------------
+
+typedef struct {
+    const char *name;
+    char **messages; // Null-terminated message bodies.
+    size_t count;
+    size_t bytes;    // Total size of the bodies.
+} BenchCorpus;
+
+// A single contract; `%zu` is replaced by its index.
+#define BENCH_CONTRACT_TEMPLATE \
+    "/// @title Token %zu\n" \
+    "/// @notice An ERC20 token with \"quoted\" docs and a \\ backslash.\n" \
+    "contract Token%zu is IERC20 {\n" \
+    "    mapping(address => uint256) private _balances;\n" \
+    "    mapping(address => mapping(address => uint256)) private _allowances;\n" \
+    "    uint256 private _totalSupply;\n" \
+    "    string private _name = \"Token %zu\";\n" \
+    "\n" \
+    "    event Minted(address indexed to, uint256 amount);\n" \
+    "    error InsufficientBalance(uint256 available, uint256 required);\n" \
+    "\n" \
+    "    modifier onlyPositive(uint256 amount) {\n" \
+    "        require(amount > 0, \"amount must be positive\");\n" \
+    "        _;\n" \
+    "    }\n" \
+    "\n" \
+    "    function totalSupply() external view returns (uint256) {\n" \
+    "        return _totalSupply;\n" \
+    "    }\n" \
+    "\n" \
+    "    function balanceOf(address account) external view returns (uint256) {\n" \
+    "        return _balances[account];\n" \
+    "    }\n" \
+    "\n" \
+    "    function transfer(address to, uint256 amount) external onlyPositive(amount) returns (bool) {\n" \
+    "        uint256 balance = _balances[msg.sender];\n" \
+    "        if (balance < amount) {\n" \
+    "            revert InsufficientBalance(balance, amount);\n" \
+    "        }\n" \
+    "        unchecked {\n" \
+    "            _balances[msg.sender] = balance - amount;\n" \
+    "        }\n" \
+    "        _balances[to] += amount; /* credit the receiver */\n" \
+    "        emit Transfer(msg.sender, to, amount);\n" \
+    "        return true;\n" \
+    "    }\n" \
+    "\n" \
+    "    function approve(address spender, uint256 amount) external returns (bool) {\n" \
+    "        _allowances[msg.sender][spender] = amount;\n" \
+    "        emit Approval(msg.sender, spender, amount);\n" \
+    "        return true;\n" \
+    "    }\n" \
+    "\n" \
+    "    function _mint(address to, uint256 amount) internal {\n" \
+    "        _totalSupply += amount * 10 ** 18 + 0x1f;\n" \
+    "        _balances[to] += amount;\n" \
+    "        emit Minted(to, amount);\n" \
+    "    }\n" \
+    "}\n" \
+    "\n"
+
+// bench_generate_contract returns a Solidity source of roughly `lines` lines,
+// made of ERC20-like contracts with comments, events, mappings and functions.
+static char *bench_generate_contract(size_t lines) {
+    const char *header =
+        "// SPDX-License-Identifier: MIT\n"
+        "pragma solidity ^0.8.20;\n"
+        "\n"
+        "import {IERC20} from \"@openzeppelin/contracts/token/ERC20/IERC20.sol\";\n"
+        "\n";
+    const size_t contract_lines = 50;
+
+    size_t copies = lines / contract_lines + 1;
+    size_t capacity = strlen(header) + copies * (strlen(BENCH_CONTRACT_TEMPLATE) + 64) + 1;
+    char *source = malloc(capacity);
+    size_t length = (size_t)snprintf(source, capacity, "%s", header);
+
+    for (size_t i = 0; i < copies; i++) {
+        length += (size_t)snprintf(source + length, capacity - length, BENCH_CONTRACT_TEMPLATE, i, i, i);
+    }
+
+    return source;
+}
+
+static void corpus_add(BenchCorpus *corpus, JsonWriter *writer) {
+    fdn_string output = json_writer_output(writer);
+    char *message = malloc(output.string_length + 1);
+    memcpy(message, output.string_start, output.string_length);
+    message[output.string_length] = '\0';
+
+    corpus->messages = realloc(corpus->messages, (corpus->count + 1) * sizeof(char *));
+    corpus->messages[corpus->count++] = message;
+    corpus->bytes += output.string_length;
+}
+
+static void corpus_free(BenchCorpus *corpus) {
+    for (size_t i = 0; i < corpus->count; i++) {
+        free(corpus->messages[i]);
+    }
+    free(corpus->messages);
+}
+
+static void write_request_header(JsonWriter *w, int64_t id, const char *method) {
+    json_writer_reset(w);
+    json_writer_begin_object(w);
+    json_writer_key(w, "jsonrpc");
+    json_writer_string_c(w, "2.0");
+    if (id >= 0) {
+        json_writer_key(w, "id");
+        json_writer_int(w, id);
+    }
+    json_writer_key(w, "method");
+    json_writer_string_c(w, method);
+    json_writer_key(w, "params");
+}
+
+static void write_position(JsonWriter *w, const char *key, int64_t line, int64_t character) {
+    json_writer_key(w, key);
+    json_writer_begin_object(w);
+    json_writer_key(w, "line");
+    json_writer_int(w, line);
+    json_writer_key(w, "character");
+    json_writer_int(w, character);
+    json_writer_end_object(w);
+}
+
+static void write_text_document(JsonWriter *w, int64_t version) {
+    json_writer_key(w, "textDocument");
+    json_writer_begin_object(w);
+    json_writer_key(w, "uri");
+    json_writer_string_c(w, "file:///home/dev/project/src/Token.sol");
+    if (version >= 0) {
+        json_writer_key(w, "version");
+        json_writer_int(w, version);
+    }
+    json_writer_end_object(w);
+}
+
+// An initialize request with the (large) capabilities a full featured editor
+// announces.
+static void corpus_initialize(BenchCorpus *corpus, JsonWriter *w) {
+    const char *capabilities =
+        "{\"workspace\":{\"applyEdit\":true,\"workspaceEdit\":{\"documentChanges\":true,"
+        "\"resourceOperations\":[\"create\",\"rename\",\"delete\"],\"failureHandling\":"
+        "\"textOnlyTransactional\",\"normalizesLineEndings\":true,\"changeAnnotationSupport\":"
+        "{\"groupsOnLabel\":true}},\"didChangeConfiguration\":{\"dynamicRegistration\":true},"
+        "\"didChangeWatchedFiles\":{\"dynamicRegistration\":true,\"relativePatternSupport\":true},"
+        "\"symbol\":{\"dynamicRegistration\":true,\"symbolKind\":{\"valueSet\":[1,2,3,4,5,6,7,"
+        "8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26]},\"tagSupport\":{\"valueSet\":[1]},"
+        "\"resolveSupport\":{\"properties\":[\"location.range\"]}},\"codeLens\":{\"refreshSupport\":"
+        "true},\"executeCommand\":{\"dynamicRegistration\":true},\"workspaceFolders\":true,"
+        "\"configuration\":true,\"semanticTokens\":{\"refreshSupport\":true},\"fileOperations\":"
+        "{\"dynamicRegistration\":true,\"didCreate\":true,\"didRename\":true,\"didDelete\":true,"
+        "\"willCreate\":true,\"willRename\":true,\"willDelete\":true}},\"textDocument\":"
+        "{\"synchronization\":{\"dynamicRegistration\":true,\"willSave\":true,\"willSaveWaitUntil\":"
+        "true,\"didSave\":true},\"completion\":{\"dynamicRegistration\":true,\"contextSupport\":true,"
+        "\"completionItem\":{\"snippetSupport\":true,\"commitCharactersSupport\":true,"
+        "\"documentationFormat\":[\"markdown\",\"plaintext\"],\"deprecatedSupport\":true,"
+        "\"preselectSupport\":true,\"tagSupport\":{\"valueSet\":[1]},\"insertReplaceSupport\":true,"
+        "\"resolveSupport\":{\"properties\":[\"documentation\",\"detail\",\"additionalTextEdits\"]},"
+        "\"insertTextModeSupport\":{\"valueSet\":[1,2]},\"labelDetailsSupport\":true},"
+        "\"insertTextMode\":2,\"completionItemKind\":{\"valueSet\":[1,2,3,4,5,6,7,8,9,10,11,12,"
+        "13,14,15,16,17,18,19,20,21,22,23,24,25]},\"completionList\":{\"itemDefaults\":"
+        "[\"commitCharacters\",\"editRange\",\"insertTextFormat\",\"insertTextMode\"]}},"
+        "\"hover\":{\"dynamicRegistration\":true,\"contentFormat\":[\"markdown\",\"plaintext\"]},"
+        "\"signatureHelp\":{\"dynamicRegistration\":true,\"signatureInformation\":"
+        "{\"documentationFormat\":[\"markdown\",\"plaintext\"],\"parameterInformation\":"
+        "{\"labelOffsetSupport\":true},\"activeParameterSupport\":true},\"contextSupport\":true},"
+        "\"definition\":{\"dynamicRegistration\":true,\"linkSupport\":true},\"references\":"
+        "{\"dynamicRegistration\":true},\"documentSymbol\":{\"dynamicRegistration\":true,"
+        "\"hierarchicalDocumentSymbolSupport\":true,\"labelSupport\":true},\"semanticTokens\":"
+        "{\"dynamicRegistration\":true,\"tokenTypes\":[\"namespace\",\"type\",\"class\",\"enum\","
+        "\"interface\",\"struct\",\"typeParameter\",\"parameter\",\"variable\",\"property\","
+        "\"enumMember\",\"event\",\"function\",\"method\",\"macro\",\"keyword\",\"modifier\","
+        "\"comment\",\"string\",\"number\",\"regexp\",\"operator\",\"decorator\"],"
+        "\"tokenModifiers\":[\"declaration\",\"definition\",\"readonly\",\"static\",\"deprecated\","
+        "\"abstract\",\"async\",\"modification\",\"documentation\",\"defaultLibrary\"],"
+        "\"formats\":[\"relative\"],\"requests\":{\"range\":true,\"full\":{\"delta\":true}},"
+        "\"multilineTokenSupport\":false,\"overlappingTokenSupport\":false}},\"window\":"
+        "{\"workDoneProgress\":true,\"showMessage\":{\"messageActionItem\":"
+        "{\"additionalPropertiesSupport\":true}},\"showDocument\":{\"support\":true}},"
+        "\"general\":{\"staleRequestSupport\":{\"cancel\":true,\"retryOnContentModified\":"
+        "[\"textDocument/semanticTokens/full\",\"textDocument/semanticTokens/range\"]},"
+        "\"positionEncodings\":[\"utf-16\"]}}";
+
+    write_request_header(w, 1, "initialize");
+    json_writer_begin_object(w);
+    json_writer_key(w, "processId");
+    json_writer_int(w, 4242);
+    json_writer_key(w, "rootUri");
+    json_writer_string_c(w, "file:///home/dev/project");
+    json_writer_key(w, "capabilities");
+    json_writer_raw(w, fdn_string_create_view(capabilities, strlen(capabilities)));
+    json_writer_key(w, "workspaceFolders");
+    json_writer_begin_array(w);
+    json_writer_begin_object(w);
+    json_writer_key(w, "uri");
+    json_writer_string_c(w, "file:///home/dev/project");
+    json_writer_key(w, "name");
+    json_writer_string_c(w, "project");
+    json_writer_end_object(w);
+    json_writer_end_array(w);
+    json_writer_end_object(w);
+    json_writer_end_object(w);
+    corpus_add(corpus, w);
+}
+
+static void corpus_did_open(BenchCorpus *corpus, JsonWriter *w, const char *source) {
+    write_request_header(w, -1, "textDocument/didOpen");
+    json_writer_begin_object(w);
+    json_writer_key(w, "textDocument");
+    json_writer_begin_object(w);
+    json_writer_key(w, "uri");
+    json_writer_string_c(w, "file:///home/dev/project/src/Token.sol");
+    json_writer_key(w, "languageId");
+    json_writer_string_c(w, "solidity");
+    json_writer_key(w, "version");
+    json_writer_int(w, 1);
+    json_writer_key(w, "text");
+    json_writer_string_c(w, source);
+    json_writer_end_object(w);
+    json_writer_end_object(w);
+    json_writer_end_object(w);
+    corpus_add(corpus, w);
+}
+
+// Typing one character at a time, as sent by an editor on every keystroke.
+static void corpus_did_change(BenchCorpus *corpus, JsonWriter *w, int count) {
+    const char *typed = "uint256 balance = _balances[msg.sender];\n";
+    for (int i = 0; i < count; i++) {
+        int64_t character = i % 40;
+        char text[2] = {typed[character], '\0'};
+
+        write_request_header(w, -1, "textDocument/didChange");
+        json_writer_begin_object(w);
+        write_text_document(w, i + 2);
+        json_writer_key(w, "contentChanges");
+        json_writer_begin_array(w);
+        json_writer_begin_object(w);
+        json_writer_key(w, "range");
+        json_writer_begin_object(w);
+        write_position(w, "start", 120, character);
+        write_position(w, "end", 120, character);
+        json_writer_end_object(w);
+        json_writer_key(w, "rangeLength");
+        json_writer_int(w, 0);
+        json_writer_key(w, "text");
+        json_writer_string_c(w, text);
+        json_writer_end_object(w);
+        json_writer_end_array(w);
+        json_writer_end_object(w);
+        json_writer_end_object(w);
+        corpus_add(corpus, w);
+    }
+}
+
+static void corpus_completion(BenchCorpus *corpus, JsonWriter *w, int count) {
+    for (int i = 0; i < count; i++) {
+        write_request_header(w, 100 + i, "textDocument/completion");
+        json_writer_begin_object(w);
+        write_text_document(w, -1);
+        write_position(w, "position", 120, i % 40);
+        json_writer_key(w, "context");
+        json_writer_begin_object(w);
+        json_writer_key(w, "triggerKind");
+        json_writer_int(w, 1);
+        json_writer_end_object(w);
+        json_writer_end_object(w);
+        json_writer_end_object(w);
+        corpus_add(corpus, w);
+    }
+}
+
+// ------------------------------------------------------------------------------
+// JSON layer throughput
+// ------------------------------------------------------------------------------
+
+// Repeat each measurement until at least this much time was spent.
+#define BENCH_MIN_SECONDS 0.2
+
+typedef enum {
+    BENCH_JSON_LEX,          // Every token of the message.
+    BENCH_JSON_PARSE,        // parser_parse_request_message.
+    BENCH_JSON_PARSE_TAPE,   // Request message, then a tape of the params.
+    BENCH_JSON_PARSE_PATHS,  // Request message, then three lazy paths.
+    BENCH_JSON_UNESCAPE,     // Request message, tape, then every string decoded.
+} BenchJsonMode;
+
+static void bench_json_corpus(const BenchCorpus *corpus, BenchJsonMode mode, const char *label) {
+    fdn_arena arena;
+    fdn_arena_init(&arena, 64 * 1024);
+
+    JsonPath paths[3];
+    json_path_compile("textDocument.uri", &paths[0]);
+    json_path_compile("position.line", &paths[1]);
+    json_path_compile("position.character", &paths[2]);
+
+    uint64_t rounds = 0;
+    uint64_t heap_calls = 0;
+    double elapsed = 0;
+
+    // One warm-up round lets the arena grow to the largest message.
+    for (int warm_up = 1; warm_up >= 0; warm_up--) {
+        uint64_t heap_before = bench_heap_calls;
+        double start = now_seconds();
+
+        do {
+            for (size_t i = 0; i < corpus->count; i++) {
+                const char *message = corpus->messages[i];
+
+                if (mode == BENCH_JSON_LEX) {
+                    Lexer lexer = lexer_new(message);
+                    Token token;
+                    do {
+                        token = lexer_next_token(&lexer);
+                        bench_sink += token.literal_length;
+                    } while (token.type != TOKEN_EOF);
+                    continue;
+                }
+
+                RequestMessage *request = parser_parse_request_message(&arena, message);
+                bench_sink += (uintptr_t)request;
+
+                if (mode == BENCH_JSON_PARSE_TAPE && request->params.string_length > 0) {
+                    JsonTape tape;
+                    bench_sink += parser_parse_tape(&arena, request->params, &tape);
+                } else if (mode == BENCH_JSON_PARSE_PATHS && request->params.string_length > 0) {
+                    JsonValue values[3];
+                    bench_sink += parser_find_paths(request->params, paths, 3, values);
+                } else if (mode == BENCH_JSON_UNESCAPE && request->params.string_length > 0) {
+                    JsonTape tape;
+                    parser_parse_tape(&arena, request->params, &tape);
+                    for (uint32_t entry = 0; entry < tape.count; entry++) {
+                        fdn_string decoded;
+                        if (json_tape_type(&tape, entry) == JSON_STRING &&
+                            json_string_unescape_to_arena(&arena, json_tape_get_string(&tape, entry), &decoded)) {
+                            bench_sink += decoded.string_length;
+                        }
+                    }
+                }
+
+                fdn_arena_reset(&arena);
+            }
+
+            if (!warm_up) {
+                rounds++;
+            }
+        } while (!warm_up && now_seconds() - start < BENCH_MIN_SECONDS);
+
+        elapsed = now_seconds() - start;
+        heap_calls = bench_heap_calls - heap_before;
+    }
+
+    double messages = (double)(rounds * corpus->count);
+    double megabytes = (double)(rounds * corpus->bytes) / (1024.0 * 1024.0);
+    printf("    %-22s %-8s %9.1f MB/s %11.0f msg/s %6.2f allocs/msg\n", corpus->name, label,
+           megabytes / elapsed, messages / elapsed, (double)heap_calls / messages);
+
+    fdn_arena_free(&arena);
+}
+
+void bench_json_layer(void) {
+    JsonWriter writer;
+    json_writer_init(&writer, 64 * 1024);
+
+    BenchCorpus initialize = {"initialize", NULL, 0, 0};
+    corpus_initialize(&initialize, &writer);
+
+    char *source = bench_generate_contract(10000);
+    BenchCorpus did_open = {"didOpen (10k lines)", NULL, 0, 0};
+    corpus_did_open(&did_open, &writer, source);
+    free(source);
+
+    BenchCorpus did_change = {"didChange (typing)", NULL, 0, 0};
+    corpus_did_change(&did_change, &writer, 1000);
+
+    BenchCorpus completion = {"completion", NULL, 0, 0};
+    corpus_completion(&completion, &writer, 1000);
+
+    BenchCorpus *corpora[] = {&initialize, &did_open, &did_change, &completion};
+    for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+        printf("    %s: %zu message(s), %.1f KB\n", corpora[i]->name, corpora[i]->count,
+               (double)corpora[i]->bytes / 1024.0);
+    }
+    printf("\n");
+
+    for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+        bench_json_corpus(corpora[i], BENCH_JSON_LEX, "lex");
+        bench_json_corpus(corpora[i], BENCH_JSON_PARSE, "parse");
+        bench_json_corpus(corpora[i], BENCH_JSON_PARSE_TAPE, "tape");
+        bench_json_corpus(corpora[i], BENCH_JSON_PARSE_PATHS, "paths");
+        bench_json_corpus(corpora[i], BENCH_JSON_UNESCAPE, "unescape");
+    }
+
+    for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+        corpus_free(corpora[i]);
+    }
+    json_writer_free(&writer);
+}
+
+// ------------------------------------------------------------------------------
+// Document store
+// ------------------------------------------------------------------------------
+
+// Typing into a large document, one character per edit, spread over the file.
+void bench_document_edits(void) {
+    char *source = bench_generate_contract(10000);
+    lsp_document_store store;
+    lsp_document_store_init(&store);
+    lsp_document *document = lsp_document_open(&store, fdn_string_create_view("file:///Token.sol", 17), 1,
+                                               fdn_string_create_view(source, strlen(source)));
+    uint32_t lines = lsp_document_line_count(document);
+
+    const int edits = 100000;
+    double start = now_seconds();
+    for (int i = 0; i < edits; i++) {
+        // Bursts of 20 keystrokes on the same line, then jump elsewhere.
+        uint32_t line = (uint32_t)(i / 20) * 7919u % lines;
+        lsp_position position = {line, (uint32_t)(i % 20)};
+        lsp_document_replace_range(document, position, position, fdn_string_create_view("x", 1));
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("    %u lines, %d single character edits: %.0f ns/edit, %u pieces\n", lines, edits,
+           elapsed * 1e9 / edits, document->piece_count - 1);
+
+    // Hover and completion requests convert positions both ways.
+    const int lookups = 1000000;
+    start = now_seconds();
+    for (int i = 0; i < lookups; i++) {
+        lsp_position position = {(uint32_t)i * 7919u % lines, (uint32_t)(i % 30)};
+        uint32_t offset = lsp_document_offset_at(document, position);
+        bench_sink += lsp_document_position_at(document, offset).character;
+    }
+    elapsed = now_seconds() - start;
+    printf("    position -> offset -> position: %.0f ns/lookup\n", elapsed * 1e9 / lookups);
+
+    lsp_document_store_free(&store);
+    free(source);
+}
+
+// ------------------------------------------------------------------------------
+// Solidity lexer
+// ------------------------------------------------------------------------------
+
+// Lexes sources the size of an OpenZeppelin contract and of a large codebase.
+void bench_solidity_lexer(void) {
+    const size_t sizes[] = {500, 100000};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        char *source = bench_generate_contract(sizes[i]);
+        size_t bytes = strlen(source);
+
+        uint64_t rounds = 0;
+        uint64_t tokens = 0;
+        double start = now_seconds();
+        do {
+            SolLexer lexer = sol_lexer_new(source);
+            SolToken token;
+            do {
+                token = sol_lexer_next_token(&lexer);
+                bench_sink += token.literal_length;
+                tokens++;
+            } while (token.type != SOL_TOKEN_EOF);
+            rounds++;
+        } while (now_seconds() - start < BENCH_MIN_SECONDS);
+        double elapsed = now_seconds() - start;
+
+        printf("    %6zu lines (%7.1f KB): %7.1f MB/s %6.1f M tokens/s\n", sizes[i], (double)bytes / 1024.0,
+               (double)(rounds * bytes) / (1024.0 * 1024.0) / elapsed, (double)tokens / 1e6 / elapsed);
+        free(source);
+    }
+}
+
+// ------------------------------------------------------------------------------
+// Solidity parser
+// ------------------------------------------------------------------------------
+
+// Parses sources the size of an OpenZeppelin contract and of a large codebase,
+// and reports the memory their tokens and trees keep resident.
+void bench_solidity_parser(void) {
+    const size_t sizes[] = {500, 100000};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        char *source = bench_generate_contract(sizes[i]);
+        size_t bytes = strlen(source);
+        size_t lines = 0;
+        for (size_t j = 0; j < bytes; j++) {
+            lines += source[j] == '\n';
+        }
+
+        fdn_string string = fdn_string_create_view(source, bytes);
+        SolText text = sol_text_from_string(&string);
+        SolSyntax syntax;
+        sol_syntax_init(&syntax);
+
+        uint64_t rounds = 0;
+        double start = now_seconds();
+        do {
+            sol_syntax_rebuild(&syntax, &text);
+            rounds++;
+        } while (now_seconds() - start < BENCH_MIN_SECONDS);
+        double elapsed = now_seconds() - start;
+
+        size_t memory = sol_syntax_memory(&syntax);
+        printf("    %6zu lines (%7.1f KB): %7.1f MB/s %8u nodes %7.1f KB/KLOC (source %.1f KB/KLOC)\n", lines,
+               (double)bytes / 1024.0, (double)(rounds * bytes) / (1024.0 * 1024.0) / elapsed, syntax.nodes.count,
+               (double)memory / 1024.0 * 1000.0 / (double)lines, (double)bytes / 1024.0 * 1000.0 / (double)lines);
+
+        sol_syntax_free(&syntax);
+        free(source);
+    }
+}
+
+// ------------------------------------------------------------------------------
+// Interning
+// ------------------------------------------------------------------------------
+
+// Interns every identifier of a large source, then compares pairs of them by
+// id and by their bytes.
+void bench_interner(void) {
+    char *source = bench_generate_contract(100000);
+    fdn_string string = fdn_string_create_view(source, strlen(source));
+    SolText text = sol_text_from_string(&string);
+    SolSyntax syntax;
+    sol_syntax_init(&syntax);
+    sol_syntax_rebuild(&syntax, &text);
+
+    uint32_t count = 0;
+    fdn_string *names = malloc(syntax.tokens.count * sizeof(fdn_string));
+    uint32_t *ids = malloc(syntax.tokens.count * sizeof(uint32_t));
+    size_t bytes = 0;
+    for (uint32_t i = 0; i < syntax.tokens.count; i++) {
+        if (syntax.tokens.types[i] == SOL_TOKEN_IDENTIFIER) {
+            names[count] = sol_token_text(&syntax.tokens, &string, i);
+            bytes += names[count].string_length;
+            count++;
+        }
+    }
+
+    // Every round starts from an empty interner; the last one is kept.
+    fdn_interner interner;
+    fdn_interner_init(&interner);
+    uint64_t rounds = 0;
+    double start = now_seconds();
+    while (1) {
+        for (uint32_t i = 0; i < count; i++) {
+            ids[i] = fdn_interner_intern(&interner, names[i]);
+        }
+        rounds++;
+        if (now_seconds() - start >= BENCH_MIN_SECONDS) {
+            break;
+        }
+        fdn_interner_free(&interner);
+        fdn_interner_init(&interner);
+    }
+    double intern_ns = (now_seconds() - start) * 1e9 / (double)(rounds * count);
+
+    // Every identifier against the one 7 positions later, where the names of
+    // a declaration and of its uses tend to repeat.
+    const uint32_t compare_rounds = 20;
+    uint64_t equal = 0;
+    start = now_seconds();
+    for (uint32_t r = 0; r < compare_rounds; r++) {
+        for (uint32_t i = 7; i < count; i++) {
+            equal += ids[i] == ids[i - 7];
+        }
+    }
+    double id_ns = (now_seconds() - start) * 1e9 / (double)(compare_rounds * (count - 7));
+
+    start = now_seconds();
+    for (uint32_t r = 0; r < compare_rounds; r++) {
+        for (uint32_t i = 7; i < count; i++) {
+            equal += fdn_string_is_eq(names[i], names[i - 7]);
+        }
+    }
+    double bytes_ns = (now_seconds() - start) * 1e9 / (double)(compare_rounds * (count - 7));
+    bench_sink += equal;
+
+    printf("    %u identifiers (%.1f KB), %u distinct: intern %5.1f ns each\n", count, (double)bytes / 1024.0,
+           fdn_interner_count(&interner), intern_ns);
+    printf("    equality: %5.2f ns by id, %5.2f ns by bytes\n", id_ns, bytes_ns);
+
+    fdn_interner_free(&interner);
+    free(ids);
+    free(names);
+    sol_syntax_free(&syntax);
+    free(source);
+}
+
+// ------------------------------------------------------------------------------
+// Workspace indexing
+// ------------------------------------------------------------------------------
+
+#define BENCH_WORKSPACE_DIRECTORIES 40
+#define BENCH_WORKSPACE_FILES_PER_DIRECTORY 50
+
+// Writes a monorepo-sized workspace of generated files below `root` and
+// returns its size in bytes.
+static size_t bench_write_workspace(const char *root) {
+    char path[512];
+    size_t bytes = 0;
+    for (int d = 0; d < BENCH_WORKSPACE_DIRECTORIES; d++) {
+        snprintf(path, sizeof(path), "%s/pkg%d", root, d);
+        mkdir(path, 0700);
+        for (int f = 0; f < BENCH_WORKSPACE_FILES_PER_DIRECTORY; f++) {
+            char *source = bench_generate_contract(200 + (size_t)(f * 37 % 400));
+            snprintf(path, sizeof(path), "%s/pkg%d/Contract%d.sol", root, d, f);
+            FILE *file = fopen(path, "wb");
+            if (file != NULL) {
+                bytes += fwrite(source, 1, strlen(source), file);
+                fclose(file);
+            }
+            free(source);
+        }
+    }
+    return bytes;
+}
+
+static void bench_remove_workspace(const char *root) {
+    char path[512];
+    for (int d = 0; d < BENCH_WORKSPACE_DIRECTORIES; d++) {
+        for (int f = 0; f < BENCH_WORKSPACE_FILES_PER_DIRECTORY; f++) {
+            snprintf(path, sizeof(path), "%s/pkg%d/Contract%d.sol", root, d, f);
+            unlink(path);
+        }
+        snprintf(path, sizeof(path), "%s/pkg%d", root, d);
+        rmdir(path);
+    }
+    rmdir(root);
+}
+
+// Indexes a monorepo-sized workspace of generated files, on one thread and on
+// every core, and then again at startup with the index cache cold and warm.
+void bench_workspace_index(void) {
+    char root[] = "/tmp/solbot-bench-XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        printf("    mkdtemp() failed\n");
+        return;
+    }
+    size_t bytes = bench_write_workspace(root);
+
+    fdn_string folder = fdn_string_create_view(root, strlen(root));
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t thread_counts[] = {1, cores > 0 ? (uint32_t)cores : 1};
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        lsp_workspace workspace;
+        lsp_workspace_init(&workspace);
+        double start = now_seconds();
+        lsp_workspace_start(&workspace, &folder, 1, thread_counts[i], NULL);
+        lsp_workspace_wait(&workspace);
+        double elapsed = now_seconds() - start;
+
+        printf("    %u files (%.1f MB), %2u thread(s): %6.1f ms, %7.1f MB/s\n", workspace.file_count,
+               (double)bytes / (1024.0 * 1024.0), workspace.thread_count, elapsed * 1e3,
+               (double)bytes / (1024.0 * 1024.0) / elapsed);
+        lsp_workspace_free(&workspace);
+    }
+
+    // The cold run parses everything and writes the cache; the warm one maps it.
+    char cache_path[512];
+    snprintf(cache_path, sizeof(cache_path), "%s/index.bin", root);
+    const char *runs[] = {"cold cache", "warm cache"};
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        lsp_workspace workspace;
+        lsp_workspace_init(&workspace);
+        double start = now_seconds();
+        lsp_workspace_start(&workspace, &folder, 1, 0, cache_path);
+        lsp_workspace_wait(&workspace);
+        double elapsed = now_seconds() - start;
+
+        struct stat info;
+        printf("    %s, %2u thread(s): %6.1f ms, %u of %u files from the cache (%.1f MB)\n", runs[i],
+               workspace.thread_count, elapsed * 1e3, workspace.files_reused, workspace.file_count,
+               stat(cache_path, &info) == 0 ? (double)info.st_size / (1024.0 * 1024.0) : 0.0);
+        lsp_workspace_free(&workspace);
+    }
+    unlink(cache_path);
+    bench_remove_workspace(root);
+}
+
+// ------------------------------------------------------------------------------
+// Workspace symbols
+// ------------------------------------------------------------------------------
+
+// Searches the symbols of a large workspace as a quick-open box would, one
+// query per keystroke, and compares the index with scoring every name.
+void bench_workspace_symbol(void) {
+    static const char *words[] = {
+        "transfer", "balance", "approve", "allowance", "owner",  "mint",    "burn",   "deposit",
+        "withdraw", "stake",   "reward",  "claim",     "vault",  "token",   "pool",   "swap",
+        "oracle",   "price",   "fee",     "admin",     "pause",  "role",    "grant",  "revoke",
+        "supply",   "share",   "asset",   "debt",      "borrow", "repay",   "liquid", "rate",
+    };
+    const uint32_t word_count = sizeof(words) / sizeof(words[0]);
+    const uint32_t count = 160000;
+
+    fdn_interner names;
+    fdn_interner_init(&names);
+    lsp_symbol *symbols = malloc(count * sizeof(lsp_symbol));
+    char name[96];
+    for (uint32_t i = 0; i < count; i++) {
+        // getTransferBalance, _stakeRewardV12, ...: three words and a version.
+        const char *second = words[(i / word_count) % word_count];
+        const char *third = words[(i * 7 + i / 1024) % word_count];
+        snprintf(name, sizeof(name), "%s%s%c%s%c%sV%u", i % 3 == 0 ? "_" : "", words[i % word_count],
+                 second[0] - 'a' + 'A', second + 1, third[0] - 'a' + 'A', third + 1, i / 4096);
+        lsp_symbol symbol = {fdn_interner_intern(&names, fdn_string_create_view(name, strlen(name))),
+                             FDN_INTERNER_NONE, i / 64, i % 500, 4, LSP_SYMBOL_FUNCTION};
+        symbols[i] = symbol;
+    }
+
+    lsp_symbol_index index;
+    double start = now_seconds();
+    lsp_symbol_index_build(&index, &names, symbols, count);
+    printf("    %u symbols, %u names, %u trigrams: built in %.1f ms\n", index.symbol_count, index.name_count,
+           index.trigram_count, (now_seconds() - start) * 1e3);
+
+    // Every prefix of each query, as it is typed.
+    static const struct {
+        const char *label;
+        const char *query;
+    } queries[] = {
+        {"substring", "transferBalance"},
+        {"substring", "RewardClaimV3"},
+        {"fuzzy", "trnsblnc"},
+        {"fuzzy", "gtRwdV7"},
+        {"no match", "zzzqqq"},
+    };
+    fdn_arena arena;
+    fdn_arena_init(&arena, 64 * 1024);
+    lsp_symbol_match matches[256];
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        const char *query = queries[q].query;
+        size_t length = strlen(query);
+        double index_max = 0;
+        double index_total = 0;
+        double scan_total = 0;
+        uint32_t found = 0;
+        for (size_t typed = 1; typed <= length; typed++) {
+            fdn_string prefix = fdn_string_create_view(query, typed);
+            fdn_arena_reset(&arena);
+            start = now_seconds();
+            found = lsp_symbol_index_search(&index, &arena, prefix, matches, 256);
+            double elapsed = now_seconds() - start;
+            index_total += elapsed;
+            index_max = elapsed > index_max ? elapsed : index_max;
+
+            // The naive search: score every name.
+            start = now_seconds();
+            uint32_t scanned = 0;
+            for (uint32_t n = 0; n < index.name_count; n++) {
+                scanned += lsp_symbol_score(prefix, fdn_interner_string(&names, index.names[n])) >= 0;
+            }
+            scan_total += now_seconds() - start;
+            bench_sink += scanned;
+        }
+        printf("    %-9s %-16s index: mean %6.3f ms, max %6.3f ms (%3u found) | score every name: %6.2f ms\n",
+               queries[q].label, query, index_total * 1e3 / (double)length, index_max * 1e3, found,
+               scan_total * 1e3 / (double)length);
+    }
+
+    fdn_arena_free(&arena);
+    lsp_symbol_index_free(&index);
+    fdn_interner_free(&names);
+}
+
+// ------------------------------------------------------------------------------
+// References
+// ------------------------------------------------------------------------------
+
+// Finds the references of names of a large workspace, from rare to ubiquitous,
+// with the reference index and by comparing every identifier of every file as
+// a rescan of the sources would, on top of sources that are lexed already.
+void bench_references(void) {
+    char root[] = "/tmp/solbot-bench-XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        printf("    mkdtemp() failed\n");
+        return;
+    }
+    bench_write_workspace(root);
+
+    fdn_string folder = fdn_string_create_view(root, strlen(root));
+    lsp_workspace workspace;
+    lsp_workspace_init(&workspace);
+    lsp_workspace_start(&workspace, &folder, 1, 0, NULL);
+    lsp_workspace_wait(&workspace);
+    const lsp_reference_index *index = &workspace.references;
+    printf("    %u files, %" PRIu64 " identifiers: %.1f MB encoded, %.2f bytes each\n", workspace.file_count,
+           index->reference_count, (double)index->starts[index->name_count] / (1024.0 * 1024.0),
+           (double)index->starts[index->name_count] / (double)index->reference_count);
+
+    const char *queries[] = {"Token7", "transfer", "IERC20", "amount"};
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        fdn_string name = fdn_string_create_view(queries[q], strlen(queries[q]));
+        const int rounds = 10;
+        double index_total = 0;
+        double scan_total = 0;
+        uint32_t found = 0;
+        for (int r = 0; r < rounds; r++) {
+            double start = now_seconds();
+            uint32_t id = fdn_interner_find(&workspace.names, name);
+            uint32_t count = lsp_reference_index_count(index, id);
+            lsp_reference *references = malloc((count > 0 ? count : 1) * sizeof(lsp_reference));
+            count = lsp_reference_index_find(index, id, references);
+            index_total += now_seconds() - start;
+            found = count;
+            bench_sink += count > 0 ? references[count - 1].position.line : 0;
+            free(references);
+
+            start = now_seconds();
+            uint32_t scanned = 0;
+            for (uint32_t f = 0; f < workspace.file_count; f++) {
+                const lsp_workspace_file *file = &workspace.files[f];
+                const SolTokenList *tokens = &file->syntax.tokens;
+                for (uint32_t t = 0; t < tokens->count; t++) {
+                    scanned += tokens->types[t] == SOL_TOKEN_IDENTIFIER &&
+                               fdn_string_is_eq(sol_token_text(tokens, &file->source, t), name);
+                }
+            }
+            scan_total += now_seconds() - start;
+            bench_sink += scanned;
+        }
+        printf("    %-10s %7u found | index: %7.3f ms | compare every identifier: %7.2f ms\n", queries[q], found,
+               index_total * 1e3 / rounds, scan_total * 1e3 / rounds);
+    }
+
+    lsp_workspace_free(&workspace);
+    bench_remove_workspace(root);
+}
+
+// ------------------------------------------------------------------------------
+// Import graph
+// ------------------------------------------------------------------------------
+
+// Builds the import graph of packages of files that import the previous file
+// of their package, its peer in the previous package and a dependency in
+// node_modules, and then lists what edits to files at the top, the middle and
+// the bottom of the graph invalidate.
+void bench_import_graph(void) {
+    enum { PACKAGES = 40, FILES_PER_PACKAGE = 50, FILE_COUNT = PACKAGES * FILES_PER_PACKAGE + 1 };
+    char (*paths)[64] = malloc(FILE_COUNT * sizeof(*paths));
+    char (*sources)[192] = malloc(FILE_COUNT * sizeof(*sources));
+    SolSyntax *syntax = malloc(FILE_COUNT * sizeof(SolSyntax));
+    lsp_import_file *files = malloc(FILE_COUNT * sizeof(lsp_import_file));
+    for (uint32_t i = 0; i < FILE_COUNT; i++) {
+        uint32_t d = i / FILES_PER_PACKAGE;
+        uint32_t f = i % FILES_PER_PACKAGE;
+        if (i == FILE_COUNT - 1) {
+            snprintf(paths[i], sizeof(paths[i]), "/bench/node_modules/@oz/Token.sol");
+            snprintf(sources[i], sizeof(sources[i]), "contract Token {}\n");
+        } else {
+            snprintf(paths[i], sizeof(paths[i]), "/bench/pkg%u/Contract%u.sol", d, f);
+            int length = snprintf(sources[i], sizeof(sources[i]), "import \"@oz/Token.sol\";\n");
+            if (f > 0) {
+                length += snprintf(sources[i] + length, sizeof(sources[i]) - (size_t)length,
+                                   "import \"./Contract%u.sol\";\n", f - 1);
+            }
+            if (d > 0) {
+                snprintf(sources[i] + length, sizeof(sources[i]) - (size_t)length,
+                         "import {C} from \"pkg%u/Contract%u.sol\";\n", d - 1, f);
+            }
+        }
+        sol_syntax_init(&syntax[i]);
+        sol_syntax_build(&syntax[i], sources[i]);
+        files[i].path = paths[i];
+        files[i].source = fdn_string_create_view(sources[i], strlen(sources[i]));
+        files[i].syntax = &syntax[i];
+    }
+
+    fdn_string folder = FDN_STRING_LITERAL("/bench");
+    lsp_import_graph graph;
+    const int rounds = 10;
+    double start = now_seconds();
+    for (int r = 0; r < rounds; r++) {
+        lsp_import_graph_build(&graph, &folder, 1, files, FILE_COUNT);
+        bench_sink += graph.edge_count;
+        if (r + 1 < rounds) {
+            lsp_import_graph_free(&graph);
+        }
+    }
+    printf("    %u files, %u imports, %u levels: built in %.2f ms\n", graph.file_count, graph.edge_count,
+           graph.level_count, (now_seconds() - start) * 1e3 / rounds);
+
+    fdn_arena arena;
+    fdn_arena_init(&arena, 64 * 1024);
+    uint32_t edited[] = {FILE_COUNT - 2, 20 * FILES_PER_PACKAGE + 25, 0, FILE_COUNT - 1};
+    for (size_t e = 0; e < sizeof(edited) / sizeof(edited[0]); e++) {
+        uint32_t *invalid = NULL;
+        uint32_t count = 0;
+        start = now_seconds();
+        for (int r = 0; r < rounds; r++) {
+            count = lsp_import_graph_invalidate(&graph, &arena, edited[e], &invalid);
+            bench_sink += count > 0 ? invalid[count - 1] : 0;
+            fdn_arena_reset(&arena);
+        }
+        printf("    edit %-38s invalidates %4u of %u files in %.3f ms\n", paths[edited[e]], count, graph.file_count,
+               (now_seconds() - start) * 1e3 / rounds);
+    }
+
+    fdn_arena_free(&arena);
+    lsp_import_graph_free(&graph);
+    for (uint32_t i = 0; i < FILE_COUNT; i++) {
+        sol_syntax_free(&syntax[i]);
+    }
+    free(files);
+    free(syntax);
+    free(sources);
+    free(paths);
+}
+
+// ------------------------------------------------------------------------------
+// Incremental Solidity syntax
+// ------------------------------------------------------------------------------
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Replays typing sessions against a large document: a statement is typed into
+// a function body one keystroke at a time, then deleted again with backspace.
+// Every keystroke updates the piece table, the line index and the syntax. Then
+// the sessions are replayed as bursts that reach the server before it is idle,
+// with the syntax updated once per burst.
+void bench_solidity_typing(void) {
+    char *source = bench_generate_contract(10000);
+    lsp_document_store store;
+    lsp_document_store_init(&store);
+    lsp_document *document = lsp_document_open(&store, fdn_string_create_view("file:///Token.sol", 17), 1,
+                                               fdn_string_create_view(source, strlen(source)));
+
+    lsp_document_syntax(document);
+
+    fdn_arena arena;
+    fdn_arena_init(&arena, 64 * 1024);
+    fdn_string text = lsp_document_text(document, &arena);
+    SolText full_text = sol_text_from_string(&text);
+    SolSyntax rebuilt;
+    sol_syntax_init(&rebuilt);
+    double start = now_seconds();
+    sol_syntax_rebuild(&rebuilt, &full_text);
+    double rebuild_time = now_seconds() - start;
+    printf("    %u lines, %u tokens, %u nodes: full lex + parse %.2f ms\n", lsp_document_line_count(document),
+           rebuilt.tokens.count, rebuilt.nodes.count, rebuild_time * 1e3);
+    sol_syntax_free(&rebuilt);
+
+    const char *statement = "uint256 fee = amount * 3 / 1000; // protocol fee";
+    const size_t statement_length = strlen(statement);
+    const int sessions = 100;
+    const size_t keystrokes = (size_t)sessions * statement_length * 2;
+    double *latencies = malloc(keystrokes * sizeof(double));
+    uint64_t tokens_lexed = 0;
+    uint64_t nodes_parsed = 0;
+    size_t keystroke = 0;
+
+    for (int session = 0; session < sessions; session++) {
+        // Jump to the transfer function of a contract spread over the file.
+        fdn_arena_reset(&arena);
+        text = lsp_document_text(document, &arena);
+        const char *cursor = text.string_start;
+        int target = session * 197 % 200;
+        for (int i = 0; i <= target; i++) {
+            cursor = strstr(cursor, "uint256 balance =") + 1;
+        }
+        lsp_position position = lsp_document_position_at(document, (uint32_t)(cursor - 1 - text.string_start));
+
+        for (size_t i = 0; i < statement_length; i++) {
+            start = now_seconds();
+            lsp_document_replace_range(document, position, position, fdn_string_create_view(statement + i, 1));
+            const SolSyntax *syntax = lsp_document_syntax(document);
+            latencies[keystroke++] = now_seconds() - start;
+            tokens_lexed += syntax->tokens_lexed;
+            nodes_parsed += syntax->nodes_parsed;
+            position.character++;
+        }
+        for (size_t i = 0; i < statement_length; i++) {
+            lsp_position before = {position.line, position.character - 1};
+            start = now_seconds();
+            lsp_document_replace_range(document, before, position, fdn_string_create_view("", 0));
+            const SolSyntax *syntax = lsp_document_syntax(document);
+            latencies[keystroke++] = now_seconds() - start;
+            tokens_lexed += syntax->tokens_lexed;
+            nodes_parsed += syntax->nodes_parsed;
+            position = before;
+        }
+    }
+
+    double total = 0;
+    for (size_t i = 0; i < keystrokes; i++) {
+        total += latencies[i];
+    }
+    qsort(latencies, keystrokes, sizeof(double), compare_doubles);
+    printf("    %zu keystrokes: mean %.1f us, p99 %.1f us, max %.1f us\n", keystrokes, total * 1e6 / (double)keystrokes,
+           latencies[keystrokes * 99 / 100] * 1e6, latencies[keystrokes - 1] * 1e6);
+    printf("    per keystroke: %.1f tokens lexed, %.1f nodes parsed\n", (double)tokens_lexed / (double)keystrokes,
+           (double)nodes_parsed / (double)keystrokes);
+
+    // The same sessions, each statement typed (and deleted) in one burst.
+    start = now_seconds();
+    for (int session = 0; session < sessions; session++) {
+        fdn_arena_reset(&arena);
+        text = lsp_document_text(document, &arena);
+        const char *cursor = text.string_start;
+        int target = session * 197 % 200;
+        for (int i = 0; i <= target; i++) {
+            cursor = strstr(cursor, "uint256 balance =") + 1;
+        }
+        lsp_position position = lsp_document_position_at(document, (uint32_t)(cursor - 1 - text.string_start));
+
+        for (size_t i = 0; i < statement_length; i++) {
+            lsp_document_replace_range(document, position, position, fdn_string_create_view(statement + i, 1));
+            position.character++;
+        }
+        lsp_document_syntax(document);
+        for (size_t i = 0; i < statement_length; i++) {
+            lsp_position before = {position.line, position.character - 1};
+            lsp_document_replace_range(document, before, position, fdn_string_create_view("", 0));
+            position = before;
+        }
+        lsp_document_syntax(document);
+    }
+    double bursts = now_seconds() - start;
+    printf("    in bursts of %zu keystrokes: %.1f us per keystroke\n", statement_length,
+           bursts * 1e6 / (double)keystrokes);
+
+    free(latencies);
+    fdn_arena_free(&arena);
+    lsp_document_store_free(&store);
+    free(source);
+}
+
+// ------------------------------------------------------------------------------
+// Completion
+// ------------------------------------------------------------------------------
+
+// Types identifiers into function bodies of large documents one keystroke at a
+// time, asking for completions after every keystroke as an editor does, and
+// measures the whole keystroke: the edit, the syntax update, the completion
+// and its JSON response.
+void bench_completion(void) {
+    const size_t sizes[] = {10000, 100000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        char *source = bench_generate_contract(sizes[s]);
+        lsp_document_store store;
+        lsp_document_store_init(&store);
+        lsp_document *document = lsp_document_open(&store, fdn_string_create_view("file:///Token.sol", 17), 1,
+                                                   fdn_string_create_view(source, strlen(source)));
+        lsp_document_syntax(document);
+
+        fdn_arena arena;
+        fdn_arena_init(&arena, 64 * 1024);
+        JsonWriter writer;
+        json_writer_init(&writer, 4096);
+
+        const char *typed[] = {"_balances[msg.sender", "amount + bal", "emit Trans", "uint256 x = block.times"};
+        const int sessions = 50;
+        size_t keystrokes = 0;
+        for (int session = 0; session < sessions; session++) {
+            keystrokes += strlen(typed[session % 4]);
+        }
+        double *latencies = malloc(keystrokes * sizeof(double));
+        uint64_t items = 0;
+        size_t keystroke = 0;
+
+        for (int session = 0; session < sessions; session++) {
+            // Start a new line in the transfer function of a contract spread
+            // over the file.
+            fdn_arena_reset(&arena);
+            fdn_string text = lsp_document_text(document, &arena);
+            const char *cursor = text.string_start;
+            int contracts = (int)(sizes[s] / 50);
+            int target = session * 197 % contracts;
+            for (int i = 0; i <= target; i++) {
+                cursor = strstr(cursor, "        unchecked {") + 1;
+            }
+            lsp_position position = lsp_document_position_at(document, (uint32_t)(cursor - 1 - text.string_start));
+            lsp_document_replace_range(document, position, position, fdn_string_create_view("\n        ", 9));
+            position.line++;
+            position.character = 8;
+
+            const char *statement = typed[session % 4];
+            for (size_t i = 0; statement[i] != '\0'; i++) {
+                fdn_arena_reset(&arena);
+                double start = now_seconds();
+                lsp_document_replace_range(document, position, position, fdn_string_create_view(statement + i, 1));
+                position.character++;
+
+                lsp_completion_list list;
+                lsp_completion_collect(document, position, &arena, 200, &list);
+                json_writer_reset(&writer);
+                json_writer_begin_array(&writer);
+                for (uint32_t item = 0; item < list.count; item++) {
+                    json_writer_begin_object(&writer);
+                    json_writer_key(&writer, "label");
+                    json_writer_string(&writer, list.items[item].label);
+                    json_writer_key(&writer, "kind");
+                    json_writer_int(&writer, list.items[item].kind);
+                    json_writer_end_object(&writer);
+                }
+                json_writer_end_array(&writer);
+                latencies[keystroke++] = now_seconds() - start;
+                items += list.count;
+            }
+        }
+
+        double total = 0;
+        for (size_t i = 0; i < keystrokes; i++) {
+            total += latencies[i];
+        }
+        qsort(latencies, keystrokes, sizeof(double), compare_doubles);
+        printf("    %6zu lines, %zu keystrokes: mean %.1f us, p99 %.1f us, max %.1f us (%.1f items)\n", sizes[s],
+               keystrokes, total * 1e6 / (double)keystrokes, latencies[keystrokes * 99 / 100] * 1e6,
+               latencies[keystrokes - 1] * 1e6, (double)items / (double)keystrokes);
+
+        free(latencies);
+        json_writer_free(&writer);
+        fdn_arena_free(&arena);
+        lsp_document_store_free(&store);
+        free(source);
+    }
+}
+
+// ==============================================================================
+// 3. MAIN ENTRY POINT
+// ==============================================================================
+
+int main(void) {
+    printf("======== Starting Benchmarks ========\n\n");
+
+    RUN_BENCH(bench_dispatch_lookup);
+    RUN_BENCH(bench_json_layer);
+    RUN_BENCH(bench_document_edits);
+    RUN_BENCH(bench_solidity_lexer);
+    RUN_BENCH(bench_solidity_parser);
+    RUN_BENCH(bench_interner);
+    RUN_BENCH(bench_workspace_index);
+    RUN_BENCH(bench_workspace_symbol);
+    RUN_BENCH(bench_references);
+    RUN_BENCH(bench_import_graph);
+    RUN_BENCH(bench_solidity_typing);
+    RUN_BENCH(bench_completion);
+
+    printf("=====================================\n");
+    return 0;
+}
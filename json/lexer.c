@@ -1,32 +1,238 @@
 #include <assert.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "lexer.h"
 #include "libs/foundation.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LEXER_X86_KERNELS 1
+#endif
+
+/////////////////////////////////////////////////
+//                BULK SCANNING                //
+/////////////////////////////////////////////////
+
+/**
+ * String contents and whitespace runs are the bulk of an LSP message (a
+ * didOpen carries the whole source file as a single JSON string). Instead of
+ * stepping through them char by char with `lexer_advance`, the lexer jumps
+ * over them with the kernels below.
+ *
+ * Each kernel returns a pointer to the first byte that is NOT part of the run.
+ * The input is null-terminated and `\0` always ends a run, so a kernel never
+ * goes past the terminator by more than the width of one aligned load. Aligned
+ * loads never cross a page boundary, which makes reading those trailing bytes
+ * safe. AddressSanitizer does not know that, hence the `no_sanitize_address`.
+ *
+ * The widest kernel supported by the CPU is picked once at runtime.
+ */
+
+// A run of string content ends at a quotation mark, a backslash or a control
+// character (this includes the null terminator).
+static inline bool is_string_stop(unsigned char ch) {
+  return ch == '"' || ch == '\\' || ch < 0x20;
+}
+
+static inline bool is_whitespace(uint32_t ch) {
+  return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r';
+}
+
+static const char *scan_string_scalar(const char *cursor) {
+  while (!is_string_stop((unsigned char)*cursor)) {
+    cursor++;
+  }
+  return cursor;
+}
+
+static const char *skip_whitespace_scalar(const char *cursor) {
+  while (is_whitespace((unsigned char)*cursor)) {
+    cursor++;
+  }
+  return cursor;
+}
+
+#ifdef LEXER_X86_KERNELS
+
+// Walks byte by byte until `cursor` is aligned to `alignment` or the run ends.
+// Returns `true` if the run ended.
+#define SCAN_UNTIL_ALIGNED(cursor, alignment, is_run_end)                      \
+  while (((uintptr_t)(cursor) & ((alignment)-1)) != 0) {                       \
+    if (is_run_end((unsigned char)*(cursor))) {                                \
+      return (cursor);                                                         \
+    }                                                                          \
+    (cursor)++;                                                                \
+  }
+
+static inline bool is_not_whitespace(unsigned char ch) {
+  return !is_whitespace(ch);
+}
+
+__attribute__((no_sanitize_address)) static const char *
+scan_string_sse2(const char *cursor) {
+  SCAN_UNTIL_ALIGNED(cursor, 16, is_string_stop);
+
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control_max = _mm_set1_epi8(0x1F);
+
+  while (1) {
+    __m128i chunk = _mm_load_si128((const __m128i *)(const void *)cursor);
+    __m128i stops = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                 _mm_cmpeq_epi8(chunk, backslash));
+    // `min(ch, 0x1F) == ch` holds exactly for the control characters.
+    stops = _mm_or_si128(
+        stops, _mm_cmpeq_epi8(_mm_min_epu8(chunk, control_max), chunk));
+
+    unsigned mask = (unsigned)_mm_movemask_epi8(stops);
+    if (mask != 0) {
+      return cursor + __builtin_ctz(mask);
+    }
+    cursor += 16;
+  }
+}
+
+__attribute__((no_sanitize_address)) static const char *
+skip_whitespace_sse2(const char *cursor) {
+  SCAN_UNTIL_ALIGNED(cursor, 16, is_not_whitespace);
+
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i carriage_return = _mm_set1_epi8('\r');
+
+  while (1) {
+    __m128i chunk = _mm_load_si128((const __m128i *)(const void *)cursor);
+    __m128i spaces = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                     _mm_cmpeq_epi8(chunk, newline)),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, tab),
+                     _mm_cmpeq_epi8(chunk, carriage_return)));
+
+    unsigned mask = ~(unsigned)_mm_movemask_epi8(spaces) & 0xFFFFu;
+    if (mask != 0) {
+      return cursor + __builtin_ctz(mask);
+    }
+    cursor += 16;
+  }
+}
+
+__attribute__((target("avx2"), no_sanitize_address)) static const char *
+scan_string_avx2(const char *cursor) {
+  SCAN_UNTIL_ALIGNED(cursor, 32, is_string_stop);
+
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i control_max = _mm256_set1_epi8(0x1F);
+
+  while (1) {
+    __m256i chunk = _mm256_load_si256((const __m256i *)(const void *)cursor);
+    __m256i stops = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote),
+                                    _mm256_cmpeq_epi8(chunk, backslash));
+    stops = _mm256_or_si256(
+        stops, _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control_max), chunk));
+
+    unsigned mask = (unsigned)_mm256_movemask_epi8(stops);
+    if (mask != 0) {
+      return cursor + __builtin_ctz(mask);
+    }
+    cursor += 32;
+  }
+}
+
+__attribute__((target("avx2"), no_sanitize_address)) static const char *
+skip_whitespace_avx2(const char *cursor) {
+  SCAN_UNTIL_ALIGNED(cursor, 32, is_not_whitespace);
+
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i carriage_return = _mm256_set1_epi8('\r');
+
+  while (1) {
+    __m256i chunk = _mm256_load_si256((const __m256i *)(const void *)cursor);
+    __m256i spaces = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space),
+                        _mm256_cmpeq_epi8(chunk, newline)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, tab),
+                        _mm256_cmpeq_epi8(chunk, carriage_return)));
+
+    unsigned mask = ~(unsigned)_mm256_movemask_epi8(spaces);
+    if (mask != 0) {
+      return cursor + __builtin_ctz(mask);
+    }
+    cursor += 32;
+  }
+}
+
+#endif // LEXER_X86_KERNELS
+
+typedef const char *(*lexer_scan_fn)(const char *cursor);
+
+static lexer_scan_fn g_scan_string = NULL;
+static lexer_scan_fn g_skip_whitespace = NULL;
+static pthread_once_t g_kernels_selected = PTHREAD_ONCE_INIT;
+
+static void lexer_pick_kernels(void) {
+  lexer_scan_fn scan_string = scan_string_scalar;
+  lexer_scan_fn skip_whitespace = skip_whitespace_scalar;
+
+#ifdef LEXER_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    scan_string = scan_string_avx2;
+    skip_whitespace = skip_whitespace_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    scan_string = scan_string_sse2;
+    skip_whitespace = skip_whitespace_sse2;
+  }
+#endif
+
+  g_skip_whitespace = skip_whitespace;
+  g_scan_string = scan_string;
+}
+
+// lexer_select_kernels picks the widest kernels the CPU supports. It is called
+// by `lexer_new`, so the selection happens once, before the first token. The
+// lexers of several threads may start at once; every one of them waits for
+// both kernels.
+static void lexer_select_kernels(void) {
+  pthread_once(&g_kernels_selected, lexer_pick_kernels);
+}
+
 /**
  * Reads the next character from the lexer's input string. This function DOES
  * NOT advance the lexer position. It just reads the char that the lexer
  * currently points to.
  *
- * NOTE (for future expansion): This is a simplified, ASCII-only implementation.
- * It assumes every character is one byte. To support full Unicode, this
- * function is the only place that needs to be upgraded with UTF-8 decoding
- * logic. The rest of the lexer can remain the same because it operates on the
- * 32-bit `ch`.
+ * Characters are decoded from UTF-8 into the 32-bit `ch`; `width` is the
+ * length of the sequence. A malformed sequence reads as U+FFFD (the
+ * replacement character) one byte wide, so the lexer always makes progress.
+ * Decoding never reads past the null terminator: it is not a continuation
+ * byte, so it ends any sequence.
  *
  * @param lexer A pointer to the Lexer whose state will be updated.
  */
 static void lexer_read_char(Lexer *lexer) {
-  // The end of the input string is marked by the null terminator.
-  if (*(lexer->position) == '\0') {
-    lexer->ch = '\0';
-    lexer->width = 0;
-  } else {
-    lexer->ch = (unsigned char)*(lexer->position);
-    lexer->width = 1; // TODO: Implement proper UTF-8 decoding.
+  unsigned char lead = (unsigned char)*(lexer->position);
+
+  // JSON structure is all ASCII; that is the hot path. The end of the input
+  // string is marked by the null terminator (width 0).
+  if (lead < 0x80) {
+    lexer->ch = lead;
+    lexer->width = lead != '\0' ? 1 : 0;
+    return;
+  }
+
+  uint32_t width = fdn_utf8_decode(lexer->position, 4, &lexer->ch);
+  if (width == 0) {
+    lexer->ch = 0xFFFD;
+    width = 1;
   }
+  lexer->width = (uint8_t)width;
 }
 
 /**
@@ -41,10 +247,16 @@ static void lexer_advance(Lexer *lexer) {
   }
 }
 
+void lexer_seek(Lexer *lexer, const char *position) {
+  lexer->position = position;
+  lexer_read_char(lexer);
+}
+
 static void lexer_skip_whitespace(Lexer *lexer) {
-  while (lexer->ch == ' ' || lexer->ch == '\n' || lexer->ch == '\t' ||
-         lexer->ch == '\r') {
-    lexer_advance(lexer);
+  // Compact JSON has no whitespace between tokens at all; don't pay for the
+  // call in that case.
+  if (is_whitespace(lexer->ch)) {
+    lexer_seek(lexer, g_skip_whitespace(lexer->position));
   }
 }
 
@@ -59,6 +271,8 @@ static inline bool is_digit(uint32_t ch) {
 Lexer lexer_new(const char *input_buffer) {
   Lexer lexer;
 
+  lexer_select_kernels();
+
   lexer.input = input_buffer;
   lexer.position = input_buffer;
 
@@ -74,7 +288,15 @@ Token lex_string(Lexer *lexer) {
 
   lexer_advance(lexer); // Move past the opening quotation mark.
 
-  while (lexer->ch != '"' && lexer->ch != '\0') {
+  while (1) {
+    // Jump over the plain string content in bulk. We land on the closing
+    // quotation mark, a backslash or a control character.
+    lexer_seek(lexer, g_scan_string(lexer->position));
+
+    if (lexer->ch == '"' || lexer->ch == '\0') {
+      break;
+    }
+
     // We encountered an escaped character e.g. \", \n or \0 (there are others
     // too). Most of those we can skip, only \0 requires special treatment.
     if (lexer->ch == '\\') {
@@ -87,14 +309,16 @@ Token lex_string(Lexer *lexer) {
       continue;
     }
 
-    lexer_advance(lexer); // Consume string content.
+    lexer_advance(lexer); // Consume the control character.
   }
 
   if (lexer->ch == '"') {
     lexer_advance(lexer);
-    tkn.literal_length = (size_t)(lexer->position - tkn.literal_start);
+  } else {
+    tkn.type = TOKEN_ILLEGAL; // The input ended before the closing quote.
   }
 
+  tkn.literal_length = (size_t)(lexer->position - tkn.literal_start);
   return tkn;
 }
 
@@ -179,6 +403,100 @@ Token lex_number(Lexer *lexer) {
   return tkn;
 }
 
+// skip_string_body returns a pointer past the closing quotation mark of the
+// string whose contents start at `cursor` (or at the null terminator).
+static const char *skip_string_body(const char *cursor) {
+  while (1) {
+    cursor = g_scan_string(cursor);
+
+    switch (*cursor) {
+    case '"':
+      return cursor + 1;
+    case '\0':
+      return cursor;
+    case '\\':
+      cursor += cursor[1] != '\0' ? 2 : 1; // Move past the escaped char.
+      break;
+    default:
+      cursor++; // A control character.
+      break;
+    }
+  }
+}
+
+// Bytes the depth-counting scan has to look at; everything else inside an
+// object or an array is skipped without further checks.
+static const bool g_is_structural[256] = {
+    ['\0'] = true, ['"'] = true, ['{'] = true,
+    ['}'] = true,  ['['] = true, [']'] = true,
+};
+
+// Characters that end a number or a literal (`true`, `false`, `null`).
+static inline bool is_scalar_end(unsigned char ch) {
+  return ch == ',' || ch == '}' || ch == ']' || ch == ':' || ch == '\0' ||
+         is_whitespace(ch);
+}
+
+void lexer_skip_value(Lexer *lexer) {
+  lexer_skip_whitespace(lexer);
+
+  const char *cursor = lexer->position;
+
+  if (*cursor == '"') {
+    cursor = skip_string_body(cursor + 1);
+  } else if (*cursor == '{' || *cursor == '[') {
+    uint32_t depth = 0;
+
+    do {
+      while (!g_is_structural[(unsigned char)*cursor]) {
+        cursor++;
+      }
+
+      switch (*cursor) {
+      case '"':
+        cursor = skip_string_body(cursor + 1);
+        continue;
+      case '{':
+      case '[':
+        depth++;
+        break;
+      case '}':
+      case ']':
+        depth--;
+        break;
+      default: // The input ended before the value was closed.
+        lexer_seek(lexer, cursor);
+        return;
+      }
+
+      cursor++;
+    } while (depth > 0);
+  } else {
+    while (!is_scalar_end((unsigned char)*cursor)) {
+      cursor++;
+    }
+  }
+
+  lexer_seek(lexer, cursor);
+}
+
+// lex_literal consumes one of the `true`, `false` or `null` literals.
+Token lex_literal(Lexer *lexer, const char *literal, TokenType type) {
+  Token tkn;
+  tkn.type = type;
+  tkn.literal_start = lexer->position;
+  tkn.literal_length = strlen(literal);
+
+  if (strncmp(lexer->position, literal, tkn.literal_length) != 0) {
+    tkn.type = TOKEN_ILLEGAL;
+    tkn.literal_length = lexer->width;
+  }
+
+  // The literal is ASCII, so it can be skipped as a whole.
+  lexer_seek(lexer, lexer->position + tkn.literal_length);
+  return tkn;
+}
+
 Token lexer_next_token(Lexer *lexer) {
   lexer_skip_whitespace(lexer);
 
@@ -203,6 +521,16 @@ Token lexer_next_token(Lexer *lexer) {
     lexer_advance(lexer);
     break;
 
+  case '[':
+    token.type = TOKEN_LBRACKET;
+    lexer_advance(lexer);
+    break;
+
+  case ']':
+    token.type = TOKEN_RBRACKET;
+    lexer_advance(lexer);
+    break;
+
   case ',':
     token.type = TOKEN_COMMA;
     lexer_advance(lexer);
@@ -216,6 +544,15 @@ Token lexer_next_token(Lexer *lexer) {
   case '"':
     return lex_string(lexer);
 
+  case 't':
+    return lex_literal(lexer, "true", TOKEN_TRUE);
+
+  case 'f':
+    return lex_literal(lexer, "false", TOKEN_FALSE);
+
+  case 'n':
+    return lex_literal(lexer, "null", TOKEN_NULL);
+
   case '\0':
     token.type = TOKEN_EOF;
     token.literal_length = 0;
@@ -228,8 +565,7 @@ Token lexer_next_token(Lexer *lexer) {
     }
 
     token.type = TOKEN_ILLEGAL;
-    token.literal_length = lexer->width; // handles illegal multi byte chars if
-                                         // UTF8 support is ever added.
+    token.literal_length = lexer->width; // The whole (multi-byte) character.
     lexer_advance(lexer);
     break;
   }
@@ -76,4 +76,22 @@ Lexer lexer_new(const char *input_buffer);
  */
 Token lexer_next_token(Lexer *lexer);
 
+/**
+ * @brief Moves the lexer to an arbitrary position in its input.
+ * @param lexer A pointer to the Lexer.
+ * @param position Must point at the beginning of a character in the input.
+ */
+void lexer_seek(Lexer *lexer, const char *position);
+
+/**
+ * @brief Advances the lexer past the next JSON value without producing tokens.
+ *
+ * Objects and arrays are skipped by counting the nesting depth of brackets
+ * (strings are jumped over in bulk so that brackets inside them don't count).
+ * The value is not validated.
+ *
+ * @param lexer A pointer to the Lexer. It is left right after the value.
+ */
+void lexer_skip_value(Lexer *lexer);
+
 #endif // JSON_LEXER_H
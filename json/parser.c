@@ -8,29 +8,18 @@
 #include "libs/foundation.h"
 #include "parser.h"
 
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#define PARSER_SSE2_UNESCAPE 1 // SSE2 is part of the x86-64 baseline.
+#endif
+
 // skip_json_value advances the lexer past json objects or arrays. In the case
 // of the LSP when we parse the incoming request message, at first we just care
 // about the `ID` and `method` fields. We can skip parsing the `params` since
 // they are a big an complex objest. We only store the beginning and ending of
 // the `params` so that the appropriate message handler function can later parse
 // it easily.
-static void skip_json_value(Lexer *lexer) {
-  uint32_t depth = 0;
-  Token tkn = lexer_next_token(lexer);
-
-  while (tkn.type != TOKEN_EOF) {
-    if (tkn.type == TOKEN_LBRACE || tkn.type == TOKEN_LBRACKET) {
-      depth++;
-    } else if (tkn.type == TOKEN_RBRACE || tkn.type == TOKEN_RBRACKET) {
-      depth--;
-    }
-
-    if (depth == 0)
-      return;
-
-    tkn = lexer_next_token(lexer);
-  }
-}
+static void skip_json_value(Lexer *lexer) { lexer_skip_value(lexer); }
 
 /* TODO: What do I want from this function?
  *
@@ -54,8 +43,9 @@ static void skip_json_value(Lexer *lexer) {
  * `Dispatcher` based on the received `method` will determine which handler
  * function to call.
  */
-RequestMessage *parser_parse_request_message(const char *request_buffer) {
-  RequestMessage *request = calloc(1, sizeof(*request));
+RequestMessage *parser_parse_request_message(fdn_arena *arena,
+                                             const char *request_buffer) {
+  RequestMessage *request = fdn_arena_alloc_zero(arena, sizeof(*request));
   if (request == NULL) {
     return NULL;
   }
@@ -65,7 +55,6 @@ RequestMessage *parser_parse_request_message(const char *request_buffer) {
 
   // Invalid JSON.
   if (token.type != TOKEN_LBRACE) {
-    free(request);
     return NULL;
   }
 
@@ -80,7 +69,6 @@ RequestMessage *parser_parse_request_message(const char *request_buffer) {
   while (1) {
     token = lexer_next_token(&lexer);
     if (token.type != TOKEN_STRING) {
-      free(request);
       return NULL;
     }
 
@@ -105,7 +93,6 @@ RequestMessage *parser_parse_request_message(const char *request_buffer) {
 
     token = lexer_next_token(&lexer);
     if (token.type != TOKEN_COLON) {
-      free(request);
       return NULL;
     }
 
@@ -113,7 +100,6 @@ RequestMessage *parser_parse_request_message(const char *request_buffer) {
       token = lexer_next_token(&lexer); // Move past the colon.
 
       if (token.type != TOKEN_STRING) {
-        free(request);
         return NULL;
       }
 
@@ -171,8 +157,748 @@ RequestMessage *parser_parse_request_message(const char *request_buffer) {
     // very end for the last key-value pair, we should enter the earlier if
     // statement.
     if (token.type != TOKEN_COMMA) {
-      free(request);
       return NULL;
     }
   }
 }
+
+/////////////////////////////////////////////////
+//                    TAPE                     //
+/////////////////////////////////////////////////
+
+typedef struct {
+  fdn_arena *arena;
+  Lexer lexer;
+  const char *source;
+  JsonTapeEntry *entries;
+  uint32_t count;
+  uint32_t capacity;
+} TapeBuilder;
+
+// tape_push appends an entry and returns its index, or JSON_TAPE_NONE if the
+// arena ran out of memory. The tape doubles in size when it is full; the old
+// copy stays in the arena until the arena is reset.
+static uint32_t tape_push(TapeBuilder *builder, JsonType type,
+                          const char *start, size_t size) {
+  if (builder->count == builder->capacity) {
+    uint32_t capacity = builder->capacity * 2;
+    JsonTapeEntry *entries =
+        fdn_arena_alloc(builder->arena, capacity * sizeof(*entries));
+    if (entries == NULL) {
+      return JSON_TAPE_NONE;
+    }
+
+    memcpy(entries, builder->entries, builder->count * sizeof(*entries));
+    builder->entries = entries;
+    builder->capacity = capacity;
+  }
+
+  uint32_t index = builder->count++;
+  JsonTapeEntry *entry = &builder->entries[index];
+  entry->type = type;
+  entry->next = index + 1;
+  entry->offset = (uint32_t)(start - builder->source);
+  entry->size = (uint32_t)size;
+
+  return index;
+}
+
+static bool tape_parse_value(TapeBuilder *builder, Token token,
+                             uint32_t depth);
+
+static bool tape_parse_object(TapeBuilder *builder, Token token,
+                              uint32_t depth) {
+  uint32_t object = tape_push(builder, JSON_OBJECT, token.literal_start, 0);
+  if (object == JSON_TAPE_NONE) {
+    return false;
+  }
+
+  uint32_t members = 0;
+  token = lexer_next_token(&builder->lexer);
+
+  if (token.type != TOKEN_RBRACE) {
+    while (1) {
+      if (token.type != TOKEN_STRING) {
+        return false;
+      }
+
+      if (tape_push(builder, JSON_STRING, token.literal_start + 1,
+                    token.literal_length - 2) == JSON_TAPE_NONE) {
+        return false;
+      }
+
+      if (lexer_next_token(&builder->lexer).type != TOKEN_COLON) {
+        return false;
+      }
+
+      token = lexer_next_token(&builder->lexer);
+      if (!tape_parse_value(builder, token, depth + 1)) {
+        return false;
+      }
+      members++;
+
+      token = lexer_next_token(&builder->lexer);
+      if (token.type == TOKEN_RBRACE) {
+        break;
+      }
+
+      if (token.type != TOKEN_COMMA) {
+        return false;
+      }
+
+      token = lexer_next_token(&builder->lexer);
+    }
+  }
+
+  builder->entries[object].next = builder->count;
+  builder->entries[object].size = members;
+  return true;
+}
+
+static bool tape_parse_array(TapeBuilder *builder, Token token,
+                             uint32_t depth) {
+  uint32_t array = tape_push(builder, JSON_ARRAY, token.literal_start, 0);
+  if (array == JSON_TAPE_NONE) {
+    return false;
+  }
+
+  uint32_t elements = 0;
+  token = lexer_next_token(&builder->lexer);
+
+  if (token.type != TOKEN_RBRACKET) {
+    while (1) {
+      if (!tape_parse_value(builder, token, depth + 1)) {
+        return false;
+      }
+      elements++;
+
+      token = lexer_next_token(&builder->lexer);
+      if (token.type == TOKEN_RBRACKET) {
+        break;
+      }
+
+      if (token.type != TOKEN_COMMA) {
+        return false;
+      }
+
+      token = lexer_next_token(&builder->lexer);
+    }
+  }
+
+  builder->entries[array].next = builder->count;
+  builder->entries[array].size = elements;
+  return true;
+}
+
+static bool tape_parse_value(TapeBuilder *builder, Token token,
+                             uint32_t depth) {
+  if (depth > JSON_TAPE_MAX_DEPTH) {
+    return false;
+  }
+
+  switch (token.type) {
+  case TOKEN_LBRACE:
+    return tape_parse_object(builder, token, depth);
+
+  case TOKEN_LBRACKET:
+    return tape_parse_array(builder, token, depth);
+
+  case TOKEN_STRING:
+    // Store the string without the quotation marks.
+    return tape_push(builder, JSON_STRING, token.literal_start + 1,
+                     token.literal_length - 2) != JSON_TAPE_NONE;
+
+  case TOKEN_NUMBER:
+    return tape_push(builder, JSON_NUMBER, token.literal_start,
+                     token.literal_length) != JSON_TAPE_NONE;
+
+  case TOKEN_TRUE:
+    return tape_push(builder, JSON_TRUE, token.literal_start,
+                     token.literal_length) != JSON_TAPE_NONE;
+
+  case TOKEN_FALSE:
+    return tape_push(builder, JSON_FALSE, token.literal_start,
+                     token.literal_length) != JSON_TAPE_NONE;
+
+  case TOKEN_NULL:
+    return tape_push(builder, JSON_NULL, token.literal_start,
+                     token.literal_length) != JSON_TAPE_NONE;
+
+  default:
+    return false;
+  }
+}
+
+bool parser_parse_tape(fdn_arena *arena, fdn_string json, JsonTape *tape) {
+  TapeBuilder builder;
+  builder.arena = arena;
+  builder.lexer = lexer_new(json.string_start);
+  builder.source = json.string_start;
+  builder.count = 0;
+
+  // Start with a guess that fits typical LSP params; the tape grows if the
+  // document is denser than that.
+  builder.capacity = (uint32_t)(json.string_length / 16) + 16;
+  builder.entries =
+      fdn_arena_alloc(arena, builder.capacity * sizeof(*builder.entries));
+  if (builder.entries == NULL) {
+    return false;
+  }
+
+  Token token = lexer_next_token(&builder.lexer);
+  if (!tape_parse_value(&builder, token, 0)) {
+    return false;
+  }
+
+  // The value has to end within the provided view.
+  if (builder.lexer.position > json.string_start + json.string_length) {
+    return false;
+  }
+
+  tape->source = json.string_start;
+  tape->entries = builder.entries;
+  tape->count = builder.count;
+  return true;
+}
+
+uint32_t json_tape_object_get(const JsonTape *tape, uint32_t object,
+                              const char *key) {
+  if (object >= tape->count || tape->entries[object].type != JSON_OBJECT) {
+    return JSON_TAPE_NONE;
+  }
+
+  uint32_t end = tape->entries[object].next;
+  uint32_t index = object + 1;
+
+  while (index < end) {
+    uint32_t value = index + 1; // The value follows its key.
+
+    if (fdn_string_is_eq_c_str(json_tape_get_string(tape, index), key)) {
+      return value;
+    }
+
+    index = tape->entries[value].next; // Jump over the value to the next key.
+  }
+
+  return JSON_TAPE_NONE;
+}
+
+uint32_t json_tape_array_get(const JsonTape *tape, uint32_t array,
+                             uint32_t i) {
+  if (array >= tape->count || tape->entries[array].type != JSON_ARRAY ||
+      i >= tape->entries[array].size) {
+    return JSON_TAPE_NONE;
+  }
+
+  uint32_t index = array + 1;
+  while (i-- > 0) {
+    index = tape->entries[index].next;
+  }
+
+  return index;
+}
+
+fdn_string json_tape_get_string(const JsonTape *tape, uint32_t index) {
+  if (index >= tape->count || tape->entries[index].type != JSON_STRING) {
+    return fdn_string_create_view("", 0);
+  }
+
+  const JsonTapeEntry *entry = &tape->entries[index];
+  return fdn_string_create_view(tape->source + entry->offset, entry->size);
+}
+
+// parse_int64 reads the number `literal` of `size` bytes as an integer.
+static bool parse_int64(const char *literal, size_t size, int64_t *out) {
+  size_t i = 0;
+  bool negative = size > 0 && literal[0] == '-';
+  if (negative) {
+    i++;
+  }
+
+  int64_t value = 0;
+  for (; i < size; i++) {
+    char ch = literal[i];
+    // Fractions and exponents are not integers.
+    if (ch < '0' || ch > '9' || value > (INT64_MAX - 9) / 10) {
+      return false;
+    }
+    value = value * 10 + (ch - '0');
+  }
+
+  *out = negative ? -value : value;
+  return true;
+}
+
+bool json_tape_get_int64(const JsonTape *tape, uint32_t index, int64_t *out) {
+  if (index >= tape->count || tape->entries[index].type != JSON_NUMBER) {
+    return false;
+  }
+
+  const JsonTapeEntry *entry = &tape->entries[index];
+  return parse_int64(tape->source + entry->offset, entry->size, out);
+}
+
+/////////////////////////////////////////////////
+//                    PATHS                    //
+/////////////////////////////////////////////////
+
+bool json_path_compile(const char *path, JsonPath *compiled) {
+  compiled->depth = 0;
+
+  const char *cursor = path;
+  while (1) {
+    const char *dot = strchr(cursor, '.');
+    size_t length = dot ? (size_t)(dot - cursor) : strlen(cursor);
+
+    if (length == 0 || compiled->depth == JSON_PATH_MAX_SEGMENTS) {
+      return false;
+    }
+
+    JsonPathSegment *segment = &compiled->segments[compiled->depth++];
+    segment->key = fdn_string_create_view(cursor, length);
+    segment->index = 0;
+
+    bool is_index = true;
+    uint32_t index = 0;
+    for (size_t i = 0; i < length; i++) {
+      if (cursor[i] < '0' || cursor[i] > '9' || index > (UINT32_MAX - 9) / 10) {
+        is_index = false;
+        break;
+      }
+      index = index * 10 + (uint32_t)(cursor[i] - '0');
+    }
+
+    if (is_index) {
+      segment->key = fdn_string_create_view("", 0);
+      segment->index = index;
+    }
+
+    if (dot == NULL) {
+      return true;
+    }
+
+    cursor = dot + 1;
+  }
+}
+
+typedef struct {
+  Lexer lexer;
+  const JsonPath *paths;
+  JsonValue *values;
+  uint32_t count;
+  uint32_t unresolved; // Bitmask of the paths that were not resolved yet.
+} PathWalk;
+
+static bool path_walk_value(PathWalk *walk, uint32_t depth, uint32_t active);
+
+// path_walk_select returns the subset of `active` paths whose segment at
+// `depth` matches the object `key` or the array `index`.
+static uint32_t path_walk_select(const PathWalk *walk, uint32_t depth,
+                                 uint32_t active, fdn_string key,
+                                 uint32_t index) {
+  uint32_t selected = 0;
+
+  for (uint32_t i = 0; i < walk->count; i++) {
+    if ((active & (1u << i)) == 0) {
+      continue;
+    }
+
+    const JsonPathSegment *segment = &walk->paths[i].segments[depth];
+    bool matches = key.string_length > 0
+                       ? fdn_string_is_eq(segment->key, key)
+                       : segment->key.string_length == 0 &&
+                             segment->index == index;
+    if (matches) {
+      selected |= 1u << i;
+    }
+  }
+
+  return selected;
+}
+
+// path_walk_member walks (or skips) a member value of an object or an array.
+static bool path_walk_member(PathWalk *walk, uint32_t depth,
+                             uint32_t selected) {
+  if (selected == 0) {
+    skip_json_value(&walk->lexer);
+    return true;
+  }
+
+  return path_walk_value(walk, depth + 1, selected);
+}
+
+static bool path_walk_object(PathWalk *walk, uint32_t depth,
+                             uint32_t active) {
+  Token token = lexer_next_token(&walk->lexer);
+  if (token.type == TOKEN_RBRACE) {
+    return true;
+  }
+
+  while (1) {
+    if (token.type != TOKEN_STRING ||
+        lexer_next_token(&walk->lexer).type != TOKEN_COLON) {
+      return false;
+    }
+
+    fdn_string key = fdn_string_create_view(token.literal_start + 1,
+                                            token.literal_length - 2);
+    uint32_t selected = path_walk_select(walk, depth, active, key, 0);
+    if (!path_walk_member(walk, depth, selected)) {
+      return false;
+    }
+
+    // Everything we were looking for has been found; the rest of the document
+    // doesn't matter.
+    if (walk->unresolved == 0) {
+      return true;
+    }
+
+    token = lexer_next_token(&walk->lexer);
+    if (token.type == TOKEN_RBRACE) {
+      return true;
+    }
+
+    if (token.type != TOKEN_COMMA) {
+      return false;
+    }
+
+    token = lexer_next_token(&walk->lexer);
+  }
+}
+
+static bool path_walk_array(PathWalk *walk, uint32_t depth, uint32_t active) {
+  // Peek for an empty array; an element has to be positioned at its start.
+  Lexer peek = walk->lexer;
+  if (lexer_next_token(&peek).type == TOKEN_RBRACKET) {
+    walk->lexer = peek;
+    return true;
+  }
+
+  for (uint32_t index = 0;; index++) {
+    fdn_string no_key = fdn_string_create_view("", 0);
+    uint32_t selected = path_walk_select(walk, depth, active, no_key, index);
+    if (!path_walk_member(walk, depth, selected)) {
+      return false;
+    }
+
+    if (walk->unresolved == 0) {
+      return true;
+    }
+
+    Token token = lexer_next_token(&walk->lexer);
+    if (token.type == TOKEN_RBRACKET) {
+      return true;
+    }
+
+    if (token.type != TOKEN_COMMA) {
+      return false;
+    }
+  }
+}
+
+// path_walk_value walks the value the lexer is positioned at. The `active`
+// paths matched all the segments up to `depth`.
+static bool path_walk_value(PathWalk *walk, uint32_t depth, uint32_t active) {
+  // Paths that end at this value, and paths that continue inside of it.
+  uint32_t ending = 0;
+  for (uint32_t i = 0; i < walk->count; i++) {
+    if ((active & (1u << i)) != 0 && walk->paths[i].depth == depth) {
+      ending |= 1u << i;
+    }
+  }
+  uint32_t deeper = active & ~ending;
+
+  Lexer start = walk->lexer;
+  Token token = lexer_next_token(&walk->lexer);
+  const char *value_start = token.literal_start;
+  JsonType type;
+
+  switch (token.type) {
+  case TOKEN_LBRACE:
+    type = JSON_OBJECT;
+    break;
+  case TOKEN_LBRACKET:
+    type = JSON_ARRAY;
+    break;
+  case TOKEN_STRING:
+    type = JSON_STRING;
+    break;
+  case TOKEN_NUMBER:
+    type = JSON_NUMBER;
+    break;
+  case TOKEN_TRUE:
+    type = JSON_TRUE;
+    break;
+  case TOKEN_FALSE:
+    type = JSON_FALSE;
+    break;
+  case TOKEN_NULL:
+    type = JSON_NULL;
+    break;
+  default:
+    return false;
+  }
+
+  if (type == JSON_OBJECT || type == JSON_ARRAY) {
+    if (deeper == 0) {
+      // Nothing to look for inside; jump over the whole subtree at once.
+      walk->lexer = start;
+      skip_json_value(&walk->lexer);
+    } else {
+      bool ok = type == JSON_OBJECT ? path_walk_object(walk, depth, deeper)
+                                    : path_walk_array(walk, depth, deeper);
+      if (!ok) {
+        return false;
+      }
+    }
+  }
+
+  fdn_string literal = fdn_string_create_view(
+      value_start, (size_t)(walk->lexer.position - value_start));
+  if (type == JSON_STRING) {
+    literal = fdn_string_create_view(token.literal_start + 1,
+                                     token.literal_length - 2);
+  }
+
+  for (uint32_t i = 0; i < walk->count; i++) {
+    if ((ending & (1u << i)) != 0) {
+      walk->values[i].found = true;
+      walk->values[i].type = type;
+      walk->values[i].literal = literal;
+    }
+  }
+  walk->unresolved &= ~ending;
+
+  return true;
+}
+
+bool parser_find_paths(fdn_string json, const JsonPath *paths, uint32_t count,
+                       JsonValue *values) {
+  if (count > JSON_PATH_MAX_BATCH) {
+    return false;
+  }
+
+  PathWalk walk;
+  walk.lexer = lexer_new(json.string_start);
+  walk.paths = paths;
+  walk.values = values;
+  walk.count = count;
+  walk.unresolved = count == 32 ? UINT32_MAX : (1u << count) - 1;
+
+  for (uint32_t i = 0; i < count; i++) {
+    values[i].found = false;
+    values[i].type = JSON_NULL;
+    values[i].literal = fdn_string_create_view("", 0);
+  }
+
+  if (count == 0) {
+    return true;
+  }
+
+  return path_walk_value(&walk, 0, walk.unresolved);
+}
+
+bool json_value_get_int64(const JsonValue *value, int64_t *out) {
+  return value->found && value->type == JSON_NUMBER &&
+         parse_int64(value->literal.string_start, value->literal.string_length,
+                     out);
+}
+
+/////////////////////////////////////////////////
+//                   STRINGS                   //
+/////////////////////////////////////////////////
+
+static int hex_digit_value(char ch) {
+  if (ch >= '0' && ch <= '9') {
+    return ch - '0';
+  }
+  if (ch >= 'a' && ch <= 'f') {
+    return ch - 'a' + 10;
+  }
+  if (ch >= 'A' && ch <= 'F') {
+    return ch - 'A' + 10;
+  }
+  return -1;
+}
+
+// read_hex4 parses the four hex digits of a \uXXXX escape.
+static bool read_hex4(const char *digits, uint32_t *value) {
+  uint32_t result = 0;
+  for (int i = 0; i < 4; i++) {
+    int digit = hex_digit_value(digits[i]);
+    if (digit < 0) {
+      return false;
+    }
+    result = (result << 4) | (uint32_t)digit;
+  }
+
+  *value = result;
+  return true;
+}
+
+static size_t encode_utf8(uint32_t code_point, char *output) {
+  if (code_point < 0x80) {
+    output[0] = (char)code_point;
+    return 1;
+  }
+  if (code_point < 0x800) {
+    output[0] = (char)(0xC0 | (code_point >> 6));
+    output[1] = (char)(0x80 | (code_point & 0x3F));
+    return 2;
+  }
+  if (code_point < 0x10000) {
+    output[0] = (char)(0xE0 | (code_point >> 12));
+    output[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+    output[2] = (char)(0x80 | (code_point & 0x3F));
+    return 3;
+  }
+  output[0] = (char)(0xF0 | (code_point >> 18));
+  output[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+  output[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+  output[3] = (char)(0x80 | (code_point & 0x3F));
+  return 4;
+}
+
+// unescape_plain_prefix returns how many bytes at the start of the `length`
+// bytes at `input` are plain ASCII without a backslash, copying them to
+// `output` on the way. Blocks of 16 such bytes (the common case for source
+// text) are moved with a single load and store.
+static size_t unescape_plain_prefix(const char *input, size_t length,
+                                    char *output) {
+  size_t i = 0;
+
+#ifdef PARSER_SSE2_UNESCAPE
+  const __m128i backslash = _mm_set1_epi8('\\');
+  while (length - i >= 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(const void *)(input + i));
+    // High bits flag non-ASCII bytes, which have to be validated.
+    int stops = _mm_movemask_epi8(_mm_cmpeq_epi8(block, backslash)) |
+                _mm_movemask_epi8(block);
+
+    if (stops != 0) {
+      // Only the bytes before the stop are copied; when unescaping in place,
+      // storing the whole block could overwrite input that is not read yet.
+      size_t prefix = (size_t)__builtin_ctz((unsigned int)stops);
+      memmove(output + i, input + i, prefix);
+      return i + prefix;
+    }
+
+    // The block was loaded before it is stored and `output` never runs ahead
+    // of `input`, so this also works when unescaping in place.
+    _mm_storeu_si128((__m128i *)(void *)(output + i), block);
+    i += 16;
+  }
+#endif
+
+  for (; i < length; i++) {
+    unsigned char ch = (unsigned char)input[i];
+    if (ch == '\\' || ch >= 0x80) {
+      break;
+    }
+    output[i] = (char)ch;
+  }
+
+  return i;
+}
+
+bool json_string_unescape(fdn_string escaped, char *output, size_t *length) {
+  const char *cursor = escaped.string_start;
+  const char *end = escaped.string_start + escaped.string_length;
+  size_t written = 0;
+
+  while (cursor < end) {
+    size_t plain =
+        unescape_plain_prefix(cursor, (size_t)(end - cursor), output + written);
+    cursor += plain;
+    written += plain;
+
+    if (cursor == end) {
+      break;
+    }
+
+    if ((unsigned char)*cursor >= 0x80) {
+      // Raw UTF-8 is copied through once it is known to be well-formed.
+      uint32_t code_point;
+      uint32_t width =
+          fdn_utf8_decode(cursor, (size_t)(end - cursor), &code_point);
+      if (width == 0) {
+        return false;
+      }
+
+      memmove(output + written, cursor, width);
+      cursor += width;
+      written += width;
+      continue;
+    }
+
+    if (end - cursor < 2) {
+      return false;
+    }
+
+    char ch = cursor[1];
+    cursor += 2;
+    switch (ch) {
+    case '"':
+    case '\\':
+    case '/':
+      output[written++] = ch;
+      break;
+    case 'b':
+      output[written++] = '\b';
+      break;
+    case 'f':
+      output[written++] = '\f';
+      break;
+    case 'n':
+      output[written++] = '\n';
+      break;
+    case 'r':
+      output[written++] = '\r';
+      break;
+    case 't':
+      output[written++] = '\t';
+      break;
+    case 'u': {
+      uint32_t code_point;
+      if (end - cursor < 4 || !read_hex4(cursor, &code_point)) {
+        return false;
+      }
+      cursor += 4;
+
+      // Characters outside the BMP are escaped as a UTF-16 surrogate pair.
+      if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+        uint32_t low;
+        if (end - cursor < 6 || cursor[0] != '\\' || cursor[1] != 'u' ||
+            !read_hex4(cursor + 2, &low) || low < 0xDC00 || low > 0xDFFF) {
+          return false;
+        }
+        cursor += 6;
+        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+      } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+        return false; // A lone low surrogate.
+      }
+
+      written += encode_utf8(code_point, output + written);
+      break;
+    }
+    default:
+      return false;
+    }
+  }
+
+  *length = written;
+  return true;
+}
+
+bool json_string_unescape_to_arena(fdn_arena *arena, fdn_string escaped,
+                                   fdn_string *decoded) {
+  char *buffer = fdn_arena_alloc(arena, escaped.string_length + 1);
+  size_t length = 0;
+  if (buffer == NULL || !json_string_unescape(escaped, buffer, &length)) {
+    return false;
+  }
+
+  buffer[length] = '\0';
+  *decoded = fdn_string_create_view(buffer, length);
+  return true;
+}
@@ -16,6 +16,157 @@ typedef struct {
   fdn_string params;
 } RequestMessage;
 
-RequestMessage *parser_parse_request_message(const char *request_buffer);
+// parser_parse_request_message parses the null-terminated `request_buffer`.
+// The returned message is allocated from the `arena` and its fields are views
+// into the `request_buffer`. Returns NULL if the JSON is invalid.
+RequestMessage *parser_parse_request_message(fdn_arena *arena,
+                                             const char *request_buffer);
+
+//////////// TAPE /////////////
+
+/**
+ * A JSON document parsed into a "tape": a flat array with one entry per value,
+ * laid out in document order. An object is followed by its members (each
+ * member is a key string followed by the value) and an array by its elements.
+ * Every entry knows where the next value starts, so a handler jumps over a
+ * whole nested subtree in one step instead of chasing pointers.
+ *
+ *   {"a": [1, 2], "b": null}
+ *
+ *   idx  type    next  size
+ *   0    OBJECT  7     2     <- size is the number of members
+ *   1    STRING  2     1     "a"
+ *   2    ARRAY   5     2     <- size is the number of elements
+ *   3    NUMBER  4     1
+ *   4    NUMBER  5     1
+ *   5    STRING  6     1     "b"
+ *   6    NULL    7     4
+ *
+ * Like `Token`, the entries don't copy any text. They store the offset of the
+ * value in the source buffer. Strings are stored without the quotation marks
+ * and still escaped.
+ */
+typedef enum {
+  JSON_OBJECT,
+  JSON_ARRAY,
+  JSON_STRING,
+  JSON_NUMBER,
+  JSON_TRUE,
+  JSON_FALSE,
+  JSON_NULL,
+} JsonType;
+
+typedef struct {
+  uint32_t type;   // JsonType of the value.
+  uint32_t next;   // Index of the entry right after this value's subtree.
+  uint32_t offset; // Offset of the value in the source buffer.
+  uint32_t size;   // Literal length for scalars, children count for containers.
+} JsonTapeEntry;
+
+typedef struct {
+  const char *source;
+  JsonTapeEntry *entries;
+  uint32_t count;
+} JsonTape;
+
+// Returned by the tape lookups when the value doesn't exist.
+#define JSON_TAPE_NONE UINT32_MAX
+
+// Objects and arrays nested deeper than this are rejected.
+#define JSON_TAPE_MAX_DEPTH 128
+
+// parser_parse_tape parses the JSON value at the start of `json` into a tape
+// allocated from the `arena`. The value must be followed by a null terminator
+// somewhere in the buffer (e.g. `params` inside a message body). Returns
+// `false` if the JSON is invalid.
+bool parser_parse_tape(fdn_arena *arena, fdn_string json, JsonTape *tape);
+
+// json_tape_object_get returns the index of the value stored under `key` in
+// the `object` entry, or JSON_TAPE_NONE.
+uint32_t json_tape_object_get(const JsonTape *tape, uint32_t object,
+                              const char *key);
+
+// json_tape_array_get returns the index of the `i`-th element of the `array`
+// entry, or JSON_TAPE_NONE.
+uint32_t json_tape_array_get(const JsonTape *tape, uint32_t array, uint32_t i);
+
+// json_tape_get_string returns the (still escaped) contents of the string at
+// `index`, or an empty view if the entry is not a string.
+fdn_string json_tape_get_string(const JsonTape *tape, uint32_t index);
+
+// json_tape_get_int64 parses the integer at `index`. Returns `false` if the
+// entry is not a number or the number is not an integer.
+bool json_tape_get_int64(const JsonTape *tape, uint32_t index, int64_t *out);
+
+static inline JsonType json_tape_type(const JsonTape *tape, uint32_t index) {
+  return (JsonType)tape->entries[index].type;
+}
+
+//////////// PATHS /////////////
+
+/**
+ * Most handlers only need a couple of fields from `params`, e.g. hover needs
+ * `textDocument.uri`, `position.line` and `position.character`. Instead of
+ * building a tape of the whole document, the paths can be resolved directly
+ * against the raw JSON text: subtrees that no path goes through are skipped
+ * with a depth-counting scan, and the scan stops as soon as every path is
+ * resolved.
+ */
+
+#define JSON_PATH_MAX_SEGMENTS 8
+
+// Up to this many paths can be resolved in one pass.
+#define JSON_PATH_MAX_BATCH 32
+
+typedef struct {
+  fdn_string key; // The object key. Empty if the segment indexes an array.
+  uint32_t index; // The array index (only used when `key` is empty).
+} JsonPathSegment;
+
+typedef struct {
+  JsonPathSegment segments[JSON_PATH_MAX_SEGMENTS];
+  uint32_t depth;
+} JsonPath;
+
+// A value found at the end of a path.
+typedef struct {
+  bool found;
+  JsonType type;
+  fdn_string literal; // Escaped contents for strings, raw JSON text otherwise.
+} JsonValue;
+
+// json_path_compile compiles a dotted path such as "textDocument.uri". Numeric
+// segments index arrays, e.g. "contentChanges.0.text". The `path` string must
+// outlive the compiled path. Returns `false` if the path is malformed or too
+// deep.
+bool json_path_compile(const char *path, JsonPath *compiled);
+
+// parser_find_paths resolves `count` paths against the JSON value at the start
+// of `json` in a single pass. `values[i]` receives the value of `paths[i]`
+// (with `found` set to false if it doesn't exist). The value must be followed
+// by a null terminator somewhere in the buffer. Returns `false` if the JSON is
+// invalid along the way or `count` exceeds JSON_PATH_MAX_BATCH.
+bool parser_find_paths(fdn_string json, const JsonPath *paths, uint32_t count,
+                       JsonValue *values);
+
+// json_value_get_int64 reads a value found by `parser_find_paths` as an
+// integer. Returns `false` if it is missing, not a number or not an integer.
+bool json_value_get_int64(const JsonValue *value, int64_t *out);
+
+//////////// STRINGS /////////////
+
+// json_string_unescape decodes the escaped contents of a JSON string (as stored
+// on the tape or returned by a path lookup) into `output`. A decoded string is
+// never longer than its escaped form, so `output` needs room for
+// `escaped.string_length` bytes; it may also be the escaped string itself to
+// decode in place. Escapes (including \uXXXX surrogate pairs) are decoded and
+// raw UTF-8 is validated in the same pass. Returns `false` on a malformed
+// escape or invalid UTF-8.
+bool json_string_unescape(fdn_string escaped, char *output, size_t *length);
+
+// json_string_unescape_to_arena decodes the string into a null-terminated copy
+// allocated from the `arena`.
+bool json_string_unescape_to_arena(fdn_arena *arena, fdn_string escaped,
+                                   fdn_string *decoded);
 
 #endif // JSON_PARSER_H
@@ -0,0 +1,216 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libs/foundation.h"
+#include "writer.h"
+
+bool json_writer_init(JsonWriter *writer, size_t capacity) {
+  writer->buffer = malloc(capacity);
+  writer->capacity = writer->buffer != NULL ? capacity : 0;
+  json_writer_reset(writer);
+
+  return writer->buffer != NULL;
+}
+
+void json_writer_free(JsonWriter *writer) {
+  free(writer->buffer);
+  writer->buffer = NULL;
+  writer->capacity = 0;
+  writer->length = 0;
+}
+
+void json_writer_reset(JsonWriter *writer) {
+  writer->length = 0;
+  writer->depth = 0;
+  writer->has_members[0] = false;
+  writer->after_key = false;
+  writer->failed = false;
+}
+
+// writer_reserve makes room for `size` more bytes. Returns `false` (and marks
+// the writer as failed) if the buffer could not grow.
+static bool writer_reserve(JsonWriter *writer, size_t size) {
+  if (writer->failed) {
+    return false;
+  }
+
+  if (writer->capacity - writer->length >= size) {
+    return true;
+  }
+
+  size_t capacity = writer->capacity > 0 ? writer->capacity * 2 : 256;
+  while (capacity - writer->length < size) {
+    capacity *= 2;
+  }
+
+  char *buffer = realloc(writer->buffer, capacity);
+  if (buffer == NULL) {
+    writer->failed = true;
+    return false;
+  }
+
+  writer->buffer = buffer;
+  writer->capacity = capacity;
+  return true;
+}
+
+static void writer_append(JsonWriter *writer, const char *data, size_t size) {
+  if (writer_reserve(writer, size)) {
+    memcpy(writer->buffer + writer->length, data, size);
+    writer->length += size;
+  }
+}
+
+static void writer_append_char(JsonWriter *writer, char ch) {
+  if (writer_reserve(writer, 1)) {
+    writer->buffer[writer->length++] = ch;
+  }
+}
+
+// writer_begin_value emits the comma that separates the value from the
+// previous one, unless it directly follows a key.
+static void writer_begin_value(JsonWriter *writer) {
+  if (writer->after_key) {
+    writer->after_key = false;
+    return;
+  }
+
+  if (writer->has_members[writer->depth]) {
+    writer_append_char(writer, ',');
+  }
+  writer->has_members[writer->depth] = true;
+}
+
+static void writer_open(JsonWriter *writer, char bracket) {
+  writer_begin_value(writer);
+  writer_append_char(writer, bracket);
+
+  if (writer->depth + 1 == JSON_WRITER_MAX_DEPTH) {
+    writer->failed = true;
+    return;
+  }
+
+  writer->depth++;
+  writer->has_members[writer->depth] = false;
+}
+
+static void writer_close(JsonWriter *writer, char bracket) {
+  if (writer->depth == 0) {
+    writer->failed = true;
+    return;
+  }
+
+  writer->depth--;
+  writer_append_char(writer, bracket);
+}
+
+void json_writer_begin_object(JsonWriter *writer) { writer_open(writer, '{'); }
+void json_writer_end_object(JsonWriter *writer) { writer_close(writer, '}'); }
+void json_writer_begin_array(JsonWriter *writer) { writer_open(writer, '['); }
+void json_writer_end_array(JsonWriter *writer) { writer_close(writer, ']'); }
+
+void json_writer_key(JsonWriter *writer, const char *key) {
+  writer_begin_value(writer);
+  writer_append_char(writer, '"');
+  writer_append(writer, key, strlen(key));
+  writer_append(writer, "\":", 2);
+  writer->after_key = true;
+}
+
+static inline bool needs_escape(unsigned char ch) {
+  return ch == '"' || ch == '\\' || ch < 0x20;
+}
+
+void json_writer_string(JsonWriter *writer, fdn_string str) {
+  writer_begin_value(writer);
+  writer_append_char(writer, '"');
+
+  const char *cursor = str.string_start;
+  const char *end = str.string_start + str.string_length;
+
+  while (cursor < end) {
+    // Copy the run of characters that don't need escaping in one go.
+    const char *run = cursor;
+    while (cursor < end && !needs_escape((unsigned char)*cursor)) {
+      cursor++;
+    }
+    writer_append(writer, run, (size_t)(cursor - run));
+
+    if (cursor == end) {
+      break;
+    }
+
+    unsigned char ch = (unsigned char)*cursor++;
+    switch (ch) {
+    case '"':
+      writer_append(writer, "\\\"", 2);
+      break;
+    case '\\':
+      writer_append(writer, "\\\\", 2);
+      break;
+    case '\n':
+      writer_append(writer, "\\n", 2);
+      break;
+    case '\r':
+      writer_append(writer, "\\r", 2);
+      break;
+    case '\t':
+      writer_append(writer, "\\t", 2);
+      break;
+    default: {
+      const char *hex = "0123456789abcdef";
+      char escaped[6] = {'\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 0xF]};
+      writer_append(writer, escaped, sizeof(escaped));
+      break;
+    }
+    }
+  }
+
+  writer_append_char(writer, '"');
+}
+
+void json_writer_string_c(JsonWriter *writer, const char *str) {
+  json_writer_string(writer, fdn_string_create_view(str, strlen(str)));
+}
+
+void json_writer_int(JsonWriter *writer, int64_t value) {
+  writer_begin_value(writer);
+
+  // Format from the end; 20 digits and a sign fit any int64_t.
+  char digits[21];
+  size_t at = sizeof(digits);
+  uint64_t magnitude =
+      value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+
+  do {
+    digits[--at] = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude > 0);
+
+  if (value < 0) {
+    digits[--at] = '-';
+  }
+
+  writer_append(writer, digits + at, sizeof(digits) - at);
+}
+
+void json_writer_bool(JsonWriter *writer, bool value) {
+  writer_begin_value(writer);
+  if (value) {
+    writer_append(writer, "true", 4);
+  } else {
+    writer_append(writer, "false", 5);
+  }
+}
+
+void json_writer_null(JsonWriter *writer) {
+  writer_begin_value(writer);
+  writer_append(writer, "null", 4);
+}
+
+void json_writer_raw(JsonWriter *writer, fdn_string json) {
+  writer_begin_value(writer);
+  writer_append(writer, json.string_start, json.string_length);
+}
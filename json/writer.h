@@ -0,0 +1,77 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libs/foundation.h"
+
+/**
+ * A streaming JSON writer. Values are appended straight into a growable output
+ * buffer that is meant to be reused for every message of a connection, so a
+ * response is formatted exactly once and the buffer only grows when a response
+ * is bigger than any previous one.
+ *
+ * Commas are inserted automatically:
+ *
+ *   json_writer_begin_object(w);
+ *   json_writer_key(w, "id");
+ *   json_writer_int(w, 1);
+ *   json_writer_key(w, "result");
+ *   json_writer_null(w);
+ *   json_writer_end_object(w);     // {"id":1,"result":null}
+ *
+ * Allocation failures are sticky: the writer stops appending and
+ * `json_writer_failed` reports it once the message is complete.
+ */
+
+// Objects and arrays nested deeper than this mark the writer as failed.
+#define JSON_WRITER_MAX_DEPTH 64
+
+typedef struct {
+  char *buffer;
+  size_t length;
+  size_t capacity;
+
+  uint32_t depth;
+  bool has_members[JSON_WRITER_MAX_DEPTH]; // Whether the next value needs a
+                                           // comma, per nesting level.
+  bool after_key; // A key was written; the value follows without a comma.
+  bool failed;
+} JsonWriter;
+
+bool json_writer_init(JsonWriter *writer, size_t capacity);
+void json_writer_free(JsonWriter *writer);
+
+// json_writer_reset empties the writer but keeps the buffer for reuse.
+void json_writer_reset(JsonWriter *writer);
+
+static inline bool json_writer_failed(const JsonWriter *writer) {
+  return writer->failed;
+}
+
+static inline fdn_string json_writer_output(const JsonWriter *writer) {
+  return fdn_string_create_view(writer->buffer, writer->length);
+}
+
+void json_writer_begin_object(JsonWriter *writer);
+void json_writer_end_object(JsonWriter *writer);
+void json_writer_begin_array(JsonWriter *writer);
+void json_writer_end_array(JsonWriter *writer);
+
+// json_writer_key writes an object key. The key is written as is; it must not
+// need escaping (all LSP property names are plain ASCII).
+void json_writer_key(JsonWriter *writer, const char *key);
+
+// json_writer_string writes `str` as a JSON string, escaping it as needed.
+void json_writer_string(JsonWriter *writer, fdn_string str);
+void json_writer_string_c(JsonWriter *writer, const char *str);
+
+void json_writer_int(JsonWriter *writer, int64_t value);
+void json_writer_bool(JsonWriter *writer, bool value);
+void json_writer_null(JsonWriter *writer);
+
+// json_writer_raw writes an already serialized JSON value.
+void json_writer_raw(JsonWriter *writer, fdn_string json);
+
+#endif // JSON_WRITER_H
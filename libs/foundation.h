@@ -1,10 +1,13 @@
 #ifndef FOUNDATION_H
 #define FOUNDATION_H
 
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
@@ -17,6 +20,10 @@ typedef struct {
   size_t string_length;
 } fdn_string;
 
+/* `FDN_STRING_LITERAL` initializes an `fdn_string` with a string literal. The
+ * length is computed at compile time, so it can be used in static tables. */
+#define FDN_STRING_LITERAL(literal) {(literal), sizeof(literal) - 1}
+
 /* `fdn_string_create_view` creates a "view" into the provided string. Returns
  * the `Foundation` library `fdn_string` type which is a view into a string. */
 static inline fdn_string fdn_string_create_view(const char *string_start,
@@ -45,20 +52,332 @@ static inline bool fdn_string_is_eq(fdn_string str1, fdn_string str2) {
   return strncmp(str1.string_start, str2.string_start, str1.string_length) == 0;
 }
 
+/* `fdn_utf8_decode` decodes the UTF-8 sequence at the start of `data` (at most
+ * `length` bytes are read) into `code_point`. Returns the width of the sequence
+ * in bytes, or 0 if it is not well-formed: truncated, overlong, a surrogate or
+ * past U+10FFFF. */
+uint32_t fdn_utf8_decode(const char *data, size_t length, uint32_t *code_point);
+
+/////////////////////////////////////////////////
+//                   HASHING                   //
+/////////////////////////////////////////////////
+
+/* `fdn_hash_bytes` is a seeded multiplicative hash that consumes 8 bytes per
+ * step (FNV-1a for the tail) with a final avalanche step, so that the low bits
+ * can be used directly to pick a slot in a table. */
+static inline uint64_t fdn_hash_bytes(const void *data, size_t length,
+                                      uint64_t seed) {
+  const unsigned char *bytes = data;
+  uint64_t hash = 0xcbf29ce484222325ULL ^ seed ^ length;
+
+  while (length >= 8) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 29;
+    bytes += 8;
+    length -= 8;
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static inline uint64_t fdn_string_hash(fdn_string str, uint64_t seed) {
+  return fdn_hash_bytes(str.string_start, str.string_length, seed);
+}
+
+/**
+ * A perfect hash over a fixed set of keys, e.g. the LSP methods or language
+ * keywords. The seed is searched for when the table is built so that every
+ * key gets a slot of its own. A lookup is then one hash and one slot read,
+ * with no probing. The slot only tells which key it *could* be; the caller
+ * compares the key to reject strings that are not in the set.
+ */
+typedef struct {
+  uint64_t seed;
+  uint32_t mask;   // Number of slots - 1 (the slot count is a power of two).
+  uint16_t *slots; // Key index + 1 for each slot; 0 marks an empty slot.
+} fdn_perfect_hash;
+
+#define FDN_PERFECT_HASH_NOT_FOUND UINT32_MAX
+
+/* `fdn_perfect_hash_build` builds the hash for `count` distinct `keys` into the
+ * caller provided `slots`. `slot_count` must be a power of two; a few times
+ * the key count makes a seed easy to find. Returns `false` if no seed was
+ * found. */
+bool fdn_perfect_hash_build(fdn_perfect_hash *hash, const fdn_string *keys,
+                            uint32_t count, uint16_t *slots,
+                            uint32_t slot_count);
+
+/* `fdn_perfect_hash_find` returns the index of the only key that `key` can be
+ * equal to, or FDN_PERFECT_HASH_NOT_FOUND. */
+static inline uint32_t fdn_perfect_hash_find(const fdn_perfect_hash *hash,
+                                             fdn_string key) {
+  uint32_t slot = (uint32_t)fdn_string_hash(key, hash->seed) & hash->mask;
+  return (uint32_t)hash->slots[slot] - 1;
+}
+
+/////////////////////////////////////////////////
+//                   ARENAS                    //
+/////////////////////////////////////////////////
+
+/**
+ * A bump allocator. Allocations are served by advancing an offset inside a
+ * block of memory; everything allocated from the arena is released at once
+ * with `fdn_arena_reset` or `fdn_arena_free`.
+ *
+ * The server uses two kinds of arenas:
+ * - a scratch arena that is reset after every message; it holds the message
+ *   body, the parsed request and the response being built,
+ * - a server arena that lives for the whole session and holds server state.
+ *
+ * When a block runs out of space a new one is chained in front of it. On reset
+ * the chain is merged into a single block big enough for everything that was
+ * allocated, so once the arena has seen its largest message, serving the next
+ * ones does not touch the heap at all.
+ */
+
+// Every allocation is aligned to this boundary. It is enough for any scalar
+// type and for 16 byte SIMD loads.
+#define FDN_ARENA_ALIGNMENT 16
+
+typedef struct fdn_arena_block fdn_arena_block;
+struct fdn_arena_block {
+  fdn_arena_block *prev; // The previously filled block (or NULL).
+  size_t capacity;       // Number of usable bytes after the block header.
+  size_t used;           // Number of bytes handed out from this block.
+};
+
+typedef struct {
+  fdn_arena_block *current; // The block allocations are served from.
+  size_t block_size;        // Minimal capacity of a newly allocated block.
+} fdn_arena;
+
+/* `fdn_arena_init` allocates the first block of `block_size` bytes. Returns
+ * `false` if the allocation failed. */
+bool fdn_arena_init(fdn_arena *arena, size_t block_size);
+
+/* `fdn_arena_alloc` returns `size` bytes of uninitialized memory aligned to
+ * `FDN_ARENA_ALIGNMENT`, or NULL if the system is out of memory. */
+void *fdn_arena_alloc(fdn_arena *arena, size_t size);
+
+/* `fdn_arena_alloc_zero` is `fdn_arena_alloc` that zeroes the memory. */
+void *fdn_arena_alloc_zero(fdn_arena *arena, size_t size);
+
+/* `fdn_arena_reset` releases every allocation made from the arena. The memory
+ * is kept for reuse. */
+void fdn_arena_reset(fdn_arena *arena);
+
+/* `fdn_arena_free` returns all the arena memory to the system. */
+void fdn_arena_free(fdn_arena *arena);
+
+/////////////////////////////////////////////////
+//                  INTERNING                  //
+/////////////////////////////////////////////////
+
+/**
+ * An interner stores every distinct string once and names it by a stable
+ * 32-bit id, so that names repeated across a workspace (identifiers, URIs)
+ * take no extra memory and compare with an integer compare.
+ *
+ * The table uses open addressing with linear probing. Every slot keeps the
+ * hash of its string next to the id, so probing only compares the bytes of
+ * strings whose hashes match, and growing the table never hashes a string
+ * again. The bytes themselves are copied into an arena, null-terminated, and
+ * never move.
+ *
+ * Interning is serialized by a mutex, so any thread may intern. Getting the
+ * string of an id takes no lock: ids map to strings through a directory of
+ * fixed-size chunks that are never moved once allocated, and an id is only
+ * handed out after its string was stored.
+ */
+
+// Strings per chunk of the id to string directory, and the maximal number of
+// chunks; the ids are limited to their product.
+#define FDN_INTERNER_CHUNK_BITS 12
+#define FDN_INTERNER_MAX_CHUNKS 4096
+
+#define FDN_INTERNER_NONE UINT32_MAX
+
+typedef struct {
+  uint32_t hash; // The low half of the hash of the string.
+  uint32_t id;   // Id + 1; 0 marks an empty slot.
+} fdn_interner_slot;
+
+typedef struct {
+  pthread_mutex_t lock; // Held while interning.
+  fdn_interner_slot *slots;
+  uint32_t mask;       // Number of slots - 1 (a power of two).
+  uint32_t count;      // Ids below it are handed out; read it atomically.
+  fdn_string **chunks; // FDN_INTERNER_MAX_CHUNKS chunks of strings by id.
+
+  // The bytes of the strings, packed into pieces of arena memory.
+  fdn_arena arena;
+  char *piece;
+  size_t piece_left;
+} fdn_interner;
+
+/* `fdn_interner_init` creates an empty interner. Returns `false` if the
+ * allocation failed. */
+bool fdn_interner_init(fdn_interner *interner);
+
+/* `fdn_interner_free` releases the interner and every interned string. */
+void fdn_interner_free(fdn_interner *interner);
+
+/* `fdn_interner_intern` returns the id of `str`, storing a copy of it if it was
+ * not interned yet. Returns FDN_INTERNER_NONE if memory ran out. */
+uint32_t fdn_interner_intern(fdn_interner *interner, fdn_string str);
+
+/* `fdn_interner_find` returns the id of `str` if it was interned, or
+ * FDN_INTERNER_NONE. Nothing is stored. */
+uint32_t fdn_interner_find(fdn_interner *interner, fdn_string str);
+
+/* `fdn_interner_string` returns the null-terminated string of `id`, or an empty
+ * string for an unknown id. */
+static inline fdn_string fdn_interner_string(const fdn_interner *interner,
+                                             uint32_t id) {
+  if (id >= __atomic_load_n(&interner->count, __ATOMIC_ACQUIRE)) {
+    return fdn_string_create_view("", 0);
+  }
+  const uint32_t mask = (1u << FDN_INTERNER_CHUNK_BITS) - 1;
+  return interner->chunks[id >> FDN_INTERNER_CHUNK_BITS][id & mask];
+}
+
+/* `fdn_interner_count` returns the number of interned strings; the ids are
+ * 0 to count - 1. */
+static inline uint32_t fdn_interner_count(const fdn_interner *interner) {
+  return __atomic_load_n(&interner->count, __ATOMIC_ACQUIRE);
+}
+
+/////////////////////////////////////////////////
+//                    QUEUE                    //
+/////////////////////////////////////////////////
+
+/**
+ * A bounded queue of pointers that any number of threads push to and pop from
+ * without a lock, e.g. the jobs of a pool of worker threads.
+ *
+ * The cells form a ring and follow the protocol of Vyukov's bounded queue
+ * (the one of the logger): a thread claims a ticket with a compare-and-swap on
+ * the head or the tail, and the sequence number of the cell of the ticket
+ * tells whether the cell is free for that producer or filled for that
+ * consumer. No thread ever waits for another one in the middle of a push or a
+ * pop.
+ *
+ * Consumers that find the queue empty park on a condition variable, and so do
+ * producers that find it full. A push or a pop only takes the mutex to wake
+ * the other side when a thread of it is parked, so a busy queue makes no
+ * system calls.
+ */
+
+typedef struct {
+  uint64_t sequence;
+  void *item;
+} fdn_queue_cell;
+
+typedef struct {
+  fdn_queue_cell *cells;
+  uint64_t mask; // Number of cells - 1 (a power of two).
+  uint64_t head; // Next ticket of a producer.
+  uint64_t tail; // Next ticket of a consumer.
+
+  // Parking of the consumers waiting for an item and of the producers
+  // waiting for room.
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pthread_cond_t room;
+  uint32_t parked;           // Consumers; read it atomically.
+  uint32_t producers_parked; // Likewise.
+  bool closed;               // Likewise.
+} fdn_queue;
+
+/* `fdn_queue_init` creates an empty queue of `capacity` items, a power of two.
+ * Returns `false` if the allocation failed. */
+bool fdn_queue_init(fdn_queue *queue, uint32_t capacity);
+
+/* `fdn_queue_free` releases the queue; the items left in it are not freed. */
+void fdn_queue_free(fdn_queue *queue);
+
+/* `fdn_queue_try_push` adds `item` unless the queue is full. */
+bool fdn_queue_try_push(fdn_queue *queue, void *item);
+
+/* `fdn_queue_try_pop` takes the oldest item into `item` unless the queue is
+ * empty. */
+bool fdn_queue_try_pop(fdn_queue *queue, void **item);
+
+/* `fdn_queue_push` adds `item`, waiting for room while the queue is full.
+ * Returns `false` once the queue is closed. */
+bool fdn_queue_push(fdn_queue *queue, void *item);
+
+/* `fdn_queue_pop` takes the oldest item into `item`, waiting while the queue
+ * is empty. Returns `false` once the queue is closed and empty. */
+bool fdn_queue_pop(fdn_queue *queue, void **item);
+
+/* `fdn_queue_close` refuses further pushes and wakes the parked threads; the
+ * items already queued can still be popped. */
+void fdn_queue_close(fdn_queue *queue);
+
 /////////////////////////////////////////////////
 //                   LOGGER                    //
 /////////////////////////////////////////////////
 
 /**
- * To use the logger, first initialize it with `fdn_log_file_init` function.
+ * To use the logger, first initialize it with `fdn_log_init` function and stop
+ * it with `fdn_log_shutdown` before the program exits.
+ *
+ * Logging never blocks the caller on I/O. A log line is formatted straight
+ * into a slot of a lock-free ring buffer and a background thread writes the
+ * filled slots to the file in batches. The time stamp is not computed per line
+ * either; the background thread refreshes a cached one on every pass. When
+ * there is nothing to write, the thread parks on a condition variable until a
+ * line is logged, so an idle program is not woken up.
+ *
+ * A line longer than a slot is truncated (and marked as such), so logging a
+ * big payload costs the same as logging a short one. When the ring is full the
+ * line is dropped and counted instead of waiting for the writer.
+ *
+ * Before `fdn_log_init` (and after `fdn_log_shutdown`) lines are written to
+ * `stderr` synchronously.
  * */
 
 typedef enum {
-  FDN_LOG_INFO,
-  FDN_LOG_ERROR,
+  FDN_LOG_DEBUG = 0,
+  FDN_LOG_INFO = 1,
+  FDN_LOG_ERROR = 2,
 } fdn_log_level;
 
-void fdn_log_init(FILE *file);
+// Lines below this level are compiled out, together with the evaluation of
+// their arguments. Define it before including the header to change it.
+#ifndef FDN_LOG_MIN_LEVEL
+#define FDN_LOG_MIN_LEVEL 1 // FDN_LOG_INFO
+#endif
+
+// Number of slots in the ring buffer (a power of two) and the maximal length
+// of a single line.
+#define FDN_LOG_SLOT_COUNT 1024
+#define FDN_LOG_SLOT_SIZE 512
+
+/* `fdn_log_init` starts the background writer that appends to the `file`.
+ * Returns `false` if the thread could not be started; lines are then written
+ * synchronously. */
+bool fdn_log_init(FILE *file);
+
+/* `fdn_log_shutdown` writes out the lines that are still queued and stops the
+ * background writer. */
+void fdn_log_shutdown(void);
+
+/* `fdn_log_dropped` returns the number of lines dropped because the ring was
+ * full. */
+uint64_t fdn_log_dropped(void);
+
 void fdn_log_message(fdn_log_level level, const char *tag, const char *file,
                      int line, const char *fmt, ...)
     __attribute__((
@@ -70,8 +389,20 @@ void fdn_log_message(fdn_log_level level, const char *tag, const char *file,
 #define FDN_LOG_TAG "DEFAULT"
 #endif
 
+#if FDN_LOG_MIN_LEVEL <= 0
+#define fdn_debug(...)                                                         \
+  fdn_log_message(FDN_LOG_DEBUG, FDN_LOG_TAG, __FILE__, __LINE__, __VA_ARGS__)
+#else
+#define fdn_debug(...) ((void)0)
+#endif
+
+#if FDN_LOG_MIN_LEVEL <= 1
 #define fdn_info(...)                                                          \
   fdn_log_message(FDN_LOG_INFO, FDN_LOG_TAG, __FILE__, __LINE__, __VA_ARGS__)
+#else
+#define fdn_info(...) ((void)0)
+#endif
+
 #define fdn_error(...)                                                         \
   fdn_log_message(FDN_LOG_ERROR, FDN_LOG_TAG, __FILE__, __LINE__, __VA_ARGS__)
 
@@ -81,40 +412,771 @@ void fdn_log_message(fdn_log_level level, const char *tag, const char *file,
 #ifndef FDN_IMPLEMENTATION_ONCE
 #define FDN_IMPLEMENTATION_ONCE
 
+/////////////////////////////////////////////////
+//                   STRINGS                   //
+/////////////////////////////////////////////////
+
+uint32_t fdn_utf8_decode(const char *data, size_t length,
+                         uint32_t *code_point) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  if (length == 0) {
+    return 0;
+  }
+
+  unsigned char lead = bytes[0];
+  if (lead < 0x80) {
+    *code_point = lead;
+    return 1;
+  }
+
+  uint32_t width;
+  uint32_t value;
+  uint32_t min;
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    width = 2;
+    value = lead & 0x1F;
+    min = 0x80;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    width = 3;
+    value = lead & 0x0F;
+    min = 0x800;
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    width = 4;
+    value = lead & 0x07;
+    min = 0x10000;
+  } else {
+    return 0; // A continuation byte, or a lead byte that is always overlong.
+  }
+
+  if (length < width) {
+    return 0;
+  }
+
+  for (uint32_t i = 1; i < width; i++) {
+    if ((bytes[i] & 0xC0) != 0x80) {
+      return 0;
+    }
+    value = (value << 6) | (bytes[i] & 0x3F);
+  }
+
+  if (value < min || value > 0x10FFFF ||
+      (value >= 0xD800 && value <= 0xDFFF)) {
+    return 0;
+  }
+
+  *code_point = value;
+  return width;
+}
+
+/////////////////////////////////////////////////
+//                   HASHING                   //
+/////////////////////////////////////////////////
+
+bool fdn_perfect_hash_build(fdn_perfect_hash *hash, const fdn_string *keys,
+                            uint32_t count, uint16_t *slots,
+                            uint32_t slot_count) {
+  if (count >= UINT16_MAX || (slot_count & (slot_count - 1)) != 0 ||
+      count > slot_count) {
+    return false;
+  }
+
+  hash->mask = slot_count - 1;
+  hash->slots = slots;
+
+  for (uint64_t seed = 0; seed < 100000; seed++) {
+    memset(slots, 0, slot_count * sizeof(*slots));
+    hash->seed = seed;
+
+    uint32_t i = 0;
+    for (; i < count; i++) {
+      uint32_t slot = (uint32_t)fdn_string_hash(keys[i], seed) & hash->mask;
+      if (slots[slot] != 0) {
+        break; // Collision; try the next seed.
+      }
+      slots[slot] = (uint16_t)(i + 1);
+    }
+
+    if (i == count) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/////////////////////////////////////////////////
+//                   ARENAS                    //
+/////////////////////////////////////////////////
+
+static size_t fdn_arena_align_up(size_t value) {
+  return (value + (FDN_ARENA_ALIGNMENT - 1)) &
+         ~(size_t)(FDN_ARENA_ALIGNMENT - 1);
+}
+
+// The header size is rounded up so that the data following it stays aligned.
+#define FDN_ARENA_HEADER_SIZE fdn_arena_align_up(sizeof(fdn_arena_block))
+
+static fdn_arena_block *fdn_arena_block_new(size_t capacity,
+                                            fdn_arena_block *prev) {
+  fdn_arena_block *block = malloc(FDN_ARENA_HEADER_SIZE + capacity);
+  if (block == NULL) {
+    return NULL;
+  }
+
+  block->prev = prev;
+  block->capacity = capacity;
+  block->used = 0;
+  return block;
+}
+
+bool fdn_arena_init(fdn_arena *arena, size_t block_size) {
+  arena->block_size = fdn_arena_align_up(block_size);
+  arena->current = fdn_arena_block_new(arena->block_size, NULL);
+  return arena->current != NULL;
+}
+
+void *fdn_arena_alloc(fdn_arena *arena, size_t size) {
+  size = fdn_arena_align_up(size);
+
+  fdn_arena_block *block = arena->current;
+  if (block == NULL || block->capacity - block->used < size) {
+    // The request does not fit; chain a new block that is at least big enough
+    // to hold it.
+    size_t capacity = size > arena->block_size ? size : arena->block_size;
+    block = fdn_arena_block_new(capacity, arena->current);
+    if (block == NULL) {
+      return NULL;
+    }
+    arena->current = block;
+  }
+
+  void *memory = (char *)block + FDN_ARENA_HEADER_SIZE + block->used;
+  block->used += size;
+  return memory;
+}
+
+void *fdn_arena_alloc_zero(fdn_arena *arena, size_t size) {
+  void *memory = fdn_arena_alloc(arena, size);
+  if (memory != NULL) {
+    memset(memory, 0, size);
+  }
+  return memory;
+}
+
+void fdn_arena_reset(fdn_arena *arena) {
+  fdn_arena_block *block = arena->current;
+  if (block == NULL) {
+    return;
+  }
+
+  if (block->prev == NULL) {
+    block->used = 0;
+    return;
+  }
+
+  // The arena overflowed since the last reset. Replace the chain with a single
+  // block that can hold all of it, so that the next message of a similar size
+  // is served without new allocations.
+  size_t total = 0;
+  while (block != NULL) {
+    fdn_arena_block *prev = block->prev;
+    total += block->capacity;
+    free(block);
+    block = prev;
+  }
+
+  arena->current = fdn_arena_block_new(total, NULL);
+}
+
+void fdn_arena_free(fdn_arena *arena) {
+  fdn_arena_block *block = arena->current;
+  while (block != NULL) {
+    fdn_arena_block *prev = block->prev;
+    free(block);
+    block = prev;
+  }
+  arena->current = NULL;
+}
+
+/////////////////////////////////////////////////
+//                  INTERNING                  //
+/////////////////////////////////////////////////
+
+#define FDN_INTERNER_INITIAL_SLOTS 1024
+#define FDN_INTERNER_PIECE_SIZE (64 * 1024)
+
+bool fdn_interner_init(fdn_interner *interner) {
+  memset(interner, 0, sizeof(*interner));
+  interner->slots =
+      calloc(FDN_INTERNER_INITIAL_SLOTS, sizeof(fdn_interner_slot));
+  interner->chunks = calloc(FDN_INTERNER_MAX_CHUNKS, sizeof(fdn_string *));
+  if (interner->slots == NULL || interner->chunks == NULL ||
+      !fdn_arena_init(&interner->arena, FDN_INTERNER_PIECE_SIZE)) {
+    free(interner->slots);
+    free(interner->chunks);
+    return false;
+  }
+
+  interner->mask = FDN_INTERNER_INITIAL_SLOTS - 1;
+  pthread_mutex_init(&interner->lock, NULL);
+  return true;
+}
+
+void fdn_interner_free(fdn_interner *interner) {
+  for (uint32_t i = 0; i < FDN_INTERNER_MAX_CHUNKS; i++) {
+    free(interner->chunks[i]);
+  }
+  free(interner->chunks);
+  free(interner->slots);
+  fdn_arena_free(&interner->arena);
+  pthread_mutex_destroy(&interner->lock);
+  memset(interner, 0, sizeof(*interner));
+}
+
+// fdn_interner_probe returns the slot of `str`, or the empty slot where it
+// belongs. Called with the lock held.
+static uint32_t fdn_interner_probe(const fdn_interner *interner,
+                                   fdn_string str, uint32_t hash) {
+  uint32_t slot = hash & interner->mask;
+  while (interner->slots[slot].id != 0) {
+    if (interner->slots[slot].hash == hash) {
+      fdn_string stored = fdn_interner_string(interner,
+                                              interner->slots[slot].id - 1);
+      if (fdn_string_is_eq(stored, str)) {
+        return slot;
+      }
+    }
+    slot = (slot + 1) & interner->mask;
+  }
+  return slot;
+}
+
+// fdn_interner_grow doubles the table. The slots carry their hashes, so the
+// strings are not hashed again.
+static bool fdn_interner_grow(fdn_interner *interner) {
+  uint32_t slot_count = (interner->mask + 1) * 2;
+  fdn_interner_slot *slots = calloc(slot_count, sizeof(fdn_interner_slot));
+  if (slots == NULL) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i <= interner->mask; i++) {
+    fdn_interner_slot entry = interner->slots[i];
+    if (entry.id == 0) {
+      continue;
+    }
+    uint32_t slot = entry.hash & (slot_count - 1);
+    while (slots[slot].id != 0) {
+      slot = (slot + 1) & (slot_count - 1);
+    }
+    slots[slot] = entry;
+  }
+
+  free(interner->slots);
+  interner->slots = slots;
+  interner->mask = slot_count - 1;
+  return true;
+}
+
+// fdn_interner_copy copies `str` into the arena, null-terminated. Short
+// strings are packed into a shared piece rather than padded to the arena
+// alignment one by one.
+static const char *fdn_interner_copy(fdn_interner *interner, fdn_string str) {
+  size_t size = str.string_length + 1;
+  char *copy;
+  if (size > FDN_INTERNER_PIECE_SIZE / 4) {
+    copy = fdn_arena_alloc(&interner->arena, size);
+  } else {
+    if (size > interner->piece_left) {
+      interner->piece = fdn_arena_alloc(&interner->arena,
+                                        FDN_INTERNER_PIECE_SIZE);
+      interner->piece_left = interner->piece != NULL
+                                 ? FDN_INTERNER_PIECE_SIZE
+                                 : 0;
+    }
+    copy = interner->piece;
+    if (copy != NULL) {
+      interner->piece += size;
+      interner->piece_left -= size;
+    }
+  }
+
+  if (copy != NULL) {
+    memcpy(copy, str.string_start, str.string_length);
+    copy[str.string_length] = '\0';
+  }
+  return copy;
+}
+
+uint32_t fdn_interner_intern(fdn_interner *interner, fdn_string str) {
+  uint32_t hash = (uint32_t)fdn_string_hash(str, 0);
+  pthread_mutex_lock(&interner->lock);
+
+  uint32_t slot = fdn_interner_probe(interner, str, hash);
+  if (interner->slots[slot].id != 0) {
+    uint32_t id = interner->slots[slot].id - 1;
+    pthread_mutex_unlock(&interner->lock);
+    return id;
+  }
+
+  uint32_t id = interner->count;
+  const uint32_t chunk_size = 1u << FDN_INTERNER_CHUNK_BITS;
+  uint32_t chunk = id >> FDN_INTERNER_CHUNK_BITS;
+  bool stored = chunk < FDN_INTERNER_MAX_CHUNKS;
+
+  // Keep the table at most half full, so that probe sequences stay short.
+  if (stored && (id + 1) * 2 > interner->mask + 1) {
+    stored = fdn_interner_grow(interner);
+    slot = fdn_interner_probe(interner, str, hash);
+  }
+  if (stored && interner->chunks[chunk] == NULL) {
+    interner->chunks[chunk] = malloc(chunk_size * sizeof(fdn_string));
+    stored = interner->chunks[chunk] != NULL;
+  }
+
+  const char *copy = stored ? fdn_interner_copy(interner, str) : NULL;
+  if (copy == NULL) {
+    pthread_mutex_unlock(&interner->lock);
+    return FDN_INTERNER_NONE;
+  }
+
+  interner->chunks[chunk][id & (chunk_size - 1)] =
+      fdn_string_create_view(copy, str.string_length);
+  interner->slots[slot].hash = hash;
+  interner->slots[slot].id = id + 1;
+
+  // Readers of the string take no lock; it has to be in place first.
+  __atomic_store_n(&interner->count, id + 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&interner->lock);
+  return id;
+}
+
+uint32_t fdn_interner_find(fdn_interner *interner, fdn_string str) {
+  uint32_t hash = (uint32_t)fdn_string_hash(str, 0);
+  pthread_mutex_lock(&interner->lock);
+
+  uint32_t slot = fdn_interner_probe(interner, str, hash);
+  uint32_t id = interner->slots[slot].id;
+
+  pthread_mutex_unlock(&interner->lock);
+  return id != 0 ? id - 1 : FDN_INTERNER_NONE;
+}
+
+/////////////////////////////////////////////////
+//                    QUEUE                    //
+/////////////////////////////////////////////////
+
+bool fdn_queue_init(fdn_queue *queue, uint32_t capacity) {
+  memset(queue, 0, sizeof(*queue));
+  if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+    return false;
+  }
+
+  queue->cells = malloc(capacity * sizeof(fdn_queue_cell));
+  if (queue->cells == NULL) {
+    return false;
+  }
+  for (uint64_t i = 0; i < capacity; i++) {
+    queue->cells[i].sequence = i;
+  }
+  queue->mask = capacity - 1;
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->ready, NULL);
+  pthread_cond_init(&queue->room, NULL);
+  return true;
+}
+
+void fdn_queue_free(fdn_queue *queue) {
+  if (queue->cells != NULL) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->ready);
+    pthread_cond_destroy(&queue->room);
+  }
+  free(queue->cells);
+  memset(queue, 0, sizeof(*queue));
+}
+
+// fdn_queue_claim_push stores the `item` in a free cell, unless the queue is
+// full, without waking anybody up.
+static bool fdn_queue_claim_push(fdn_queue *queue, void *item) {
+  uint64_t ticket = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+  while (1) {
+    fdn_queue_cell *cell = &queue->cells[ticket & queue->mask];
+    uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    if (sequence == ticket) {
+      if (__atomic_compare_exchange_n(&queue->head, &ticket, ticket + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        cell->item = item;
+        __atomic_store_n(&cell->sequence, ticket + 1, __ATOMIC_RELEASE);
+        return true;
+      }
+    } else if (sequence < ticket) {
+      return false; // The cell still holds the item of the previous round.
+    } else {
+      ticket = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+// fdn_queue_claim_pop takes the oldest item, unless the queue is empty,
+// without waking anybody up.
+static bool fdn_queue_claim_pop(fdn_queue *queue, void **item) {
+  uint64_t ticket = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+  while (1) {
+    fdn_queue_cell *cell = &queue->cells[ticket & queue->mask];
+    uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    if (sequence == ticket + 1) {
+      if (__atomic_compare_exchange_n(&queue->tail, &ticket, ticket + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *item = cell->item;
+        // Hand the cell back to the producers for the next round.
+        __atomic_store_n(&cell->sequence, ticket + queue->mask + 1,
+                         __ATOMIC_RELEASE);
+        return true;
+      }
+    } else if (sequence < ticket + 1) {
+      return false; // Not filled yet.
+    } else {
+      ticket = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+// fdn_queue_wake wakes up a thread `parked` on the `condition`, if there is
+// one. A thread parks after it registered and found the queue empty (or full);
+// either it sees the change just made or this sees it registered.
+static void fdn_queue_wake(fdn_queue *queue, uint32_t *parked,
+                           pthread_cond_t *condition) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(parked, __ATOMIC_RELAXED) > 0) {
+    pthread_mutex_lock(&queue->lock);
+    pthread_cond_signal(condition);
+    pthread_mutex_unlock(&queue->lock);
+  }
+}
+
+bool fdn_queue_try_push(fdn_queue *queue, void *item) {
+  if (!fdn_queue_claim_push(queue, item)) {
+    return false;
+  }
+  fdn_queue_wake(queue, &queue->parked, &queue->ready);
+  return true;
+}
+
+bool fdn_queue_try_pop(fdn_queue *queue, void **item) {
+  if (!fdn_queue_claim_pop(queue, item)) {
+    return false;
+  }
+  fdn_queue_wake(queue, &queue->producers_parked, &queue->room);
+  return true;
+}
+
+bool fdn_queue_push(fdn_queue *queue, void *item) {
+  while (!__atomic_load_n(&queue->closed, __ATOMIC_ACQUIRE)) {
+    if (fdn_queue_try_push(queue, item)) {
+      return true;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    __atomic_add_fetch(&queue->producers_parked, 1, __ATOMIC_SEQ_CST);
+    bool pushed = fdn_queue_claim_push(queue, item);
+    if (!pushed && !__atomic_load_n(&queue->closed, __ATOMIC_ACQUIRE)) {
+      pthread_cond_wait(&queue->room, &queue->lock);
+    }
+    __atomic_sub_fetch(&queue->producers_parked, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&queue->lock);
+
+    if (pushed) {
+      fdn_queue_wake(queue, &queue->parked, &queue->ready);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool fdn_queue_pop(fdn_queue *queue, void **item) {
+  while (!fdn_queue_try_pop(queue, item)) {
+    pthread_mutex_lock(&queue->lock);
+    __atomic_add_fetch(&queue->parked, 1, __ATOMIC_SEQ_CST);
+    bool popped = fdn_queue_claim_pop(queue, item);
+    bool closed = __atomic_load_n(&queue->closed, __ATOMIC_ACQUIRE);
+    if (!popped && !closed) {
+      pthread_cond_wait(&queue->ready, &queue->lock);
+    }
+    __atomic_sub_fetch(&queue->parked, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&queue->lock);
+
+    if (popped) {
+      fdn_queue_wake(queue, &queue->producers_parked, &queue->room);
+      return true;
+    }
+    if (closed) {
+      // Items pushed before the close are still handed out.
+      return fdn_queue_try_pop(queue, item);
+    }
+  }
+  return true;
+}
+
+void fdn_queue_close(fdn_queue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  __atomic_store_n(&queue->closed, true, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&queue->ready);
+  pthread_cond_broadcast(&queue->room);
+  pthread_mutex_unlock(&queue->lock);
+}
+
 /////////////////////////////////////////////////
 //                   LOGGER                    //
 /////////////////////////////////////////////////
 
-static FILE *g_fdn_log_file = NULL;
+typedef struct {
+  // Vyukov's bounded queue protocol: a slot is free for the producer holding
+  // ticket `n` when `sequence == n` and ready for the writer when
+  // `sequence == n + 1`.
+  uint64_t sequence;
+  uint32_t length;
+  char text[FDN_LOG_SLOT_SIZE];
+} fdn_log_slot;
 
-void fdn_log_init(FILE *file) { g_fdn_log_file = file; }
+static FILE *g_fdn_log_file = NULL;
+static fdn_log_slot g_fdn_log_ring[FDN_LOG_SLOT_COUNT];
+static uint64_t g_fdn_log_head = 0; // Next ticket handed to a producer.
+static uint64_t g_fdn_log_tail = 0; // Next ticket the writer consumes.
+static uint64_t g_fdn_log_dropped = 0;
+static uint64_t g_fdn_log_time = 0; // "HH:MM:SS" packed into 8 bytes.
+static bool g_fdn_log_running = false;
+static bool g_fdn_log_stop = false;
+static pthread_t g_fdn_log_thread;
 
-void fdn_log_message(fdn_log_level level, const char *tag, const char *file,
-                     int line, const char *fmt, ...) {
-  FILE *stream = g_fdn_log_file ? g_fdn_log_file : stderr;
+// Parking of the writer while the ring is empty.
+static pthread_mutex_t g_fdn_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_fdn_log_ready = PTHREAD_COND_INITIALIZER;
+static uint32_t g_fdn_log_parked = 0;
 
+static void fdn_log_refresh_time(void) {
   time_t t = time(NULL);
-  struct tm *tm_info = localtime(&t);
-  char time_buffer[20];
-  strftime(time_buffer, 20, "%H:%M:%S", tm_info);
+  struct tm tm_info;
+  char time_buffer[9];
+  localtime_r(&t, &tm_info);
+  strftime(time_buffer, sizeof(time_buffer), "%H:%M:%S", &tm_info);
+
+  uint64_t packed;
+  memcpy(&packed, time_buffer, sizeof(packed));
+  __atomic_store_n(&g_fdn_log_time, packed, __ATOMIC_RELAXED);
+}
+
+// fdn_log_drain writes every ready slot to the file. Returns the number of
+// lines written. Only called from the writer thread (or after it stopped).
+static size_t fdn_log_drain(void) {
+  size_t written = 0;
+
+  while (1) {
+    fdn_log_slot *slot =
+        &g_fdn_log_ring[g_fdn_log_tail & (FDN_LOG_SLOT_COUNT - 1)];
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) !=
+        g_fdn_log_tail + 1) {
+      break;
+    }
+
+    fwrite(slot->text, 1, slot->length, g_fdn_log_file);
+
+    // Hand the slot back to the producers for the next round.
+    __atomic_store_n(&slot->sequence, g_fdn_log_tail + FDN_LOG_SLOT_COUNT,
+                     __ATOMIC_RELEASE);
+    g_fdn_log_tail++;
+    written++;
+  }
+
+  if (written > 0) {
+    fflush(g_fdn_log_file);
+  }
+
+  return written;
+}
+
+// fdn_log_has_lines tells whether the next slot for the writer is ready.
+static bool fdn_log_has_lines(void) {
+  const fdn_log_slot *slot =
+      &g_fdn_log_ring[g_fdn_log_tail & (FDN_LOG_SLOT_COUNT - 1)];
+  return __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) ==
+         g_fdn_log_tail + 1;
+}
+
+static void *fdn_log_writer_main(void *arg) {
+  (void)arg;
+
+  while (!__atomic_load_n(&g_fdn_log_stop, __ATOMIC_ACQUIRE)) {
+    fdn_log_refresh_time();
+
+    if (fdn_log_drain() > 0) {
+      continue;
+    }
+
+    // The cached time stamp goes stale while the writer is parked; clearing
+    // it makes the producers refresh it themselves.
+    pthread_mutex_lock(&g_fdn_log_lock);
+    __atomic_store_n(&g_fdn_log_time, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_fdn_log_parked, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&g_fdn_log_stop, __ATOMIC_ACQUIRE) &&
+        !fdn_log_has_lines()) {
+      pthread_cond_wait(&g_fdn_log_ready, &g_fdn_log_lock);
+    }
+    __atomic_store_n(&g_fdn_log_parked, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&g_fdn_log_lock);
+  }
 
-  const char *level_str = (level == FDN_LOG_ERROR) ? "[ERROR]" : "[INFO]";
+  fdn_log_drain();
+  return NULL;
+}
+
+bool fdn_log_init(FILE *file) {
+  g_fdn_log_file = file;
+
+  for (uint64_t i = 0; i < FDN_LOG_SLOT_COUNT; i++) {
+    g_fdn_log_ring[i].sequence = i;
+  }
+  g_fdn_log_head = 0;
+  g_fdn_log_tail = 0;
+  g_fdn_log_stop = false;
+  fdn_log_refresh_time();
+
+  g_fdn_log_running =
+      pthread_create(&g_fdn_log_thread, NULL, fdn_log_writer_main, NULL) == 0;
+  return g_fdn_log_running;
+}
+
+void fdn_log_shutdown(void) {
+  if (!g_fdn_log_running) {
+    return;
+  }
+
+  pthread_mutex_lock(&g_fdn_log_lock);
+  __atomic_store_n(&g_fdn_log_stop, true, __ATOMIC_RELEASE);
+  pthread_cond_signal(&g_fdn_log_ready);
+  pthread_mutex_unlock(&g_fdn_log_lock);
+  pthread_join(g_fdn_log_thread, NULL);
+  g_fdn_log_running = false;
+}
+
+uint64_t fdn_log_dropped(void) {
+  return __atomic_load_n(&g_fdn_log_dropped, __ATOMIC_RELAXED);
+}
+
+// fdn_log_format writes the line into `buffer` and returns its length. Lines
+// that don't fit are cut and end with a truncation marker.
+static size_t fdn_log_format(char *buffer, size_t size, fdn_log_level level,
+                             const char *tag, const char *file, int line,
+                             const char *time_str, const char *fmt,
+                             va_list args) {
+  const char *level_str = "[INFO]";
+  if (level == FDN_LOG_ERROR) {
+    level_str = "[ERROR]";
+  } else if (level == FDN_LOG_DEBUG) {
+    level_str = "[DEBUG]";
+  }
 
   // Get a stripped file path e.g. from nix/store/.../main.c -> /main.c
   const char *short_file = strrchr(file, '/');
   // +1 to skip the slash e.g. /main.c -> main.c
   short_file = short_file ? short_file + 1 : file;
 
-  fprintf(stream, "%s %s [%s] %s:%d: ", level_str, time_buffer, tag, short_file,
-          line);
+  // Leave room for the newline.
+  size_t room = size - 1;
+
+  int prefix_len = snprintf(buffer, room, "%s %s [%s] %s:%d: ", level_str,
+                            time_str, tag, short_file, line);
+  size_t length = prefix_len < 0 ? 0 : (size_t)prefix_len;
+
+  if (length < room) {
+    int message_len = vsnprintf(buffer + length, room - length, fmt, args);
+    length += message_len < 0 ? 0 : (size_t)message_len;
+  }
+
+  if (length >= room) {
+    const char marker[] = "... [truncated]";
+    length = room - 1; // vsnprintf needs the last byte for its terminator.
+    memcpy(buffer + length - (sizeof(marker) - 1), marker, sizeof(marker) - 1);
+  }
+
+  buffer[length++] = '\n';
+  return length;
+}
 
+void fdn_log_message(fdn_log_level level, const char *tag, const char *file,
+                     int line, const char *fmt, ...) {
   va_list args;
   va_start(args, fmt);
-  vfprintf(stream, fmt, args);
+
+  if (!__atomic_load_n(&g_fdn_log_running, __ATOMIC_ACQUIRE)) {
+    // No writer thread; fall back to writing synchronously.
+    FILE *stream = g_fdn_log_file ? g_fdn_log_file : stderr;
+    char text[FDN_LOG_SLOT_SIZE];
+
+    fdn_log_refresh_time();
+    uint64_t packed = __atomic_load_n(&g_fdn_log_time, __ATOMIC_RELAXED);
+    char time_str[9] = {0};
+    memcpy(time_str, &packed, sizeof(packed));
+
+    size_t length = fdn_log_format(text, sizeof(text), level, tag, file, line,
+                                   time_str, fmt, args);
+    fwrite(text, 1, length, stream);
+    fflush(stream);
+
+    va_end(args);
+    return;
+  }
+
+  // Claim a ticket for a free slot.
+  uint64_t ticket = __atomic_load_n(&g_fdn_log_head, __ATOMIC_RELAXED);
+  fdn_log_slot *slot;
+
+  while (1) {
+    slot = &g_fdn_log_ring[ticket & (FDN_LOG_SLOT_COUNT - 1)];
+    uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+    if (sequence == ticket) {
+      if (__atomic_compare_exchange_n(&g_fdn_log_head, &ticket, ticket + 1,
+                                      true, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED)) {
+        break;
+      }
+      // Another producer took the ticket; `ticket` now holds the new head.
+    } else if (sequence < ticket) {
+      // The writer hasn't consumed this slot from the previous round yet; the
+      // ring is full. Drop the line rather than wait.
+      __atomic_fetch_add(&g_fdn_log_dropped, 1, __ATOMIC_RELAXED);
+      va_end(args);
+      return;
+    } else {
+      ticket = __atomic_load_n(&g_fdn_log_head, __ATOMIC_RELAXED);
+    }
+  }
+
+  uint64_t packed = __atomic_load_n(&g_fdn_log_time, __ATOMIC_RELAXED);
+  if (packed == 0) {
+    // The writer is parked and did not refresh it.
+    fdn_log_refresh_time();
+    packed = __atomic_load_n(&g_fdn_log_time, __ATOMIC_RELAXED);
+  }
+  char time_str[9] = {0};
+  memcpy(time_str, &packed, sizeof(packed));
+
+  slot->length = (uint32_t)fdn_log_format(slot->text, sizeof(slot->text), level,
+                                          tag, file, line, time_str, fmt, args);
   va_end(args);
 
-  fprintf(stream, "\n");
-  fflush(stream);
+  // Publish the slot to the writer, and wake it up if it is parked. The fence
+  // orders the publication before the check; the writer orders them the
+  // other way around, so one of the two sees the other.
+  __atomic_store_n(&slot->sequence, ticket + 1, __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&g_fdn_log_parked, __ATOMIC_RELAXED) != 0) {
+    pthread_mutex_lock(&g_fdn_log_lock);
+    pthread_cond_signal(&g_fdn_log_ready);
+    pthread_mutex_unlock(&g_fdn_log_lock);
+  }
 }
 
 #endif // FDN_IMPLEMENTATION_ONCE
@@ -0,0 +1,459 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "libs/foundation.h"
+#include "solidity/parser.h"
+
+#define CACHE_MAGIC "SOLBOTIX"
+
+// Written as is; reads back differently on a machine of the other byte order.
+#define CACHE_BYTE_ORDER 0x01020304u
+
+// The data of every entry starts at a multiple of this.
+#define CACHE_ALIGNMENT 8
+
+// Bytes per token (start, length and type) and per node (token start, token
+// end, descendants and kind).
+#define CACHE_TOKEN_SIZE (2 * sizeof(uint32_t) + 1)
+#define CACHE_NODE_SIZE (3 * sizeof(uint32_t) + 1)
+
+static uint64_t cache_align(uint64_t offset) {
+  return (offset + CACHE_ALIGNMENT - 1) & ~(uint64_t)(CACHE_ALIGNMENT - 1);
+}
+
+/////////////////////////////////////////////////
+//                   READING                   //
+/////////////////////////////////////////////////
+
+// cache_range_is_valid tells whether `count` items of `width` bytes at
+// `offset` lie within the cache and are aligned for 32-bit reads.
+static bool cache_range_is_valid(const lsp_cache *cache, uint64_t offset,
+                                 uint32_t count, size_t width) {
+  return offset % sizeof(uint32_t) == 0 && offset <= cache->size &&
+         (uint64_t)count * width <= cache->size - offset;
+}
+
+static bool cache_entry_is_valid(const lsp_cache *cache,
+                                 const lsp_cache_entry *entry,
+                                 const lsp_cache_entry *previous) {
+  if (entry->path >= cache->size ||
+      entry->path_length >= cache->size - entry->path ||
+      cache->data[entry->path + entry->path_length] != '\0' ||
+      memchr(cache->data + entry->path, '\0', entry->path_length) != NULL) {
+    return false;
+  }
+
+  // The lookup relies on the entries being sorted by path.
+  if (previous != NULL &&
+      strcmp(cache->data + previous->path, cache->data + entry->path) >= 0) {
+    return false;
+  }
+
+  return entry->node_count > 0 &&
+         cache_range_is_valid(cache, entry->tokens, entry->token_count,
+                              CACHE_TOKEN_SIZE) &&
+         cache_range_is_valid(cache, entry->nodes, entry->node_count,
+                              CACHE_NODE_SIZE);
+}
+
+// cache_is_valid checks the header and the bounds of every entry. The tokens
+// and trees are checked entry by entry, see cache_data_is_valid.
+static bool cache_is_valid(const lsp_cache *cache) {
+  if (cache->size < sizeof(lsp_cache_header)) {
+    return false;
+  }
+
+  const lsp_cache_header *header = (const lsp_cache_header *)cache->data;
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != LSP_CACHE_VERSION ||
+      header->byte_order != CACHE_BYTE_ORDER || header->size != cache->size ||
+      (uint64_t)header->file_count * sizeof(lsp_cache_entry) >
+          cache->size - sizeof(lsp_cache_header)) {
+    return false;
+  }
+
+  const lsp_cache_entry *entries =
+      (const lsp_cache_entry *)(cache->data + sizeof(lsp_cache_header));
+  for (uint32_t i = 0; i < header->file_count; i++) {
+    if (!cache_entry_is_valid(cache, &entries[i],
+                              i > 0 ? &entries[i - 1] : NULL)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// cache_data_is_valid tells whether the tokens of the `entry` lie within its
+// source file and its nodes within its tokens and the tree, so that a syntax
+// pointing at them is safe to walk.
+static bool cache_data_is_valid(const lsp_cache *cache,
+                                const lsp_cache_entry *entry) {
+  const uint32_t *tokens = (const uint32_t *)(cache->data + entry->tokens);
+  uint32_t token_count = entry->token_count;
+  const uint32_t *lengths = tokens + token_count;
+  const uint8_t *types = (const uint8_t *)(tokens + 2 * (size_t)token_count);
+  for (uint32_t i = 0; i < token_count; i++) {
+    if (tokens[i] > entry->size || lengths[i] > entry->size - tokens[i] ||
+        types[i] >= SOL_TOKEN_TYPE_COUNT) {
+      return false;
+    }
+  }
+
+  const uint32_t *nodes = (const uint32_t *)(cache->data + entry->nodes);
+  uint32_t node_count = entry->node_count;
+  const uint32_t *token_ends = nodes + node_count;
+  const uint32_t *descendants = nodes + 2 * (size_t)node_count;
+  const uint8_t *kinds = (const uint8_t *)(nodes + 3 * (size_t)node_count);
+  for (uint32_t i = 0; i < node_count; i++) {
+    if (nodes[i] > token_ends[i] || token_ends[i] > token_count ||
+        descendants[i] >= node_count - i || kinds[i] >= SOL_NODE_KIND_COUNT) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// cache_keep_valid points the cache at the entries whose data is valid,
+// copying them out of the mapping if any have to be dropped.
+static bool cache_keep_valid(lsp_cache *cache, const lsp_cache_entry *entries,
+                             uint32_t count) {
+  uint32_t kept_count = 0;
+  bool *valid = malloc((count > 0 ? count : 1) * sizeof(bool));
+  if (valid == NULL) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    valid[i] = cache_data_is_valid(cache, &entries[i]);
+    kept_count += valid[i];
+  }
+
+  cache->entries = entries;
+  if (kept_count < count) {
+    cache->kept = malloc((kept_count > 0 ? kept_count : 1) *
+                         sizeof(lsp_cache_entry));
+    if (cache->kept == NULL) {
+      free(valid);
+      return false;
+    }
+    for (uint32_t i = 0, j = 0; i < count; i++) {
+      if (valid[i]) {
+        cache->kept[j++] = entries[i];
+      }
+    }
+    cache->entries = cache->kept;
+    fdn_error("Dropped %" PRIu32 " damaged entries of the index cache.",
+              count - kept_count);
+  }
+  cache->file_count = kept_count;
+  free(valid);
+  return true;
+}
+
+bool lsp_cache_open(lsp_cache *cache, const char *path) {
+  memset(cache, 0, sizeof(*cache));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) ||
+      (uint64_t)info.st_size < sizeof(lsp_cache_header) ||
+      (uint64_t)info.st_size > SIZE_MAX) {
+    close(fd);
+    return false;
+  }
+
+  size_t size = (size_t)info.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  cache->data = mapping;
+  cache->size = size;
+  if (!cache_is_valid(cache)) {
+    fdn_error("Ignoring the stale or damaged index cache %s.", path);
+    lsp_cache_close(cache);
+    return false;
+  }
+
+  const lsp_cache_header *header = (const lsp_cache_header *)cache->data;
+  if (!cache_keep_valid(cache,
+                        (const lsp_cache_entry *)(cache->data +
+                                                  sizeof(lsp_cache_header)),
+                        header->file_count)) {
+    lsp_cache_close(cache);
+    return false;
+  }
+  return true;
+}
+
+void lsp_cache_close(lsp_cache *cache) {
+  if (cache->data != NULL) {
+    munmap((void *)(uintptr_t)cache->data, cache->size);
+  }
+  free(cache->kept);
+  memset(cache, 0, sizeof(*cache));
+}
+
+const lsp_cache_entry *lsp_cache_find(const lsp_cache *cache,
+                                      const char *path) {
+  uint32_t low = 0;
+  uint32_t high = cache->file_count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    int order = strcmp(cache->data + cache->entries[middle].path, path);
+    if (order == 0) {
+      return &cache->entries[middle];
+    }
+    if (order < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return NULL;
+}
+
+void lsp_cache_syntax(const lsp_cache *cache, const lsp_cache_entry *entry,
+                      SolSyntax *syntax) {
+  sol_syntax_init(syntax);
+
+  // The mapping is read-only; the columns are only ever read through it.
+  uint32_t *tokens = (uint32_t *)(uintptr_t)(cache->data + entry->tokens);
+  uint32_t token_count = entry->token_count;
+  syntax->tokens.starts = tokens;
+  syntax->tokens.lengths = tokens + token_count;
+  syntax->tokens.types = (uint8_t *)(tokens + 2 * (size_t)token_count);
+  syntax->tokens.count = token_count;
+  syntax->tokens.capacity = token_count;
+
+  uint32_t *nodes = (uint32_t *)(uintptr_t)(cache->data + entry->nodes);
+  uint32_t node_count = entry->node_count;
+  syntax->nodes.token_starts = nodes;
+  syntax->nodes.token_ends = nodes + node_count;
+  syntax->nodes.descendants = nodes + 2 * (size_t)node_count;
+  syntax->nodes.kinds = (uint8_t *)(nodes + 3 * (size_t)node_count);
+  syntax->nodes.count = node_count;
+  syntax->nodes.capacity = node_count;
+}
+
+/////////////////////////////////////////////////
+//                   WRITING                   //
+/////////////////////////////////////////////////
+
+static int compare_files(const void *left, const void *right) {
+  const lsp_cache_file *const *a = left;
+  const lsp_cache_file *const *b = right;
+  return strcmp((*a)->path, (*b)->path);
+}
+
+// cache_write writes `length` bytes at `offset`, which it advances. The `data`
+// of an empty column may be NULL.
+static bool cache_write(FILE *output, const void *data, size_t length,
+                        uint64_t *offset) {
+  if (length == 0) {
+    return true;
+  }
+  *offset += length;
+  return fwrite(data, 1, length, output) == length;
+}
+
+// cache_pad writes zeros up to the next aligned offset.
+static bool cache_pad(FILE *output, uint64_t *offset) {
+  static const char zeros[CACHE_ALIGNMENT] = {0};
+  size_t padding = (size_t)(cache_align(*offset) - *offset);
+  return cache_write(output, zeros, padding, offset);
+}
+
+static bool cache_write_file(FILE *output, const lsp_cache_file *file,
+                             uint64_t *offset) {
+  const SolTokenList *tokens = &file->syntax->tokens;
+  const SolNodeList *nodes = &file->syntax->nodes;
+  size_t token_count = tokens->count;
+  size_t node_count = nodes->count;
+
+  return cache_write(output, file->path, strlen(file->path) + 1, offset) &&
+         cache_pad(output, offset) &&
+         cache_write(output, tokens->starts, token_count * sizeof(uint32_t),
+                     offset) &&
+         cache_write(output, tokens->lengths, token_count * sizeof(uint32_t),
+                     offset) &&
+         cache_write(output, tokens->types, token_count, offset) &&
+         cache_pad(output, offset) &&
+         cache_write(output, nodes->token_starts,
+                     node_count * sizeof(uint32_t), offset) &&
+         cache_write(output, nodes->token_ends, node_count * sizeof(uint32_t),
+                     offset) &&
+         cache_write(output, nodes->descendants,
+                     node_count * sizeof(uint32_t), offset) &&
+         cache_write(output, nodes->kinds, node_count, offset) &&
+         cache_pad(output, offset);
+}
+
+// cache_make_parents creates the missing directories of `path`.
+static bool cache_make_parents(const char *path) {
+  size_t length = strlen(path);
+  char *directory = malloc(length + 1);
+  if (directory == NULL) {
+    return false;
+  }
+  memcpy(directory, path, length + 1);
+
+  bool made = true;
+  for (size_t i = 1; i < length && made; i++) {
+    if (directory[i] != '/') {
+      continue;
+    }
+    directory[i] = '\0';
+    made = mkdir(directory, 0700) == 0 || errno == EEXIST;
+    directory[i] = '/';
+  }
+
+  free(directory);
+  return made;
+}
+
+bool lsp_cache_write(const char *path, const lsp_cache_file *files,
+                     uint32_t file_count) {
+  const lsp_cache_file **sorted =
+      malloc((file_count > 0 ? file_count : 1) * sizeof(*sorted));
+  lsp_cache_entry *entries =
+      calloc(file_count > 0 ? file_count : 1, sizeof(lsp_cache_entry));
+  size_t temporary_size = strlen(path) + 32;
+  char *temporary = malloc(temporary_size);
+  if (sorted == NULL || entries == NULL || temporary == NULL ||
+      !cache_make_parents(path)) {
+    free(sorted);
+    free(entries);
+    free(temporary);
+    return false;
+  }
+
+  for (uint32_t i = 0; i < file_count; i++) {
+    sorted[i] = &files[i];
+  }
+  qsort(sorted, file_count, sizeof(*sorted), compare_files);
+
+  // A path is only saved once.
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < file_count; i++) {
+    if (count == 0 || strcmp(sorted[count - 1]->path, sorted[i]->path) != 0) {
+      sorted[count++] = sorted[i];
+    }
+  }
+
+  // Lay the data out first, so that the table can be written up front.
+  uint64_t offset =
+      sizeof(lsp_cache_header) + (uint64_t)count * sizeof(lsp_cache_entry);
+
+  for (uint32_t i = 0; i < count; i++) {
+    const lsp_cache_file *file = sorted[i];
+    lsp_cache_entry *entry = &entries[i];
+    entry->hash = file->hash;
+    entry->mtime = file->mtime;
+    entry->size = file->size;
+    entry->path_length = (uint32_t)strlen(file->path);
+    entry->token_count = file->syntax->tokens.count;
+    entry->node_count = file->syntax->nodes.count;
+
+    entry->path = offset;
+    offset = cache_align(offset + entry->path_length + 1);
+    entry->tokens = offset;
+    offset = cache_align(offset + entry->token_count * CACHE_TOKEN_SIZE);
+    entry->nodes = offset;
+    offset = cache_align(offset + entry->node_count * CACHE_NODE_SIZE);
+  }
+
+  lsp_cache_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+  header.version = LSP_CACHE_VERSION;
+  header.byte_order = CACHE_BYTE_ORDER;
+  header.size = offset;
+  header.file_count = count;
+
+  // Readers only ever see the old cache or the complete new one.
+  snprintf(temporary, temporary_size, "%s.%ld.tmp", path, (long)getpid());
+  FILE *output = fopen(temporary, "wb");
+  bool written = output != NULL &&
+                 fwrite(&header, sizeof(header), 1, output) == 1 &&
+                 fwrite(entries, sizeof(lsp_cache_entry), count, output) ==
+                     count;
+
+  uint64_t written_offset =
+      sizeof(lsp_cache_header) + (uint64_t)count * sizeof(lsp_cache_entry);
+  for (uint32_t i = 0; i < count && written; i++) {
+    written = cache_write_file(output, sorted[i], &written_offset);
+  }
+  written = written && written_offset == offset;
+
+  if (output != NULL && fclose(output) != 0) {
+    written = false;
+  }
+  if (written) {
+    written = rename(temporary, path) == 0;
+  }
+  if (!written) {
+    unlink(temporary);
+  }
+
+  free(sorted);
+  free(entries);
+  free(temporary);
+  return written;
+}
+
+/////////////////////////////////////////////////
+//                   HASHING                   //
+/////////////////////////////////////////////////
+
+uint64_t lsp_cache_hash(const char *data, size_t length) {
+  return fdn_hash_bytes(data, length, LSP_CACHE_VERSION);
+}
+
+bool lsp_cache_path(fdn_arena *arena, const fdn_string *folders,
+                    uint32_t folder_count, fdn_string *path) {
+  const char *base = getenv("XDG_CACHE_HOME");
+  const char *suffix = "";
+  if (base == NULL || base[0] != '/') {
+    // Relative paths in XDG_CACHE_HOME are invalid and to be ignored.
+    base = getenv("HOME");
+    suffix = "/.cache";
+  }
+  if (base == NULL || base[0] == '\0') {
+    return false;
+  }
+
+  // Every set of folders gets a cache of its own.
+  uint64_t hash = 0;
+  for (uint32_t i = 0; i < folder_count; i++) {
+    hash = fdn_string_hash(folders[i], hash);
+  }
+
+  int length = snprintf(NULL, 0, "%s%s/solbot/index-%016" PRIx64 ".bin",
+                        base, suffix, hash);
+  char *output = length > 0 ? fdn_arena_alloc(arena, (size_t)length + 1)
+                            : NULL;
+  if (output == NULL) {
+    return false;
+  }
+  snprintf(output, (size_t)length + 1, "%s%s/solbot/index-%016" PRIx64 ".bin",
+           base, suffix, hash);
+
+  *path = fdn_string_create_view(output, (size_t)length);
+  return true;
+}
@@ -0,0 +1,101 @@
+#ifndef LSP_CACHE_H
+#define LSP_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libs/foundation.h"
+#include "solidity/parser.h"
+
+/**
+ * The index of a workspace, saved to disk so that the next start of the server
+ * only has to parse the files that changed in between.
+ *
+ * The cache is one file, laid out so that it can be used where it is mapped,
+ * without deserialization: a header, a table of fixed-size entries sorted by
+ * path, and then the data of every entry at 8-byte aligned offsets. An entry
+ * holds the size, modification time and content hash of a source file, and
+ * the columns of its tokens and parse tree in the same layout as SolSyntax
+ * keeps them in memory, so a syntax can point straight into the mapping.
+ *
+ * A cache is written to a temporary file that is renamed over the old one, so
+ * readers never see a partial file. The header records the format version,
+ * the byte order and the total size; a cache that does not match them is
+ * ignored as a whole and rebuilt. An entry whose tokens or tree point outside
+ * of its file or of each other is dropped when the cache is opened.
+ */
+
+// Bump whenever the layout, or the token types and node kinds, change.
+#define LSP_CACHE_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order; // LSP_CACHE_BYTE_ORDER as written.
+  uint64_t size;       // Of the whole file, to catch truncation.
+  uint32_t file_count;
+  uint32_t reserved;
+} lsp_cache_header;
+
+typedef struct {
+  uint64_t hash;     // Of the contents, see lsp_cache_hash.
+  int64_t mtime;     // Modification time in nanoseconds.
+  uint64_t size;     // Of the contents, in bytes.
+  uint64_t path;     // Offset of the null-terminated path.
+  uint64_t tokens;   // Offset of the starts, lengths and types of the tokens.
+  uint64_t nodes;    // Offset of the token starts, token ends, descendants
+                     // and kinds of the nodes.
+  uint32_t path_length;
+  uint32_t token_count;
+  uint32_t node_count;
+  uint32_t reserved;
+} lsp_cache_entry;
+
+typedef struct {
+  const char *data; // The mapping, or NULL if there is no usable cache.
+  size_t size;
+  const lsp_cache_entry *entries; // Into the mapping, or else `kept`.
+  uint32_t file_count;
+  lsp_cache_entry *kept; // The valid entries, if some were damaged; owned.
+} lsp_cache;
+
+// What lsp_cache_write saves of one file.
+typedef struct {
+  const char *path;
+  uint64_t hash;
+  int64_t mtime;
+  uint64_t size;
+  const SolSyntax *syntax;
+} lsp_cache_file;
+
+// lsp_cache_open maps the cache at `path`. Returns `false`, leaving an empty
+// cache behind, if there is none or it is stale or damaged.
+bool lsp_cache_open(lsp_cache *cache, const char *path);
+void lsp_cache_close(lsp_cache *cache);
+
+// lsp_cache_find returns the entry of the file at `path`, or NULL.
+const lsp_cache_entry *lsp_cache_find(const lsp_cache *cache,
+                                      const char *path);
+
+// lsp_cache_syntax points the columns of `syntax` at the tokens and the tree
+// of `entry`. The syntax is read-only: it must not be edited or freed, and is
+// valid for as long as the cache stays open.
+void lsp_cache_syntax(const lsp_cache *cache, const lsp_cache_entry *entry,
+                      SolSyntax *syntax);
+
+// lsp_cache_write saves the `files` to a new cache at `path`, creating its
+// directory if needed. Returns `false` if it could not be written; the old
+// cache is left in place then.
+bool lsp_cache_write(const char *path, const lsp_cache_file *files,
+                     uint32_t file_count);
+
+// lsp_cache_hash hashes the contents of a source file.
+uint64_t lsp_cache_hash(const char *data, size_t length);
+
+// lsp_cache_path returns where the cache of the workspace with the `folders`
+// is kept: under `$XDG_CACHE_HOME/solbot`, or else `~/.cache/solbot`. Returns
+// `false` if neither is set.
+bool lsp_cache_path(fdn_arena *arena, const fdn_string *folders,
+                    uint32_t folder_count, fdn_string *path);
+
+#endif // LSP_CACHE_H
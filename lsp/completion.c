@@ -0,0 +1,610 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "completion.h"
+#include "documents.h"
+#include "libs/foundation.h"
+#include "solidity/parser.h"
+#include "symbols.h"
+
+#define COMPLETION_INITIAL_ITEMS 64
+
+#define COMPLETION_NONE UINT32_MAX
+
+// How much of the text before the cursor is read to find the identifier being
+// typed and the object of a member access.
+#define COMPLETION_WINDOW 256
+
+/////////////////////////////////////////////////
+//                   BUILT-INS                 //
+/////////////////////////////////////////////////
+
+#define KEYWORD(label) {FDN_STRING_LITERAL(label), NULL, LSP_COMPLETION_KEYWORD}
+#define UNIT(label) {FDN_STRING_LITERAL(label), "unit", LSP_COMPLETION_UNIT}
+
+// The keywords, types, units and globals, in the order of compare_labels.
+static const lsp_completion_item builtin_items[] = {
+    {FDN_STRING_LITERAL("abi"), "ABI encoding", LSP_COMPLETION_MODULE},
+    KEYWORD("abstract"),
+    {FDN_STRING_LITERAL("addmod"), "addmod(uint256, uint256, uint256)",
+     LSP_COMPLETION_FUNCTION},
+    KEYWORD("address"),
+    KEYWORD("anonymous"),
+    KEYWORD("assembly"),
+    {FDN_STRING_LITERAL("assert"), "assert(bool)", LSP_COMPLETION_FUNCTION},
+    {FDN_STRING_LITERAL("blobhash"), "blobhash(uint256) returns (bytes32)",
+     LSP_COMPLETION_FUNCTION},
+    {FDN_STRING_LITERAL("block"), "the current block", LSP_COMPLETION_MODULE},
+    {FDN_STRING_LITERAL("blockhash"), "blockhash(uint256) returns (bytes32)",
+     LSP_COMPLETION_FUNCTION},
+    KEYWORD("bool"),
+    KEYWORD("break"),
+    KEYWORD("bytes"),
+    KEYWORD("bytes32"),
+    KEYWORD("bytes4"),
+    KEYWORD("calldata"),
+    KEYWORD("catch"),
+    KEYWORD("constant"),
+    KEYWORD("constructor"),
+    KEYWORD("continue"),
+    KEYWORD("contract"),
+    UNIT("days"),
+    KEYWORD("delete"),
+    KEYWORD("do"),
+    {FDN_STRING_LITERAL("ecrecover"),
+     "ecrecover(bytes32, uint8, bytes32, bytes32) returns (address)",
+     LSP_COMPLETION_FUNCTION},
+    KEYWORD("else"),
+    KEYWORD("emit"),
+    KEYWORD("enum"),
+    KEYWORD("error"),
+    UNIT("ether"),
+    KEYWORD("event"),
+    KEYWORD("external"),
+    KEYWORD("fallback"),
+    KEYWORD("false"),
+    KEYWORD("for"),
+    KEYWORD("function"),
+    {FDN_STRING_LITERAL("gasleft"), "gasleft() returns (uint256)",
+     LSP_COMPLETION_FUNCTION},
+    UNIT("gwei"),
+    UNIT("hours"),
+    KEYWORD("if"),
+    KEYWORD("immutable"),
+    KEYWORD("import"),
+    KEYWORD("indexed"),
+    KEYWORD("int"),
+    KEYWORD("int256"),
+    KEYWORD("interface"),
+    KEYWORD("internal"),
+    KEYWORD("is"),
+    {FDN_STRING_LITERAL("keccak256"),
+     "keccak256(bytes memory) returns (bytes32)", LSP_COMPLETION_FUNCTION},
+    KEYWORD("library"),
+    KEYWORD("mapping"),
+    KEYWORD("memory"),
+    UNIT("minutes"),
+    KEYWORD("modifier"),
+    {FDN_STRING_LITERAL("msg"), "the current call", LSP_COMPLETION_MODULE},
+    {FDN_STRING_LITERAL("mulmod"), "mulmod(uint256, uint256, uint256)",
+     LSP_COMPLETION_FUNCTION},
+    KEYWORD("new"),
+    KEYWORD("override"),
+    KEYWORD("payable"),
+    KEYWORD("pragma"),
+    KEYWORD("private"),
+    KEYWORD("public"),
+    KEYWORD("pure"),
+    KEYWORD("receive"),
+    {FDN_STRING_LITERAL("require"), "require(bool, string memory)",
+     LSP_COMPLETION_FUNCTION},
+    KEYWORD("return"),
+    KEYWORD("returns"),
+    {FDN_STRING_LITERAL("revert"), "revert(string memory)",
+     LSP_COMPLETION_FUNCTION},
+    {FDN_STRING_LITERAL("ripemd160"),
+     "ripemd160(bytes memory) returns (bytes20)", LSP_COMPLETION_FUNCTION},
+    UNIT("seconds"),
+    {FDN_STRING_LITERAL("selfdestruct"), "selfdestruct(address payable)",
+     LSP_COMPLETION_FUNCTION},
+    {FDN_STRING_LITERAL("sha256"), "sha256(bytes memory) returns (bytes32)",
+     LSP_COMPLETION_FUNCTION},
+    KEYWORD("storage"),
+    KEYWORD("string"),
+    KEYWORD("struct"),
+    {FDN_STRING_LITERAL("super"), "the base contract", LSP_COMPLETION_VARIABLE},
+    {FDN_STRING_LITERAL("this"), "the current contract",
+     LSP_COMPLETION_VARIABLE},
+    KEYWORD("true"),
+    KEYWORD("try"),
+    {FDN_STRING_LITERAL("tx"), "the current transaction",
+     LSP_COMPLETION_MODULE},
+    KEYWORD("type"),
+    KEYWORD("uint"),
+    KEYWORD("uint128"),
+    KEYWORD("uint16"),
+    KEYWORD("uint256"),
+    KEYWORD("uint32"),
+    KEYWORD("uint64"),
+    KEYWORD("uint8"),
+    KEYWORD("unchecked"),
+    KEYWORD("using"),
+    KEYWORD("view"),
+    KEYWORD("virtual"),
+    UNIT("weeks"),
+    UNIT("wei"),
+    KEYWORD("while"),
+};
+
+#undef KEYWORD
+#undef UNIT
+
+#define MEMBER(label, detail)                                                  \
+  {FDN_STRING_LITERAL(label), detail, LSP_COMPLETION_PROPERTY}
+#define METHOD(label, detail)                                                  \
+  {FDN_STRING_LITERAL(label), detail, LSP_COMPLETION_METHOD}
+
+static const lsp_completion_item abi_members[] = {
+    METHOD("decode", "abi.decode(bytes memory, (...)) returns (...)"),
+    METHOD("encode", "abi.encode(...) returns (bytes memory)"),
+    METHOD("encodeCall",
+           "abi.encodeCall(function, (...)) returns (bytes memory)"),
+    METHOD("encodePacked", "abi.encodePacked(...) returns (bytes memory)"),
+    METHOD("encodeWithSelector",
+           "abi.encodeWithSelector(bytes4, ...) returns (bytes memory)"),
+    METHOD("encodeWithSignature",
+           "abi.encodeWithSignature(string memory, ...) returns "
+           "(bytes memory)"),
+};
+
+static const lsp_completion_item block_members[] = {
+    MEMBER("basefee", "uint256"),    MEMBER("blobbasefee", "uint256"),
+    MEMBER("chainid", "uint256"),    MEMBER("coinbase", "address payable"),
+    MEMBER("difficulty", "uint256"), MEMBER("gaslimit", "uint256"),
+    MEMBER("number", "uint256"),     MEMBER("prevrandao", "uint256"),
+    MEMBER("timestamp", "uint256"),
+};
+
+static const lsp_completion_item msg_members[] = {
+    MEMBER("data", "bytes calldata"),
+    MEMBER("sender", "address"),
+    MEMBER("sig", "bytes4"),
+    MEMBER("value", "uint256"),
+};
+
+static const lsp_completion_item tx_members[] = {
+    MEMBER("gasprice", "uint256"),
+    MEMBER("origin", "address"),
+};
+
+#undef MEMBER
+#undef METHOD
+
+typedef struct {
+  fdn_string object;
+  const lsp_completion_item *members;
+  uint32_t count;
+} MemberTable;
+
+#define MEMBER_TABLE(object, members)                                          \
+  {FDN_STRING_LITERAL(object), members,                                        \
+   sizeof(members) / sizeof(members[0])}
+
+static const MemberTable member_tables[] = {
+    MEMBER_TABLE("abi", abi_members),
+    MEMBER_TABLE("block", block_members),
+    MEMBER_TABLE("msg", msg_members),
+    MEMBER_TABLE("tx", tx_members),
+};
+
+#undef MEMBER_TABLE
+
+/////////////////////////////////////////////////
+//                    LABELS                   //
+/////////////////////////////////////////////////
+
+static inline char completion_to_lower(char ch) {
+  return (ch >= 'A' && ch <= 'Z') ? (char)(ch - 'A' + 'a') : ch;
+}
+
+static inline bool completion_is_identifier(char ch) {
+  return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+         (ch >= '0' && ch <= '9') || ch == '_' || ch == '$';
+}
+
+// compare_labels orders labels alphabetically ignoring case, and labels that
+// only differ in case by their bytes.
+static int compare_labels(fdn_string a, fdn_string b) {
+  size_t length =
+      a.string_length < b.string_length ? a.string_length : b.string_length;
+  for (size_t i = 0; i < length; i++) {
+    char x = completion_to_lower(a.string_start[i]);
+    char y = completion_to_lower(b.string_start[i]);
+    if (x != y) {
+      return (unsigned char)x < (unsigned char)y ? -1 : 1;
+    }
+  }
+  if (a.string_length != b.string_length) {
+    return a.string_length < b.string_length ? -1 : 1;
+  }
+  return memcmp(a.string_start, b.string_start, length);
+}
+
+static int compare_items(const void *left, const void *right) {
+  return compare_labels(((const lsp_completion_item *)left)->label,
+                        ((const lsp_completion_item *)right)->label);
+}
+
+static bool label_has_prefix(fdn_string label, fdn_string prefix) {
+  if (label.string_length < prefix.string_length) {
+    return false;
+  }
+  for (size_t i = 0; i < prefix.string_length; i++) {
+    if (completion_to_lower(label.string_start[i]) !=
+        completion_to_lower(prefix.string_start[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// label_is_before_prefix tells whether the `label` comes before every label
+// that starts with the `prefix` in the order of compare_labels.
+static bool label_is_before_prefix(fdn_string label, fdn_string prefix) {
+  for (size_t i = 0; i < label.string_length && i < prefix.string_length;
+       i++) {
+    char x = completion_to_lower(label.string_start[i]);
+    char y = completion_to_lower(prefix.string_start[i]);
+    if (x != y) {
+      return (unsigned char)x < (unsigned char)y;
+    }
+  }
+  return label.string_length < prefix.string_length;
+}
+
+// prefix_range finds the run of the sorted `items` whose labels start with the
+// `prefix`, ignoring case, and returns its first item; `*end` is set past it.
+static uint32_t prefix_range(const lsp_completion_item *items, uint32_t count,
+                             fdn_string prefix, uint32_t *end) {
+  uint32_t low = 0;
+  uint32_t high = count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (label_is_before_prefix(items[middle].label, prefix)) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  *end = low;
+  while (*end < count && label_has_prefix(items[*end].label, prefix)) {
+    (*end)++;
+  }
+  return low;
+}
+
+/////////////////////////////////////////////////
+//                    SCOPE                    //
+/////////////////////////////////////////////////
+
+// The candidates from the document, grown in the arena.
+typedef struct {
+  const lsp_document *document;
+  const SolSyntax *syntax;
+  fdn_arena *arena;
+  fdn_string prefix;
+  lsp_completion_item *items;
+  uint32_t count;
+  uint32_t capacity;
+} ScopeItems;
+
+// scope_add adds the identifier at `token` if it starts with the prefix.
+static bool scope_add(ScopeItems *scope, uint32_t token, const char *detail,
+                      uint8_t kind) {
+  const SolTokenList *tokens = &scope->syntax->tokens;
+  if (tokens->lengths[token] < scope->prefix.string_length) {
+    return true;
+  }
+  fdn_string label = lsp_document_text_range(
+      scope->document, tokens->starts[token], tokens->lengths[token],
+      scope->arena);
+  if (label.string_length == 0) {
+    return false;
+  }
+  if (!label_has_prefix(label, scope->prefix)) {
+    return true;
+  }
+
+  if (scope->count == scope->capacity) {
+    uint32_t capacity =
+        scope->capacity > 0 ? scope->capacity * 2 : COMPLETION_INITIAL_ITEMS;
+    lsp_completion_item *items =
+        fdn_arena_alloc(scope->arena, capacity * sizeof(lsp_completion_item));
+    if (items == NULL) {
+      return false;
+    }
+    if (scope->count > 0) {
+      memcpy(items, scope->items, scope->count * sizeof(lsp_completion_item));
+    }
+    scope->items = items;
+    scope->capacity = capacity;
+  }
+
+  lsp_completion_item *item = &scope->items[scope->count++];
+  item->label = label;
+  item->detail = detail;
+  item->kind = kind;
+  return true;
+}
+
+// declaration_item gives the completion kind and detail of a declaration of
+// the lsp_symbol_kind `symbol`. Returns `false` for constructors, which cannot
+// be referred to by name.
+static bool declaration_item(uint8_t symbol, lsp_completion_item *item) {
+  static const struct {
+    uint8_t symbol;
+    uint8_t kind;
+    const char *detail;
+  } kinds[] = {
+      {LSP_SYMBOL_CLASS, LSP_COMPLETION_CLASS, "contract"},
+      {LSP_SYMBOL_INTERFACE, LSP_COMPLETION_INTERFACE, "interface"},
+      {LSP_SYMBOL_MODULE, LSP_COMPLETION_MODULE, "library"},
+      {LSP_SYMBOL_METHOD, LSP_COMPLETION_METHOD, NULL},
+      {LSP_SYMBOL_FUNCTION, LSP_COMPLETION_FUNCTION, "function"},
+      {LSP_SYMBOL_EVENT, LSP_COMPLETION_EVENT, "event"},
+      {LSP_SYMBOL_OBJECT, LSP_COMPLETION_CLASS, "error"},
+      {LSP_SYMBOL_STRUCT, LSP_COMPLETION_STRUCT, "struct"},
+      {LSP_SYMBOL_ENUM, LSP_COMPLETION_ENUM, "enum"},
+      {LSP_SYMBOL_TYPE_PARAMETER, LSP_COMPLETION_TYPE_PARAMETER,
+       "user-defined value type"},
+  };
+
+  for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+    if (kinds[i].symbol == symbol) {
+      item->detail = kinds[i].detail;
+      item->kind = kinds[i].kind;
+      return true;
+    }
+  }
+  return false;
+}
+
+// variable_name returns the token naming the state or constant variable
+// `node`: the last identifier before its initializer.
+static uint32_t variable_name(const SolSyntax *syntax, uint32_t node) {
+  const SolTokenList *tokens = &syntax->tokens;
+  uint32_t name = COMPLETION_NONE;
+  for (uint32_t token = syntax->nodes.token_starts[node];
+       token < syntax->nodes.token_ends[node]; token++) {
+    SolTokenType type = (SolTokenType)tokens->types[token];
+    if (type == SOL_TOKEN_ASSIGN || type == SOL_TOKEN_SEMICOLON) {
+      break;
+    }
+    if (type == SOL_TOKEN_IDENTIFIER) {
+      name = token;
+    }
+  }
+  return name;
+}
+
+// is_local_declaration tells whether the identifier at `token` is declared
+// there, as a parameter or a local variable: it follows a type or a data
+// location and is followed by the end of the declaration or its initializer.
+static bool is_local_declaration(const SolTokenList *tokens, uint32_t token,
+                                 uint32_t end) {
+  if (token + 1 >= end) {
+    return false;
+  }
+  switch ((SolTokenType)tokens->types[token - 1]) {
+  case SOL_TOKEN_IDENTIFIER:
+  case SOL_TOKEN_ELEMENTARY_TYPE:
+  case SOL_TOKEN_MEMORY:
+  case SOL_TOKEN_STORAGE:
+  case SOL_TOKEN_CALLDATA:
+  case SOL_TOKEN_PAYABLE:
+  case SOL_TOKEN_RBRACKET:
+    break;
+  default:
+    return false;
+  }
+  switch ((SolTokenType)tokens->types[token + 1]) {
+  case SOL_TOKEN_COMMA:
+  case SOL_TOKEN_RPAREN:
+  case SOL_TOKEN_SEMICOLON:
+  case SOL_TOKEN_ASSIGN:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// node_contains tells whether the source range of `node` contains `offset`.
+static bool node_contains(const SolSyntax *syntax, uint32_t node,
+                          uint32_t offset) {
+  uint32_t first = syntax->nodes.token_starts[node];
+  uint32_t last = syntax->nodes.token_ends[node];
+  if (first == last) {
+    return false;
+  }
+  return syntax->tokens.starts[first] < offset &&
+         offset <= syntax->tokens.starts[last - 1] +
+                       syntax->tokens.lengths[last - 1];
+}
+
+// scope_collect adds the identifiers in scope at `offset` that start with the
+// prefix: the declarations of the file, the members of the enclosing
+// contract, and the parameters and locals of the enclosing function.
+static bool scope_collect(ScopeItems *scope, uint32_t offset) {
+  const SolSyntax *syntax = scope->syntax;
+  const SolNodeList *nodes = &syntax->nodes;
+  const SolTokenList *tokens = &syntax->tokens;
+
+  // Only the contract around the offset is descended into; the subtrees of
+  // all other nodes are skipped.
+  uint32_t function = COMPLETION_NONE;
+  uint32_t contract_end = 0;
+  uint32_t node = 1;
+  while (node < nodes->count) {
+    SolNodeKind kind = (SolNodeKind)nodes->kinds[node];
+    uint32_t next = sol_node_next_sibling(nodes, node);
+    bool in_contract = node < contract_end;
+
+    uint8_t symbol;
+    uint32_t name;
+    lsp_completion_item item;
+    if (kind == SOL_NODE_VARIABLE) {
+      name = variable_name(syntax, node);
+      if (name != COMPLETION_NONE &&
+          !scope_add(scope, name, in_contract ? "state variable" : "constant",
+                     LSP_COMPLETION_FIELD)) {
+        return false;
+      }
+    } else if (lsp_declaration_describe(syntax, node, in_contract, &symbol,
+                                        &name) &&
+               tokens->types[name] == SOL_TOKEN_IDENTIFIER &&
+               declaration_item(symbol, &item) &&
+               !scope_add(scope, name, item.detail, item.kind)) {
+      return false;
+    }
+
+    if ((kind == SOL_NODE_FUNCTION || kind == SOL_NODE_MODIFIER) &&
+        node_contains(syntax, node, offset)) {
+      function = node;
+    }
+    if ((kind == SOL_NODE_CONTRACT || kind == SOL_NODE_INTERFACE ||
+         kind == SOL_NODE_LIBRARY) &&
+        node_contains(syntax, node, offset)) {
+      contract_end = next;
+      node++;
+    } else {
+      node = next;
+    }
+  }
+
+  // The parameters and locals declared before the offset. Blocks are not
+  // told apart: a local of a block that already ended is still offered.
+  if (function != COMPLETION_NONE) {
+    uint32_t end = nodes->token_ends[function];
+    for (uint32_t token = nodes->token_starts[function] + 1;
+         token < end && tokens->starts[token] < offset; token++) {
+      if (tokens->types[token] == SOL_TOKEN_IDENTIFIER &&
+          is_local_declaration(tokens, token, end) &&
+          !scope_add(scope, token, "variable", LSP_COMPLETION_VARIABLE)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/////////////////////////////////////////////////
+//                  COMPLETION                 //
+/////////////////////////////////////////////////
+
+// list_add appends the `item` unless the list is full or it repeats the label
+// of the last item.
+static void list_add(lsp_completion_list *list, uint32_t limit,
+                     const lsp_completion_item *item) {
+  if (list->count > 0 &&
+      fdn_string_is_eq(list->items[list->count - 1].label, item->label)) {
+    return;
+  }
+  if (list->count == limit) {
+    list->incomplete = true;
+    return;
+  }
+  list->items[list->count++] = *item;
+}
+
+// list_merge merges two sorted runs of items into the list. Of two items
+// with the same label, the one of `first` is kept.
+static void list_merge(lsp_completion_list *list, uint32_t limit,
+                       const lsp_completion_item *first, uint32_t first_count,
+                       const lsp_completion_item *second,
+                       uint32_t second_count) {
+  uint32_t i = 0;
+  uint32_t j = 0;
+  while ((i < first_count || j < second_count) && !list->incomplete) {
+    if (j == second_count ||
+        (i < first_count && compare_labels(first[i].label,
+                                           second[j].label) <= 0)) {
+      list_add(list, limit, &first[i++]);
+    } else {
+      list_add(list, limit, &second[j++]);
+    }
+  }
+}
+
+bool lsp_completion_collect(lsp_document *document, lsp_position position,
+                            fdn_arena *arena, uint32_t limit,
+                            lsp_completion_list *list) {
+  memset(list, 0, sizeof(*list));
+
+  const SolSyntax *syntax = lsp_document_syntax(document);
+  list->items = fdn_arena_alloc(arena, (limit > 0 ? limit : 1) *
+                                           sizeof(lsp_completion_item));
+  if (list->items == NULL) {
+    return false;
+  }
+
+  // The identifier being typed ends at the cursor, and a member access is
+  // right before it; only the text just before the cursor is read.
+  uint32_t offset = lsp_document_offset_at(document, position);
+  uint32_t window = offset < COMPLETION_WINDOW ? offset : COMPLETION_WINDOW;
+  fdn_string before =
+      lsp_document_text_range(document, offset - window, window, arena);
+  const char *text = before.string_start;
+  uint32_t start = (uint32_t)before.string_length;
+  while (start > 0 && completion_is_identifier(text[start - 1])) {
+    start--;
+  }
+  fdn_string prefix = fdn_string_create_view(
+      text + start, before.string_length - start);
+
+  // After `object.`, only the members of a global are known.
+  uint32_t dot = start;
+  while (dot > 0 && (text[dot - 1] == ' ' || text[dot - 1] == '\t')) {
+    dot--;
+  }
+  if (dot > 0 && text[dot - 1] == '.') {
+    uint32_t object_end = dot - 1;
+    uint32_t object_start = object_end;
+    while (object_start > 0 &&
+           completion_is_identifier(text[object_start - 1])) {
+      object_start--;
+    }
+    fdn_string object =
+        fdn_string_create_view(text + object_start, object_end - object_start);
+    for (size_t i = 0; i < sizeof(member_tables) / sizeof(member_tables[0]);
+         i++) {
+      const MemberTable *table = &member_tables[i];
+      if (fdn_string_is_eq(table->object, object)) {
+        uint32_t end;
+        uint32_t first =
+            prefix_range(table->members, table->count, prefix, &end);
+        list_merge(list, limit, table->members + first, end - first, NULL, 0);
+      }
+    }
+    return true;
+  }
+
+  ScopeItems scope = {document, syntax, arena, prefix, NULL, 0, 0};
+  if (!scope_collect(&scope, offset - (uint32_t)prefix.string_length)) {
+    return false;
+  }
+  if (scope.count > 1) {
+    qsort(scope.items, scope.count, sizeof(lsp_completion_item),
+          compare_items);
+  }
+
+  uint32_t builtin_count =
+      (uint32_t)(sizeof(builtin_items) / sizeof(builtin_items[0]));
+  uint32_t end;
+  uint32_t first = prefix_range(builtin_items, builtin_count, prefix, &end);
+  list_merge(list, limit, scope.items, scope.count, builtin_items + first,
+             end - first);
+  return true;
+}
@@ -0,0 +1,66 @@
+#ifndef LSP_COMPLETION_H
+#define LSP_COMPLETION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "documents.h"
+#include "libs/foundation.h"
+
+/**
+ * Completion of the identifier being typed in an open document.
+ *
+ * The candidates come from two sorted arrays. The Solidity keywords, types,
+ * units and globals (`msg`, `block.timestamp`, `abi.encode`, ...) are a
+ * constant table kept in alphabetical order; the candidates starting with the
+ * typed prefix are one run of it, found by binary search. The identifiers in
+ * scope are collected from the syntax of the document on every request: the
+ * declarations at the file level, the members of the enclosing contract, and
+ * the parameters and locals of the enclosing function declared before the
+ * cursor. Only those matching the prefix are kept, allocated from the arena of
+ * the request, and sorted; the two runs are then merged.
+ *
+ * After a `.`, the members of the global before it are completed instead.
+ * Member access on other expressions would need their types, which the syntax
+ * alone does not give, so nothing is offered then.
+ */
+
+// CompletionItemKind values of the LSP.
+typedef enum {
+  LSP_COMPLETION_METHOD = 2,
+  LSP_COMPLETION_FUNCTION = 3,
+  LSP_COMPLETION_FIELD = 5,
+  LSP_COMPLETION_VARIABLE = 6,
+  LSP_COMPLETION_CLASS = 7,
+  LSP_COMPLETION_INTERFACE = 8,
+  LSP_COMPLETION_MODULE = 9,
+  LSP_COMPLETION_PROPERTY = 10,
+  LSP_COMPLETION_UNIT = 11,
+  LSP_COMPLETION_ENUM = 13,
+  LSP_COMPLETION_KEYWORD = 14,
+  LSP_COMPLETION_STRUCT = 22,
+  LSP_COMPLETION_EVENT = 23,
+  LSP_COMPLETION_TYPE_PARAMETER = 25,
+} lsp_completion_kind;
+
+typedef struct {
+  fdn_string label;
+  const char *detail; // Static text, or NULL.
+  uint8_t kind;       // lsp_completion_kind
+} lsp_completion_item;
+
+typedef struct {
+  lsp_completion_item *items; // In alphabetical order, ignoring case.
+  uint32_t count;
+  bool incomplete; // More candidates matched than were listed.
+} lsp_completion_list;
+
+// lsp_completion_collect lists up to `limit` candidates for the identifier
+// that ends at the `position` of the `document`, bringing its syntax up to
+// date first. The items, and the labels that are not static, are allocated
+// from the `arena`. Returns `false` if memory ran out.
+bool lsp_completion_collect(lsp_document *document, lsp_position position,
+                            fdn_arena *arena, uint32_t limit,
+                            lsp_completion_list *list);
+
+#endif // LSP_COMPLETION_H
@@ -1,142 +1,1241 @@
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "cache.h"
+#include "completion.h"
 #include "dispatcher.h"
+#include "documents.h"
+#include "imports.h"
+#include "json/parser.h"
+#include "json/writer.h"
 #include "libs/foundation.h"
+#include "references.h"
+#include "workspace.h"
 
 // --- Global State ---
 static bool g_shutdown_requested = 0;
+static fdn_arena *g_server_arena = NULL;
+
+// The documents opened by the client. Exclusive handlers hold the lock for
+// writing, concurrent ones for reading.
+static lsp_document_store g_documents;
+static pthread_rwlock_t g_documents_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Taken by a writer while it waits for the lock, which keeps new readers out:
+// the default rwlock prefers readers, so a stream of requests would otherwise
+// hold the reader thread up, and with it the reading of `$/cancelRequest`.
+static pthread_mutex_t g_documents_turnstile = PTHREAD_MUTEX_INITIALIZER;
+
+// Scratch space of dispatcher_sync, for the text and path of a document.
+#define DISPATCH_SYNC_ARENA_BLOCK_SIZE (64 * 1024)
+
+// The Solidity files of the workspace folders, indexed in the background.
+static lsp_workspace g_workspace;
+
+static dispatch_stats g_stats;
 
 /////// LSP REQUEST MESSAGE HANDLERS - FORWARD DECLARATIONS ///////
 
-lsp_status handle_initialize(int32_t id, fdn_string params);
-lsp_status handle_shutdown(int32_t id, fdn_string params);
+lsp_status handle_initialize(lsp_context *context, int32_t id,
+                             fdn_string params);
+lsp_status handle_shutdown(lsp_context *context, int32_t id, fdn_string params);
+lsp_status handle_workspace_symbol(lsp_context *context, int32_t id,
+                                   fdn_string params);
+lsp_status handle_completion(lsp_context *context, int32_t id,
+                             fdn_string params);
+lsp_status handle_definition(lsp_context *context, int32_t id,
+                             fdn_string params);
+lsp_status handle_references(lsp_context *context, int32_t id,
+                             fdn_string params);
 
 /// LSP NOTIFICATIONS - FORWARD DECLARATIONS ///
 
 // TODO: End the process; should exit with status 0 if there was shutdown
 // request before. If there was no shutdown request, it should exit with
 // status 1.
-lsp_status handle_exit(int32_t id, fdn_string params);
+lsp_status handle_exit(lsp_context *context, int32_t id, fdn_string params);
+lsp_status handle_did_open(lsp_context *context, int32_t id, fdn_string params);
+lsp_status handle_did_change(lsp_context *context, int32_t id,
+                             fdn_string params);
+lsp_status handle_did_close(lsp_context *context, int32_t id,
+                            fdn_string params);
 
 ///////////////////////////////////////////////////
 ///////// DISPATCHER - LSP MESSAGE ROUTER /////////
 ///////////////////////////////////////////////////
 
 dispatch_entry dispatch_table[] = {
-    {"initialize", handle_initialize},
-    {"shutdown", handle_shutdown},
-    {"exit", handle_exit},
-    {NULL, NULL} // sentinel value marks the end of loop iteration over the
-                 // dispatch table
+    {FDN_STRING_LITERAL("initialize"), handle_initialize,
+     LSP_DISPATCH_EXCLUSIVE},
+    {FDN_STRING_LITERAL("shutdown"), handle_shutdown, LSP_DISPATCH_EXCLUSIVE},
+    {FDN_STRING_LITERAL("workspace/symbol"), handle_workspace_symbol,
+     LSP_DISPATCH_CONCURRENT},
+    {FDN_STRING_LITERAL("textDocument/completion"), handle_completion,
+     LSP_DISPATCH_CONCURRENT},
+    {FDN_STRING_LITERAL("textDocument/definition"), handle_definition,
+     LSP_DISPATCH_CONCURRENT},
+    {FDN_STRING_LITERAL("textDocument/references"), handle_references,
+     LSP_DISPATCH_CONCURRENT},
+    {FDN_STRING_LITERAL("exit"), handle_exit, LSP_DISPATCH_EXCLUSIVE},
+    {FDN_STRING_LITERAL("textDocument/didOpen"), handle_did_open,
+     LSP_DISPATCH_EXCLUSIVE},
+    {FDN_STRING_LITERAL("textDocument/didChange"), handle_did_change,
+     LSP_DISPATCH_EXCLUSIVE},
+    {FDN_STRING_LITERAL("textDocument/didClose"), handle_did_close,
+     LSP_DISPATCH_EXCLUSIVE},
+    {{NULL, 0}, NULL, LSP_DISPATCH_CONCURRENT} // sentinel value marks the end
+                                               // of loop iteration over the
+                                               // dispatch table
 };
 
-lsp_status dispatch_message(fdn_string method, bool has_id, int32_t id,
-                            fdn_string params) {
-  for (int32_t i = 0; dispatch_table[i].method != NULL; i++) {
-    if (fdn_string_is_eq_c_str(method, dispatch_table[i].method)) {
-      lsp_status should_exit = dispatch_table[i].handler(id, params);
-      return should_exit;
+// The methods are looked up through a perfect hash over the `dispatch_table`
+// instead of comparing the method against every entry. The slot count has to
+// stay a power of two and a few times bigger than the table.
+#define DISPATCH_INDEX_SLOTS 512
+
+static fdn_perfect_hash g_dispatch_index;
+static uint16_t g_dispatch_index_slots[DISPATCH_INDEX_SLOTS];
+
+// The values that the requests about a position in a document read. They come
+// every keystroke, so they are picked out of the params in a single pass
+// instead of building a tape of them.
+typedef enum {
+  POSITION_PARAM_URI,
+  POSITION_PARAM_LINE,
+  POSITION_PARAM_CHARACTER,
+  POSITION_PARAM_INCLUDE_DECLARATION, // Of references requests.
+  POSITION_PARAM_COUNT,
+} position_param;
+
+static const char *const g_position_param_paths[POSITION_PARAM_COUNT] = {
+    "textDocument.uri", "position.line", "position.character",
+    "context.includeDeclaration"};
+static JsonPath g_position_params[POSITION_PARAM_COUNT];
+
+bool lsp_context_init(lsp_context *context, fdn_arena *arena, lsp_send_fn send,
+                      void *sender) {
+  context->arena = arena;
+  context->send = send;
+  context->sender = sender;
+  context->cancelled = NULL;
+  context->responded = false;
+  return json_writer_init(&context->writer, 4096);
+}
+
+void lsp_context_free(lsp_context *context) {
+  json_writer_free(&context->writer);
+}
+
+bool dispatcher_init(fdn_arena *server_arena) {
+  g_server_arena = server_arena;
+
+  if (g_documents.slots == NULL && !lsp_document_store_init(&g_documents)) {
+    return false;
+  }
+
+  fdn_string methods[DISPATCH_INDEX_SLOTS];
+  uint32_t count = 0;
+  while (dispatch_table[count].handler != NULL) {
+    if (count == DISPATCH_INDEX_SLOTS / 4) {
+      return false; // The index is too small for a seed to be found quickly.
     }
+    methods[count] = dispatch_table[count].method;
+    count++;
   }
 
-  // TODO: Handle the case where a method was not found. This probably requires
-  // implementing:
-  // - send error function similar to send response
-  // - sending a specific error code in main (or here???)
-  // - LSP should still work but we should notify the client
-  return LSP_STATUS_CONTINUE;
+  for (uint32_t i = 0; i < POSITION_PARAM_COUNT; i++) {
+    if (!json_path_compile(g_position_param_paths[i], &g_position_params[i])) {
+      return false;
+    }
+  }
+
+  return fdn_perfect_hash_build(&g_dispatch_index, methods, count,
+                                g_dispatch_index_slots, DISPATCH_INDEX_SLOTS);
 }
 
-// `send_response` prepares a response message by constructing the full JSON
-// payload using the provided `id` and `json_result`. The function returns `0`
-// on success and `-1` on error. The provided `json_result` MUST be a valid JSON
-// object. The `send_response` function constructs the message by appending the
-// regular "jsonrpc", "id" and "result" fields required by the LSP. The
-// `json_result` is placed as a value of the `result` field.
-static int send_response(int32_t id, const char *json_result) {
-  size_t result_len = strlen(json_result);
-  // Calculate the length required for the specialized JSON result to be sent
-  // back to the client + a small overhead of 64 bytes for the constant portion
-  // of each response message (the "jsonrpc", "id", "result" fields etc.).
-  size_t required_len = result_len + 64;
-
-  char stack_buffer[2048];
-  char *buffer = stack_buffer; // default to stack buffer for small mesages
-
-  if (required_len > sizeof(stack_buffer)) {
-    buffer = malloc(required_len);
-    if (!buffer)
-      return -1; // allocation error; server should most likely treat this as a
-                 // sign to exit.
-  }
-
-  // Write the formatted JSON response into the buffer.
-  int response_len = snprintf(buffer, required_len,
-                              "{\"jsonrpc\":\"2.0\",\"id\":%d,\"result\":%s}",
-                              id, json_result);
-
-  // Append the Content-Length header to the response and send it to `stdout`.
-  if (fprintf(stdout, "Content-Length: %d\r\n\r\n%s", response_len, buffer) <
-      0) {
-    if (buffer != stack_buffer)
-      free(buffer);
-    return -1;
+void dispatcher_free(void) {
+  fdn_info("%" PRIu64 " didChange notification(s) with %" PRIu64
+           " edit(s) took %" PRIu64 " syntax update(s).",
+           g_stats.changes, g_stats.edits, g_stats.syntax_updates);
+  fdn_info("%" PRIu64 " import update(s) invalidated %" PRIu64 " file(s).",
+           g_stats.import_updates, g_stats.files_invalidated);
+  lsp_workspace_free(&g_workspace);
+  lsp_document_store_free(&g_documents);
+}
+
+const dispatch_stats *dispatcher_stats(void) { return &g_stats; }
+
+static void documents_lock_write(void) {
+  pthread_mutex_lock(&g_documents_turnstile);
+  pthread_rwlock_wrlock(&g_documents_lock);
+  pthread_mutex_unlock(&g_documents_turnstile);
+}
+
+static void documents_lock_read(void) {
+  pthread_mutex_lock(&g_documents_turnstile);
+  pthread_mutex_unlock(&g_documents_turnstile);
+  pthread_rwlock_rdlock(&g_documents_lock);
+}
+
+// document_sync_imports resolves the imports of the `document` again into the
+// import graph of the workspace, adding the file if the graph does not have
+// it, and logs which files the edit invalidates.
+static void document_sync_imports(fdn_arena *arena, lsp_document *document) {
+  document->imports_synced = true;
+  fdn_string path;
+  if (!lsp_uri_to_path(arena, document->uri, &path)) {
+    return;
+  }
+
+  lsp_import_file file;
+  file.path = path.string_start;
+  file.syntax = lsp_document_syntax(document);
+  file.source = lsp_document_text(document, arena);
+  uint32_t index;
+  if (file.source.string_start == NULL ||
+      !lsp_import_graph_update(&g_workspace.imports, arena, &file, &index)) {
+    fdn_error("Ran out of memory while resolving the imports of %s.",
+              path.string_start);
+    return;
+  }
+
+  uint32_t *invalid;
+  uint32_t count =
+      index != LSP_IMPORT_NONE
+          ? lsp_import_graph_invalidate(&g_workspace.imports, arena, index,
+                                        &invalid)
+          : 0;
+  g_stats.import_updates++;
+  g_stats.files_invalidated += count;
+  fdn_debug("Updated the imports of %s, which invalidates %" PRIu32
+            " file(s).",
+            path.string_start, count);
+}
+
+void dispatcher_sync(void) {
+  documents_lock_write();
+  fdn_arena arena;
+  bool indexed = lsp_workspace_is_done(&g_workspace) &&
+                 fdn_arena_init(&arena, DISPATCH_SYNC_ARENA_BLOCK_SIZE);
+  for (uint32_t i = 0; i < g_documents.capacity; i++) {
+    lsp_document *document = g_documents.slots[i];
+    if (document == NULL) {
+      continue;
+    }
+
+    if (document->syntax_pending > 0) {
+      fdn_debug("Updating the syntax of %.*s after %" PRIu32 " edit(s).",
+                (int)document->uri.string_length, document->uri.string_start,
+                document->syntax_pending);
+      g_stats.syntax_updates++;
+      lsp_document_syntax(document);
+    }
+    if (indexed && !document->imports_synced) {
+      document_sync_imports(&arena, document);
+      fdn_arena_reset(&arena);
+    }
+  }
+  if (indexed) {
+    fdn_arena_free(&arena);
   }
+  pthread_rwlock_unlock(&g_documents_lock);
+}
+
+const dispatch_entry *dispatch_lookup(fdn_string method) {
+  uint32_t index = fdn_perfect_hash_find(&g_dispatch_index, method);
+  if (index == FDN_PERFECT_HASH_NOT_FOUND) {
+    return NULL;
+  }
+
+  // The slot is taken by a single method; make sure it is this one.
+  const dispatch_entry *entry = &dispatch_table[index];
+  return fdn_string_is_eq(entry->method, method) ? entry : NULL;
+}
+
+static int response_error(lsp_context *context, int32_t id,
+                          lsp_error_code code, const char *message);
+
+lsp_status dispatch_message(lsp_context *context, fdn_string method,
+                            bool has_id, int32_t id, fdn_string params) {
+  context->responded = false;
+
+  // Notifications the server does not know, such as the optional "$/" ones,
+  // are ignored.
+  const dispatch_entry *entry = dispatch_lookup(method);
+  if (entry == NULL) {
+    fdn_info("No handler for %.*s.", (int)method.string_length,
+             method.string_start);
+    if (has_id && response_error(context, id, LSP_ERROR_METHOD_NOT_FOUND,
+                                 "Method not found.") == -1) {
+      return LSP_STATUS_EXIT;
+    }
+    return LSP_STATUS_CONTINUE;
+  }
+
+  // A request cancelled while it was queued is not started at all.
+  lsp_status should_exit = LSP_STATUS_CONTINUE;
+  if (!lsp_context_cancelled(context)) {
+    if (entry->mode == LSP_DISPATCH_EXCLUSIVE) {
+      documents_lock_write();
+    } else {
+      documents_lock_read();
+    }
+    should_exit = entry->handler(context, id, params);
+    pthread_rwlock_unlock(&g_documents_lock);
+  }
+
+  if (!has_id || context->responded) {
+    return should_exit;
+  }
+
+  // The handler gave up without an answer, because the request was cancelled
+  // or because it failed.
+  int32_t code = lsp_context_cancelled(context)
+                     ? __atomic_load_n(context->cancelled, __ATOMIC_RELAXED)
+                     : LSP_ERROR_INTERNAL_ERROR;
+  const char *message = "The request failed.";
+  if (code == LSP_ERROR_CONTENT_MODIFIED) {
+    message = "The document changed.";
+  } else if (code == LSP_ERROR_REQUEST_CANCELLED) {
+    message = "The request was cancelled.";
+  }
+  if (response_error(context, id, (lsp_error_code)code, message) == -1) {
+    return LSP_STATUS_EXIT;
+  }
+  return should_exit;
+}
 
-  if (fflush(stdout) == EOF) {
-    if (buffer != stack_buffer)
-      free(buffer);
+// `response_begin` starts the response to the request `id`. It writes the
+// regular "jsonrpc", "id" and "result" fields required by the LSP and returns
+// the writer positioned at the value of the `result` field. The handler writes
+// exactly one value (the result) and calls `response_send`.
+static JsonWriter *response_begin(lsp_context *context, int32_t id) {
+  JsonWriter *writer = &context->writer;
+  json_writer_reset(writer);
+
+  json_writer_begin_object(writer);
+  json_writer_key(writer, "jsonrpc");
+  json_writer_string_c(writer, "2.0");
+  json_writer_key(writer, "id");
+  json_writer_int(writer, id);
+  json_writer_key(writer, "result");
+
+  return writer;
+}
+
+// `response_send` closes the response started with `response_begin` and hands
+// it to the client. The function returns `0` on success and `-1` on error; the
+// server should most likely treat an error as a sign to exit.
+static int response_send(lsp_context *context) {
+  JsonWriter *writer = &context->writer;
+  json_writer_end_object(writer);
+
+  if (json_writer_failed(writer)) {
     return -1;
   }
 
-  if (buffer != stack_buffer) {
-    free(buffer);
+  if (!context->send(context->sender, json_writer_output(writer))) {
+    return -1;
   }
 
+  context->responded = true;
   return 0; // success
 }
 
+// `response_error` answers the request `id` with an error instead of a result.
+// It returns like `response_send`.
+static int response_error(lsp_context *context, int32_t id,
+                          lsp_error_code code, const char *message) {
+  JsonWriter *writer = &context->writer;
+  json_writer_reset(writer);
+
+  json_writer_begin_object(writer);
+  json_writer_key(writer, "jsonrpc");
+  json_writer_string_c(writer, "2.0");
+  json_writer_key(writer, "id");
+  json_writer_int(writer, id);
+  json_writer_key(writer, "error");
+  json_writer_begin_object(writer);
+  json_writer_key(writer, "code");
+  json_writer_int(writer, code);
+  json_writer_key(writer, "message");
+  json_writer_string_c(writer, message);
+  json_writer_end_object(writer);
+
+  return response_send(context);
+}
+
+// `response_invalid_params` logs the `message` and answers the request `id`
+// with it as an LSP_ERROR_INVALID_PARAMS error.
+static lsp_status response_invalid_params(lsp_context *context, int32_t id,
+                                          const char *message) {
+  fdn_error("%s", message);
+  if (response_error(context, id, LSP_ERROR_INVALID_PARAMS, message) == -1) {
+    return LSP_STATUS_EXIT;
+  }
+  return LSP_STATUS_CONTINUE;
+}
+
 //////////////////////////////////////////////////////////////
 /////// LSP REQUEST MESSAGE HANDLERS - IMPLEMENTATIONS ///////
 //////////////////////////////////////////////////////////////
 
-lsp_status handle_initialize(int32_t id, fdn_string params) {
-  (void)params;
+static void workspace_start(fdn_arena *arena, fdn_string params);
+static bool tape_get_text(fdn_arena *arena, const JsonTape *tape,
+                          uint32_t index, fdn_string *text);
+static bool tape_get_position(const JsonTape *tape, uint32_t object,
+                              const char *key, lsp_position *position);
+
+// position_params_find picks the `values` of every position_param out of the
+// `params`. Returns `false` if the params are not valid JSON.
+static bool position_params_find(fdn_string params, JsonValue *values) {
+  return params.string_start != NULL &&
+         parser_find_paths(params, g_position_params, POSITION_PARAM_COUNT,
+                           values);
+}
+
+static bool value_get_uint32(const JsonValue *value, uint32_t *out) {
+  int64_t number = 0;
+  if (!json_value_get_int64(value, &number) || number < 0 ||
+      number > UINT32_MAX) {
+    return false;
+  }
 
-  // TODO: Parse the initialize request meessage
-  
-  const char *result = "{\"capabilities\":{}}";
+  *out = (uint32_t)number;
+  return true;
+}
+
+// position_params_get reads the uri of the document, unescaped into the
+// `arena`, and the position out of the `values`.
+static bool position_params_get(fdn_arena *arena, const JsonValue *values,
+                                fdn_string *uri, lsp_position *position) {
+  const JsonValue *uri_value = &values[POSITION_PARAM_URI];
+  return uri_value->found && uri_value->type == JSON_STRING &&
+         json_string_unescape_to_arena(arena, uri_value->literal, uri) &&
+         value_get_uint32(&values[POSITION_PARAM_LINE], &position->line) &&
+         value_get_uint32(&values[POSITION_PARAM_CHARACTER],
+                          &position->character);
+}
+
+lsp_status handle_initialize(lsp_context *context, int32_t id,
+                             fdn_string params) {
+  fdn_arena *arena = context->arena;
+  // Indexing runs in the background; the response does not wait for it.
+  workspace_start(arena, params);
+
+  JsonWriter *result = response_begin(context, id);
+  json_writer_begin_object(result);
+  json_writer_key(result, "capabilities");
+  json_writer_begin_object(result);
 
-  if (send_response(id, result) == -1) {
+  // Documents are synced incrementally; only the edited ranges are sent.
+  json_writer_key(result, "textDocumentSync");
+  json_writer_begin_object(result);
+  json_writer_key(result, "openClose");
+  json_writer_bool(result, true);
+  json_writer_key(result, "change");
+  json_writer_int(result, 2); // TextDocumentSyncKind.Incremental
+  json_writer_end_object(result);
+
+  json_writer_key(result, "workspaceSymbolProvider");
+  json_writer_bool(result, true);
+  json_writer_key(result, "definitionProvider");
+  json_writer_bool(result, true);
+  json_writer_key(result, "referencesProvider");
+  json_writer_bool(result, true);
+
+  // Members of the globals are completed after a dot.
+  json_writer_key(result, "completionProvider");
+  json_writer_begin_object(result);
+  json_writer_key(result, "triggerCharacters");
+  json_writer_begin_array(result);
+  json_writer_string_c(result, ".");
+  json_writer_end_array(result);
+  json_writer_end_object(result);
+
+  json_writer_end_object(result);
+  json_writer_end_object(result);
+
+  if (response_send(context) == -1) {
     return LSP_STATUS_EXIT;
   }
 
   return LSP_STATUS_CONTINUE;
 }
 
-lsp_status handle_shutdown(int32_t id, fdn_string params) {
+lsp_status handle_shutdown(lsp_context *context, int32_t id,
+                           fdn_string params) {
   (void)params;
   g_shutdown_requested = true;
 
-  const char *response = "{"
-                         "\"jsonrpc\": \"2.0\","
-                         "\"id\": 2,"
-                         "\"result\":null"
-                         "}";
+  json_writer_null(response_begin(context, id));
+
+  if (response_send(context) == -1) {
+    return LSP_STATUS_EXIT;
+  }
+
+  return LSP_STATUS_CONTINUE;
+}
+
+// write_location writes the Location of a name of `length` bytes at `start`.
+// The range covers the name; Solidity identifiers are ASCII, so its length in
+// UTF-16 code units is its length in bytes.
+static void write_location(JsonWriter *writer, fdn_string uri,
+                           lsp_position start, uint32_t length) {
+  json_writer_begin_object(writer);
+  json_writer_key(writer, "uri");
+  json_writer_string(writer, uri);
+  json_writer_key(writer, "range");
+  json_writer_begin_object(writer);
+  json_writer_key(writer, "start");
+  json_writer_begin_object(writer);
+  json_writer_key(writer, "line");
+  json_writer_int(writer, start.line);
+  json_writer_key(writer, "character");
+  json_writer_int(writer, start.character);
+  json_writer_end_object(writer);
+  json_writer_key(writer, "end");
+  json_writer_begin_object(writer);
+  json_writer_key(writer, "line");
+  json_writer_int(writer, start.line);
+  json_writer_key(writer, "character");
+  json_writer_int(writer, (int64_t)start.character + length);
+  json_writer_end_object(writer);
+  json_writer_end_object(writer);
+  json_writer_end_object(writer);
+}
+
+// document_path_id returns the interned path of the open `document` if the
+// workspace index has a file there, or FDN_INTERNER_NONE. The client's text
+// is newer than that file, so it takes precedence over the index.
+static uint32_t document_path_id(fdn_arena *arena,
+                                 const lsp_document *document) {
+  fdn_string path;
+  if (!lsp_uri_to_path(arena, document->uri, &path)) {
+    return FDN_INTERNER_NONE;
+  }
+  return fdn_interner_find(&g_workspace.names, path);
+}
+
+// The most symbols a `workspace/symbol` response lists. Clients ask again as
+// the query grows, so the best few are enough.
+#define WORKSPACE_SYMBOL_LIMIT 256
+
+typedef struct {
+  fdn_string name;
+  fdn_string container;
+  fdn_string uri;
+  uint32_t line;
+  uint32_t character;
+  uint8_t kind;
+  int32_t score;
+} symbol_result;
+
+// compare_symbol_results orders the best matches first, and equal ones by
+// name.
+static int compare_symbol_results(const void *left, const void *right) {
+  const symbol_result *a = left;
+  const symbol_result *b = right;
+  if (a->score != b->score) {
+    return a->score > b->score ? -1 : 1;
+  }
+  size_t length = a->name.string_length < b->name.string_length
+                      ? a->name.string_length
+                      : b->name.string_length;
+  int order = memcmp(a->name.string_start, b->name.string_start, length);
+  if (order != 0) {
+    return order;
+  }
+  return (a->name.string_length > b->name.string_length) -
+         (a->name.string_length < b->name.string_length);
+}
+
+// open_document_symbols adds the declarations of the open `document` that
+// match the `query` to the `results`, which have room for `capacity`.
+static uint32_t open_document_symbols(fdn_arena *arena,
+                                      lsp_document *document,
+                                      fdn_string query,
+                                      symbol_result *results, uint32_t count,
+                                      uint32_t capacity) {
+  const SolSyntax *syntax = lsp_document_syntax(document);
+  fdn_string text = lsp_document_text(document, arena);
+  lsp_declaration_list declarations = {0};
+  if (text.string_length != lsp_document_length(document) ||
+      !lsp_declarations_collect(syntax, text, &declarations)) {
+    lsp_declaration_list_free(&declarations);
+    return count;
+  }
+
+  for (uint32_t i = 0; i < declarations.count && count < capacity; i++) {
+    const lsp_declaration *declaration = &declarations.items[i];
+    int32_t score = lsp_symbol_score(query, declaration->name);
+    if (score < 0) {
+      continue;
+    }
+    symbol_result *result = &results[count++];
+    result->name = declaration->name;
+    result->container = declaration->container;
+    result->uri = document->uri;
+    result->line = declaration->line;
+    result->character = declaration->character;
+    result->kind = declaration->kind;
+    result->score = score;
+  }
+
+  lsp_declaration_list_free(&declarations);
+  return count;
+}
+
+// workspace_symbols adds the symbols of the workspace index that match the
+// `query` to the `results`, leaving out the files whose interned path is one
+// of the `shadowed` ones.
+static uint32_t workspace_symbols(fdn_arena *arena, fdn_string query,
+                                  const uint32_t *shadowed,
+                                  uint32_t shadowed_count,
+                                  symbol_result *results, uint32_t count,
+                                  uint32_t capacity) {
+  const lsp_symbol_index *index = &g_workspace.symbols;
+  const fdn_interner *names = &g_workspace.names;
+  lsp_symbol_match *matches =
+      fdn_arena_alloc(arena, WORKSPACE_SYMBOL_LIMIT * sizeof(lsp_symbol_match));
+  if (matches == NULL) {
+    return count;
+  }
+
+  uint32_t match_count = lsp_symbol_index_search(index, arena, query, matches,
+                                                 WORKSPACE_SYMBOL_LIMIT);
+  for (uint32_t m = 0; m < match_count; m++) {
+    uint32_t name = matches[m].name;
+    for (uint32_t s = index->name_starts[name];
+         s < index->name_starts[name + 1] && count < capacity; s++) {
+      const lsp_symbol *symbol = &index->symbols[s];
+      const lsp_workspace_file *file = &g_workspace.files[symbol->file];
+      bool is_shadowed = false;
+      for (uint32_t i = 0; i < shadowed_count && !is_shadowed; i++) {
+        is_shadowed = shadowed[i] == file->path_id;
+      }
+      fdn_string path = {file->path, strlen(file->path)};
+      symbol_result *result = &results[count];
+      if (is_shadowed || !lsp_path_to_uri(arena, path, &result->uri)) {
+        continue;
+      }
+
+      result->name = fdn_interner_string(names, symbol->name);
+      result->container = symbol->container == FDN_INTERNER_NONE
+                              ? (fdn_string){NULL, 0}
+                              : fdn_interner_string(names, symbol->container);
+      result->line = symbol->line;
+      result->character = symbol->character;
+      result->kind = symbol->kind;
+      result->score = matches[m].score;
+      count++;
+    }
+  }
+  return count;
+}
+
+// handle_workspace_symbol answers with the symbols whose names match the
+// query best. Until the workspace is indexed only the open documents are
+// searched.
+lsp_status handle_workspace_symbol(lsp_context *context, int32_t id,
+                                   fdn_string params) {
+  fdn_arena *arena = context->arena;
+  JsonTape tape;
+  fdn_string query = {"", 0};
+  if (!parser_parse_tape(arena, params, &tape)) {
+    return response_invalid_params(context, id,
+                                   "Invalid workspace/symbol params.");
+  }
+  uint32_t query_index = json_tape_object_get(&tape, 0, "query");
+  if (query_index != JSON_TAPE_NONE &&
+      !tape_get_text(arena, &tape, query_index, &query)) {
+    return response_invalid_params(context, id,
+                                   "Invalid workspace/symbol query.");
+  }
+
+  // Every open document may contribute a full page of its own.
+  uint32_t capacity = (g_documents.count + 1) * WORKSPACE_SYMBOL_LIMIT;
+  symbol_result *results =
+      fdn_arena_alloc(arena, capacity * sizeof(symbol_result));
+  uint32_t *shadowed =
+      fdn_arena_alloc(arena, (g_documents.count + 1) * sizeof(uint32_t));
+  uint32_t count = 0;
+  uint32_t shadowed_count = 0;
+  bool indexed = lsp_workspace_is_done(&g_workspace);
+  for (uint32_t i = 0; results != NULL && shadowed != NULL &&
+                       !lsp_context_cancelled(context) &&
+                       i < g_documents.capacity;
+       i++) {
+    lsp_document *document = g_documents.slots[i];
+    if (document == NULL) {
+      continue;
+    }
+    count = open_document_symbols(arena, document, query, results, count,
+                                  count + WORKSPACE_SYMBOL_LIMIT);
+
+    uint32_t path_id =
+        indexed ? document_path_id(arena, document) : FDN_INTERNER_NONE;
+    if (path_id != FDN_INTERNER_NONE) {
+      shadowed[shadowed_count++] = path_id;
+    }
+  }
+  if (indexed && results != NULL && shadowed != NULL &&
+      !lsp_context_cancelled(context)) {
+    count = workspace_symbols(arena, query, shadowed, shadowed_count, results,
+                              count, capacity);
+  }
+  if (lsp_context_cancelled(context)) {
+    return LSP_STATUS_CONTINUE;
+  }
+
+  qsort(results, count, sizeof(symbol_result), compare_symbol_results);
+  if (count > WORKSPACE_SYMBOL_LIMIT) {
+    count = WORKSPACE_SYMBOL_LIMIT;
+  }
+
+  JsonWriter *writer = response_begin(context, id);
+  json_writer_begin_array(writer);
+  for (uint32_t i = 0; i < count; i++) {
+    const symbol_result *result = &results[i];
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "name");
+    json_writer_string(writer, result->name);
+    json_writer_key(writer, "kind");
+    json_writer_int(writer, result->kind);
+
+    json_writer_key(writer, "location");
+    write_location(writer, result->uri,
+                   (lsp_position){result->line, result->character},
+                   (uint32_t)result->name.string_length);
+
+    if (result->container.string_length > 0) {
+      json_writer_key(writer, "containerName");
+      json_writer_string(writer, result->container);
+    }
+    json_writer_end_object(writer);
+  }
+  json_writer_end_array(writer);
+
+  if (response_send(context) == -1) {
+    return LSP_STATUS_EXIT;
+  }
+
+  return LSP_STATUS_CONTINUE;
+}
+
+// The most items a completion response lists. The list is marked incomplete
+// beyond that, so the client asks again as the prefix grows.
+#define COMPLETION_LIMIT 200
+
+lsp_status handle_completion(lsp_context *context, int32_t id,
+                             fdn_string params) {
+  fdn_arena *arena = context->arena;
+  JsonValue values[POSITION_PARAM_COUNT];
+  fdn_string uri;
+  lsp_position position;
+  if (!position_params_find(params, values) ||
+      !position_params_get(arena, values, &uri, &position)) {
+    return response_invalid_params(context, id, "Invalid completion params.");
+  }
+
+  lsp_completion_list list = {0};
+  lsp_document *document = lsp_document_find(&g_documents, uri);
+  if (document == NULL) {
+    fdn_error("Completion for %.*s which is not open.", (int)uri.string_length,
+              uri.string_start);
+  } else if (!lsp_completion_collect(document, position, arena,
+                                     COMPLETION_LIMIT, &list)) {
+    fdn_error("Ran out of memory while completing in %.*s.",
+              (int)uri.string_length, uri.string_start);
+  }
+  if (lsp_context_cancelled(context)) {
+    return LSP_STATUS_CONTINUE;
+  }
+
+  JsonWriter *writer = response_begin(context, id);
+  json_writer_begin_object(writer);
+  json_writer_key(writer, "isIncomplete");
+  json_writer_bool(writer, list.incomplete);
+  json_writer_key(writer, "items");
+  json_writer_begin_array(writer);
+  for (uint32_t i = 0; i < list.count; i++) {
+    const lsp_completion_item *item = &list.items[i];
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "label");
+    json_writer_string(writer, item->label);
+    json_writer_key(writer, "kind");
+    json_writer_int(writer, item->kind);
+    if (item->detail != NULL) {
+      json_writer_key(writer, "detail");
+      json_writer_string_c(writer, item->detail);
+    }
+    json_writer_end_object(writer);
+  }
+  json_writer_end_array(writer);
+  json_writer_end_object(writer);
+
+  if (response_send(context) == -1) {
+    return LSP_STATUS_EXIT;
+  }
+
+  return LSP_STATUS_CONTINUE;
+}
+
+// A name that a definition or references response points to.
+typedef struct {
+  fdn_string uri;
+  lsp_position start;
+  bool qualified; // Declared in the contract named before the dot.
+} location_result;
+
+typedef struct {
+  location_result *items;
+  uint32_t count;
+  uint32_t capacity;
+} location_list;
 
-  printf("Content-Length: %zu\r\n", strlen(response));
-  printf("\r\n");
-  printf("%s", response);
-  fflush(stdout);
-  send_response(id, "null");
+static bool locations_push(fdn_arena *arena, location_list *list,
+                           location_result location) {
+  if (list->count == list->capacity) {
+    uint32_t capacity = list->capacity > 0 ? list->capacity * 2 : 64;
+    location_result *items =
+        fdn_arena_alloc(arena, capacity * sizeof(location_result));
+    if (items == NULL) {
+      return false;
+    }
+    if (list->count > 0) {
+      memcpy(items, list->items, list->count * sizeof(location_result));
+    }
+    list->items = items;
+    list->capacity = capacity;
+  }
+
+  list->items[list->count++] = location;
+  return true;
+}
+
+// The identifier under the cursor of a definition or references request.
+typedef struct {
+  lsp_document *document;
+  fdn_string name;
+  fdn_string qualifier; // The identifier before a dot before it, or empty.
+} reference_target;
+
+// reference_target_parse finds the identifier at the `position` of the
+// `document`. Returns `false` if there is none.
+static bool reference_target_parse(fdn_arena *arena, lsp_document *document,
+                                   lsp_position position,
+                                   reference_target *target) {
+  const SolSyntax *syntax = lsp_document_syntax(document);
+  const SolTokenList *tokens = &syntax->tokens;
+  uint32_t token =
+      lsp_identifier_at(syntax, lsp_document_offset_at(document, position));
+  if (token == LSP_REFERENCE_NONE) {
+    return false;
+  }
+
+  target->document = document;
+  target->name = lsp_document_text_range(document, tokens->starts[token],
+                                         tokens->lengths[token], arena);
+  target->qualifier = (fdn_string){"", 0};
+  if (token >= 2 && tokens->types[token - 1] == SOL_TOKEN_DOT &&
+      tokens->types[token - 2] == SOL_TOKEN_IDENTIFIER) {
+    target->qualifier = lsp_document_text_range(
+        document, tokens->starts[token - 2], tokens->lengths[token - 2], arena);
+  }
+  return target->name.string_length == tokens->lengths[token];
+}
+
+// request_document reads the document and position of a definition or
+// references request out of the `values` of its params.
+static bool request_document(fdn_arena *arena, const char *method,
+                             const JsonValue *values, lsp_document **document,
+                             lsp_position *position) {
+  fdn_string uri;
+  if (!position_params_get(arena, values, &uri, position)) {
+    fdn_error("Invalid %s params.", method);
+    return false;
+  }
+
+  *document = lsp_document_find(&g_documents, uri);
+  if (*document == NULL) {
+    fdn_error("%s in %.*s which is not open.", method, (int)uri.string_length,
+              uri.string_start);
+    return false;
+  }
+  return true;
+}
+
+// request_target finds the identifier at the position of a definition or
+// references request.
+static bool request_target(fdn_arena *arena, const char *method,
+                           const JsonValue *values, reference_target *target) {
+  lsp_document *document;
+  lsp_position position;
+  return request_document(arena, method, values, &document, &position) &&
+         reference_target_parse(arena, document, position, target);
+}
+
+// open_document_declarations collects the declarations of the open
+// `document`, or returns `false`.
+static bool open_document_declarations(fdn_arena *arena,
+                                       lsp_document *document,
+                                       lsp_declaration_list *declarations) {
+  const SolSyntax *syntax = lsp_document_syntax(document);
+  fdn_string text = lsp_document_text(document, arena);
+  return text.string_length == lsp_document_length(document) &&
+         lsp_declarations_collect(syntax, text, declarations);
+}
+
+// collect_definitions adds the declarations named like the `target` in the
+// open documents and in the files of the workspace index that are not open.
+// It stops early if the request is cancelled.
+static bool collect_definitions(lsp_context *context,
+                                const reference_target *target,
+                                location_list *list) {
+  fdn_arena *arena = context->arena;
+  uint32_t *shadowed =
+      fdn_arena_alloc(arena, (g_documents.count + 1) * sizeof(uint32_t));
+  if (shadowed == NULL) {
+    return false;
+  }
+  uint32_t shadowed_count = 0;
+  bool indexed = lsp_workspace_is_done(&g_workspace);
+
+  for (uint32_t i = 0; i < g_documents.capacity; i++) {
+    lsp_document *document = g_documents.slots[i];
+    if (document == NULL) {
+      continue;
+    }
+    if (lsp_context_cancelled(context)) {
+      return true;
+    }
+    uint32_t path_id =
+        indexed ? document_path_id(arena, document) : FDN_INTERNER_NONE;
+    if (path_id != FDN_INTERNER_NONE) {
+      shadowed[shadowed_count++] = path_id;
+    }
+
+    lsp_declaration_list declarations = {0};
+    bool collected = open_document_declarations(arena, document, &declarations);
+    for (uint32_t d = 0; collected && d < declarations.count; d++) {
+      const lsp_declaration *declaration = &declarations.items[d];
+      location_result location = {
+          document->uri,
+          {declaration->line, declaration->character},
+          target->qualifier.string_length > 0 &&
+              fdn_string_is_eq(declaration->container, target->qualifier)};
+      if (fdn_string_is_eq(declaration->name, target->name)) {
+        collected = locations_push(arena, list, location);
+      }
+    }
+    lsp_declaration_list_free(&declarations);
+    if (!collected) {
+      return false;
+    }
+  }
+  if (!indexed) {
+    return true;
+  }
+
+  const lsp_symbol_index *index = &g_workspace.symbols;
+  uint32_t name = lsp_symbol_index_find(index, target->name);
+  uint32_t qualifier =
+      target->qualifier.string_length > 0
+          ? fdn_interner_find(&g_workspace.names, target->qualifier)
+          : FDN_INTERNER_NONE;
+  for (uint32_t s = name != LSP_SYMBOL_NONE ? index->name_starts[name] : 0;
+       name != LSP_SYMBOL_NONE && s < index->name_starts[name + 1]; s++) {
+    const lsp_symbol *symbol = &index->symbols[s];
+    const lsp_workspace_file *file = &g_workspace.files[symbol->file];
+    bool is_shadowed = false;
+    for (uint32_t i = 0; i < shadowed_count && !is_shadowed; i++) {
+      is_shadowed = shadowed[i] == file->path_id;
+    }
+    fdn_string path = {file->path, strlen(file->path)};
+    location_result location = {
+        {NULL, 0},
+        {symbol->line, symbol->character},
+        qualifier != FDN_INTERNER_NONE && symbol->container == qualifier};
+    if (is_shadowed) {
+      continue;
+    }
+    if (!lsp_path_to_uri(arena, path, &location.uri) ||
+        !locations_push(arena, list, location)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// import_definition adds the start of the file that the path of an import
+// under the cursor resolves to, if the workspace has it. Returns `false` if the
+// cursor is not on the path of an import.
+static bool import_definition(fdn_arena *arena, lsp_document *document,
+                              lsp_position position, location_list *list) {
+  const SolSyntax *syntax = lsp_document_syntax(document);
+  uint32_t token =
+      lsp_import_at(syntax, lsp_document_offset_at(document, position));
+  if (token == LSP_IMPORT_NONE) {
+    return false;
+  }
+
+  fdn_string importer;
+  if (!lsp_workspace_is_done(&g_workspace) ||
+      !lsp_uri_to_path(arena, document->uri, &importer)) {
+    return true;
+  }
+  fdn_string text =
+      lsp_document_text_range(document, syntax->tokens.starts[token],
+                              syntax->tokens.lengths[token], arena);
+  uint32_t file = lsp_import_graph_resolve(&g_workspace.imports, arena,
+                                           importer, lsp_import_unquote(text));
+  if (file == LSP_IMPORT_NONE) {
+    return true;
+  }
+
+  // Files opened since the indexing are only in the graph.
+  const char *path = g_workspace.imports.paths[file];
+  location_result location = {{NULL, 0}, {0, 0}, false};
+  if (!lsp_path_to_uri(arena, fdn_string_create_view(path, strlen(path)),
+                       &location.uri) ||
+      !locations_push(arena, list, location)) {
+    fdn_error("Ran out of memory while resolving the import of %s.", path);
+  }
+  return true;
+}
+
+// handle_definition answers with the declarations of the name under the
+// cursor. After `A.`, only those declared in a contract named `A` are listed,
+// if there are any. On the path of an import, it answers with the file
+// imported.
+lsp_status handle_definition(lsp_context *context, int32_t id,
+                             fdn_string params) {
+  fdn_arena *arena = context->arena;
+  JsonValue values[POSITION_PARAM_COUNT];
+  lsp_document *document;
+  lsp_position position;
+  reference_target target = {NULL, {"", 0}, {"", 0}};
+  location_list list = {0};
+  if (!position_params_find(params, values)) {
+    return response_invalid_params(context, id, "Invalid definition params.");
+  }
+  if (request_document(arena, "definition", values, &document, &position) &&
+      !import_definition(arena, document, position, &list) &&
+      reference_target_parse(arena, document, position, &target) &&
+      !collect_definitions(context, &target, &list)) {
+    fdn_error("Ran out of memory while looking up the definitions of %.*s.",
+              (int)target.name.string_length, target.name.string_start);
+  }
+  if (lsp_context_cancelled(context)) {
+    return LSP_STATUS_CONTINUE;
+  }
+
+  bool qualified = false;
+  for (uint32_t i = 0; i < list.count && !qualified; i++) {
+    qualified = list.items[i].qualified;
+  }
+
+  JsonWriter *writer = response_begin(context, id);
+  json_writer_begin_array(writer);
+  for (uint32_t i = 0; i < list.count; i++) {
+    const location_result *location = &list.items[i];
+    if (location->qualified || !qualified) {
+      write_location(writer, location->uri, location->start,
+                     (uint32_t)target.name.string_length);
+    }
+  }
+  json_writer_end_array(writer);
+
+  if (response_send(context) == -1) {
+    return LSP_STATUS_EXIT;
+  }
+
+  return LSP_STATUS_CONTINUE;
+}
+
+// is_declared tells whether a declaration of the `name` is at `start` in the
+// file at `file_index` of the workspace; `name` is its index in the symbol
+// index.
+static bool is_declared(uint32_t name, uint32_t file_index,
+                        lsp_position start) {
+  const lsp_symbol_index *index = &g_workspace.symbols;
+  for (uint32_t s = name != LSP_SYMBOL_NONE ? index->name_starts[name] : 0;
+       name != LSP_SYMBOL_NONE && s < index->name_starts[name + 1]; s++) {
+    const lsp_symbol *symbol = &index->symbols[s];
+    if (symbol->file == file_index && symbol->line == start.line &&
+        symbol->character == start.character) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// open_document_references adds the identifiers of the open `document`
+// spelled like the `target`.
+static bool open_document_references(fdn_arena *arena, lsp_document *document,
+                                     const reference_target *target,
+                                     bool include_declarations,
+                                     location_list *list) {
+  const SolSyntax *syntax = lsp_document_syntax(document);
+  const SolTokenList *tokens = &syntax->tokens;
+  fdn_string text = lsp_document_text(document, arena);
+  lsp_declaration_list declarations = {0};
+  bool pushed = text.string_length == lsp_document_length(document) &&
+                lsp_declarations_collect(syntax, text, &declarations);
+  for (uint32_t token = 0; pushed && token < tokens->count; token++) {
+    if (tokens->types[token] != SOL_TOKEN_IDENTIFIER ||
+        !fdn_string_is_eq(sol_token_text(tokens, &text, token), target->name)) {
+      continue;
+    }
+
+    location_result location = {
+        document->uri,
+        lsp_document_position_at(document, tokens->starts[token]), false};
+    bool declared = false;
+    for (uint32_t d = 0; !include_declarations && !declared &&
+                         d < declarations.count;
+         d++) {
+      declared = declarations.items[d].line == location.start.line &&
+                 declarations.items[d].character == location.start.character;
+    }
+    if (!declared) {
+      pushed = locations_push(arena, list, location);
+    }
+  }
+
+  lsp_declaration_list_free(&declarations);
+  return pushed;
+}
+
+// workspace_references adds the occurrences of the `target` in the files of
+// the workspace index, leaving out the `shadowed` ones. They are decoded from
+// the reference index, grouped by file, without reading any source. It stops
+// early if the request is cancelled.
+static bool workspace_references(lsp_context *context,
+                                 const reference_target *target,
+                                 bool include_declarations,
+                                 const uint32_t *shadowed,
+                                 uint32_t shadowed_count,
+                                 location_list *list) {
+  fdn_arena *arena = context->arena;
+  const lsp_reference_index *index = &g_workspace.references;
+  uint32_t name = fdn_interner_find(&g_workspace.names, target->name);
+  uint32_t count = lsp_reference_index_count(index, name);
+  if (count == 0) {
+    return true;
+  }
+
+  lsp_reference *references =
+      fdn_arena_alloc(arena, count * sizeof(lsp_reference));
+  if (references == NULL) {
+    return false;
+  }
+  count = lsp_reference_index_find(index, name, references);
+  uint32_t symbol_name =
+      include_declarations
+          ? LSP_SYMBOL_NONE
+          : lsp_symbol_index_find(&g_workspace.symbols, target->name);
+
+  uint32_t previous_file = LSP_REFERENCE_NONE;
+  location_result location = {{NULL, 0}, {0, 0}, false};
+  bool is_shadowed = false;
+  for (uint32_t r = 0; r < count; r++) {
+    uint32_t file_index = references[r].file;
+    const lsp_workspace_file *file = &g_workspace.files[file_index];
+    if (file_index != previous_file) {
+      if (lsp_context_cancelled(context)) {
+        return true;
+      }
+      previous_file = file_index;
+      is_shadowed = false;
+      for (uint32_t i = 0; i < shadowed_count && !is_shadowed; i++) {
+        is_shadowed = shadowed[i] == file->path_id;
+      }
+      fdn_string path = {file->path, strlen(file->path)};
+      if (!is_shadowed && !lsp_path_to_uri(arena, path, &location.uri)) {
+        return false;
+      }
+    }
+
+    location.start = references[r].position;
+    if (!is_shadowed && !is_declared(symbol_name, file_index, location.start) &&
+        !locations_push(arena, list, location)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// handle_references answers with every identifier spelled like the one under
+// the cursor. Until the workspace is indexed only the open documents are
+// searched.
+lsp_status handle_references(lsp_context *context, int32_t id,
+                             fdn_string params) {
+  fdn_arena *arena = context->arena;
+  JsonValue values[POSITION_PARAM_COUNT];
+  reference_target target;
+  location_list list = {0};
+  if (!position_params_find(params, values)) {
+    return response_invalid_params(context, id, "Invalid references params.");
+  }
+
+  const JsonValue *include = &values[POSITION_PARAM_INCLUDE_DECLARATION];
+  bool include_declarations = !include->found || include->type != JSON_FALSE;
+  uint32_t *shadowed =
+      fdn_arena_alloc(arena, (g_documents.count + 1) * sizeof(uint32_t));
+  uint32_t shadowed_count = 0;
+  bool indexed = lsp_workspace_is_done(&g_workspace);
+  bool found = request_target(arena, "references", values, &target);
+  bool collected = shadowed != NULL;
+  for (uint32_t i = 0; found && collected && !lsp_context_cancelled(context) &&
+                       i < g_documents.capacity;
+       i++) {
+    lsp_document *document = g_documents.slots[i];
+    if (document == NULL) {
+      continue;
+    }
+    uint32_t path_id =
+        indexed ? document_path_id(arena, document) : FDN_INTERNER_NONE;
+    if (path_id != FDN_INTERNER_NONE) {
+      shadowed[shadowed_count++] = path_id;
+    }
+    collected = open_document_references(arena, document, &target,
+                                          include_declarations, &list);
+  }
+  if (found && collected && indexed) {
+    collected = workspace_references(context, &target, include_declarations,
+                                     shadowed, shadowed_count, &list);
+  }
+  if (found && !collected) {
+    fdn_error("Ran out of memory while looking up the references of %.*s.",
+              (int)target.name.string_length, target.name.string_start);
+  }
+  if (lsp_context_cancelled(context)) {
+    return LSP_STATUS_CONTINUE;
+  }
+
+  JsonWriter *writer = response_begin(context, id);
+  json_writer_begin_array(writer);
+  for (uint32_t i = 0; found && i < list.count; i++) {
+    write_location(writer, list.items[i].uri, list.items[i].start,
+                   (uint32_t)target.name.string_length);
+  }
+  json_writer_end_array(writer);
+
+  if (response_send(context) == -1) {
+    return LSP_STATUS_EXIT;
+  }
 
   return LSP_STATUS_CONTINUE;
 }
 
-lsp_status handle_exit(int32_t id, fdn_string params) {
+lsp_status handle_exit(lsp_context *context, int32_t id, fdn_string params) {
+  (void)context;
   (void)id;
   (void)params;
 
@@ -144,3 +1243,223 @@ lsp_status handle_exit(int32_t id, fdn_string params) {
   // then signal exit to the process.
   return LSP_STATUS_EXIT;
 }
+
+//////////////////////////////////////////////////////////////
+///////////// LSP NOTIFICATIONS - IMPLEMENTATIONS ////////////
+//////////////////////////////////////////////////////////////
+
+// tape_get_text unescapes the string at `index` into the `arena`.
+static bool tape_get_text(fdn_arena *arena, const JsonTape *tape,
+                          uint32_t index, fdn_string *text) {
+  if (index == JSON_TAPE_NONE || json_tape_type(tape, index) != JSON_STRING) {
+    return false;
+  }
+
+  return json_string_unescape_to_arena(arena, json_tape_get_string(tape, index),
+                                       text);
+}
+
+static bool tape_get_uint32(const JsonTape *tape, uint32_t index,
+                            uint32_t *out) {
+  int64_t value = 0;
+  if (index == JSON_TAPE_NONE || !json_tape_get_int64(tape, index, &value) ||
+      value < 0 || value > UINT32_MAX) {
+    return false;
+  }
+
+  *out = (uint32_t)value;
+  return true;
+}
+
+// tape_get_position reads a `Position` object stored under `key`.
+static bool tape_get_position(const JsonTape *tape, uint32_t object,
+                              const char *key, lsp_position *position) {
+  uint32_t index = json_tape_object_get(tape, object, key);
+  return tape_get_uint32(tape, json_tape_object_get(tape, index, "line"),
+                         &position->line) &&
+         tape_get_uint32(tape, json_tape_object_get(tape, index, "character"),
+                         &position->character);
+}
+
+// workspace_start starts indexing the folders of the initialize `params`:
+// the `workspaceFolders`, or else the `rootUri`, or else the `rootPath`. The
+// index is cached in the user's cache directory across restarts.
+static void workspace_start(fdn_arena *arena, fdn_string params) {
+  JsonTape tape;
+  if (!parser_parse_tape(arena, params, &tape)) {
+    fdn_error("Invalid initialize params.");
+    return;
+  }
+
+  fdn_string folders[64];
+  uint32_t count = 0;
+  uint32_t list = json_tape_object_get(&tape, 0, "workspaceFolders");
+  if (list != JSON_TAPE_NONE && json_tape_type(&tape, list) == JSON_ARRAY) {
+    uint32_t folder = list + 1;
+    for (uint32_t i = 0; i < tape.entries[list].size &&
+                         count < sizeof(folders) / sizeof(folders[0]);
+         i++) {
+      fdn_string uri;
+      uint32_t uri_index = json_tape_object_get(&tape, folder, "uri");
+      if (tape_get_text(arena, &tape, uri_index, &uri) &&
+          lsp_uri_to_path(arena, uri, &folders[count])) {
+        count++;
+      }
+      folder = tape.entries[folder].next;
+    }
+  }
+
+  fdn_string root;
+  if (count == 0 &&
+      tape_get_text(arena, &tape, json_tape_object_get(&tape, 0, "rootUri"),
+                    &root) &&
+      lsp_uri_to_path(arena, root, &folders[count])) {
+    count++;
+  }
+  if (count == 0 && tape_get_text(arena, &tape,
+                                  json_tape_object_get(&tape, 0, "rootPath"),
+                                  &folders[count])) {
+    count++;
+  }
+
+  if (count == 0) {
+    fdn_info("No workspace folders to index.");
+    return;
+  }
+  fdn_string cache_path;
+  bool cached = lsp_cache_path(arena, folders, count, &cache_path);
+  if (!lsp_workspace_start(&g_workspace, folders, count, 0,
+                           cached ? cache_path.string_start : NULL)) {
+    fdn_error("Failed to start indexing the workspace.");
+  }
+}
+
+lsp_status handle_did_open(lsp_context *context, int32_t id,
+                           fdn_string params) {
+  fdn_arena *arena = context->arena;
+  (void)id;
+
+  JsonTape tape;
+  if (!parser_parse_tape(arena, params, &tape)) {
+    fdn_error("Invalid didOpen params.");
+    return LSP_STATUS_CONTINUE;
+  }
+
+  uint32_t text_document = json_tape_object_get(&tape, 0, "textDocument");
+  fdn_string uri;
+  fdn_string text;
+  int64_t version = 0;
+  if (!tape_get_text(arena, &tape,
+                     json_tape_object_get(&tape, text_document, "uri"), &uri) ||
+      !tape_get_text(arena, &tape,
+                     json_tape_object_get(&tape, text_document, "text"),
+                     &text) ||
+      !json_tape_get_int64(
+          &tape, json_tape_object_get(&tape, text_document, "version"),
+          &version)) {
+    fdn_error("Invalid didOpen params.");
+    return LSP_STATUS_CONTINUE;
+  }
+
+  if (lsp_document_open(&g_documents, uri, version, text) == NULL) {
+    fdn_error("Failed to open %.*s.", (int)uri.string_length, uri.string_start);
+  }
+
+  return LSP_STATUS_CONTINUE;
+}
+
+lsp_status handle_did_change(lsp_context *context, int32_t id,
+                             fdn_string params) {
+  fdn_arena *arena = context->arena;
+  (void)id;
+
+  JsonTape tape;
+  if (!parser_parse_tape(arena, params, &tape)) {
+    fdn_error("Invalid didChange params.");
+    return LSP_STATUS_CONTINUE;
+  }
+
+  uint32_t text_document = json_tape_object_get(&tape, 0, "textDocument");
+  uint32_t changes = json_tape_object_get(&tape, 0, "contentChanges");
+  fdn_string uri;
+  int64_t version = 0;
+  if (!tape_get_text(arena, &tape,
+                     json_tape_object_get(&tape, text_document, "uri"), &uri) ||
+      !json_tape_get_int64(
+          &tape, json_tape_object_get(&tape, text_document, "version"),
+          &version) ||
+      changes == JSON_TAPE_NONE || json_tape_type(&tape, changes) != JSON_ARRAY) {
+    fdn_error("Invalid didChange params.");
+    return LSP_STATUS_CONTINUE;
+  }
+
+  lsp_document *document = lsp_document_find(&g_documents, uri);
+  if (document == NULL) {
+    fdn_error("didChange for %.*s which is not open.", (int)uri.string_length,
+              uri.string_start);
+    return LSP_STATUS_CONTINUE;
+  }
+
+  g_stats.changes++;
+  document->imports_synced = false;
+
+  // The changes apply one after another; each range refers to the text as
+  // left by the previous change.
+  uint32_t change = changes + 1;
+  for (uint32_t i = 0; i < tape.entries[changes].size; i++) {
+    fdn_string text;
+    if (!tape_get_text(arena, &tape,
+                       json_tape_object_get(&tape, change, "text"), &text)) {
+      fdn_error("Invalid content change in didChange.");
+      return LSP_STATUS_CONTINUE;
+    }
+
+    bool applied;
+    if (json_tape_object_get(&tape, change, "range") == JSON_TAPE_NONE) {
+      applied = lsp_document_replace_all(document, text);
+    } else {
+      lsp_position start;
+      lsp_position end;
+      uint32_t range = json_tape_object_get(&tape, change, "range");
+      if (!tape_get_position(&tape, range, "start", &start) ||
+          !tape_get_position(&tape, range, "end", &end)) {
+        fdn_error("Invalid range in didChange.");
+        return LSP_STATUS_CONTINUE;
+      }
+      applied = lsp_document_replace_range(document, start, end, text);
+    }
+
+    if (!applied) {
+      fdn_error("Failed to apply a change to %.*s.", (int)uri.string_length,
+                uri.string_start);
+      return LSP_STATUS_CONTINUE;
+    }
+    g_stats.edits++;
+
+    change = tape.entries[change].next;
+  }
+
+  document->version = version;
+  return LSP_STATUS_CONTINUE;
+}
+
+lsp_status handle_did_close(lsp_context *context, int32_t id,
+                            fdn_string params) {
+  fdn_arena *arena = context->arena;
+  (void)id;
+
+  JsonTape tape;
+  fdn_string uri;
+  if (!parser_parse_tape(arena, params, &tape) ||
+      !tape_get_text(
+          arena, &tape,
+          json_tape_object_get(
+              &tape, json_tape_object_get(&tape, 0, "textDocument"), "uri"),
+          &uri)) {
+    fdn_error("Invalid didClose params.");
+    return LSP_STATUS_CONTINUE;
+  }
+
+  lsp_document_close(&g_documents, uri);
+  return LSP_STATUS_CONTINUE;
+}
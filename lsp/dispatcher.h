@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 
+#include "json/writer.h"
 #include "libs/foundation.h"
 
 typedef enum {
@@ -10,20 +11,123 @@ typedef enum {
   LSP_STATUS_EXIT = 1,
 } lsp_status;
 
-typedef lsp_status (*lsp_handler_fn)(int32_t id, fdn_string params);
+// The codes of the error responses the server sends.
+typedef enum {
+  LSP_ERROR_METHOD_NOT_FOUND = -32601,
+  LSP_ERROR_INVALID_PARAMS = -32602,
+  LSP_ERROR_INTERNAL_ERROR = -32603,
+  LSP_ERROR_REQUEST_CANCELLED = -32800, // By the client, with $/cancelRequest.
+  LSP_ERROR_CONTENT_MODIFIED = -32801,  // The document changed since.
+} lsp_error_code;
+
+// lsp_send_fn hands the `body` of a message to the client; the body may be
+// reused once it returns. Returns `false` if the message could not be sent.
+typedef bool (*lsp_send_fn)(void *sender, fdn_string body);
+
+// The context a message is handled in. Every thread that dispatches messages
+// has one of its own, so handlers may run on several threads at once.
+typedef struct {
+  // The scratch arena of the message. Everything allocated from it is
+  // released once the message has been handled.
+  fdn_arena *arena;
+  JsonWriter writer; // The response being built; reused from one to the next.
+  lsp_send_fn send;
+  void *sender;
+
+  // The lsp_error_code the request being handled was cancelled with, or 0.
+  // Another thread sets it while the handler runs; NULL if it never will.
+  const int32_t *cancelled;
+  bool responded; // Whether the message was answered.
+} lsp_context;
+
+// lsp_context_init prepares a context that sends its responses through `send`.
+// Returns `false` if the response buffer could not be allocated.
+bool lsp_context_init(lsp_context *context, fdn_arena *arena, lsp_send_fn send,
+                      void *sender);
+
+void lsp_context_free(lsp_context *context);
+
+// lsp_context_cancelled tells whether nobody waits for the answer to the
+// request being handled anymore. Long handlers check it between steps and
+// return without an answer once it is set; dispatch_message then answers with
+// the error.
+static inline bool lsp_context_cancelled(const lsp_context *context) {
+  return context->cancelled != NULL &&
+         __atomic_load_n(context->cancelled, __ATOMIC_RELAXED) != 0;
+}
+
+typedef lsp_status (*lsp_handler_fn)(lsp_context *context, int32_t id,
+                                     fdn_string params);
+
+// How the server runs the handler of a method.
+typedef enum {
+  // On a worker thread, next to the handlers of other requests. The handler
+  // only reads the open documents.
+  LSP_DISPATCH_CONCURRENT = 0,
+  // On the thread reading the messages, once every message before it was
+  // handled and before any message after it is. The handler has the open
+  // documents to itself, e.g. to apply the edits of a didChange.
+  LSP_DISPATCH_EXCLUSIVE = 1,
+} lsp_dispatch_mode;
 
 typedef struct {
-  const char *method;
+  fdn_string method; // Initialized with FDN_STRING_LITERAL.
   lsp_handler_fn handler;
+  lsp_dispatch_mode mode;
 } dispatch_entry;
 
 extern dispatch_entry dispatch_table[];
 
+// dispatcher_init hands the dispatcher the `server_arena` which is used for the
+// state that has to outlive a single message. It must live until the server
+// exits. It also builds the method lookup index; it has to be called before any
+// message is dispatched. Returns `false` if the dispatcher could not be
+// initialized.
+bool dispatcher_init(fdn_arena *server_arena);
+
+// dispatcher_free releases the state the dispatcher holds, including every open
+// document.
+void dispatcher_free(void);
+
+// Counters of the edits the client sent and of the work they caused.
+typedef struct {
+  uint64_t changes; // didChange notifications.
+  uint64_t edits;   // Content changes carried by the notifications.
+
+  // Syntax updates run for the edits. Consecutive edits of a document that
+  // arrive before the server is idle are coalesced into a single update.
+  uint64_t syntax_updates;
+
+  // Documents whose imports were resolved again into the import graph, and
+  // the files that invalidated, the documents themselves included.
+  uint64_t import_updates;
+  uint64_t files_invalidated;
+} dispatch_stats;
+
+// dispatcher_stats returns the counters since the dispatcher was initialized.
+const dispatch_stats *dispatcher_stats(void);
+
+// dispatcher_sync brings the syntax of every edited document up to date, and
+// once the workspace is indexed, its imports in the import graph. The server
+// calls it once no more messages are queued, so that the work that follows an
+// edit runs once per burst of edits rather than per keystroke. It waits for the
+// concurrent handlers running meanwhile.
+void dispatcher_sync(void);
+
+// dispatch_lookup returns the `dispatch_table` entry of the `method`, or NULL
+// if the method is not supported. It takes constant time regardless of the
+// size of the table.
+const dispatch_entry *dispatch_lookup(fdn_string method);
+
 // dispatch_message returns `LSP_STATUS_EXIT` if the server should stop; returns
 // `LSP_STATUS_CONTINUE` otherwise. It is the primary function that drives the
 // requested logic execution. It parses the parameters, prepares the response
-// and sends it out to the client.
-lsp_status dispatch_message(fdn_string method, bool has_id, int32_t id,
-                            fdn_string params);
+// and sends it out to the client through the `context`. Any thread may call
+// it; the documents are locked as the mode of the method requires. Unknown
+// requests are answered with LSP_ERROR_METHOD_NOT_FOUND, cancelled ones with
+// the error they were cancelled with, and any other request its handler left
+// unanswered with LSP_ERROR_INTERNAL_ERROR, so that none is dropped.
+lsp_status dispatch_message(lsp_context *context, fdn_string method,
+                            bool has_id, int32_t id, fdn_string params);
 
 #endif // LSP_DISPATCHER_H
@@ -0,0 +1,1018 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "documents.h"
+#include "libs/foundation.h"
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#define DOCUMENTS_SSE2_SCAN 1 // SSE2 is part of the x86-64 baseline.
+#endif
+
+// Buffers and documents are addressed with 32-bit offsets. Keeping them well
+// below the limit means capacities can double without overflowing.
+#define DOCUMENT_MAX_LENGTH (UINT32_MAX / 2)
+
+#define DOCUMENT_STORE_INITIAL_CAPACITY 16
+#define DOCUMENT_INITIAL_PIECES 64
+#define DOCUMENT_INITIAL_LINES 64
+
+/////////////////////////////////////////////////
+//                   BUFFERS                   //
+/////////////////////////////////////////////////
+
+static bool buffer_reserve(lsp_text_buffer *buffer, uint32_t size) {
+  if (buffer->capacity - buffer->length >= size) {
+    return true;
+  }
+
+  size_t capacity = buffer->capacity > 0 ? buffer->capacity : 256;
+  while (capacity - buffer->length < size) {
+    capacity *= 2;
+  }
+
+  char *data = realloc(buffer->data, capacity);
+  if (data == NULL) {
+    return false;
+  }
+
+  buffer->data = data;
+  buffer->capacity = (uint32_t)capacity;
+  return true;
+}
+
+// buffer_append copies the `text` to the end of the buffer. The start of an
+// empty text may be NULL.
+static bool buffer_append(lsp_text_buffer *buffer, fdn_string text) {
+  if (text.string_length == 0) {
+    return true;
+  }
+  if ((uint64_t)buffer->length + text.string_length > DOCUMENT_MAX_LENGTH ||
+      !buffer_reserve(buffer, (uint32_t)text.string_length)) {
+    return false;
+  }
+
+  memcpy(buffer->data + buffer->length, text.string_start, text.string_length);
+  buffer->length += (uint32_t)text.string_length;
+  return true;
+}
+
+/////////////////////////////////////////////////
+//                    PIECES                   //
+/////////////////////////////////////////////////
+
+// pieces_reserve makes sure `count` more pieces can be created. The tree
+// operations only create pieces after a successful reservation, so they never
+// fail halfway through an edit (and never move the array while walking it).
+static bool pieces_reserve(lsp_document *document, uint32_t count) {
+  uint32_t available = document->piece_capacity - document->piece_count;
+  for (uint32_t free_piece = document->free_pieces;
+       free_piece != LSP_PIECE_NONE && available < count;
+       free_piece = document->pieces[free_piece].left) {
+    available++;
+  }
+
+  if (available >= count) {
+    return true;
+  }
+
+  uint32_t capacity = document->piece_capacity * 2;
+  lsp_piece *pieces = realloc(document->pieces, capacity * sizeof(lsp_piece));
+  if (pieces == NULL) {
+    return false;
+  }
+
+  document->pieces = pieces;
+  document->piece_capacity = capacity;
+  return true;
+}
+
+// A xorshift generator is plenty for treap priorities.
+static uint32_t document_next_random(lsp_document *document) {
+  uint32_t x = document->random_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  document->random_state = x;
+  return x;
+}
+
+static void piece_update(lsp_document *document, uint32_t node) {
+  lsp_piece *piece = &document->pieces[node];
+  piece->subtree_length = document->pieces[piece->left].subtree_length +
+                          piece->length +
+                          document->pieces[piece->right].subtree_length;
+}
+
+// piece_new creates a leaf for a slice of a buffer. The space must have been
+// reserved with `pieces_reserve`.
+static uint32_t piece_new(lsp_document *document, lsp_buffer_kind buffer,
+                          uint32_t start, uint32_t length) {
+  uint32_t node;
+  if (document->free_pieces != LSP_PIECE_NONE) {
+    node = document->free_pieces;
+    document->free_pieces = document->pieces[node].left;
+  } else {
+    node = document->piece_count++;
+  }
+
+  lsp_piece *piece = &document->pieces[node];
+  piece->left = LSP_PIECE_NONE;
+  piece->right = LSP_PIECE_NONE;
+  piece->priority = document_next_random(document);
+  piece->buffer = buffer;
+  piece->start = start;
+  piece->length = length;
+  piece->subtree_length = length;
+
+  return node;
+}
+
+static void piece_free_tree(lsp_document *document, uint32_t node) {
+  if (node == LSP_PIECE_NONE) {
+    return;
+  }
+
+  piece_free_tree(document, document->pieces[node].left);
+  piece_free_tree(document, document->pieces[node].right);
+
+  document->pieces[node].left = document->free_pieces;
+  document->free_pieces = node;
+}
+
+// piece_split splits the tree at `node` into the pieces holding the first
+// `offset` bytes (`left`) and the rest (`right`). A piece that straddles the
+// offset is cut in two, which takes one reserved piece.
+static void piece_split(lsp_document *document, uint32_t node, uint32_t offset,
+                        uint32_t *left, uint32_t *right) {
+  if (node == LSP_PIECE_NONE) {
+    *left = LSP_PIECE_NONE;
+    *right = LSP_PIECE_NONE;
+    return;
+  }
+
+  uint32_t left_length =
+      document->pieces[document->pieces[node].left].subtree_length;
+  uint32_t length = document->pieces[node].length;
+  uint32_t split_left;
+  uint32_t split_right;
+
+  if (offset <= left_length) {
+    piece_split(document, document->pieces[node].left, offset, &split_left,
+                &split_right);
+    document->pieces[node].left = split_right;
+    piece_update(document, node);
+    *left = split_left;
+    *right = node;
+  } else if (offset >= left_length + length) {
+    piece_split(document, document->pieces[node].right,
+                offset - left_length - length, &split_left, &split_right);
+    document->pieces[node].right = split_left;
+    piece_update(document, node);
+    *left = node;
+    *right = split_right;
+  } else {
+    uint32_t cut = offset - left_length;
+    lsp_piece original = document->pieces[node];
+    uint32_t tail = piece_new(document, (lsp_buffer_kind)original.buffer,
+                              original.start + cut, length - cut);
+
+    // The tail takes over the right subtree; keeping the priority of the piece
+    // it was cut from keeps both halves in heap order.
+    document->pieces[tail].priority = original.priority;
+    document->pieces[tail].right = original.right;
+    piece_update(document, tail);
+
+    document->pieces[node].length = cut;
+    document->pieces[node].right = LSP_PIECE_NONE;
+    piece_update(document, node);
+
+    *left = node;
+    *right = tail;
+  }
+}
+
+// piece_merge joins two trees; every piece of `left` comes before `right`.
+static uint32_t piece_merge(lsp_document *document, uint32_t left,
+                            uint32_t right) {
+  if (left == LSP_PIECE_NONE) {
+    return right;
+  }
+  if (right == LSP_PIECE_NONE) {
+    return left;
+  }
+
+  if (document->pieces[left].priority > document->pieces[right].priority) {
+    uint32_t merged =
+        piece_merge(document, document->pieces[left].right, right);
+    document->pieces[left].right = merged;
+    piece_update(document, left);
+    return left;
+  }
+
+  uint32_t merged = piece_merge(document, left, document->pieces[right].left);
+  document->pieces[right].left = merged;
+  piece_update(document, right);
+  return right;
+}
+
+// piece_find returns the piece holding the byte at `offset` and stores the
+// offset of its first byte in `piece_start`.
+static uint32_t piece_find(const lsp_document *document, uint32_t offset,
+                           uint32_t *piece_start) {
+  uint32_t node = document->root;
+  uint32_t base = 0;
+
+  while (node != LSP_PIECE_NONE) {
+    const lsp_piece *piece = &document->pieces[node];
+    uint32_t left_end = base + document->pieces[piece->left].subtree_length;
+
+    if (offset < left_end) {
+      node = piece->left;
+    } else if (offset < left_end + piece->length) {
+      *piece_start = left_end;
+      return node;
+    } else {
+      base = left_end + piece->length;
+      node = piece->right;
+    }
+  }
+
+  return LSP_PIECE_NONE;
+}
+
+// document_slice_at returns the text from `offset` (which must be inside the
+// document) to the end of the piece holding it.
+static const char *document_slice_at(const lsp_document *document,
+                                     uint32_t offset, uint32_t *length) {
+  uint32_t piece_start = 0;
+  const lsp_piece *piece =
+      &document->pieces[piece_find(document, offset, &piece_start)];
+
+  *length = piece->length - (offset - piece_start);
+  return document->buffers[piece->buffer].data + piece->start +
+         (offset - piece_start);
+}
+
+// document_splice replaces the bytes between `from` and `to` with the
+// `length` bytes at `added_start` in the added buffer. Three pieces must be
+// reserved: one per cut and one for the inserted text.
+static void document_splice(lsp_document *document, uint32_t from, uint32_t to,
+                            uint32_t added_start, uint32_t length) {
+  uint32_t before;
+  uint32_t rest;
+  uint32_t removed;
+  uint32_t after;
+  piece_split(document, document->root, from, &before, &rest);
+  piece_split(document, rest, to - from, &removed, &after);
+  piece_free_tree(document, removed);
+
+  if (length > 0) {
+    uint32_t last = before;
+    while (last != LSP_PIECE_NONE &&
+           document->pieces[last].right != LSP_PIECE_NONE) {
+      last = document->pieces[last].right;
+    }
+
+    const lsp_piece *piece = &document->pieces[last];
+    if (last != LSP_PIECE_NONE && piece->buffer == LSP_BUFFER_ADDED &&
+        piece->start + piece->length == added_start) {
+      // Typing appends to the piece of the previous keystroke instead of
+      // adding a piece per character.
+      for (uint32_t node = before; node != LSP_PIECE_NONE;
+           node = document->pieces[node].right) {
+        document->pieces[node].subtree_length += length;
+      }
+      document->pieces[last].length += length;
+    } else {
+      uint32_t inserted =
+          piece_new(document, LSP_BUFFER_ADDED, added_start, length);
+      before = piece_merge(document, before, inserted);
+    }
+  }
+
+  document->root = piece_merge(document, before, after);
+}
+
+// document_read copies `length` bytes of the text from `offset` on.
+static void document_read(const void *context, uint32_t offset,
+                          uint32_t length, char *output) {
+  const lsp_document *document = context;
+  while (length > 0) {
+    uint32_t slice_length = 0;
+    const char *slice = document_slice_at(document, offset, &slice_length);
+    uint32_t count = slice_length < length ? slice_length : length;
+
+    memcpy(output, slice, count);
+    output += count;
+    offset += count;
+    length -= count;
+  }
+}
+
+// document_source gives the Solidity front end access to the text.
+static SolText document_source(const lsp_document *document) {
+  SolText text;
+  text.context = document;
+  text.length = lsp_document_length(document);
+  text.read = document_read;
+  return text;
+}
+
+// document_defer_syntax merges the replacement of `removed` bytes at `offset`
+// with `inserted` bytes into the edits the syntax has not seen yet.
+static void document_defer_syntax(lsp_document *document, uint32_t offset,
+                                  uint32_t removed, uint32_t inserted) {
+  if (document->syntax_pending++ == 0) {
+    document->syntax_offset = offset;
+    document->syntax_removed = removed;
+    document->syntax_inserted = inserted;
+    return;
+  }
+
+  // Both ranges are in the text between the two edits: the pending edits
+  // left `[start, end)` there, and this one replaces `[offset, offset +
+  // removed)`. Past `end`, the text is still the one the syntax was built
+  // from, shifted by the pending edits.
+  uint32_t start = document->syntax_offset;
+  uint32_t end = start + document->syntax_inserted;
+  uint32_t merged_start = offset < start ? offset : start;
+  uint32_t merged_end = offset + removed > end ? offset + removed : end;
+
+  document->syntax_offset = merged_start;
+  document->syntax_removed = merged_end - document->syntax_inserted +
+                             document->syntax_removed - merged_start;
+  document->syntax_inserted = merged_end - removed + inserted - merged_start;
+}
+
+const SolSyntax *lsp_document_syntax(lsp_document *document) {
+  pthread_mutex_lock(&document->syntax_lock);
+  if (document->syntax_pending == 0) {
+    pthread_mutex_unlock(&document->syntax_lock);
+    return &document->syntax;
+  }
+
+  // If memory runs out, the syntax is left empty and rebuilt next time.
+  SolText source = document_source(document);
+  if (document->syntax_offset == 0 &&
+      document->syntax_inserted == source.length) {
+    sol_syntax_rebuild(&document->syntax, &source);
+  } else {
+    sol_syntax_edit(&document->syntax, &source, document->syntax_offset,
+                    document->syntax_removed, document->syntax_inserted);
+  }
+
+  document->syntax_pending = 0;
+  pthread_mutex_unlock(&document->syntax_lock);
+  return &document->syntax;
+}
+
+/////////////////////////////////////////////////
+//                    LINES                    //
+/////////////////////////////////////////////////
+
+static uint32_t line_physical(const lsp_line_index *lines, uint32_t line) {
+  return line < lines->gap_start ? line
+                                 : line + (lines->gap_end - lines->gap_start);
+}
+
+static uint32_t line_start(const lsp_document *document, uint32_t line) {
+  const lsp_line_index *lines = &document->lines;
+  if (line < lines->gap_start) {
+    return lines->starts[line];
+  }
+  return lsp_document_length(document) -
+         lines->starts[line_physical(lines, line)];
+}
+
+static uint8_t line_flags(const lsp_document *document, uint32_t line) {
+  return document->lines.flags[line_physical(&document->lines, line)];
+}
+
+// line_end returns the offset of the line terminator of the `line` (or the end
+// of the document for the last line).
+static uint32_t line_end(const lsp_document *document, uint32_t line) {
+  if (line + 1 >= lsp_document_line_count(document)) {
+    return lsp_document_length(document);
+  }
+
+  uint32_t terminator =
+      (line_flags(document, line) & LSP_LINE_CRLF) != 0 ? 2 : 1;
+  return line_start(document, line + 1) - terminator;
+}
+
+// line_of_offset returns the line holding the byte at `offset`.
+static uint32_t line_of_offset(const lsp_document *document, uint32_t offset) {
+  uint32_t low = 0;
+  uint32_t high = lsp_document_line_count(document);
+  while (high - low > 1) {
+    uint32_t middle = low + (high - low) / 2;
+    if (line_start(document, middle) <= offset) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+
+  return low;
+}
+
+// lines_reserve makes sure `count` more lines fit into the gap.
+static bool lines_reserve(lsp_line_index *lines, uint32_t count) {
+  uint32_t gap = lines->gap_end - lines->gap_start;
+  if (gap >= count) {
+    return true;
+  }
+
+  uint32_t used = lines->capacity - gap;
+  size_t capacity = lines->capacity > 0 ? lines->capacity : 64;
+  while (capacity - used < count) {
+    capacity *= 2;
+  }
+  if (capacity > DOCUMENT_MAX_LENGTH) {
+    return false;
+  }
+
+  uint32_t *starts = realloc(lines->starts, capacity * sizeof(uint32_t));
+  if (starts == NULL) {
+    return false;
+  }
+  lines->starts = starts;
+
+  uint8_t *flags = realloc(lines->flags, capacity);
+  if (flags == NULL) {
+    return false;
+  }
+  lines->flags = flags;
+
+  // Keep the entries after the gap at the end of the arrays.
+  uint32_t after = lines->capacity - lines->gap_end;
+  uint32_t gap_end = (uint32_t)capacity - after;
+  memmove(lines->starts + gap_end, lines->starts + lines->gap_end,
+          after * sizeof(uint32_t));
+  memmove(lines->flags + gap_end, lines->flags + lines->gap_end, after);
+
+  lines->gap_end = gap_end;
+  lines->capacity = (uint32_t)capacity;
+  return true;
+}
+
+// lines_move_gap moves the gap so that `line` lines are in front of it. Line
+// starts that cross the gap are converted between the two encodings, which
+// uses the current length of the document.
+static void lines_move_gap(lsp_document *document, uint32_t line) {
+  lsp_line_index *lines = &document->lines;
+  uint32_t length = lsp_document_length(document);
+
+  while (lines->gap_start > line) {
+    lines->gap_start--;
+    lines->gap_end--;
+    lines->starts[lines->gap_end] = length - lines->starts[lines->gap_start];
+    lines->flags[lines->gap_end] = lines->flags[lines->gap_start];
+  }
+
+  while (lines->gap_start < line) {
+    lines->starts[lines->gap_start] = length - lines->starts[lines->gap_end];
+    lines->flags[lines->gap_start] = lines->flags[lines->gap_end];
+    lines->gap_start++;
+    lines->gap_end++;
+  }
+}
+
+// lines_push appends a line starting at `start` in front of the gap.
+static bool lines_push(lsp_line_index *lines, uint32_t start) {
+  if (!lines_reserve(lines, 1)) {
+    return false;
+  }
+
+  lines->starts[lines->gap_start] = start;
+  lines->flags[lines->gap_start] = 0;
+  lines->gap_start++;
+  return true;
+}
+
+// lines_line_feed records the line feed at `data[at]`: the line in front of
+// the gap ends there and a new one starts after it.
+static bool lines_line_feed(lsp_line_index *lines, const char *data,
+                            uint32_t at, uint32_t base,
+                            unsigned char previous) {
+  unsigned char before = at > 0 ? (unsigned char)data[at - 1] : previous;
+  if (before == '\r') {
+    lines->flags[lines->gap_start - 1] |= LSP_LINE_CRLF;
+  }
+
+  return lines_push(lines, base + at + 1);
+}
+
+// lines_scan indexes the `length` bytes at `data`, which sit at offset `base`
+// of the document. Every line feed starts a new line in front of the gap, and
+// non-ASCII bytes flag the line they are on. `previous` carries the last byte
+// of the previous call, so that "\r\n" split across pieces is recognized.
+// Returns `false` if the index could not grow.
+static bool lines_scan(lsp_line_index *lines, const char *data,
+                       uint32_t length, uint32_t base,
+                       unsigned char *previous) {
+  uint32_t i = 0;
+
+#ifdef DOCUMENTS_SSE2_SCAN
+  // Most blocks of source code have neither a line feed nor a non-ASCII byte
+  // and are skipped with a single test.
+  const __m128i line_feed = _mm_set1_epi8('\n');
+  for (; length - i >= 16; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(const void *)(data + i));
+    uint32_t line_feeds =
+        (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, line_feed));
+    uint32_t non_ascii = (uint32_t)_mm_movemask_epi8(block);
+
+    while ((line_feeds | non_ascii) != 0) {
+      uint32_t next = line_feeds != 0 ? (uint32_t)__builtin_ctz(line_feeds) : 16;
+      if ((non_ascii & ((1u << next) - 1)) != 0) {
+        lines->flags[lines->gap_start - 1] |= LSP_LINE_NON_ASCII;
+      }
+      if (line_feeds == 0) {
+        break;
+      }
+
+      if (!lines_line_feed(lines, data, i + next, base, *previous)) {
+        return false;
+      }
+      non_ascii &= ~((2u << next) - 1);
+      line_feeds &= line_feeds - 1;
+    }
+  }
+#endif
+
+  for (; i < length; i++) {
+    unsigned char ch = (unsigned char)data[i];
+    if (ch == '\n') {
+      if (!lines_line_feed(lines, data, i, base, *previous)) {
+        return false;
+      }
+    } else if (ch >= 0x80) {
+      lines->flags[lines->gap_start - 1] |= LSP_LINE_NON_ASCII;
+    }
+  }
+
+  if (length > 0) {
+    *previous = (unsigned char)data[length - 1];
+  }
+  return true;
+}
+
+// lines_rebuild indexes the whole `text` of the document from scratch.
+static bool lines_rebuild(lsp_document *document, fdn_string text) {
+  lsp_line_index *lines = &document->lines;
+  lines->gap_start = 0;
+  lines->gap_end = lines->capacity;
+
+  unsigned char previous = '\0';
+  return lines_push(lines, 0) &&
+         lines_scan(lines, text.string_start, (uint32_t)text.string_length, 0,
+                    &previous);
+}
+
+// lines_rescan re-indexes the text from the start of the line in front of the
+// gap up to the start of the line after the gap, which is where an edit
+// happened. The lines in between must have been removed.
+static void lines_rescan(lsp_document *document) {
+  lsp_line_index *lines = &document->lines;
+  uint32_t first = lines->gap_start - 1;
+  uint32_t from = lines->starts[first];
+  uint32_t to = lsp_document_length(document);
+  bool has_next = lines->gap_end < lines->capacity;
+  if (has_next) {
+    to -= lines->starts[lines->gap_end];
+  }
+
+  lines->flags[first] = 0;
+  unsigned char previous = '\0';
+  while (from < to) {
+    uint32_t length = 0;
+    const char *data = document_slice_at(document, from, &length);
+    if (length > to - from) {
+      length = to - from;
+    }
+
+    // The lines were reserved by the caller; this cannot fail.
+    lines_scan(lines, data, length, from, &previous);
+    from += length;
+  }
+
+  // The line feed in front of the next line was scanned again and pushed a
+  // duplicate of it.
+  if (has_next) {
+    lines->gap_start--;
+  }
+}
+
+/////////////////////////////////////////////////
+//                  DOCUMENTS                  //
+/////////////////////////////////////////////////
+
+static void document_free(lsp_document *document) {
+  free(document->buffers[LSP_BUFFER_ORIGINAL].data);
+  free(document->buffers[LSP_BUFFER_ADDED].data);
+  free(document->pieces);
+  free(document->lines.starts);
+  free(document->lines.flags);
+  sol_syntax_free(&document->syntax);
+  pthread_mutex_destroy(&document->syntax_lock);
+  free(document->uri_data);
+  free(document);
+}
+
+static lsp_document *document_new(fdn_string uri, int64_t version,
+                                  fdn_string text) {
+  lsp_document *document = calloc(1, sizeof(lsp_document));
+  if (document == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&document->syntax_lock, NULL);
+
+  document->uri_data = malloc(uri.string_length + 1);
+  document->pieces = calloc(DOCUMENT_INITIAL_PIECES, sizeof(lsp_piece));
+  if (document->uri_data == NULL || document->pieces == NULL ||
+      !lines_reserve(&document->lines, DOCUMENT_INITIAL_LINES)) {
+    document_free(document);
+    return NULL;
+  }
+
+  memcpy(document->uri_data, uri.string_start, uri.string_length);
+  document->uri_data[uri.string_length] = '\0';
+  document->uri = fdn_string_create_view(document->uri_data, uri.string_length);
+  document->version = version;
+  document->piece_capacity = DOCUMENT_INITIAL_PIECES;
+  document->piece_count = 1; // Entry 0 is the empty tree.
+  document->random_state = 0x9E3779B9u;
+  sol_syntax_init(&document->syntax);
+
+  if (!lsp_document_replace_all(document, text)) {
+    document_free(document);
+    return NULL;
+  }
+
+  return document;
+}
+
+bool lsp_document_replace_all(lsp_document *document, fdn_string text) {
+  uint32_t old_length = lsp_document_length(document);
+  document->buffers[LSP_BUFFER_ORIGINAL].length = 0;
+  document->buffers[LSP_BUFFER_ADDED].length = 0;
+  document->piece_count = 1;
+  document->free_pieces = LSP_PIECE_NONE;
+  document->root = LSP_PIECE_NONE;
+
+  if (text.string_length > 0 &&
+      (!buffer_append(&document->buffers[LSP_BUFFER_ORIGINAL], text) ||
+       !lines_rebuild(document, text))) {
+    // Leave an empty (but consistent) document behind.
+    lines_rebuild(document, fdn_string_create_view("", 0));
+    document_defer_syntax(document, 0, old_length, 0);
+    return false;
+  }
+
+  if (text.string_length > 0) {
+    document->root = piece_new(document, LSP_BUFFER_ORIGINAL, 0,
+                               (uint32_t)text.string_length);
+  } else if (!lines_rebuild(document, text)) {
+    document_defer_syntax(document, 0, old_length, 0);
+    return false;
+  }
+
+  document_defer_syntax(document, 0, old_length,
+                        (uint32_t)text.string_length);
+  return true;
+}
+
+bool lsp_document_replace_range(lsp_document *document, lsp_position start,
+                                lsp_position end, fdn_string text) {
+  uint32_t from = lsp_document_offset_at(document, start);
+  uint32_t to = lsp_document_offset_at(document, end);
+  if (to < from) {
+    to = from;
+  }
+
+  uint64_t new_length =
+      (uint64_t)lsp_document_length(document) - (to - from) + text.string_length;
+  if (new_length > DOCUMENT_MAX_LENGTH) {
+    return false;
+  }
+
+  uint32_t new_lines = 0;
+  const char *cursor = text.string_start;
+  const char *text_end = text.string_start + text.string_length;
+  while ((cursor = memchr(cursor, '\n', (size_t)(text_end - cursor))) != NULL) {
+    new_lines++;
+    cursor++;
+  }
+
+  // Reserve everything up front so the edit cannot fail halfway. The rescan
+  // pushes one extra (duplicate) line.
+  if (!pieces_reserve(document, 3) ||
+      !lines_reserve(&document->lines, new_lines + 1)) {
+    return false;
+  }
+
+  lsp_text_buffer *added = &document->buffers[LSP_BUFFER_ADDED];
+  uint32_t added_start = added->length;
+  if (!buffer_append(added, text)) {
+    return false;
+  }
+
+  // Drop the lines that start inside the replaced range, with the gap right
+  // after the line of the edit. The gap moves before the text changes; the
+  // conversion of the line starts depends on the length of the document.
+  uint32_t first = line_of_offset(document, from);
+  uint32_t last = line_of_offset(document, to);
+  lines_move_gap(document, first + 1);
+  document->lines.gap_end += last - first;
+
+  document_splice(document, from, to, added_start,
+                  (uint32_t)text.string_length);
+  lines_rescan(document);
+
+  document_defer_syntax(document, from, to - from,
+                        (uint32_t)text.string_length);
+  return true;
+}
+
+// utf8_sequence_length returns the length of the UTF-8 sequence started by the
+// `lead` byte. Stray continuation bytes count as one byte.
+static uint32_t utf8_sequence_length(unsigned char lead) {
+  if (lead < 0xC0) {
+    return 1;
+  }
+  if (lead < 0xE0) {
+    return 2;
+  }
+  if (lead < 0xF0) {
+    return 3;
+  }
+  return 4;
+}
+
+// document_walk_utf16 advances from `offset` over `*units` UTF-16 code units,
+// but not past `limit`. The units left over are stored back in `units`.
+static uint32_t document_walk_utf16(const lsp_document *document,
+                                    uint32_t offset, uint32_t limit,
+                                    uint32_t *units) {
+  while (*units > 0 && offset < limit) {
+    uint32_t length = 0;
+    const unsigned char *data =
+        (const unsigned char *)document_slice_at(document, offset, &length);
+
+    // A character may continue in the next piece; `i` can run past `length`.
+    uint32_t i = 0;
+    while (i < length && *units > 0 && offset + i < limit) {
+      uint32_t width = utf8_sequence_length(data[i]);
+      uint32_t character_units = width == 4 ? 2 : 1; // Astral characters are
+                                                     // surrogate pairs.
+      if (character_units > *units) {
+        return offset + i; // In the middle of a surrogate pair; round down.
+      }
+
+      *units -= character_units;
+      i += width;
+    }
+    offset += i;
+  }
+
+  return offset < limit ? offset : limit;
+}
+
+uint32_t lsp_document_offset_at(const lsp_document *document,
+                                lsp_position position) {
+  if (position.line >= lsp_document_line_count(document)) {
+    return lsp_document_length(document);
+  }
+
+  uint32_t start = line_start(document, position.line);
+  uint32_t end = line_end(document, position.line);
+
+  // On an ASCII line every byte is one UTF-16 code unit.
+  if ((line_flags(document, position.line) & LSP_LINE_NON_ASCII) == 0) {
+    return position.character < end - start ? start + position.character : end;
+  }
+
+  uint32_t units = position.character;
+  return document_walk_utf16(document, start, end, &units);
+}
+
+lsp_position lsp_document_position_at(const lsp_document *document,
+                                      uint32_t offset) {
+  uint32_t length = lsp_document_length(document);
+  if (offset > length) {
+    offset = length;
+  }
+
+  lsp_position position;
+  position.line = line_of_offset(document, offset);
+  uint32_t start = line_start(document, position.line);
+
+  if ((line_flags(document, position.line) & LSP_LINE_NON_ASCII) == 0) {
+    position.character = offset - start;
+    return position;
+  }
+
+  // Count the code units of the characters in front of the offset.
+  position.character = 0;
+  uint32_t cursor = start;
+  while (cursor < offset) {
+    uint32_t slice_length = 0;
+    const unsigned char *data =
+        (const unsigned char *)document_slice_at(document, cursor, &slice_length);
+
+    uint32_t i = 0;
+    while (i < slice_length && cursor + i < offset) {
+      uint32_t width = utf8_sequence_length(data[i]);
+      if (cursor + i + width > offset) {
+        return position; // Inside of a character; round down.
+      }
+
+      position.character += width == 4 ? 2 : 1;
+      i += width;
+    }
+    cursor += i;
+  }
+
+  return position;
+}
+
+static char *document_copy_pieces(const lsp_document *document, uint32_t node,
+                                  char *output) {
+  if (node == LSP_PIECE_NONE) {
+    return output;
+  }
+
+  const lsp_piece *piece = &document->pieces[node];
+  output = document_copy_pieces(document, piece->left, output);
+  memcpy(output, document->buffers[piece->buffer].data + piece->start,
+         piece->length);
+  return document_copy_pieces(document, piece->right, output + piece->length);
+}
+
+fdn_string lsp_document_text(const lsp_document *document, fdn_arena *arena) {
+  uint32_t length = lsp_document_length(document);
+  char *text = fdn_arena_alloc(arena, (size_t)length + 1);
+  if (text == NULL) {
+    return fdn_string_create_view("", 0);
+  }
+
+  document_copy_pieces(document, document->root, text);
+  text[length] = '\0';
+  return fdn_string_create_view(text, length);
+}
+
+fdn_string lsp_document_text_range(const lsp_document *document,
+                                   uint32_t offset, uint32_t length,
+                                   fdn_arena *arena) {
+  uint32_t document_length = lsp_document_length(document);
+  if (offset > document_length) {
+    offset = document_length;
+  }
+  if (length > document_length - offset) {
+    length = document_length - offset;
+  }
+
+  char *text = fdn_arena_alloc(arena, (size_t)length + 1);
+  if (text == NULL) {
+    return fdn_string_create_view("", 0);
+  }
+
+  document_read(document, offset, length, text);
+  text[length] = '\0';
+  return fdn_string_create_view(text, length);
+}
+
+/////////////////////////////////////////////////
+//                    STORE                    //
+/////////////////////////////////////////////////
+
+bool lsp_document_store_init(lsp_document_store *store) {
+  store->slots =
+      calloc(DOCUMENT_STORE_INITIAL_CAPACITY, sizeof(lsp_document *));
+  store->capacity = store->slots != NULL ? DOCUMENT_STORE_INITIAL_CAPACITY : 0;
+  store->count = 0;
+
+  return store->slots != NULL;
+}
+
+void lsp_document_store_free(lsp_document_store *store) {
+  for (uint32_t i = 0; i < store->capacity; i++) {
+    if (store->slots[i] != NULL) {
+      document_free(store->slots[i]);
+    }
+  }
+
+  free(store->slots);
+  store->slots = NULL;
+  store->capacity = 0;
+  store->count = 0;
+}
+
+static uint32_t store_home_slot(const lsp_document_store *store,
+                                fdn_string uri) {
+  return (uint32_t)fdn_string_hash(uri, 0) & (store->capacity - 1);
+}
+
+// store_find_slot returns the slot of the `uri`, or the empty slot where it
+// would be inserted.
+static uint32_t store_find_slot(const lsp_document_store *store,
+                                fdn_string uri) {
+  uint32_t mask = store->capacity - 1;
+  uint32_t slot = store_home_slot(store, uri);
+
+  while (store->slots[slot] != NULL &&
+         !fdn_string_is_eq(store->slots[slot]->uri, uri)) {
+    slot = (slot + 1) & mask;
+  }
+
+  return slot;
+}
+
+static bool store_grow(lsp_document_store *store) {
+  lsp_document_store grown;
+  grown.capacity = store->capacity * 2;
+  grown.count = store->count;
+  grown.slots = calloc(grown.capacity, sizeof(lsp_document *));
+  if (grown.slots == NULL) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < store->capacity; i++) {
+    lsp_document *document = store->slots[i];
+    if (document != NULL) {
+      grown.slots[store_find_slot(&grown, document->uri)] = document;
+    }
+  }
+
+  free(store->slots);
+  *store = grown;
+  return true;
+}
+
+lsp_document *lsp_document_find(const lsp_document_store *store,
+                                fdn_string uri) {
+  if (store->capacity == 0) {
+    return NULL;
+  }
+
+  return store->slots[store_find_slot(store, uri)];
+}
+
+lsp_document *lsp_document_open(lsp_document_store *store, fdn_string uri,
+                                int64_t version, fdn_string text) {
+  lsp_document_close(store, uri);
+
+  // Keep the load factor under 3/4 so probe sequences stay short.
+  if ((store->count + 1) * 4 > store->capacity * 3 && !store_grow(store)) {
+    return NULL;
+  }
+
+  lsp_document *document = document_new(uri, version, text);
+  if (document == NULL) {
+    return NULL;
+  }
+
+  store->slots[store_find_slot(store, uri)] = document;
+  store->count++;
+  return document;
+}
+
+void lsp_document_close(lsp_document_store *store, fdn_string uri) {
+  if (store->capacity == 0) {
+    return;
+  }
+
+  uint32_t mask = store->capacity - 1;
+  uint32_t hole = store_find_slot(store, uri);
+  if (store->slots[hole] == NULL) {
+    return;
+  }
+
+  document_free(store->slots[hole]);
+  store->count--;
+
+  // Shift the following entries of the probe sequence back into the hole so
+  // that lookups never stop early at an empty slot.
+  uint32_t slot = hole;
+  while (1) {
+    slot = (slot + 1) & mask;
+    lsp_document *document = store->slots[slot];
+    if (document == NULL) {
+      break;
+    }
+
+    uint32_t home = store_home_slot(store, document->uri);
+    bool stays = hole <= slot ? (hole < home && home <= slot)
+                              : (hole < home || home <= slot);
+    if (!stays) {
+      store->slots[hole] = document;
+      hole = slot;
+    }
+  }
+
+  store->slots[hole] = NULL;
+}
@@ -0,0 +1,198 @@
+#ifndef LSP_DOCUMENTS_H
+#define LSP_DOCUMENTS_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libs/foundation.h"
+#include "solidity/parser.h"
+
+/**
+ * The text of every document the client opened, kept in sync with the edits
+ * sent in didChange notifications.
+ *
+ * A document is a piece table: the text it was opened with (the original
+ * buffer) is never modified, and inserted text is appended to a second,
+ * append-only buffer. The document is the sequence of pieces (slices of either
+ * buffer) that, concatenated, make up the current text:
+ *
+ *   original: "contract A {}"        added: "B"
+ *   pieces:   [original 0..9] [added 0..1] [original 10..13]
+ *   text:     "contract AB {}"
+ *
+ * The pieces are the nodes of a treap ordered by their position in the text.
+ * Every node keeps the length of its subtree, so the piece at a byte offset is
+ * found in O(log n). An edit splits the tree at the edges of the replaced
+ * range, drops the pieces in between and links in a single new piece, so a
+ * keystroke costs O(edit size + log n) regardless of the size of the document.
+ *
+ * Lines are tracked separately in a line index: the start offset of every line
+ * plus flags telling whether the line is pure ASCII. LSP positions count UTF-16
+ * code units, which for an ASCII line are just bytes, so most positions map to
+ * offsets (and back) without looking at the text at all. The index is a gap
+ * buffer: line starts after the gap are stored as distances from the end of
+ * the document, so an edit only rewrites the lines it touches and the gap
+ * follows the cursor around the file.
+ *
+ * Every document also keeps its Solidity tokens and parse tree, which edits
+ * update in place (see solidity/parser.h). The update is deferred until the
+ * syntax is asked for: the edits made in the meantime are merged into one
+ * replacement of the range they all fall into, so a burst of keystrokes is
+ * lexed and parsed once.
+ */
+
+// Pieces are referred to by their index in `lsp_document.pieces`. Index 0 is
+// the empty tree.
+#define LSP_PIECE_NONE 0
+
+typedef enum {
+  LSP_BUFFER_ORIGINAL = 0,
+  LSP_BUFFER_ADDED = 1,
+} lsp_buffer_kind;
+
+typedef struct {
+  uint32_t left;
+  uint32_t right;
+  uint32_t priority; // Heap order of the treap; random.
+
+  uint32_t buffer; // lsp_buffer_kind of the slice.
+  uint32_t start;  // Offset of the slice in the buffer.
+  uint32_t length; // Length of the slice in bytes.
+
+  uint32_t subtree_length; // Bytes of all the pieces in the subtree.
+} lsp_piece;
+
+typedef struct {
+  char *data;
+  uint32_t length;
+  uint32_t capacity;
+} lsp_text_buffer;
+
+// Flags of a line in the line index.
+#define LSP_LINE_NON_ASCII 0x1 // Characters and bytes may differ.
+#define LSP_LINE_CRLF 0x2      // Ends with "\r\n" rather than "\n".
+
+typedef struct {
+  // Line starts and flags, indexed by line number outside of the gap.
+  // Entries before the gap hold offsets from the start of the document; the
+  // ones after it hold distances from the end of the document.
+  uint32_t *starts;
+  uint8_t *flags;
+  uint32_t capacity;
+  uint32_t gap_start; // The number of lines before the gap.
+  uint32_t gap_end;   // The first entry after the gap.
+} lsp_line_index;
+
+typedef struct {
+  char *uri_data; // Owned copy of the URI.
+  fdn_string uri;
+  int64_t version;
+
+  lsp_text_buffer buffers[2]; // Indexed by lsp_buffer_kind.
+
+  lsp_piece *pieces;
+  uint32_t piece_count; // Including the unused entry 0.
+  uint32_t piece_capacity;
+  uint32_t free_pieces; // Linked through `left`.
+  uint32_t root;
+
+  uint32_t random_state;
+
+  lsp_line_index lines;
+
+  // The syntax of the text as it was `syntax_pending` edits ago. The edits
+  // since then replaced `syntax_removed` bytes at `syntax_offset` with
+  // `syntax_inserted` bytes. Use `lsp_document_syntax` to bring it up to date.
+  // Handlers reading the document on several threads may do so at once, so
+  // the update holds `syntax_lock`.
+  pthread_mutex_t syntax_lock;
+  SolSyntax syntax;
+  uint32_t syntax_pending;
+  uint32_t syntax_offset;
+  uint32_t syntax_removed;
+  uint32_t syntax_inserted;
+
+  // Whether the import graph of the workspace has the imports of the current
+  // text; kept by the dispatcher.
+  bool imports_synced;
+} lsp_document;
+
+// Open documents by URI. An open-addressing hash table with linear probing;
+// the capacity is a power of two.
+typedef struct {
+  lsp_document **slots;
+  uint32_t capacity;
+  uint32_t count;
+} lsp_document_store;
+
+// A zero-based position in a document. The `character` counts UTF-16 code
+// units, as in the LSP.
+typedef struct {
+  uint32_t line;
+  uint32_t character;
+} lsp_position;
+
+bool lsp_document_store_init(lsp_document_store *store);
+
+// lsp_document_store_free closes every document and frees the store.
+void lsp_document_store_free(lsp_document_store *store);
+
+// lsp_document_open stores a new document with the `text`, replacing the
+// document previously opened under the same `uri`. Returns NULL if the
+// document could not be allocated.
+lsp_document *lsp_document_open(lsp_document_store *store, fdn_string uri,
+                                int64_t version, fdn_string text);
+
+// lsp_document_find returns the open document of the `uri`, or NULL.
+lsp_document *lsp_document_find(const lsp_document_store *store,
+                                fdn_string uri);
+
+// lsp_document_close frees the document of the `uri`, if it is open.
+void lsp_document_close(lsp_document_store *store, fdn_string uri);
+
+// lsp_document_replace_range replaces the text between `start` and `end` with
+// `text`. Positions past the end of a line or of the document are clamped.
+// Returns `false` if the document could not grow; it is unchanged then.
+bool lsp_document_replace_range(lsp_document *document, lsp_position start,
+                                lsp_position end, fdn_string text);
+
+// lsp_document_replace_all replaces the whole text of the document.
+bool lsp_document_replace_all(lsp_document *document, fdn_string text);
+
+// lsp_document_offset_at converts a `position` to a byte offset. It takes
+// constant time on ASCII lines.
+uint32_t lsp_document_offset_at(const lsp_document *document,
+                                lsp_position position);
+
+// lsp_document_position_at converts a byte offset to a position. Offsets past
+// the end of the document are clamped.
+lsp_position lsp_document_position_at(const lsp_document *document,
+                                      uint32_t offset);
+
+static inline uint32_t lsp_document_length(const lsp_document *document) {
+  return document->pieces[document->root].subtree_length;
+}
+
+static inline uint32_t lsp_document_line_count(const lsp_document *document) {
+  const lsp_line_index *lines = &document->lines;
+  return lines->gap_start + (lines->capacity - lines->gap_end);
+}
+
+// lsp_document_syntax applies the pending edits to the syntax of the document
+// and returns it. If memory runs out, the syntax is empty until the next call.
+// Several threads may call it at once as long as none edits the document.
+const SolSyntax *lsp_document_syntax(lsp_document *document);
+
+// lsp_document_text copies the current text into the `arena`. The copy is
+// null-terminated.
+fdn_string lsp_document_text(const lsp_document *document, fdn_arena *arena);
+
+// lsp_document_text_range copies the `length` bytes of the text from `offset`
+// on into the `arena`, clamped to the end of the text. The copy is
+// null-terminated.
+fdn_string lsp_document_text_range(const lsp_document *document,
+                                   uint32_t offset, uint32_t length,
+                                   fdn_arena *arena);
+
+#endif // LSP_DOCUMENTS_H
@@ -0,0 +1,1052 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "imports.h"
+#include "libs/foundation.h"
+#include "solidity/parser.h"
+
+#define IMPORT_ARENA_BLOCK_SIZE (16 * 1024)
+
+/////////////////////////////////////////////////
+//                    PATHS                    //
+/////////////////////////////////////////////////
+
+// import_normalize removes the `.` and `..` components and the repeated and
+// trailing slashes of the `length` bytes at `path` in place, and returns the
+// new length.
+static size_t import_normalize(char *path, size_t length) {
+  size_t root = length > 0 && path[0] == '/' ? 1 : 0;
+  size_t out = root;
+  size_t i = 0;
+  while (i < length) {
+    size_t start = i;
+    while (i < length && path[i] != '/') {
+      i++;
+    }
+    size_t size = i - start;
+    i++;
+
+    if (size == 0 || (size == 1 && path[start] == '.')) {
+      continue;
+    }
+    if (size == 2 && path[start] == '.' && path[start + 1] == '.') {
+      while (out > root && path[out - 1] != '/') {
+        out--;
+      }
+      if (out > root) {
+        out--;
+      }
+      continue;
+    }
+
+    // The output trails the input by at least the slash before `start`.
+    if (out > root) {
+      path[out++] = '/';
+    }
+    memmove(path + out, path + start, size);
+    out += size;
+  }
+  return out;
+}
+
+static size_t import_parts_length(const fdn_string *parts,
+                                  uint32_t part_count) {
+  size_t length = 0;
+  for (uint32_t i = 0; i < part_count; i++) {
+    length += parts[i].string_length;
+  }
+  return length;
+}
+
+// import_join writes the `parts` to `output`, which has room for them and a
+// null terminator, normalizing them as a path if `normalize` is set. Returns
+// the length written.
+static size_t import_join(char *output, const fdn_string *parts,
+                          uint32_t part_count, bool normalize) {
+  size_t length = 0;
+  for (uint32_t i = 0; i < part_count; i++) {
+    memcpy(output + length, parts[i].string_start, parts[i].string_length);
+    length += parts[i].string_length;
+  }
+  if (normalize) {
+    length = import_normalize(output, length);
+  }
+  output[length] = '\0';
+  return length;
+}
+
+// import_string returns the `parts` joined on the heap, or NULL.
+static char *import_string(const fdn_string *parts, uint32_t part_count,
+                           bool normalize) {
+  char *string = malloc(import_parts_length(parts, part_count) + 1);
+  if (string != NULL) {
+    import_join(string, parts, part_count, normalize);
+  }
+  return string;
+}
+
+// import_directory returns the directory of the `path`, without the slash.
+static fdn_string import_directory(fdn_string path) {
+  size_t length = path.string_length;
+  while (length > 0 && path.string_start[length - 1] != '/') {
+    length--;
+  }
+  return fdn_string_create_view(path.string_start, length > 0 ? length - 1 : 0);
+}
+
+static bool import_has_prefix(fdn_string string, const char *prefix) {
+  size_t length = strlen(prefix);
+  return string.string_length >= length &&
+         memcmp(string.string_start, prefix, length) == 0;
+}
+
+static fdn_string import_view(const char *string) {
+  return fdn_string_create_view(string, strlen(string));
+}
+
+/////////////////////////////////////////////////
+//                  RESOLUTION                 //
+/////////////////////////////////////////////////
+
+// import_file_find returns the file at the normalized `path`, or
+// LSP_IMPORT_NONE.
+static uint32_t import_file_find(const lsp_import_graph *graph,
+                                 fdn_string path) {
+  if (graph->path_slot_count == 0) {
+    return LSP_IMPORT_NONE;
+  }
+
+  uint32_t mask = graph->path_slot_count - 1;
+  uint32_t slot = (uint32_t)fdn_string_hash(path, 0) & mask;
+  while (true) {
+    uint32_t file = graph->path_slots[slot];
+    if (file == LSP_IMPORT_NONE ||
+        (strncmp(graph->paths[file], path.string_start, path.string_length) ==
+             0 &&
+         graph->paths[file][path.string_length] == '\0')) {
+      return file;
+    }
+    slot = (slot + 1) & mask;
+  }
+}
+
+// import_candidate returns the file at the path made of the `parts`, or
+// LSP_IMPORT_NONE.
+static uint32_t import_candidate(const lsp_import_graph *graph,
+                                 fdn_arena *arena, const fdn_string *parts,
+                                 uint32_t part_count) {
+  char *path = fdn_arena_alloc(arena, import_parts_length(parts, part_count) +
+                                          1);
+  if (path == NULL) {
+    return LSP_IMPORT_NONE;
+  }
+  size_t length = import_join(path, parts, part_count, true);
+  return import_file_find(graph, fdn_string_create_view(path, length));
+}
+
+// import_remapping returns the remapping that applies to the `import` in the
+// file at `importer`, or NULL.
+static const lsp_import_remapping *
+import_remapping(const lsp_import_graph *graph, fdn_string importer,
+                 fdn_string import) {
+  const lsp_import_remapping *best = NULL;
+  size_t best_context = 0;
+  size_t best_prefix = 0;
+  for (uint32_t i = 0; i < graph->remapping_count; i++) {
+    const lsp_import_remapping *remapping = &graph->remappings[i];
+    size_t context = strlen(remapping->context);
+    size_t prefix = strlen(remapping->prefix);
+    // Of two equal remappings, the later one wins.
+    if (import_has_prefix(importer, remapping->context) &&
+        import_has_prefix(import, remapping->prefix) &&
+        (best == NULL || context > best_context ||
+         (context == best_context && prefix >= best_prefix))) {
+      best = remapping;
+      best_context = context;
+      best_prefix = prefix;
+    }
+  }
+  return best;
+}
+
+uint32_t lsp_import_graph_resolve(const lsp_import_graph *graph,
+                                  fdn_arena *arena, fdn_string importer,
+                                  fdn_string import) {
+  if (import.string_length == 0) {
+    return LSP_IMPORT_NONE;
+  }
+
+  fdn_string slash = FDN_STRING_LITERAL("/");
+  fdn_string directory = import_directory(importer);
+  if (import_has_prefix(import, "./") || import_has_prefix(import, "../")) {
+    fdn_string parts[] = {directory, slash, import};
+    return import_candidate(graph, arena, parts, 3);
+  }
+
+  uint32_t file = LSP_IMPORT_NONE;
+  const lsp_import_remapping *remapping =
+      import_remapping(graph, importer, import);
+  if (remapping != NULL) {
+    size_t prefix = strlen(remapping->prefix);
+    fdn_string parts[] = {
+        import_view(remapping->target),
+        fdn_string_create_view(import.string_start + prefix,
+                               import.string_length - prefix)};
+    file = import_candidate(graph, arena, parts, 2);
+  }
+
+  // Below the folders, and in the way Foundry remaps `lib/` by default.
+  const char *name_end = memchr(import.string_start, '/', import.string_length);
+  for (uint32_t i = 0; i < graph->folder_count && file == LSP_IMPORT_NONE;
+       i++) {
+    fdn_string folder = import_view(graph->folders[i]);
+    fdn_string parts[] = {folder, slash, import};
+    file = import_candidate(graph, arena, parts, 3);
+    if (file == LSP_IMPORT_NONE && name_end != NULL) {
+      fdn_string name = fdn_string_create_view(
+          import.string_start, (size_t)(name_end - import.string_start));
+      fdn_string rest = fdn_string_create_view(
+          name_end, import.string_length - name.string_length);
+      fdn_string source_parts[] = {folder, FDN_STRING_LITERAL("/lib/"), name,
+                                   FDN_STRING_LITERAL("/src"), rest};
+      fdn_string root_parts[] = {folder, FDN_STRING_LITERAL("/lib/"), import};
+      file = import_candidate(graph, arena, source_parts, 5);
+      if (file == LSP_IMPORT_NONE) {
+        file = import_candidate(graph, arena, root_parts, 3);
+      }
+    }
+  }
+
+  // In the `node_modules` of the directory of the importer and above it.
+  while (file == LSP_IMPORT_NONE) {
+    fdn_string parts[] = {directory, FDN_STRING_LITERAL("/node_modules/"),
+                          import};
+    file = import_candidate(graph, arena, parts, 3);
+    if (directory.string_length == 0) {
+      break;
+    }
+    directory = import_directory(directory);
+  }
+  return file;
+}
+
+/////////////////////////////////////////////////
+//                    SYNTAX                   //
+/////////////////////////////////////////////////
+
+uint32_t lsp_import_path_token(const SolSyntax *syntax, uint32_t node) {
+  const SolNodeList *nodes = &syntax->nodes;
+  if (node >= nodes->count || nodes->kinds[node] != SOL_NODE_IMPORT) {
+    return LSP_IMPORT_NONE;
+  }
+
+  // The only string of `import "A.sol" as A;` and `import {B} from "A.sol";`.
+  for (uint32_t token = nodes->token_starts[node];
+       token < nodes->token_ends[node]; token++) {
+    if (syntax->tokens.types[token] == SOL_TOKEN_STRING) {
+      return token;
+    }
+  }
+  return LSP_IMPORT_NONE;
+}
+
+uint32_t lsp_import_at(const SolSyntax *syntax, uint32_t offset) {
+  const SolNodeList *nodes = &syntax->nodes;
+  const SolTokenList *tokens = &syntax->tokens;
+
+  // Import directives are only found at the file level.
+  for (uint32_t node = 1; node < nodes->count;
+       node = sol_node_next_sibling(nodes, node)) {
+    uint32_t token = lsp_import_path_token(syntax, node);
+    if (token != LSP_IMPORT_NONE && tokens->starts[token] <= offset &&
+        offset <= tokens->starts[token] + tokens->lengths[token]) {
+      return token;
+    }
+  }
+  return LSP_IMPORT_NONE;
+}
+
+fdn_string lsp_import_unquote(fdn_string text) {
+  if (text.string_length < 2) {
+    return fdn_string_create_view(text.string_start, 0);
+  }
+  return fdn_string_create_view(text.string_start + 1, text.string_length - 2);
+}
+
+/////////////////////////////////////////////////
+//                    GRAPH                    //
+/////////////////////////////////////////////////
+
+// A resolution cached while the graph is built; `file` is LSP_IMPORT_NONE for
+// an unresolved import.
+typedef struct {
+  fdn_string directory; // NULL in an empty slot.
+  fdn_string import;
+  const lsp_import_remapping *remapping; // That applied, or NULL.
+  uint32_t file;
+} ImportResolution;
+
+typedef struct {
+  ImportResolution *slots;
+  uint32_t slot_count; // A power of two.
+  uint32_t count;
+} ImportCache;
+
+// import_resolve_cached resolves the `import` in the file at `importer`,
+// remembering the resolution for the other files of its directory. A
+// remapping may apply to some files of a directory only, so the one that
+// applies is part of the key.
+static uint32_t import_resolve_cached(const lsp_import_graph *graph,
+                                      ImportCache *cache, fdn_arena *arena,
+                                      fdn_string importer, fdn_string import) {
+  fdn_string directory = import_directory(importer);
+  const lsp_import_remapping *remapping =
+      import_remapping(graph, importer, import);
+  uint32_t mask = cache->slot_count - 1;
+  uint32_t slot =
+      (uint32_t)fdn_string_hash(import, fdn_string_hash(directory, 0)) & mask;
+  while (cache->slots[slot].directory.string_start != NULL) {
+    const ImportResolution *cached = &cache->slots[slot];
+    if (cached->remapping == remapping &&
+        fdn_string_is_eq(cached->directory, directory) &&
+        fdn_string_is_eq(cached->import, import)) {
+      return cached->file;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  uint32_t file = lsp_import_graph_resolve(graph, arena, importer, import);
+  fdn_arena_reset(arena);
+
+  // A full cache only stops caching; it is sized for every import anyway.
+  if (cache->count + 1 < cache->slot_count) {
+    cache->slots[slot] =
+        (ImportResolution){directory, import, remapping, file};
+    cache->count++;
+  }
+  return file;
+}
+
+// import_add_remapping adds the remapping on a `line` of the
+// `remappings.txt` of the `folder`. Lines without one are skipped.
+static bool import_add_remapping(lsp_import_graph *graph, const char *folder,
+                                 const char *line) {
+  size_t length = strlen(line);
+  while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' ||
+                        line[length - 1] == ' ' || line[length - 1] == '\t')) {
+    length--;
+  }
+  while (length > 0 && (*line == ' ' || *line == '\t')) {
+    line++;
+    length--;
+  }
+
+  const char *equals = memchr(line, '=', length);
+  if (equals == NULL || equals == line) {
+    return true;
+  }
+  const char *colon = memchr(line, ':', (size_t)(equals - line));
+  const char *prefix = colon != NULL ? colon + 1 : line;
+  const char *target = equals + 1;
+
+  lsp_import_remapping *remappings =
+      realloc(graph->remappings,
+              (graph->remapping_count + 1) * sizeof(lsp_import_remapping));
+  if (remappings == NULL) {
+    return false;
+  }
+  graph->remappings = remappings;
+
+  fdn_string slash = FDN_STRING_LITERAL("/");
+  fdn_string context_parts[] = {
+      import_view(folder), slash,
+      fdn_string_create_view(line, colon != NULL ? (size_t)(colon - line) : 0)};
+  fdn_string prefix_parts[] = {
+      fdn_string_create_view(prefix, (size_t)(equals - prefix))};
+  fdn_string target_parts[] = {
+      import_view(*target == '/' ? "" : folder), slash,
+      fdn_string_create_view(target, length - (size_t)(target - line))};
+
+  lsp_import_remapping remapping = {
+      import_string(context_parts, colon != NULL ? 3 : 1, false),
+      import_string(prefix_parts, 1, false),
+      import_string(target_parts, 3, false)};
+  if (remapping.context == NULL || remapping.prefix == NULL ||
+      remapping.target == NULL) {
+    free(remapping.context);
+    free(remapping.prefix);
+    free(remapping.target);
+    return false;
+  }
+  graph->remappings[graph->remapping_count++] = remapping;
+  return true;
+}
+
+// import_read_remappings adds the remappings of the `remappings.txt` at the
+// root of the `folder`, if it has one.
+static bool import_read_remappings(lsp_import_graph *graph,
+                                   const char *folder) {
+  fdn_string parts[] = {import_view(folder),
+                        FDN_STRING_LITERAL("/remappings.txt")};
+  char *path = import_string(parts, 2, false);
+  if (path == NULL) {
+    return false;
+  }
+  FILE *file = fopen(path, "r");
+  free(path);
+  if (file == NULL) {
+    return true;
+  }
+
+  char line[4096];
+  bool read = true;
+  while (read && fgets(line, sizeof(line), file) != NULL) {
+    read = import_add_remapping(graph, folder, line);
+  }
+  fclose(file);
+  return read;
+}
+
+// import_add_missing remembers that the `import` of the `file` did not
+// resolve.
+static bool import_add_missing(lsp_import_graph *graph, uint32_t file,
+                               fdn_string import) {
+  if (graph->unresolved == graph->missing_capacity) {
+    uint32_t capacity =
+        graph->missing_capacity > 0 ? 2 * graph->missing_capacity : 16;
+    lsp_import_missing *missing =
+        realloc(graph->missing, capacity * sizeof(lsp_import_missing));
+    if (missing == NULL) {
+      return false;
+    }
+    graph->missing = missing;
+    graph->missing_capacity = capacity;
+  }
+
+  char *copy = import_string(&import, 1, false);
+  if (copy == NULL) {
+    return false;
+  }
+  graph->missing[graph->unresolved++] = (lsp_import_missing){file, copy};
+  return true;
+}
+
+// import_remove_missing forgets the unresolved imports of the `file`.
+static void import_remove_missing(lsp_import_graph *graph, uint32_t file) {
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < graph->unresolved; i++) {
+    if (graph->missing[i].file == file) {
+      free(graph->missing[i].import);
+    } else {
+      graph->missing[kept++] = graph->missing[i];
+    }
+  }
+  graph->unresolved = kept;
+}
+
+// import_hash_path adds the path of the `file` to the hash table of the paths.
+// A path listed twice keeps its first file.
+static void import_hash_path(lsp_import_graph *graph, uint32_t file) {
+  fdn_string path = import_view(graph->paths[file]);
+  uint32_t mask = graph->path_slot_count - 1;
+  uint32_t slot = (uint32_t)fdn_string_hash(path, 0) & mask;
+  while (graph->path_slots[slot] != LSP_IMPORT_NONE &&
+         strcmp(graph->paths[graph->path_slots[slot]], graph->paths[file]) !=
+             0) {
+    slot = (slot + 1) & mask;
+  }
+  if (graph->path_slots[slot] == LSP_IMPORT_NONE) {
+    graph->path_slots[slot] = file;
+  }
+}
+
+// import_add_paths copies the normalized paths of the `files` and hashes
+// them.
+static bool import_add_paths(lsp_import_graph *graph,
+                             const lsp_import_file *files,
+                             uint32_t file_count) {
+  uint32_t slot_count = 16;
+  while (slot_count < 2 * (uint64_t)file_count) {
+    slot_count *= 2;
+  }
+  graph->paths = calloc(file_count > 0 ? file_count : 1, sizeof(char *));
+  graph->path_slots = malloc(slot_count * sizeof(uint32_t));
+  if (graph->paths == NULL || graph->path_slots == NULL) {
+    return false;
+  }
+  memset(graph->path_slots, 0xff, slot_count * sizeof(uint32_t));
+  graph->path_slot_count = slot_count;
+  graph->file_count = file_count;
+
+  for (uint32_t i = 0; i < file_count; i++) {
+    fdn_string parts[] = {import_view(files[i].path)};
+    graph->paths[i] = import_string(parts, 1, true);
+    if (graph->paths[i] == NULL) {
+      return false;
+    }
+    import_hash_path(graph, i);
+  }
+  return true;
+}
+
+// import_collect resolves the imports of the `files` into the edges from
+// every file to the files it imports, skipping repeated imports.
+static bool import_collect(lsp_import_graph *graph,
+                           const lsp_import_file *files) {
+  uint32_t import_count = 0;
+  for (uint32_t f = 0; f < graph->file_count; f++) {
+    const SolNodeList *nodes = &files[f].syntax->nodes;
+    for (uint32_t node = 1; node < nodes->count;
+         node = sol_node_next_sibling(nodes, node)) {
+      import_count += nodes->kinds[node] == SOL_NODE_IMPORT;
+    }
+  }
+
+  ImportCache cache = {NULL, 16, 0};
+  while (cache.slot_count < 2 * (uint64_t)import_count) {
+    cache.slot_count *= 2;
+  }
+  cache.slots = calloc(cache.slot_count, sizeof(ImportResolution));
+  graph->import_starts =
+      malloc(((size_t)graph->file_count + 1) * sizeof(uint32_t));
+  graph->imports = malloc((import_count > 0 ? import_count : 1) *
+                          sizeof(uint32_t));
+  fdn_arena arena;
+  bool collected = cache.slots != NULL && graph->import_starts != NULL &&
+                   graph->imports != NULL &&
+                   fdn_arena_init(&arena, IMPORT_ARENA_BLOCK_SIZE);
+  if (!collected) {
+    free(cache.slots);
+    return false;
+  }
+
+  for (uint32_t f = 0; f < graph->file_count && collected; f++) {
+    const lsp_import_file *file = &files[f];
+    const SolSyntax *syntax = file->syntax;
+    fdn_string importer = import_view(file->path);
+    graph->import_starts[f] = graph->edge_count;
+    for (uint32_t node = 1; node < syntax->nodes.count;
+         node = sol_node_next_sibling(&syntax->nodes, node)) {
+      uint32_t token = lsp_import_path_token(syntax, node);
+      if (token == LSP_IMPORT_NONE) {
+        continue;
+      }
+
+      fdn_string import = lsp_import_unquote(
+          sol_token_text(&syntax->tokens, &file->source, token));
+      uint32_t imported =
+          import_resolve_cached(graph, &cache, &arena, importer, import);
+      if (imported == LSP_IMPORT_NONE) {
+        collected = import_add_missing(graph, f, import);
+        if (!collected) {
+          break;
+        }
+        continue;
+      }
+
+      bool repeated = imported == f;
+      for (uint32_t e = graph->import_starts[f];
+           e < graph->edge_count && !repeated; e++) {
+        repeated = graph->imports[e] == imported;
+      }
+      if (!repeated) {
+        graph->imports[graph->edge_count++] = imported;
+      }
+    }
+  }
+  graph->import_starts[graph->file_count] = graph->edge_count;
+
+  fdn_arena_free(&arena);
+  free(cache.slots);
+  return collected;
+}
+
+// import_invert lists the edges again by the file imported.
+static bool import_invert(lsp_import_graph *graph) {
+  uint32_t file_count = graph->file_count;
+  graph->dependent_starts = calloc((size_t)file_count + 1, sizeof(uint32_t));
+  graph->dependents = malloc(
+      (graph->edge_count > 0 ? graph->edge_count : 1) * sizeof(uint32_t));
+  if (graph->dependent_starts == NULL || graph->dependents == NULL) {
+    return false;
+  }
+
+  for (uint32_t e = 0; e < graph->edge_count; e++) {
+    graph->dependent_starts[graph->imports[e] + 1]++;
+  }
+  for (uint32_t f = 0; f < file_count; f++) {
+    graph->dependent_starts[f + 1] += graph->dependent_starts[f];
+  }
+
+  // The starts are moved on while the edges are placed, then moved back.
+  for (uint32_t f = 0; f < file_count; f++) {
+    for (uint32_t e = graph->import_starts[f]; e < graph->import_starts[f + 1];
+         e++) {
+      graph->dependents[graph->dependent_starts[graph->imports[e]]++] = f;
+    }
+  }
+  for (uint32_t f = file_count; f > 0; f--) {
+    graph->dependent_starts[f] = graph->dependent_starts[f - 1];
+  }
+  graph->dependent_starts[0] = 0;
+  return true;
+}
+
+// import_levels sorts the files into levels. The import cycles are found with
+// Tarjan's algorithm, run without recursion. It completes a cycle, or a file
+// outside of any, only after everything it imports, so the level of its files
+// is one above the highest level among those.
+static bool import_levels(lsp_import_graph *graph) {
+  uint32_t file_count = graph->file_count;
+  size_t slots = file_count > 0 ? file_count : 1;
+  uint32_t *scratch = malloc(6 * slots * sizeof(uint32_t));
+  graph->levels = malloc(slots * sizeof(uint32_t));
+  graph->order = malloc(slots * sizeof(uint32_t));
+  if (scratch == NULL || graph->levels == NULL || graph->order == NULL) {
+    free(scratch);
+    return false;
+  }
+
+  uint32_t *visits = scratch; // The visit number of every file.
+  uint32_t *lows = visits + slots;
+  uint32_t *cycles = lows + slots; // Set once the cycle of a file is done.
+  uint32_t *edges = cycles + slots; // The next import of a file to visit.
+  uint32_t *stack = edges + slots;
+  uint32_t *calls = stack + slots;
+  memset(visits, 0xff, slots * sizeof(uint32_t));
+  memset(cycles, 0xff, slots * sizeof(uint32_t));
+
+  uint32_t visit_count = 0;
+  uint32_t stack_count = 0;
+  uint32_t cycle_count = 0;
+  for (uint32_t root = 0; root < file_count; root++) {
+    if (visits[root] != LSP_IMPORT_NONE) {
+      continue;
+    }
+
+    uint32_t call_count = 0;
+    uint32_t visit = root;
+    while (true) {
+      if (visit != LSP_IMPORT_NONE) {
+        visits[visit] = lows[visit] = visit_count++;
+        edges[visit] = graph->import_starts[visit];
+        stack[stack_count++] = visit;
+        calls[call_count++] = visit;
+        visit = LSP_IMPORT_NONE;
+      }
+      if (call_count == 0) {
+        break;
+      }
+
+      uint32_t file = calls[call_count - 1];
+      if (edges[file] < graph->import_starts[file + 1]) {
+        uint32_t imported = graph->imports[edges[file]++];
+        if (visits[imported] == LSP_IMPORT_NONE) {
+          visit = imported;
+        } else if (cycles[imported] == LSP_IMPORT_NONE &&
+                   visits[imported] < lows[file]) {
+          lows[file] = visits[imported]; // Still on the stack.
+        }
+        continue;
+      }
+
+      call_count--;
+      if (call_count > 0 && lows[file] < lows[calls[call_count - 1]]) {
+        lows[calls[call_count - 1]] = lows[file];
+      }
+      if (lows[file] != visits[file]) {
+        continue;
+      }
+
+      // The `file` and the files above it on the stack form a cycle.
+      uint32_t first = stack_count;
+      do {
+        cycles[stack[--first]] = cycle_count;
+      } while (stack[first] != file);
+
+      uint32_t level = 0;
+      for (uint32_t s = first; s < stack_count; s++) {
+        uint32_t member = stack[s];
+        for (uint32_t e = graph->import_starts[member];
+             e < graph->import_starts[member + 1]; e++) {
+          uint32_t imported = graph->imports[e];
+          if (cycles[imported] != cycle_count &&
+              graph->levels[imported] >= level) {
+            level = graph->levels[imported] + 1;
+          }
+        }
+      }
+      for (uint32_t s = first; s < stack_count; s++) {
+        graph->levels[stack[s]] = level;
+      }
+      if (level >= graph->level_count) {
+        graph->level_count = level + 1;
+      }
+      stack_count = first;
+      cycle_count++;
+    }
+  }
+  free(scratch);
+
+  graph->level_starts =
+      calloc((size_t)graph->level_count + 1, sizeof(uint32_t));
+  if (graph->level_starts == NULL) {
+    return false;
+  }
+  for (uint32_t f = 0; f < file_count; f++) {
+    graph->level_starts[graph->levels[f] + 1]++;
+  }
+  for (uint32_t l = 0; l < graph->level_count; l++) {
+    graph->level_starts[l + 1] += graph->level_starts[l];
+  }
+  for (uint32_t f = 0; f < file_count; f++) {
+    graph->order[graph->level_starts[graph->levels[f]]++] = f;
+  }
+  for (uint32_t l = graph->level_count; l > 0; l--) {
+    graph->level_starts[l] = graph->level_starts[l - 1];
+  }
+  graph->level_starts[0] = 0;
+  return true;
+}
+
+bool lsp_import_graph_build(lsp_import_graph *graph, const fdn_string *folders,
+                            uint32_t folder_count, const lsp_import_file *files,
+                            uint32_t file_count) {
+  memset(graph, 0, sizeof(*graph));
+
+  graph->folders = calloc(folder_count > 0 ? folder_count : 1, sizeof(char *));
+  bool built = graph->folders != NULL;
+  for (uint32_t i = 0; built && i < folder_count; i++) {
+    graph->folders[i] = import_string(&folders[i], 1, true);
+    built = graph->folders[i] != NULL;
+    graph->folder_count += built;
+    built = built && import_read_remappings(graph, graph->folders[i]);
+  }
+
+  built = built && import_add_paths(graph, files, file_count) &&
+          import_collect(graph, files) && import_invert(graph) &&
+          import_levels(graph);
+  if (!built) {
+    lsp_import_graph_free(graph);
+  }
+  return built;
+}
+
+void lsp_import_graph_free(lsp_import_graph *graph) {
+  free(graph->import_starts);
+  free(graph->imports);
+  free(graph->dependent_starts);
+  free(graph->dependents);
+  free(graph->order);
+  free(graph->level_starts);
+  free(graph->levels);
+
+  for (uint32_t i = 0; i < graph->folder_count; i++) {
+    free(graph->folders[i]);
+  }
+  free(graph->folders);
+  for (uint32_t i = 0; i < graph->remapping_count; i++) {
+    free(graph->remappings[i].context);
+    free(graph->remappings[i].prefix);
+    free(graph->remappings[i].target);
+  }
+  free(graph->remappings);
+  for (uint32_t i = 0; i < graph->unresolved; i++) {
+    free(graph->missing[i].import);
+  }
+  free(graph->missing);
+  for (uint32_t i = 0; graph->paths != NULL && i < graph->file_count; i++) {
+    free(graph->paths[i]);
+  }
+  free(graph->paths);
+  free(graph->path_slots);
+  memset(graph, 0, sizeof(*graph));
+}
+
+/////////////////////////////////////////////////
+//                   UPDATES                   //
+/////////////////////////////////////////////////
+
+// import_is_workspace_source tells whether the normalized `path` is a `.sol`
+// file below one of the folders.
+static bool import_is_workspace_source(const lsp_import_graph *graph,
+                                       const char *path) {
+  size_t length = strlen(path);
+  if (length < 4 || strcmp(path + length - 4, ".sol") != 0) {
+    return false;
+  }
+  for (uint32_t i = 0; i < graph->folder_count; i++) {
+    const char *folder = graph->folders[i];
+    size_t folder_length = strlen(folder);
+    if (import_has_prefix(import_view(path), folder) &&
+        folder_length > 0 &&
+        (path[folder_length] == '/' || folder[folder_length - 1] == '/')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// import_add_file adds a file without imports at the normalized `path`, which
+// the graph takes over, and returns its index, or LSP_IMPORT_NONE.
+static uint32_t import_add_file(lsp_import_graph *graph, char *path) {
+  uint32_t file = graph->file_count;
+  char **paths = realloc(graph->paths, ((size_t)file + 1) * sizeof(char *));
+  if (paths == NULL) {
+    return LSP_IMPORT_NONE;
+  }
+  graph->paths = paths;
+  uint32_t *starts =
+      realloc(graph->import_starts, ((size_t)file + 2) * sizeof(uint32_t));
+  if (starts == NULL) {
+    return LSP_IMPORT_NONE;
+  }
+  graph->import_starts = starts;
+
+  // The paths are hashed again into a larger table once it is half full.
+  if (2 * ((uint64_t)file + 1) > graph->path_slot_count) {
+    uint32_t slot_count = 2 * graph->path_slot_count;
+    uint32_t *slots = malloc(slot_count * sizeof(uint32_t));
+    if (slots == NULL) {
+      return LSP_IMPORT_NONE;
+    }
+    free(graph->path_slots);
+    graph->path_slots = slots;
+    graph->path_slot_count = slot_count;
+    memset(slots, 0xff, slot_count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < file; i++) {
+      import_hash_path(graph, i);
+    }
+  }
+
+  graph->paths[file] = path;
+  graph->import_starts[file + 1] = graph->edge_count;
+  graph->file_count++;
+  import_hash_path(graph, file);
+  return file;
+}
+
+// import_set_edges replaces the imports of the `file` with the `count` files
+// at `imported`, moving the edges of the files after it.
+static bool import_set_edges(lsp_import_graph *graph, uint32_t file,
+                             const uint32_t *imported, uint32_t count) {
+  uint32_t start = graph->import_starts[file];
+  uint32_t end = graph->import_starts[file + 1];
+  uint32_t edge_count = graph->edge_count - (end - start) + count;
+  if (edge_count > graph->edge_count) {
+    uint32_t *imports =
+        realloc(graph->imports, (size_t)edge_count * sizeof(uint32_t));
+    if (imports == NULL) {
+      return false;
+    }
+    graph->imports = imports;
+  }
+
+  memmove(graph->imports + start + count, graph->imports + end,
+          (graph->edge_count - end) * sizeof(uint32_t));
+  memcpy(graph->imports + start, imported, count * sizeof(uint32_t));
+  for (uint32_t f = file + 1; f <= graph->file_count; f++) {
+    graph->import_starts[f] = graph->import_starts[f] - (end - start) + count;
+  }
+  graph->edge_count = edge_count;
+  return true;
+}
+
+// import_retry_missing resolves the imports that did not resolve so far again,
+// after a file was added, and adds the edges of those that do now.
+static bool import_retry_missing(lsp_import_graph *graph, fdn_arena *arena) {
+  uint32_t i = 0;
+  while (i < graph->unresolved) {
+    const lsp_import_missing *missing = &graph->missing[i];
+    uint32_t file = missing->file;
+    uint32_t imported =
+        lsp_import_graph_resolve(graph, arena, import_view(graph->paths[file]),
+                                 import_view(missing->import));
+    if (imported == LSP_IMPORT_NONE) {
+      i++;
+      continue;
+    }
+
+    free(missing->import);
+    graph->missing[i] = graph->missing[--graph->unresolved];
+    uint32_t start = graph->import_starts[file];
+    uint32_t count = graph->import_starts[file + 1] - start;
+    bool repeated = imported == file;
+    for (uint32_t e = 0; e < count && !repeated; e++) {
+      repeated = graph->imports[start + e] == imported;
+    }
+    uint32_t *edges = fdn_arena_alloc(arena, (count + 1) * sizeof(uint32_t));
+    if (edges == NULL) {
+      return false;
+    }
+    memcpy(edges, graph->imports + start, count * sizeof(uint32_t));
+    edges[count] = imported;
+    if (!repeated && !import_set_edges(graph, file, edges, count + 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// import_resolve_file resolves the imports of the `file` at the index `f` into
+// `edges`, allocated from the `arena`, and remembers those that do not
+// resolve. Returns how many edges there are, or UINT32_MAX if memory ran out.
+static uint32_t import_resolve_file(lsp_import_graph *graph, fdn_arena *arena,
+                                    const lsp_import_file *file, uint32_t f,
+                                    uint32_t **edges) {
+  const SolSyntax *syntax = file->syntax;
+  uint32_t import_count = 0;
+  for (uint32_t node = 1; node < syntax->nodes.count;
+       node = sol_node_next_sibling(&syntax->nodes, node)) {
+    import_count += syntax->nodes.kinds[node] == SOL_NODE_IMPORT;
+  }
+  *edges = fdn_arena_alloc(arena, (import_count > 0 ? import_count : 1) *
+                                      sizeof(uint32_t));
+  if (*edges == NULL) {
+    return UINT32_MAX;
+  }
+
+  import_remove_missing(graph, f);
+  fdn_string importer = import_view(graph->paths[f]);
+  uint32_t count = 0;
+  for (uint32_t node = 1; node < syntax->nodes.count;
+       node = sol_node_next_sibling(&syntax->nodes, node)) {
+    uint32_t token = lsp_import_path_token(syntax, node);
+    if (token == LSP_IMPORT_NONE) {
+      continue;
+    }
+
+    fdn_string import = lsp_import_unquote(
+        sol_token_text(&syntax->tokens, &file->source, token));
+    uint32_t imported =
+        lsp_import_graph_resolve(graph, arena, importer, import);
+    if (imported == LSP_IMPORT_NONE) {
+      if (!import_add_missing(graph, f, import)) {
+        return UINT32_MAX;
+      }
+      continue;
+    }
+
+    bool repeated = imported == f;
+    for (uint32_t e = 0; e < count && !repeated; e++) {
+      repeated = (*edges)[e] == imported;
+    }
+    if (!repeated) {
+      (*edges)[count++] = imported;
+    }
+  }
+  return count;
+}
+
+// import_reorder lists the edges by the file imported and sorts the files
+// into levels again.
+static bool import_reorder(lsp_import_graph *graph) {
+  free(graph->dependent_starts);
+  free(graph->dependents);
+  free(graph->order);
+  free(graph->level_starts);
+  free(graph->levels);
+  graph->dependent_starts = NULL;
+  graph->dependents = NULL;
+  graph->order = NULL;
+  graph->level_starts = NULL;
+  graph->levels = NULL;
+  graph->level_count = 0;
+  return import_invert(graph) && import_levels(graph);
+}
+
+bool lsp_import_graph_update(lsp_import_graph *graph, fdn_arena *arena,
+                             const lsp_import_file *file, uint32_t *index) {
+  *index = LSP_IMPORT_NONE;
+  if (graph->import_starts == NULL) {
+    return false; // The graph was never built, or memory ran out.
+  }
+
+  fdn_string parts[] = {import_view(file->path)};
+  char *path = import_string(parts, 1, true);
+  if (path == NULL) {
+    lsp_import_graph_free(graph);
+    return false;
+  }
+
+  uint32_t f = import_file_find(graph, import_view(path));
+  bool added = false;
+  if (f == LSP_IMPORT_NONE && import_is_workspace_source(graph, path)) {
+    f = import_add_file(graph, path);
+    added = f != LSP_IMPORT_NONE;
+    if (!added) {
+      free(path);
+    }
+    if (!added || !import_retry_missing(graph, arena)) {
+      lsp_import_graph_free(graph);
+      return false;
+    }
+  } else {
+    free(path);
+  }
+  if (f == LSP_IMPORT_NONE) {
+    return true;
+  }
+
+  uint32_t *edges;
+  uint32_t count = import_resolve_file(graph, arena, file, f, &edges);
+  bool updated = count != UINT32_MAX;
+
+  // Most edits leave the imports alone, and with them the levels.
+  uint32_t start = graph->import_starts[f];
+  bool changed =
+      updated && (count != graph->import_starts[f + 1] - start ||
+                  memcmp(edges, graph->imports + start,
+                         count * sizeof(uint32_t)) != 0);
+  updated = updated && (!changed || import_set_edges(graph, f, edges, count));
+  updated = updated && (!(added || changed) || import_reorder(graph));
+  if (!updated) {
+    lsp_import_graph_free(graph);
+    return false;
+  }
+  *index = f;
+  return true;
+}
+
+uint32_t lsp_import_graph_invalidate(const lsp_import_graph *graph,
+                                     fdn_arena *arena, uint32_t file,
+                                     uint32_t **files) {
+  if (file >= graph->file_count || graph->order == NULL) {
+    return 0;
+  }
+  uint32_t *queue = fdn_arena_alloc(arena, graph->file_count *
+                                               sizeof(uint32_t));
+  uint8_t *reached = fdn_arena_alloc_zero(arena, graph->file_count);
+  if (queue == NULL || reached == NULL) {
+    return 0;
+  }
+
+  uint32_t count = 0;
+  queue[count++] = file;
+  reached[file] = 1;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t imported = queue[i];
+    for (uint32_t d = graph->dependent_starts[imported];
+         d < graph->dependent_starts[imported + 1]; d++) {
+      uint32_t dependent = graph->dependents[d];
+      if (!reached[dependent]) {
+        reached[dependent] = 1;
+        queue[count++] = dependent;
+      }
+    }
+  }
+
+  // The files reached, in the order of their levels.
+  uint32_t listed = 0;
+  for (uint32_t i = 0; i < graph->file_count && listed < count; i++) {
+    if (reached[graph->order[i]]) {
+      queue[listed++] = graph->order[i];
+    }
+  }
+  *files = queue;
+  return count;
+}
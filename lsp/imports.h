@@ -0,0 +1,139 @@
+#ifndef LSP_IMPORTS_H
+#define LSP_IMPORTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libs/foundation.h"
+#include "solidity/parser.h"
+
+/**
+ * The graph of the `import` directives between the Solidity files of the
+ * workspace, which tells what an edit to a file invalidates: the file and,
+ * transitively, every file importing it.
+ *
+ * The path of an import is resolved the way the toolchains do:
+ *
+ *   "./A.sol", "../A.sol"   relative to the directory of the importing file
+ *   remappings              the `remappings.txt` of a workspace folder
+ *                           (Foundry), `[context:]prefix=target`; the longest
+ *                           context and then the longest prefix wins
+ *   "src/A.sol"             below every workspace folder, and below the `src/`
+ *                           or the root of its dependency in `lib/`
+ *                           ("forge-std/Test.sol")
+ *   "@oz/token/A.sol"       in the `node_modules` of the directory of the
+ *                           importing file or of any directory above it
+ *                           (Hardhat, npm)
+ *
+ * Only the files of the workspace are candidates; the imports of anything else
+ * are counted as unresolved. The files of a directory import much the same
+ * paths, so the resolutions are cached by directory, import path and the
+ * remapping that applies while the graph is built.
+ *
+ * The edges are kept both ways in compressed arrays. The files are also sorted
+ * into levels: a file is on a level above every file it imports, so the files
+ * of one level are independent of each other and can be analysed in parallel
+ * once the levels below are done. The files of an import cycle, which
+ * Solidity allows, depend on each other and share a level.
+ *
+ * After an edit, the imports of the file edited are resolved again and the
+ * graph is updated in place: its edges are replaced, the other files keep
+ * theirs, and the levels are sorted again. A file that is not in the graph yet
+ * is added, and the imports that did not resolve so far are tried against it.
+ */
+
+#define LSP_IMPORT_NONE UINT32_MAX
+
+// A file as given to the build.
+typedef struct {
+  const char *path; // Absolute and null-terminated.
+  fdn_string source;
+  const SolSyntax *syntax;
+} lsp_import_file;
+
+// An import that did not resolve, tried again when a file is added.
+typedef struct {
+  uint32_t file; // The importing file.
+  char *import;  // Null-terminated.
+} lsp_import_missing;
+
+// A line of a `remappings.txt`; the strings are null-terminated.
+typedef struct {
+  char *context; // Absolute; the folder if the line has no context.
+  char *prefix;
+  char *target; // Absolute.
+} lsp_import_remapping;
+
+typedef struct {
+  // The files imported by the file `f` are `imports[import_starts[f]]` up to
+  // `imports[import_starts[f + 1]]`, and likewise for the files importing it.
+  uint32_t *import_starts; // `file_count + 1` entries.
+  uint32_t *imports;
+  uint32_t *dependent_starts;
+  uint32_t *dependents;
+
+  // The files by level, the files of the level `l` being `order[level_starts
+  // [l]]` up to `order[level_starts[l + 1]]`.
+  uint32_t *order;
+  uint32_t *level_starts; // `level_count + 1` entries.
+  uint32_t *levels;       // The level of every file.
+  uint32_t level_count;
+
+  uint32_t file_count;
+  uint32_t edge_count;
+  uint32_t unresolved; // Imports of files outside of the workspace.
+  lsp_import_missing *missing; // `unresolved` of them.
+  uint32_t missing_capacity;
+
+  // What the resolution needs after the build.
+  char **folders;
+  uint32_t folder_count;
+  lsp_import_remapping *remappings;
+  uint32_t remapping_count;
+  char **paths;         // Of the files, normalized.
+  uint32_t *path_slots; // Hash table of the files by path.
+  uint32_t path_slot_count;
+} lsp_import_graph;
+
+// lsp_import_graph_build collects and resolves the imports of the
+// `file_count` files of the `folders`, reading the `remappings.txt` at the
+// root of every folder. Returns `false` if memory ran out; the graph is empty
+// then.
+bool lsp_import_graph_build(lsp_import_graph *graph, const fdn_string *folders,
+                            uint32_t folder_count, const lsp_import_file *files,
+                            uint32_t file_count);
+
+void lsp_import_graph_free(lsp_import_graph *graph);
+
+// lsp_import_graph_update resolves the imports of the `file` again, adding it
+// if it is a `.sol` file of a folder that the graph does not have yet. Sets
+// `index` to the file in the graph, or to LSP_IMPORT_NONE if it is not part of
+// the workspace. Returns `false` if memory ran out; the graph is empty then.
+bool lsp_import_graph_update(lsp_import_graph *graph, fdn_arena *arena,
+                             const lsp_import_file *file, uint32_t *index);
+
+// lsp_import_path_token returns the string token with the path of the import
+// directive `node` of the `syntax`, or LSP_IMPORT_NONE.
+uint32_t lsp_import_path_token(const SolSyntax *syntax, uint32_t node);
+
+// lsp_import_at returns the string token with the path of an import directive
+// of the `syntax` that contains the `offset`, or LSP_IMPORT_NONE.
+uint32_t lsp_import_at(const SolSyntax *syntax, uint32_t offset);
+
+// lsp_import_unquote returns the path in the `text` of a string token.
+fdn_string lsp_import_unquote(fdn_string text);
+
+// lsp_import_graph_resolve returns the file that the `import` path in the
+// file at `importer` refers to, or LSP_IMPORT_NONE.
+uint32_t lsp_import_graph_resolve(const lsp_import_graph *graph,
+                                  fdn_arena *arena, fdn_string importer,
+                                  fdn_string import);
+
+// lsp_import_graph_invalidate lists the files that an edit to the `file`
+// invalidates, itself included, in `files` allocated from the `arena`, sorted
+// by level. Returns how many there are, or 0 if memory ran out.
+uint32_t lsp_import_graph_invalidate(const lsp_import_graph *graph,
+                                     fdn_arena *arena, uint32_t file,
+                                     uint32_t **files);
+
+#endif // LSP_IMPORTS_H
@@ -0,0 +1,361 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "documents.h"
+#include "libs/foundation.h"
+#include "references.h"
+#include "solidity/parser.h"
+
+/////////////////////////////////////////////////
+//                  COLLECTING                 //
+/////////////////////////////////////////////////
+
+void lsp_reference_cache_init(lsp_reference_cache *cache) {
+  memset(cache->slots, 0, sizeof(cache->slots));
+}
+
+// reference_slot returns the slot of the identifier `text` in a cache. A
+// collision only costs a trip to the interner, so the hash only mixes the
+// length and the first and last eight bytes.
+static uint32_t reference_slot(fdn_string text) {
+  uint64_t head = 0;
+  uint64_t tail = 0;
+  size_t length = text.string_length < 8 ? text.string_length : 8;
+  memcpy(&head, text.string_start, length);
+  memcpy(&tail, text.string_start + text.string_length - length, length);
+  uint64_t hash = (head ^ (tail * 0x9e3779b97f4a7c15ULL) ^
+                   text.string_length) *
+                  0xff51afd7ed558ccdULL;
+  return (uint32_t)(hash >> 40) & (LSP_REFERENCE_CACHE_SLOTS - 1);
+}
+
+// reference_intern returns the id of the identifier `text`, looking in the
+// `cache` before the interner.
+static uint32_t reference_intern(fdn_interner *names,
+                                 lsp_reference_cache *cache, fdn_string text) {
+  uint32_t slot = reference_slot(text);
+  lsp_reference_cache_slot *cached = &cache->slots[slot];
+  if (cached->text != NULL && cached->length == text.string_length &&
+      memcmp(cached->text, text.string_start, text.string_length) == 0) {
+    return cached->id;
+  }
+
+  uint32_t id = fdn_interner_intern(names, text);
+  if (id != FDN_INTERNER_NONE) {
+    cached->text = fdn_interner_string(names, id).string_start;
+    cached->length = (uint32_t)text.string_length;
+    cached->id = id;
+  }
+  return id;
+}
+
+#define REFERENCE_ONES 0x0101010101010101ULL
+#define REFERENCE_HIGHS 0x8080808080808080ULL
+
+// position_advance moves the `position` at the offset `at` of the `text` on
+// to the `offset`. Columns count UTF-16 code units: one for every byte but
+// the continuation bytes of UTF-8, and two for the characters past U+FFFF.
+// Eight bytes at a time are skipped while they hold no newline and no
+// non-ASCII byte, which is most of the time.
+static void position_advance(const char *text, uint32_t *at, uint32_t offset,
+                             lsp_position *position) {
+  uint32_t i = *at;
+  while (i < offset) {
+    if (offset - i >= 8) {
+      uint64_t word;
+      memcpy(&word, text + i, sizeof(word));
+      uint64_t newlines = word ^ (REFERENCE_ONES * '\n');
+      if (((word | ((newlines - REFERENCE_ONES) & ~newlines)) &
+           REFERENCE_HIGHS) == 0) {
+        position->character += 8;
+        i += 8;
+        continue;
+      }
+    }
+
+    unsigned char byte = (unsigned char)text[i++];
+    if (byte == '\n') {
+      position->line++;
+      position->character = 0;
+    } else if ((byte & 0xc0) != 0x80) {
+      position->character += byte >= 0xf0 ? 2 : 1;
+    }
+  }
+  *at = i;
+}
+
+bool lsp_references_collect(const SolSyntax *syntax, fdn_string source,
+                            fdn_interner *names, lsp_reference_cache *cache,
+                            lsp_reference_list *list) {
+  lsp_reference_list_free(list);
+
+  const SolTokenList *tokens = &syntax->tokens;
+  uint32_t count = 0;
+  for (uint32_t token = 0; token < tokens->count; token++) {
+    count += tokens->types[token] == SOL_TOKEN_IDENTIFIER;
+  }
+
+  list->names = malloc((count > 0 ? count : 1) * sizeof(uint32_t));
+  list->positions = malloc((count > 0 ? count : 1) * sizeof(lsp_position));
+  if (list->names == NULL || list->positions == NULL) {
+    lsp_reference_list_free(list);
+    return false;
+  }
+
+  // The position is carried from one identifier to the next, so the source is
+  // read once.
+  uint32_t at = 0;
+  lsp_position position = {0, 0};
+  for (uint32_t token = 0; token < tokens->count; token++) {
+    if (tokens->types[token] != SOL_TOKEN_IDENTIFIER) {
+      continue;
+    }
+
+    uint32_t offset = tokens->starts[token];
+    position_advance(source.string_start, &at, offset, &position);
+
+    uint32_t name = reference_intern(
+        names, cache, sol_token_text(tokens, &source, token));
+    if (name == FDN_INTERNER_NONE) {
+      lsp_reference_list_free(list);
+      return false;
+    }
+    list->names[list->count] = name;
+    list->positions[list->count] = position;
+    list->count++;
+  }
+  return true;
+}
+
+void lsp_reference_list_free(lsp_reference_list *list) {
+  free(list->names);
+  free(list->positions);
+  memset(list, 0, sizeof(*list));
+}
+
+/////////////////////////////////////////////////
+//                    INDEX                    //
+/////////////////////////////////////////////////
+
+// The lowest two bits of the first varint of an occurrence.
+typedef enum {
+  STEP_COLUMNS = 0,
+  STEP_LINES = 1,
+  STEP_FILES = 2,
+} ReferenceStep;
+
+static uint32_t varint_size(uint64_t value) {
+  uint32_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+static uint8_t *varint_write(uint8_t *at, uint64_t value) {
+  while (value >= 0x80) {
+    *at++ = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *at++ = (uint8_t)value;
+  return at;
+}
+
+static uint64_t varint_read(const uint8_t **at, const uint8_t *end) {
+  uint64_t value = 0;
+  for (uint32_t shift = 0; *at < end && shift < 64; shift += 7) {
+    uint8_t byte = *(*at)++;
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      break;
+    }
+  }
+  return value;
+}
+
+// The previous occurrence of every name while the streams are encoded.
+typedef struct {
+  uint32_t *files;
+  lsp_position *positions;
+  uint32_t *ends; // The size of the stream so far, then where it goes on.
+} ReferenceCursors;
+
+// reference_steps sets the varints of an occurrence of the `name` relative to
+// its previous one, and returns how many there are.
+static uint32_t reference_steps(const lsp_reference_index *index,
+                                const ReferenceCursors *cursors, uint32_t name,
+                                uint32_t file, lsp_position position,
+                                uint64_t values[3]) {
+  bool first = index->counts[name] == 0;
+  uint32_t previous_file = first ? 0 : cursors->files[name];
+  lsp_position previous = cursors->positions[name];
+
+  if (first || file != previous_file) {
+    values[0] = ((uint64_t)(file - previous_file) << 2) | STEP_FILES;
+    values[1] = position.line;
+    values[2] = position.character;
+    return 3;
+  }
+  if (position.line != previous.line) {
+    values[0] = ((uint64_t)(position.line - previous.line) << 2) | STEP_LINES;
+    values[1] = position.character;
+    return 2;
+  }
+  values[0] = (uint64_t)(position.character - previous.character) << 2;
+  return 1;
+}
+
+// index_encode walks every occurrence in order, either to size the streams
+// or, once `index->data` is allocated, to write them.
+static void index_encode(lsp_reference_index *index,
+                         const ReferenceCursors *cursors,
+                         const lsp_reference_list *files,
+                         uint32_t file_count) {
+  for (uint32_t file = 0; file < file_count; file++) {
+    const lsp_reference_list *list = &files[file];
+    for (uint32_t i = 0; i < list->count; i++) {
+      uint32_t name = list->names[i];
+      lsp_position position = list->positions[i];
+      uint64_t values[3];
+      uint32_t value_count =
+          reference_steps(index, cursors, name, file, position, values);
+      for (uint32_t v = 0; v < value_count; v++) {
+        if (index->data == NULL) {
+          cursors->ends[name] += varint_size(values[v]);
+        } else {
+          uint8_t *at = index->data + cursors->ends[name];
+          cursors->ends[name] = (uint32_t)(varint_write(at, values[v]) -
+                                           index->data);
+        }
+      }
+      cursors->files[name] = file;
+      cursors->positions[name] = position;
+      index->counts[name]++;
+    }
+  }
+}
+
+bool lsp_reference_index_build(lsp_reference_index *index, uint32_t name_count,
+                               const lsp_reference_list *files,
+                               uint32_t file_count) {
+  memset(index, 0, sizeof(*index));
+
+  size_t slots = name_count > 0 ? name_count : 1;
+  ReferenceCursors cursors = {malloc(slots * sizeof(uint32_t)),
+                              malloc(slots * sizeof(lsp_position)),
+                              calloc(slots, sizeof(uint32_t))};
+  index->starts = malloc(((size_t)name_count + 1) * sizeof(uint32_t));
+  index->counts = calloc(slots, sizeof(uint32_t));
+  bool built = cursors.files != NULL && cursors.positions != NULL &&
+               cursors.ends != NULL && index->starts != NULL &&
+               index->counts != NULL;
+  for (uint32_t file = 0; built && file < file_count; file++) {
+    for (uint32_t i = 0; built && i < files[file].count; i++) {
+      built = files[file].names[i] < name_count;
+    }
+  }
+
+  // The first pass sizes the stream of every name, the second writes them.
+  uint64_t size = 0;
+  if (built) {
+    index->name_count = name_count;
+    index_encode(index, &cursors, files, file_count);
+    for (uint32_t name = 0; name < name_count; name++) {
+      index->starts[name] = (uint32_t)size;
+      size += cursors.ends[name];
+      cursors.ends[name] = index->starts[name];
+      index->reference_count += index->counts[name];
+    }
+    index->starts[name_count] = (uint32_t)size;
+    built = size <= UINT32_MAX;
+  }
+  if (built) {
+    index->data = malloc(size > 0 ? (size_t)size : 1);
+    built = index->data != NULL;
+  }
+  if (built) {
+    memset(index->counts, 0, name_count * sizeof(uint32_t));
+    index_encode(index, &cursors, files, file_count);
+  }
+
+  free(cursors.files);
+  free(cursors.positions);
+  free(cursors.ends);
+  if (!built) {
+    lsp_reference_index_free(index);
+  }
+  return built;
+}
+
+void lsp_reference_index_free(lsp_reference_index *index) {
+  free(index->data);
+  free(index->starts);
+  free(index->counts);
+  memset(index, 0, sizeof(*index));
+}
+
+uint32_t lsp_reference_index_find(const lsp_reference_index *index,
+                                  uint32_t name, lsp_reference *references) {
+  uint32_t expected = lsp_reference_index_count(index, name);
+  if (expected == 0) {
+    return 0;
+  }
+
+  const uint8_t *at = index->data + index->starts[name];
+  const uint8_t *end = index->data + index->starts[name + 1];
+  lsp_reference reference = {0, {0, 0}};
+  uint32_t count = 0;
+  while (at < end && count < expected) {
+    uint64_t step = varint_read(&at, end);
+    uint32_t distance = (uint32_t)(step >> 2);
+    switch ((ReferenceStep)(step & 3)) {
+    case STEP_FILES:
+      reference.file += distance;
+      reference.position.line = (uint32_t)varint_read(&at, end);
+      reference.position.character = (uint32_t)varint_read(&at, end);
+      break;
+    case STEP_LINES:
+      reference.position.line += distance;
+      reference.position.character = (uint32_t)varint_read(&at, end);
+      break;
+    default:
+      reference.position.character += distance;
+      break;
+    }
+    references[count++] = reference;
+  }
+  return count;
+}
+
+/////////////////////////////////////////////////
+//                    TOKENS                   //
+/////////////////////////////////////////////////
+
+uint32_t lsp_identifier_at(const SolSyntax *syntax, uint32_t offset) {
+  const SolTokenList *tokens = &syntax->tokens;
+
+  // The last token starting at the offset or before it.
+  uint32_t low = 0;
+  uint32_t high = tokens->count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (tokens->starts[middle] <= offset) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  // The cursor may also sit right after an identifier, before the token that
+  // starts there.
+  for (uint32_t token = low; token > 0 && low - token < 2; token--) {
+    if (tokens->types[token - 1] == SOL_TOKEN_IDENTIFIER &&
+        offset <= tokens->starts[token - 1] + tokens->lengths[token - 1]) {
+      return token - 1;
+    }
+  }
+  return LSP_REFERENCE_NONE;
+}
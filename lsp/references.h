@@ -0,0 +1,111 @@
+#ifndef LSP_REFERENCES_H
+#define LSP_REFERENCES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "documents.h"
+#include "libs/foundation.h"
+#include "solidity/parser.h"
+
+/**
+ * Where every identifier of the workspace occurs, for `textDocument/references`
+ * and `textDocument/definition`.
+ *
+ * The occurrences are grouped by the interned name of the identifier. Those of
+ * a name are one stream of bytes, sorted by file and then by position, and
+ * delta-encoded so that a dependency tree with millions of identifiers takes
+ * about two bytes per occurrence. Positions are stored as the LSP wants them,
+ * lines and UTF-16 columns, so finding the references of a name decodes its
+ * stream and never reads the sources. Every occurrence starts with a varint
+ * (7 bits per byte, the high bit set on all bytes but the last) whose lowest
+ * two bits tell how far it is from the previous one:
+ *
+ *   columns << 2        further on the same line
+ *   lines << 2 | 1      on a later line; then a varint with the column
+ *   files << 2 | 2      in a later file; then varints with the line and the
+ *                       column
+ *
+ * The first occurrence of a name counts its files from the first file.
+ *
+ * Identifiers are matched by their spelling: without types, every `transfer`
+ * of the workspace is a reference of `IERC20.transfer`.
+ */
+
+#define LSP_REFERENCE_NONE UINT32_MAX
+
+// Slots of an lsp_reference_cache; a power of two.
+#define LSP_REFERENCE_CACHE_SLOTS 4096
+
+typedef struct {
+  uint32_t file; // The index of the file, as given to the build.
+  lsp_position position;
+} lsp_reference;
+
+// The identifiers of one file, in the order of the source.
+typedef struct {
+  uint32_t *names; // Interned.
+  lsp_position *positions;
+  uint32_t count;
+} lsp_reference_list;
+
+// The identifiers interned last by a thread, by the hash of their text, so
+// that the names repeated all over a file skip the lock of the interner.
+typedef struct {
+  const char *text; // The interned copy; NULL in an empty slot.
+  uint32_t length;
+  uint32_t id;
+} lsp_reference_cache_slot;
+
+typedef struct {
+  lsp_reference_cache_slot slots[LSP_REFERENCE_CACHE_SLOTS];
+} lsp_reference_cache;
+
+typedef struct {
+  // The occurrences of the name with the interned id `n` are encoded in
+  // `data[starts[n]]` up to `data[starts[n + 1]]`, `counts[n]` of them.
+  uint8_t *data;
+  uint32_t *starts; // `name_count + 1` entries.
+  uint32_t *counts;
+  uint32_t name_count;
+  uint64_t reference_count;
+} lsp_reference_index;
+
+void lsp_reference_cache_init(lsp_reference_cache *cache);
+
+// lsp_references_collect replaces the `list` with the identifiers of the
+// `syntax` of `source`, the text it was parsed from, interning their names in
+// `names`. Returns `false` if memory ran out.
+bool lsp_references_collect(const SolSyntax *syntax, fdn_string source,
+                            fdn_interner *names, lsp_reference_cache *cache,
+                            lsp_reference_list *list);
+
+void lsp_reference_list_free(lsp_reference_list *list);
+
+// lsp_reference_index_build indexes the identifiers of the `file_count` files,
+// whose names are interned ids below `name_count`. Returns `false` if memory
+// ran out; the index is empty then.
+bool lsp_reference_index_build(lsp_reference_index *index, uint32_t name_count,
+                               const lsp_reference_list *files,
+                               uint32_t file_count);
+
+void lsp_reference_index_free(lsp_reference_index *index);
+
+// lsp_reference_index_count returns the number of occurrences of the interned
+// `name`.
+static inline uint32_t
+lsp_reference_index_count(const lsp_reference_index *index, uint32_t name) {
+  return name < index->name_count ? index->counts[name] : 0;
+}
+
+// lsp_reference_index_find writes the occurrences of the interned `name` to
+// `references`, which has room for lsp_reference_index_count of them, sorted
+// by file and then by position. Returns how many it wrote.
+uint32_t lsp_reference_index_find(const lsp_reference_index *index,
+                                  uint32_t name, lsp_reference *references);
+
+// lsp_identifier_at returns the identifier token of the `syntax` that contains
+// the `offset` or ends at it, or LSP_REFERENCE_NONE.
+uint32_t lsp_identifier_at(const SolSyntax *syntax, uint32_t offset);
+
+#endif // LSP_REFERENCES_H
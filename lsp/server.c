@@ -0,0 +1,373 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dispatcher.h"
+#include "json/parser.h"
+#include "libs/foundation.h"
+#include "server.h"
+#include "transport.h"
+
+#define SERVER_ARENA_BLOCK_SIZE (64 * 1024)
+
+// A request for the workers, with its own copy of the message.
+struct lsp_server_job {
+  lsp_server_job *previous; // In `jobs_in_flight`.
+  lsp_server_job *next;
+  fdn_string method; // Views into `body`.
+  fdn_string params;
+  fdn_string uri; // Of the document it is about, decoded; may be empty.
+  int32_t id;
+  bool has_id;
+  int32_t cancelled; // The lsp_error_code, or 0; accessed atomically.
+  char body[]; // Followed by the decoded `uri`.
+};
+
+// A message for the writer.
+typedef struct {
+  size_t length;
+  char body[];
+} ServerMessage;
+
+// server_send queues a copy of the `body` for the writer.
+static bool server_send(void *sender, fdn_string body) {
+  lsp_server *server = sender;
+  ServerMessage *message = malloc(sizeof(ServerMessage) + body.string_length);
+  if (message == NULL) {
+    return false;
+  }
+
+  message->length = body.string_length;
+  memcpy(message->body, body.string_start, body.string_length);
+  if (!fdn_queue_push(&server->messages, message)) {
+    free(message);
+    return false;
+  }
+  return true;
+}
+
+static void *server_write(void *argument) {
+  lsp_server *server = argument;
+  void *item;
+  bool failed = false;
+  while (fdn_queue_pop(&server->messages, &item)) {
+    ServerMessage *message = item;
+    // Once the client is gone, the rest is dropped.
+    if (!failed &&
+        lsp_transport_write_message(
+            server->transport,
+            fdn_string_create_view(message->body, message->length)) !=
+            LSP_TRANSPORT_OK) {
+      fdn_error("Failed to write a message to the client.");
+      failed = true;
+    }
+    free(message);
+  }
+  return NULL;
+}
+
+// server_unlist removes the `job` from the jobs in flight.
+static void server_unlist(lsp_server *server, lsp_server_job *job) {
+  pthread_mutex_lock(&server->jobs_lock);
+  if (job->previous != NULL) {
+    job->previous->next = job->next;
+  } else {
+    server->jobs_in_flight = job->next;
+  }
+  if (job->next != NULL) {
+    job->next->previous = job->previous;
+  }
+  pthread_mutex_unlock(&server->jobs_lock);
+}
+
+static void *server_work(void *argument) {
+  lsp_server_worker *worker = argument;
+  lsp_server *server = worker->server;
+  void *item;
+  while (fdn_queue_pop(&server->jobs, &item)) {
+    lsp_server_job *job = item;
+    worker->context.cancelled = &job->cancelled;
+    dispatch_message(&worker->context, job->method, job->has_id, job->id,
+                     job->params);
+    worker->context.cancelled = NULL;
+    fdn_arena_reset(&worker->arena);
+    server_unlist(server, job);
+    free(job);
+    __atomic_sub_fetch(&server->jobs_pending, 1, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+// server_find returns the value at the `path` of the `params`, escaped, or an
+// empty string if there is no value of the `type` there.
+static fdn_string server_find(fdn_string params, const char *path,
+                              JsonType type) {
+  JsonPath compiled;
+  JsonValue value;
+  if (params.string_start == NULL || !json_path_compile(path, &compiled) ||
+      !parser_find_paths(params, &compiled, 1, &value) || !value.found ||
+      value.type != type) {
+    return (fdn_string){NULL, 0};
+  }
+  return value.literal;
+}
+
+// server_find_uri decodes the `escaped` URI into `output`, which needs room for
+// its escaped length, so that URIs escaped differently compare equal. Returns
+// an empty string if there is none or it is malformed.
+static fdn_string server_find_uri(fdn_string escaped, char *output) {
+  size_t length;
+  if (escaped.string_length == 0 ||
+      !json_string_unescape(escaped, output, &length)) {
+    return (fdn_string){NULL, 0};
+  }
+  return fdn_string_create_view(output, length);
+}
+
+// server_cancel cancels the jobs in flight that are the request `id`, or if
+// `by_uri`, that are about the document at the decoded `uri`, with the error
+// `code`.
+// A job keeps the error it was cancelled with first.
+static void server_cancel(lsp_server *server, bool by_uri, int32_t id,
+                          fdn_string uri, lsp_error_code code) {
+  pthread_mutex_lock(&server->jobs_lock);
+  for (lsp_server_job *job = server->jobs_in_flight; job != NULL;
+       job = job->next) {
+    bool matches = by_uri ? job->uri.string_length > 0 &&
+                                fdn_string_is_eq(job->uri, uri)
+                          : job->has_id && job->id == id;
+    int32_t expected = 0;
+    if (matches) {
+      __atomic_compare_exchange_n(&job->cancelled, &expected, (int32_t)code,
+                                  false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&server->jobs_lock);
+}
+
+// server_cancel_request handles a $/cancelRequest. Requests that are answered
+// already, or that were never read, are not an error.
+static void server_cancel_request(lsp_server *server, fdn_string params) {
+  fdn_string id = server_find(params, "id", JSON_NUMBER);
+  if (id.string_length == 0) {
+    fdn_error("Only requests with a number as id can be cancelled.");
+    return;
+  }
+  server_cancel(server, false, (int32_t)strtol(id.string_start, NULL, 10),
+                (fdn_string){NULL, 0}, LSP_ERROR_REQUEST_CANCELLED);
+}
+
+// server_rebase moves a `view` into the `body` to the same place in its `copy`.
+static fdn_string server_rebase(fdn_string view, const char *body,
+                                const char *copy) {
+  if (view.string_start == NULL) {
+    return view;
+  }
+  return fdn_string_create_view(copy + (view.string_start - body),
+                                view.string_length);
+}
+
+// server_queue_job copies the `request`, whose fields are views into the
+// `body`, into a job for the workers.
+static bool server_queue_job(lsp_server *server, fdn_string body,
+                             const RequestMessage *request) {
+  fdn_string uri =
+      server_find(request->params, "textDocument.uri", JSON_STRING);
+  lsp_server_job *job = malloc(sizeof(lsp_server_job) + body.string_length +
+                               1 + uri.string_length);
+  if (job == NULL) {
+    return false;
+  }
+
+  // The parsers expect the body to be null-terminated.
+  memcpy(job->body, body.string_start, body.string_length + 1);
+  job->method = server_rebase(request->method, body.string_start, job->body);
+  job->params = server_rebase(request->params, body.string_start, job->body);
+  job->uri = server_find_uri(uri, job->body + body.string_length + 1);
+  job->id = request->id;
+  job->has_id = request->has_id;
+  job->cancelled = 0;
+
+  pthread_mutex_lock(&server->jobs_lock);
+  job->previous = NULL;
+  job->next = server->jobs_in_flight;
+  if (job->next != NULL) {
+    job->next->previous = job;
+  }
+  server->jobs_in_flight = job;
+  pthread_mutex_unlock(&server->jobs_lock);
+
+  __atomic_add_fetch(&server->jobs_pending, 1, __ATOMIC_RELAXED);
+  if (!fdn_queue_push(&server->jobs, job)) {
+    __atomic_sub_fetch(&server->jobs_pending, 1, __ATOMIC_RELAXED);
+    server_unlist(server, job);
+    free(job);
+    return false;
+  }
+  return true;
+}
+
+bool lsp_server_init(lsp_server *server, lsp_transport *transport,
+                     uint32_t worker_count) {
+  memset(server, 0, sizeof(*server));
+  server->transport = transport;
+  pthread_mutex_init(&server->jobs_lock, NULL);
+  if (!fdn_queue_init(&server->jobs, LSP_SERVER_QUEUE_SIZE) ||
+      !fdn_queue_init(&server->messages, LSP_SERVER_QUEUE_SIZE)) {
+    lsp_server_free(server);
+    return false;
+  }
+
+  if (worker_count == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    worker_count = cores > 0 ? (uint32_t)cores : 1;
+  }
+  if (worker_count > LSP_SERVER_MAX_WORKERS) {
+    worker_count = LSP_SERVER_MAX_WORKERS;
+  }
+
+  server->writer_started =
+      pthread_create(&server->writer, NULL, server_write, server) == 0;
+  bool started = server->writer_started;
+  while (started && server->worker_count < worker_count) {
+    lsp_server_worker *worker = &server->workers[server->worker_count];
+    worker->server = server;
+    started = fdn_arena_init(&worker->arena, SERVER_ARENA_BLOCK_SIZE);
+    if (started && !lsp_context_init(&worker->context, &worker->arena,
+                                     server_send, server)) {
+      fdn_arena_free(&worker->arena);
+      started = false;
+    }
+    if (started &&
+        pthread_create(&worker->thread, NULL, server_work, worker) != 0) {
+      lsp_context_free(&worker->context);
+      fdn_arena_free(&worker->arena);
+      started = false;
+    }
+    server->worker_count += started;
+  }
+
+  if (!started) {
+    lsp_server_free(server);
+  }
+  return started;
+}
+
+int lsp_server_run(lsp_server *server) {
+  // The scratch arena holds everything that belongs to a single message read
+  // and is reset once the message is handled or queued.
+  fdn_arena arena;
+  lsp_context context;
+  if (!fdn_arena_init(&arena, SERVER_ARENA_BLOCK_SIZE)) {
+    return 1;
+  }
+  if (!lsp_context_init(&context, &arena, server_send, server)) {
+    fdn_arena_free(&arena);
+    return 1;
+  }
+
+  int exit_status = 1;
+  while (1) {
+    fdn_string body;
+    lsp_transport_status transport_status =
+        lsp_transport_read_message(server->transport, &body);
+
+    if (transport_status != LSP_TRANSPORT_OK) {
+      fdn_error("Failed to read the next message (status %d).",
+                (int)transport_status);
+      break;
+    }
+
+    // Only a preview of the body is logged; didOpen/didChange carry whole
+    // files.
+    fdn_info("Raw request message (%zu bytes): %.*s", body.string_length,
+             body.string_length > 256 ? 256 : (int)body.string_length,
+             body.string_start);
+
+    RequestMessage *request =
+        parser_parse_request_message(&arena, body.string_start);
+    if (request == NULL) {
+      break;
+    }
+
+    fdn_info("Dispatching method: %.*s", (int)request->method.string_length,
+             request->method.string_start);
+
+    const dispatch_entry *entry = dispatch_lookup(request->method);
+    lsp_status status = LSP_STATUS_CONTINUE;
+    if (fdn_string_is_eq_c_str(request->method, "$/cancelRequest")) {
+      server_cancel_request(server, request->params);
+    } else if (entry != NULL && entry->mode == LSP_DISPATCH_CONCURRENT) {
+      if (!server_queue_job(server, body, request)) {
+        fdn_error("Failed to queue %.*s.", (int)request->method.string_length,
+                  request->method.string_start);
+      }
+    } else {
+      // The requests about a document that an edit supersedes are cancelled
+      // first, so that the edit waits as little as possible for them.
+      if (entry != NULL &&
+          __atomic_load_n(&server->jobs_pending, __ATOMIC_ACQUIRE) > 0) {
+        fdn_string escaped =
+            server_find(request->params, "textDocument.uri", JSON_STRING);
+        char *decoded = fdn_arena_alloc(&arena, escaped.string_length + 1);
+        fdn_string uri = decoded != NULL ? server_find_uri(escaped, decoded)
+                                         : (fdn_string){NULL, 0};
+        if (uri.string_length > 0) {
+          server_cancel(server, true, 0, uri, LSP_ERROR_CONTENT_MODIFIED);
+        }
+      }
+      status = dispatch_message(&context, request->method, request->has_id,
+                                request->id, request->params);
+    }
+
+    fdn_arena_reset(&arena);
+
+    if (status == LSP_STATUS_EXIT) {
+      fdn_info("Exit signal received. Shutting down.");
+      exit_status = 0;
+      break;
+    }
+
+    // Messages the client queued while this one was handled are handled
+    // first; a burst of didChange notifications is then followed up once.
+    // Jobs bring the syntax up to date themselves, so the reader does not
+    // wait for them.
+    if (!lsp_transport_message_ready(server->transport) &&
+        __atomic_load_n(&server->jobs_pending, __ATOMIC_ACQUIRE) == 0) {
+      dispatcher_sync();
+    }
+  }
+
+  lsp_context_free(&context);
+  fdn_arena_free(&arena);
+  return exit_status;
+}
+
+void lsp_server_free(lsp_server *server) {
+  // The workers finish the jobs that are queued; the writer then writes out
+  // their responses.
+  if (server->jobs.cells != NULL) {
+    fdn_queue_close(&server->jobs);
+  }
+  for (uint32_t i = 0; i < server->worker_count; i++) {
+    lsp_server_worker *worker = &server->workers[i];
+    pthread_join(worker->thread, NULL);
+    lsp_context_free(&worker->context);
+    fdn_arena_free(&worker->arena);
+  }
+
+  if (server->messages.cells != NULL) {
+    fdn_queue_close(&server->messages);
+  }
+  if (server->writer_started) {
+    pthread_join(server->writer, NULL);
+  }
+
+  fdn_queue_free(&server->jobs);
+  fdn_queue_free(&server->messages);
+  pthread_mutex_destroy(&server->jobs_lock);
+  memset(server, 0, sizeof(*server));
+}
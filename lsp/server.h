@@ -0,0 +1,94 @@
+#ifndef LSP_SERVER_H
+#define LSP_SERVER_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "dispatcher.h"
+#include "libs/foundation.h"
+#include "transport.h"
+
+/**
+ * The threads that serve the connection.
+ *
+ * The thread calling `lsp_server_run` reads the messages. It frames and parses
+ * each one and then looks at the mode of its method (see dispatcher.h):
+ *
+ *   exclusive    didOpen, didChange, didClose, initialize, shutdown and exit
+ *                are handled right there, in the order they arrived. The
+ *                handler has the documents to itself, so every request read
+ *                after a change sees it.
+ *   concurrent   requests are copied out of the input buffer into a job and
+ *                pushed to a queue, waiting for room while it is full. A pool
+ *                of workers pops the jobs and handles them side by side, so a
+ *                slow request holds up neither the other requests nor the
+ *                reading of the messages after it.
+ *
+ * Handlers never write to the output themselves. Their responses are copied
+ * into a second queue, which a single writer thread empties into the
+ * transport, so messages go out whole and one at a time and a slow client only
+ * holds up the writer.
+ *
+ * When the input runs dry and no job is pending, the reader brings the syntax
+ * of the edited documents up to date (see dispatcher_sync).
+ *
+ * Jobs stay listed from the moment they are queued until their handler
+ * returns, and the reader cancels them through that list, without waiting for
+ * the workers:
+ *
+ *   $/cancelRequest    the request with the id given, with
+ *                      LSP_ERROR_REQUEST_CANCELLED.
+ *   an exclusive       every request read before it that is about the same
+ *   notification       document (`textDocument.uri`), with
+ *                      LSP_ERROR_CONTENT_MODIFIED: its position is from a
+ *                      version of the text that is gone.
+ *
+ * A cancelled job that has not started is answered with the error when a
+ * worker pops it, without running its handler; a running one once its handler
+ * notices (see lsp_context_cancelled).
+ */
+
+#define LSP_SERVER_MAX_WORKERS 16
+
+// Jobs and responses that may be queued at once; more wait for room.
+#define LSP_SERVER_QUEUE_SIZE 1024
+
+typedef struct lsp_server lsp_server;
+typedef struct lsp_server_job lsp_server_job; // Defined in server.c.
+
+typedef struct {
+  lsp_server *server;
+  pthread_t thread;
+  fdn_arena arena;
+  lsp_context context;
+} lsp_server_worker;
+
+struct lsp_server {
+  lsp_transport *transport;
+  fdn_queue jobs;      // Requests for the workers.
+  fdn_queue messages;  // Responses for the writer.
+  uint32_t jobs_pending; // Queued or running; accessed atomically.
+  pthread_mutex_t jobs_lock;
+  lsp_server_job *jobs_in_flight; // Queued or running; hold `jobs_lock`.
+
+  lsp_server_worker workers[LSP_SERVER_MAX_WORKERS];
+  uint32_t worker_count;
+  pthread_t writer;
+  bool writer_started;
+};
+
+// lsp_server_init starts the writer and `worker_count` workers, or one per
+// core if it is 0, for messages read from and written to the `transport`.
+// Returns `false` if the threads could not be started.
+bool lsp_server_init(lsp_server *server, lsp_transport *transport,
+                     uint32_t worker_count);
+
+// lsp_server_run reads and dispatches messages until the exit notification or
+// the end of the input. Returns the exit status of the process.
+int lsp_server_run(lsp_server *server);
+
+// lsp_server_free waits for the jobs and the responses that are queued and
+// stops the threads.
+void lsp_server_free(lsp_server *server);
+
+#endif // LSP_SERVER_H
@@ -0,0 +1,867 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libs/foundation.h"
+#include "solidity/parser.h"
+#include "symbols.h"
+
+#define SYMBOLS_INITIAL_DECLARATIONS 64
+
+#define SYMBOLS_NONE UINT32_MAX
+
+// The tiers of a match, from the worst to the best. A score is the tier, then
+// the number of characters matched at word boundaries, then the shortness of
+// the name, packed into one integer.
+typedef enum {
+  MATCH_SUBSEQUENCE,
+  MATCH_SUBSTRING,
+  MATCH_WORD,
+  MATCH_PREFIX,
+  MATCH_EXACT,
+} MatchTier;
+
+static int32_t match_score(MatchTier tier, size_t boundaries,
+                           size_t name_length) {
+  uint32_t bonus = boundaries < 255 ? (uint32_t)boundaries : 255;
+  uint32_t shortness = name_length < 255 ? 255 - (uint32_t)name_length : 0;
+  return (int32_t)(((uint32_t)tier << 16) | (bonus << 8) | shortness);
+}
+
+/////////////////////////////////////////////////
+//                 DECLARATIONS                //
+/////////////////////////////////////////////////
+
+// declaration_kind returns the symbol kind of a declaration starting with the
+// `first` token, or 0 for nodes that are no symbols.
+static uint8_t declaration_kind(SolNodeKind kind, SolTokenType first,
+                                bool in_contract) {
+  switch (kind) {
+  case SOL_NODE_CONTRACT:
+    return LSP_SYMBOL_CLASS;
+  case SOL_NODE_INTERFACE:
+    return LSP_SYMBOL_INTERFACE;
+  case SOL_NODE_LIBRARY:
+    return LSP_SYMBOL_MODULE;
+  case SOL_NODE_FUNCTION:
+    if (first == SOL_TOKEN_CONSTRUCTOR) {
+      return LSP_SYMBOL_CONSTRUCTOR;
+    }
+    return in_contract ? LSP_SYMBOL_METHOD : LSP_SYMBOL_FUNCTION;
+  case SOL_NODE_MODIFIER:
+    return LSP_SYMBOL_METHOD;
+  case SOL_NODE_EVENT:
+    return LSP_SYMBOL_EVENT;
+  case SOL_NODE_ERROR:
+    return LSP_SYMBOL_OBJECT;
+  case SOL_NODE_STRUCT:
+    return LSP_SYMBOL_STRUCT;
+  case SOL_NODE_ENUM:
+    return LSP_SYMBOL_ENUM;
+  case SOL_NODE_USER_TYPE:
+    return LSP_SYMBOL_TYPE_PARAMETER;
+  default:
+    return 0;
+  }
+}
+
+// declaration_name returns the token that names the declaration `node`: the
+// first identifier before its parameters or body. Constructors, fallback and
+// receive functions are named by their keyword.
+static uint32_t declaration_name(const SolSyntax *syntax, uint32_t node) {
+  const SolTokenList *tokens = &syntax->tokens;
+  uint32_t first = syntax->nodes.token_starts[node];
+  uint32_t end = syntax->nodes.token_ends[node];
+
+  SolTokenType type = tokens->types[first];
+  if (type == SOL_TOKEN_CONSTRUCTOR || type == SOL_TOKEN_FALLBACK ||
+      type == SOL_TOKEN_RECEIVE) {
+    return first;
+  }
+
+  for (uint32_t token = first + 1; token < end; token++) {
+    switch (tokens->types[token]) {
+    case SOL_TOKEN_IDENTIFIER:
+      return token;
+    case SOL_TOKEN_LPAREN:
+    case SOL_TOKEN_LBRACE:
+    case SOL_TOKEN_SEMICOLON:
+      return SYMBOLS_NONE;
+    default:
+      break;
+    }
+  }
+  return SYMBOLS_NONE;
+}
+
+bool lsp_declaration_describe(const SolSyntax *syntax, uint32_t node,
+                              bool in_contract, uint8_t *kind,
+                              uint32_t *name) {
+  const SolNodeList *nodes = &syntax->nodes;
+  if (nodes->token_starts[node] == nodes->token_ends[node]) {
+    return false;
+  }
+
+  *kind = declaration_kind(
+      (SolNodeKind)nodes->kinds[node],
+      (SolTokenType)syntax->tokens.types[nodes->token_starts[node]],
+      in_contract);
+  *name = *kind != 0 ? declaration_name(syntax, node) : SYMBOLS_NONE;
+  return *name != SYMBOLS_NONE;
+}
+
+// Tracks the line of an offset while the offsets only grow, so that a whole
+// file is scanned for newlines once.
+typedef struct {
+  uint32_t offset;
+  uint32_t line;
+  uint32_t line_start;
+} SourceCursor;
+
+static void cursor_advance(SourceCursor *cursor, fdn_string source,
+                           uint32_t offset) {
+  const char *at = source.string_start + cursor->offset;
+  const char *end = source.string_start + offset;
+  const char *newline;
+  while (at < end && (newline = memchr(at, '\n', (size_t)(end - at))) != NULL) {
+    cursor->line++;
+    cursor->line_start = (uint32_t)(newline + 1 - source.string_start);
+    at = newline + 1;
+  }
+  cursor->offset = offset;
+}
+
+// cursor_character returns the column of the cursor in UTF-16 code units.
+static uint32_t cursor_character(const SourceCursor *cursor,
+                                 fdn_string source) {
+  const char *at = source.string_start + cursor->line_start;
+  const char *end = source.string_start + cursor->offset;
+  uint32_t character = 0;
+  while (at < end) {
+    uint32_t code_point;
+    uint32_t width = (unsigned char)*at < 0x80
+                         ? 1
+                         : fdn_utf8_decode(at, (size_t)(end - at), &code_point);
+    if (width == 0) {
+      width = 1; // A malformed byte counts as one unit.
+    }
+    character += width == 4 ? 2 : 1; // A surrogate pair past U+FFFF.
+    at += width;
+  }
+  return character;
+}
+
+static bool declarations_push(lsp_declaration_list *list,
+                              const lsp_declaration *declaration) {
+  if (list->count == list->capacity) {
+    uint32_t capacity =
+        list->capacity > 0 ? list->capacity * 2 : SYMBOLS_INITIAL_DECLARATIONS;
+    lsp_declaration *items =
+        realloc(list->items, capacity * sizeof(lsp_declaration));
+    if (items == NULL) {
+      return false;
+    }
+    list->items = items;
+    list->capacity = capacity;
+  }
+
+  list->items[list->count++] = *declaration;
+  return true;
+}
+
+bool lsp_declarations_collect(const SolSyntax *syntax, fdn_string source,
+                              lsp_declaration_list *list) {
+  list->count = 0;
+
+  const SolNodeList *nodes = &syntax->nodes;
+  SourceCursor cursor = {0, 0, 0};
+  fdn_string container = fdn_string_create_view("", 0);
+  uint32_t container_end = 0;
+
+  // Contracts are descended into for their members; the subtrees of all other
+  // nodes are skipped.
+  uint32_t node = 1;
+  while (node < nodes->count) {
+    SolNodeKind kind = (SolNodeKind)nodes->kinds[node];
+    uint32_t next = sol_node_next_sibling(nodes, node);
+    bool in_contract = node < container_end;
+    if (!in_contract) {
+      container = fdn_string_create_view("", 0);
+    }
+
+    uint8_t symbol_kind;
+    uint32_t name;
+    bool named = lsp_declaration_describe(syntax, node, in_contract,
+                                          &symbol_kind, &name);
+    lsp_declaration declaration;
+    if (named) {
+      cursor_advance(&cursor, source, syntax->tokens.starts[name]);
+      declaration.name = sol_token_text(&syntax->tokens, &source, name);
+      declaration.container = container;
+      declaration.line = cursor.line;
+      declaration.character = cursor_character(&cursor, source);
+      declaration.kind = symbol_kind;
+      if (!declarations_push(list, &declaration)) {
+        return false;
+      }
+    }
+
+    if (kind == SOL_NODE_CONTRACT || kind == SOL_NODE_INTERFACE ||
+        kind == SOL_NODE_LIBRARY) {
+      container = named ? declaration.name : fdn_string_create_view("", 0);
+      container_end = next;
+      node++;
+    } else {
+      node = next;
+    }
+  }
+
+  return true;
+}
+
+void lsp_declaration_list_free(lsp_declaration_list *list) {
+  free(list->items);
+  memset(list, 0, sizeof(*list));
+}
+
+/////////////////////////////////////////////////
+//                   MATCHING                  //
+/////////////////////////////////////////////////
+
+static inline char name_to_lower(char ch) {
+  return (ch >= 'A' && ch <= 'Z') ? (char)(ch - 'A' + 'a') : ch;
+}
+
+static inline bool name_is_upper(char ch) { return ch >= 'A' && ch <= 'Z'; }
+static inline bool name_is_lower(char ch) { return ch >= 'a' && ch <= 'z'; }
+static inline bool name_is_digit(char ch) { return ch >= '0' && ch <= '9'; }
+
+// is_word_start tells whether a word of the name starts at `i`: after an
+// underscore, at a capital following a lowercase letter or ending an acronym
+// (`Token` in `USDCToken`), or at the first digit of a number.
+static bool name_is_word_start(fdn_string name, size_t i) {
+  if (i == 0) {
+    return true;
+  }
+
+  char previous = name.string_start[i - 1];
+  char ch = name.string_start[i];
+  if (previous == '_' || previous == '$') {
+    return ch != '_' && ch != '$';
+  }
+  if (name_is_upper(ch)) {
+    return name_is_lower(previous) || name_is_digit(previous) ||
+           (name_is_upper(previous) && i + 1 < name.string_length &&
+            name_is_lower(name.string_start[i + 1]));
+  }
+  return name_is_digit(ch) && !name_is_digit(previous);
+}
+
+static bool name_is_eq_ignoring_case(const char *left, const char *right,
+                                     size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (name_to_lower(left[i]) != name_to_lower(right[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool name_is_subsequence(const char *query, size_t query_length,
+                                const char *name, size_t name_length) {
+  size_t matched = 0;
+  for (size_t i = 0; i < name_length && matched < query_length; i++) {
+    matched += name_to_lower(name[i]) == name_to_lower(query[matched]);
+  }
+  return matched == query_length;
+}
+
+int32_t lsp_symbol_score(fdn_string query, fdn_string name) {
+  size_t query_length = query.string_length;
+  size_t name_length = name.string_length;
+  if (query_length > name_length) {
+    return -1;
+  }
+
+  // The best place of the query as a whole: the start, a word or anywhere.
+  int tier = -1;
+  for (size_t i = 0; i + query_length <= name_length; i++) {
+    if (!name_is_eq_ignoring_case(name.string_start + i, query.string_start,
+                                  query_length)) {
+      continue;
+    }
+    if (i == 0) {
+      tier = query_length == name_length ? MATCH_EXACT : MATCH_PREFIX;
+      break;
+    }
+    if (name_is_word_start(name, i)) {
+      tier = MATCH_WORD;
+      break;
+    }
+    if (tier < 0) {
+      tier = MATCH_SUBSTRING;
+    }
+  }
+  if (tier >= 0) {
+    return match_score((MatchTier)tier, 0, name_length);
+  }
+
+  // Otherwise its characters in order, each at the start of a word if the
+  // rest of the query still fits after it.
+  size_t boundaries = 0;
+  size_t at = 0;
+  for (size_t j = 0; j < query_length; j++) {
+    char ch = name_to_lower(query.string_start[j]);
+    size_t leftmost = at;
+    while (leftmost < name_length &&
+           name_to_lower(name.string_start[leftmost]) != ch) {
+      leftmost++;
+    }
+    if (leftmost == name_length) {
+      return -1;
+    }
+
+    size_t chosen = leftmost;
+    for (size_t i = leftmost + 1;
+         !name_is_word_start(name, leftmost) && i < name_length; i++) {
+      if (name_to_lower(name.string_start[i]) == ch &&
+          name_is_word_start(name, i) &&
+          name_is_subsequence(query.string_start + j + 1, query_length - j - 1,
+                              name.string_start + i + 1, name_length - i - 1)) {
+        chosen = i;
+        break;
+      }
+    }
+
+    boundaries += name_is_word_start(name, chosen);
+    at = chosen + 1;
+  }
+  return match_score(MATCH_SUBSEQUENCE, boundaries, name_length);
+}
+
+// char_mask returns the bit of a character in the mask of a name; letters
+// ignore case.
+static uint64_t char_mask(char ch) {
+  ch = name_to_lower(ch);
+  if (name_is_lower(ch)) {
+    return (uint64_t)1 << (ch - 'a');
+  }
+  if (name_is_digit(ch)) {
+    return (uint64_t)1 << (26 + ch - '0');
+  }
+  return (uint64_t)1 << (ch == '_' ? 36 : ch == '$' ? 37 : 38);
+}
+
+static uint64_t string_mask(fdn_string str) {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < str.string_length; i++) {
+    mask |= char_mask(str.string_start[i]);
+  }
+  return mask;
+}
+
+static uint32_t trigram_at(const char *text) {
+  return ((uint32_t)(unsigned char)name_to_lower(text[0]) << 16) |
+         ((uint32_t)(unsigned char)name_to_lower(text[1]) << 8) |
+         (uint32_t)(unsigned char)name_to_lower(text[2]);
+}
+
+/////////////////////////////////////////////////
+//                    INDEX                    //
+/////////////////////////////////////////////////
+
+typedef struct {
+  fdn_string text;
+  uint32_t id;
+} NameEntry;
+
+// compare_names orders names alphabetically ignoring case, and names that
+// only differ in case by their bytes.
+static int compare_names(fdn_string a, fdn_string b) {
+  size_t length =
+      a.string_length < b.string_length ? a.string_length : b.string_length;
+  for (size_t i = 0; i < length; i++) {
+    char x = name_to_lower(a.string_start[i]);
+    char y = name_to_lower(b.string_start[i]);
+    if (x != y) {
+      return (unsigned char)x < (unsigned char)y ? -1 : 1;
+    }
+  }
+  if (a.string_length != b.string_length) {
+    return a.string_length < b.string_length ? -1 : 1;
+  }
+  return memcmp(a.string_start, b.string_start, length);
+}
+
+static int compare_name_entries(const void *left, const void *right) {
+  return compare_names(((const NameEntry *)left)->text,
+                       ((const NameEntry *)right)->text);
+}
+
+static inline fdn_string index_name(const lsp_symbol_index *index,
+                                    uint32_t n) {
+  return fdn_string_create_view(index->name_text + index->name_offsets[n],
+                                index->name_offsets[n + 1] -
+                                    index->name_offsets[n]);
+}
+
+// index_build_names collects the distinct names in alphabetical order, copies
+// them back to back, and groups the symbols by them.
+static bool index_build_names(lsp_symbol_index *index,
+                              const fdn_interner *names, uint32_t *name_of_id,
+                              lsp_symbol *symbols, uint32_t count) {
+  NameEntry *entries = malloc((count > 0 ? count : 1) * sizeof(NameEntry));
+  if (entries == NULL) {
+    return false;
+  }
+
+  uint32_t name_count = 0;
+  size_t text_length = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t id = symbols[i].name;
+    if (name_of_id[id] == SYMBOLS_NONE) {
+      name_of_id[id] = 0;
+      entries[name_count].text = fdn_interner_string(names, id);
+      entries[name_count].id = id;
+      text_length += entries[name_count].text.string_length;
+      name_count++;
+    }
+  }
+  if (text_length > UINT32_MAX) {
+    free(entries);
+    return false;
+  }
+  qsort(entries, name_count, sizeof(NameEntry), compare_name_entries);
+
+  index->names = malloc((name_count > 0 ? name_count : 1) * sizeof(uint32_t));
+  index->name_masks =
+      malloc((name_count > 0 ? name_count : 1) * sizeof(uint64_t));
+  index->name_starts = calloc(name_count + 1, sizeof(uint32_t));
+  index->name_text = malloc(text_length > 0 ? text_length : 1);
+  index->name_offsets = malloc((name_count + 1) * sizeof(uint32_t));
+  uint32_t *next = malloc((name_count > 0 ? name_count : 1) * sizeof(uint32_t));
+  index->symbols = malloc((count > 0 ? count : 1) * sizeof(lsp_symbol));
+  if (index->names == NULL || index->name_masks == NULL ||
+      index->name_starts == NULL || index->name_text == NULL ||
+      index->name_offsets == NULL || next == NULL || index->symbols == NULL) {
+    free(entries);
+    free(next);
+    return false;
+  }
+
+  index->name_count = name_count;
+  uint32_t offset = 0;
+  for (uint32_t n = 0; n < name_count; n++) {
+    fdn_string text = entries[n].text;
+    index->names[n] = entries[n].id;
+    index->name_masks[n] = string_mask(text);
+    index->name_offsets[n] = offset;
+    memcpy(index->name_text + offset, text.string_start, text.string_length);
+    offset += (uint32_t)text.string_length;
+    name_of_id[entries[n].id] = n;
+  }
+  index->name_offsets[name_count] = offset;
+  free(entries);
+
+  // A counting sort, which keeps the symbols of a name in their order.
+  for (uint32_t i = 0; i < count; i++) {
+    index->name_starts[name_of_id[symbols[i].name] + 1]++;
+  }
+  for (uint32_t n = 0; n < name_count; n++) {
+    index->name_starts[n + 1] += index->name_starts[n];
+    next[n] = index->name_starts[n];
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    index->symbols[next[name_of_id[symbols[i].name]]++] = symbols[i];
+  }
+  index->symbol_count = count;
+
+  free(next);
+  return true;
+}
+
+// sort_pairs_by_trigram sorts (trigram, name) pairs by their trigram with a
+// radix sort, one byte of it at a time. The sort is stable, so pairs that are
+// collected name by name keep their names ascending within every trigram.
+static void sort_pairs_by_trigram(uint64_t *pairs, uint64_t *scratch,
+                                  size_t count) {
+  for (uint32_t shift = 32; shift < 56; shift += 8) {
+    size_t starts[257] = {0};
+    for (size_t i = 0; i < count; i++) {
+      starts[((pairs[i] >> shift) & 0xff) + 1]++;
+    }
+    for (size_t b = 0; b < 256; b++) {
+      starts[b + 1] += starts[b];
+    }
+    for (size_t i = 0; i < count; i++) {
+      scratch[starts[(pairs[i] >> shift) & 0xff]++] = pairs[i];
+    }
+    memcpy(pairs, scratch, count * sizeof(uint64_t));
+  }
+}
+
+// index_build_trigrams builds the posting lists from (trigram, name) pairs,
+// sorted so that each list comes out grouped and ascending.
+static bool index_build_trigrams(lsp_symbol_index *index) {
+  size_t pair_capacity = 0;
+  for (uint32_t n = 0; n < index->name_count; n++) {
+    size_t length = index_name(index, n).string_length;
+    pair_capacity += length > 2 ? length - 2 : 0;
+  }
+
+  uint64_t *pairs = malloc((pair_capacity > 0 ? pair_capacity : 1) *
+                           sizeof(uint64_t));
+  uint64_t *scratch = malloc((pair_capacity > 0 ? pair_capacity : 1) *
+                             sizeof(uint64_t));
+  if (pairs == NULL || scratch == NULL) {
+    free(pairs);
+    free(scratch);
+    return false;
+  }
+
+  size_t pair_count = 0;
+  for (uint32_t n = 0; n < index->name_count; n++) {
+    fdn_string name = index_name(index, n);
+    size_t first_pair = pair_count;
+    for (size_t i = 0; i + 3 <= name.string_length; i++) {
+      uint64_t pair = ((uint64_t)trigram_at(name.string_start + i) << 32) | n;
+      bool seen = false;
+      for (size_t j = first_pair; j < pair_count && !seen; j++) {
+        seen = pairs[j] == pair;
+      }
+      if (!seen) {
+        pairs[pair_count++] = pair;
+      }
+    }
+  }
+  sort_pairs_by_trigram(pairs, scratch, pair_count);
+  free(scratch);
+
+  uint32_t trigram_count = 0;
+  for (size_t i = 0; i < pair_count; i++) {
+    trigram_count += i == 0 || (pairs[i] >> 32) != (pairs[i - 1] >> 32);
+  }
+
+  index->trigrams =
+      malloc((trigram_count > 0 ? trigram_count : 1) * sizeof(uint32_t));
+  index->trigram_starts = malloc((trigram_count + 1) * sizeof(uint32_t));
+  index->postings =
+      malloc((pair_count > 0 ? pair_count : 1) * sizeof(uint32_t));
+  if (index->trigrams == NULL || index->trigram_starts == NULL ||
+      index->postings == NULL) {
+    free(pairs);
+    return false;
+  }
+
+  uint32_t trigram = 0;
+  for (size_t i = 0; i < pair_count; i++) {
+    if (i == 0 || (pairs[i] >> 32) != (pairs[i - 1] >> 32)) {
+      index->trigrams[trigram] = (uint32_t)(pairs[i] >> 32);
+      index->trigram_starts[trigram] = (uint32_t)i;
+      trigram++;
+    }
+    index->postings[i] = (uint32_t)pairs[i];
+  }
+  index->trigram_starts[trigram_count] = (uint32_t)pair_count;
+  index->trigram_count = trigram_count;
+
+  free(pairs);
+  return true;
+}
+
+bool lsp_symbol_index_build(lsp_symbol_index *index, const fdn_interner *names,
+                            lsp_symbol *symbols, uint32_t count) {
+  memset(index, 0, sizeof(*index));
+
+  uint32_t id_count = fdn_interner_count(names);
+  uint32_t *name_of_id =
+      malloc((id_count > 0 ? id_count : 1) * sizeof(uint32_t));
+  bool built = name_of_id != NULL;
+  if (built) {
+    memset(name_of_id, 0xff, id_count * sizeof(uint32_t));
+    built = index_build_names(index, names, name_of_id, symbols, count) &&
+            index_build_trigrams(index);
+  }
+
+  free(name_of_id);
+  free(symbols);
+  if (!built) {
+    lsp_symbol_index_free(index);
+  }
+  return built;
+}
+
+void lsp_symbol_index_free(lsp_symbol_index *index) {
+  free(index->symbols);
+  free(index->names);
+  free(index->name_masks);
+  free(index->name_starts);
+  free(index->name_text);
+  free(index->name_offsets);
+  free(index->trigrams);
+  free(index->trigram_starts);
+  free(index->postings);
+  memset(index, 0, sizeof(*index));
+}
+
+uint32_t lsp_symbol_index_find(const lsp_symbol_index *index,
+                               fdn_string name) {
+  uint32_t low = 0;
+  uint32_t high = index->name_count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    int order = compare_names(index_name(index, middle), name);
+    if (order == 0) {
+      return middle;
+    }
+    if (order < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return LSP_SYMBOL_NONE;
+}
+
+/////////////////////////////////////////////////
+//                    SEARCH                   //
+/////////////////////////////////////////////////
+
+// The matches found so far are kept in a min-heap of at most `limit` entries,
+// with the worst match at the root.
+typedef struct {
+  lsp_symbol_match *items;
+  uint32_t count;
+  uint32_t limit;
+} MatchHeap;
+
+// Among equal scores, the name that comes first alphabetically is better.
+static bool match_is_worse(lsp_symbol_match a, lsp_symbol_match b) {
+  return a.score < b.score || (a.score == b.score && a.name > b.name);
+}
+
+static void heap_sift_down(MatchHeap *heap, uint32_t i) {
+  while (1) {
+    uint32_t worst = i;
+    uint32_t left = 2 * i + 1;
+    uint32_t right = left + 1;
+    if (left < heap->count &&
+        match_is_worse(heap->items[left], heap->items[worst])) {
+      worst = left;
+    }
+    if (right < heap->count &&
+        match_is_worse(heap->items[right], heap->items[worst])) {
+      worst = right;
+    }
+    if (worst == i) {
+      return;
+    }
+    lsp_symbol_match swap = heap->items[i];
+    heap->items[i] = heap->items[worst];
+    heap->items[worst] = swap;
+    i = worst;
+  }
+}
+
+static void heap_offer(MatchHeap *heap, lsp_symbol_match match) {
+  if (heap->count < heap->limit) {
+    uint32_t i = heap->count++;
+    heap->items[i] = match;
+    while (i > 0 &&
+           match_is_worse(heap->items[i], heap->items[(i - 1) / 2])) {
+      lsp_symbol_match swap = heap->items[i];
+      heap->items[i] = heap->items[(i - 1) / 2];
+      heap->items[(i - 1) / 2] = swap;
+      i = (i - 1) / 2;
+    }
+  } else if (match_is_worse(heap->items[0], match)) {
+    heap->items[0] = match;
+    heap_sift_down(heap, 0);
+  }
+}
+
+// heap_sort_best_first empties the heap into its array, best match first.
+static void heap_sort_best_first(MatchHeap *heap) {
+  uint32_t count = heap->count;
+  while (heap->count > 1) {
+    lsp_symbol_match worst = heap->items[0];
+    heap->items[0] = heap->items[--heap->count];
+    heap->items[heap->count] = worst;
+    heap_sift_down(heap, 0);
+  }
+  heap->count = count;
+}
+
+// lower_bound returns the first position in the ascending `values` holding
+// `value` or more.
+static uint32_t lower_bound(const uint32_t *values, uint32_t count,
+                            uint32_t value) {
+  uint32_t low = 0;
+  uint32_t high = count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (values[middle] < value) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// search_trigrams offers the names that contain the query as a whole. Returns
+// `false` if a trigram of the query is in no name at all.
+static bool search_trigrams(const lsp_symbol_index *index, fdn_arena *arena,
+                            fdn_string query, MatchHeap *heap) {
+  uint32_t list_count = (uint32_t)query.string_length - 2;
+  uint32_t *starts = fdn_arena_alloc(arena, list_count * sizeof(uint32_t));
+  uint32_t *ends = fdn_arena_alloc(arena, list_count * sizeof(uint32_t));
+  if (starts == NULL || ends == NULL) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < list_count; i++) {
+    uint32_t trigram = trigram_at(query.string_start + i);
+    uint32_t t = lower_bound(index->trigrams, index->trigram_count, trigram);
+    if (t == index->trigram_count || index->trigrams[t] != trigram) {
+      return false;
+    }
+    starts[i] = index->trigram_starts[t];
+    ends[i] = index->trigram_starts[t + 1];
+
+    // Keep the lists sorted by length, shortest first.
+    for (uint32_t j = i; j > 0 && ends[j] - starts[j] <
+                                      ends[j - 1] - starts[j - 1];
+         j--) {
+      uint32_t start = starts[j];
+      uint32_t end = ends[j];
+      starts[j] = starts[j - 1];
+      ends[j] = ends[j - 1];
+      starts[j - 1] = start;
+      ends[j - 1] = end;
+    }
+  }
+
+  uint32_t candidate_count = ends[0] - starts[0];
+  uint32_t *candidates =
+      fdn_arena_alloc(arena, (candidate_count > 0 ? candidate_count : 1) *
+                                 sizeof(uint32_t));
+  if (candidates == NULL) {
+    return false;
+  }
+  memcpy(candidates, index->postings + starts[0],
+         candidate_count * sizeof(uint32_t));
+
+  for (uint32_t i = 1; i < list_count && candidate_count > 0; i++) {
+    const uint32_t *list = index->postings + starts[i];
+    uint32_t length = ends[i] - starts[i];
+    uint32_t position = 0;
+    uint32_t kept = 0;
+    for (uint32_t c = 0; c < candidate_count && position < length; c++) {
+      position += lower_bound(list + position, length - position,
+                              candidates[c]);
+      if (position < length && list[position] == candidates[c]) {
+        candidates[kept++] = candidates[c];
+      }
+    }
+    candidate_count = kept;
+  }
+
+  // Names with every trigram in scattered places are left to the scan, and
+  // the prefixes were offered already.
+  int32_t least = match_score(MATCH_SUBSTRING, 0, SIZE_MAX);
+  int32_t prefix = match_score(MATCH_PREFIX, 0, SIZE_MAX);
+  for (uint32_t c = 0; c < candidate_count; c++) {
+    int32_t score = lsp_symbol_score(query, index_name(index, candidates[c]));
+    if (score >= least && score < prefix) {
+      heap_offer(heap, (lsp_symbol_match){candidates[c], score});
+    }
+  }
+  return true;
+}
+
+// name_is_before_prefix tells whether the `name` comes before every name that
+// starts with the `prefix` in the order of the index.
+static bool name_is_before_prefix(fdn_string name, fdn_string prefix) {
+  for (size_t i = 0; i < name.string_length && i < prefix.string_length;
+       i++) {
+    char x = name_to_lower(name.string_start[i]);
+    char y = name_to_lower(prefix.string_start[i]);
+    if (x != y) {
+      return (unsigned char)x < (unsigned char)y;
+    }
+  }
+  return name.string_length < prefix.string_length;
+}
+
+// search_prefixes offers the names that start with the query, which are one
+// run of the names in their order.
+static void search_prefixes(const lsp_symbol_index *index, fdn_string query,
+                            MatchHeap *heap) {
+  uint32_t low = 0;
+  uint32_t high = index->name_count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (name_is_before_prefix(index_name(index, middle), query)) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  for (uint32_t n = low; n < index->name_count; n++) {
+    fdn_string name = index_name(index, n);
+    if (name.string_length < query.string_length ||
+        !name_is_eq_ignoring_case(name.string_start, query.string_start,
+                                  query.string_length)) {
+      return;
+    }
+    heap_offer(heap, (lsp_symbol_match){n, lsp_symbol_score(query, name)});
+  }
+}
+
+static void search_scan(const lsp_symbol_index *index, fdn_string query,
+                        MatchHeap *heap) {
+  uint64_t mask = string_mask(query);
+  for (uint32_t n = 0; n < index->name_count; n++) {
+    fdn_string name = index_name(index, n);
+    if ((index->name_masks[n] & mask) != mask ||
+        !name_is_subsequence(query.string_start, query.string_length,
+                             name.string_start, name.string_length)) {
+      continue;
+    }
+    int32_t score = lsp_symbol_score(query, name);
+    if (score >= 0) {
+      heap_offer(heap, (lsp_symbol_match){n, score});
+    }
+  }
+}
+
+uint32_t lsp_symbol_index_search(const lsp_symbol_index *index,
+                                 fdn_arena *arena, fdn_string query,
+                                 lsp_symbol_match *matches, uint32_t limit) {
+  MatchHeap heap = {matches, 0, limit};
+  if (limit == 0) {
+    return 0;
+  }
+
+  // Better matches outrank worse ones whatever else there is, so the search
+  // stops at the first tier that fills the results: prefixes, then whole
+  // substrings, and then everything.
+  search_prefixes(index, query, &heap);
+  if (heap.count == limit) {
+    heap_sort_best_first(&heap);
+    return heap.count;
+  }
+  if (query.string_length >= 3 &&
+      search_trigrams(index, arena, query, &heap) && heap.count == limit) {
+    heap_sort_best_first(&heap);
+    return heap.count;
+  }
+
+  heap.count = 0;
+  search_scan(index, query, &heap);
+  heap_sort_best_first(&heap);
+  return heap.count;
+}
@@ -0,0 +1,148 @@
+#ifndef LSP_SYMBOLS_H
+#define LSP_SYMBOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libs/foundation.h"
+#include "solidity/parser.h"
+
+/**
+ * The named declarations of the workspace (contracts, functions, modifiers,
+ * events, errors, structs, enums and user types) and a search over their
+ * names for `workspace/symbol`.
+ *
+ * Symbols are grouped by name, and the distinct names are kept in
+ * alphabetical order, so the names starting with a query are one run found by
+ * binary search. Every name is also indexed by the trigrams of its lowercase
+ * spelling: for each trigram, the sorted list of the names containing it. A
+ * query of three or more characters intersects the lists of its trigrams,
+ * shortest first, which leaves the names that may contain the query as a
+ * whole; only those are scored. Since a better kind of match always outranks
+ * a worse one, the search stops as soon as prefixes or substrings fill the
+ * results. Only otherwise are the names scanned in full for scattered
+ * subsequences; a scan skips most names by a bit mask of the characters they
+ * contain.
+ *
+ * Matches rank, from best to worst: the whole name, a prefix, a substring at
+ * a word boundary (`Safe` in `getSafeOwner`, `owner` in `max_owner`), any
+ * substring, and a subsequence, the more of its characters at word
+ * boundaries the better (`tf` in `transferFrom`). Shorter names rank first
+ * among equals, and then the names in alphabetical order, ignoring case.
+ */
+
+// SymbolKind values of the LSP.
+typedef enum {
+  LSP_SYMBOL_MODULE = 2,
+  LSP_SYMBOL_CLASS = 5,
+  LSP_SYMBOL_METHOD = 6,
+  LSP_SYMBOL_CONSTRUCTOR = 9,
+  LSP_SYMBOL_ENUM = 10,
+  LSP_SYMBOL_INTERFACE = 11,
+  LSP_SYMBOL_FUNCTION = 12,
+  LSP_SYMBOL_OBJECT = 19,
+  LSP_SYMBOL_STRUCT = 23,
+  LSP_SYMBOL_EVENT = 24,
+  LSP_SYMBOL_TYPE_PARAMETER = 26,
+} lsp_symbol_kind;
+
+//////////// DECLARATIONS /////////////
+
+// A named declaration of a source file. The names are views into the source.
+typedef struct {
+  fdn_string name;
+  fdn_string container; // The enclosing contract, or empty at the file level.
+  uint32_t line;        // The position of the name.
+  uint32_t character;   // In UTF-16 code units.
+  uint8_t kind;         // lsp_symbol_kind
+} lsp_declaration;
+
+typedef struct {
+  lsp_declaration *items;
+  uint32_t count;
+  uint32_t capacity;
+} lsp_declaration_list;
+
+// lsp_declarations_collect replaces the `list` with the declarations of the
+// `syntax` of `source`, the text it was parsed from, in the order of the
+// source. Returns `false` if memory ran out.
+bool lsp_declarations_collect(const SolSyntax *syntax, fdn_string source,
+                              lsp_declaration_list *list);
+
+void lsp_declaration_list_free(lsp_declaration_list *list);
+
+// lsp_declaration_describe tells whether the `node` of the `syntax` is a named
+// declaration, and if so sets its lsp_symbol_kind and the token of its name.
+// `in_contract` tells whether the node is a member of a contract.
+bool lsp_declaration_describe(const SolSyntax *syntax, uint32_t node,
+                              bool in_contract, uint8_t *kind, uint32_t *name);
+
+//////////// INDEX /////////////
+
+#define LSP_SYMBOL_NONE UINT32_MAX
+
+typedef struct {
+  uint32_t name;      // Interned.
+  uint32_t container; // Interned, or FDN_INTERNER_NONE.
+  uint32_t file;      // Set by whoever collects the symbols.
+  uint32_t line;
+  uint32_t character;
+  uint8_t kind;
+} lsp_symbol;
+
+typedef struct {
+  // The symbols of the name at index `n` are `symbols[name_starts[n]]` up to
+  // `symbols[name_starts[n + 1]]`. The names are sorted alphabetically,
+  // ignoring case.
+  lsp_symbol *symbols;
+  uint32_t symbol_count;
+  uint32_t *names;       // The interned id of every distinct name.
+  uint64_t *name_masks;  // The characters every name contains.
+  uint32_t *name_starts; // `name_count + 1` entries.
+  uint32_t name_count;
+
+  // The names back to back, so a scan reads them in order: the name at index
+  // `n` is `name_text[name_offsets[n]]` up to `name_text[name_offsets[n + 1]]`.
+  char *name_text;
+  uint32_t *name_offsets;
+
+  // The names containing the trigram at index `t` are
+  // `postings[trigram_starts[t]]` up to `postings[trigram_starts[t + 1]]`.
+  uint32_t *trigrams; // Three lowercase bytes each, sorted.
+  uint32_t *trigram_starts;
+  uint32_t *postings; // Name indexes, ascending for every trigram.
+  uint32_t trigram_count;
+} lsp_symbol_index;
+
+// A name matching a query; see lsp_symbol_index.
+typedef struct {
+  uint32_t name; // The index of the name.
+  int32_t score;
+} lsp_symbol_match;
+
+// lsp_symbol_index_build indexes the `count` symbols, whose names were
+// interned in `names`. It takes ownership of the `symbols`, which must have
+// been allocated with malloc. Returns `false` if memory ran out; the index is
+// empty then.
+bool lsp_symbol_index_build(lsp_symbol_index *index, const fdn_interner *names,
+                            lsp_symbol *symbols, uint32_t count);
+
+void lsp_symbol_index_free(lsp_symbol_index *index);
+
+// lsp_symbol_index_find returns the index of the `name`, matching its case,
+// or LSP_SYMBOL_NONE.
+uint32_t lsp_symbol_index_find(const lsp_symbol_index *index,
+                               fdn_string name);
+
+// lsp_symbol_index_search writes up to `limit` of the names that match the
+// `query` best to `matches`, best first, and returns how many it wrote. The
+// scratch memory is allocated from the `arena`.
+uint32_t lsp_symbol_index_search(const lsp_symbol_index *index,
+                                 fdn_arena *arena, fdn_string query,
+                                 lsp_symbol_match *matches, uint32_t limit);
+
+// lsp_symbol_score rates how well the `name` matches the `query`, ignoring
+// case. A greater score is a better match; a negative one is no match.
+int32_t lsp_symbol_score(fdn_string query, fdn_string name);
+
+#endif // LSP_SYMBOLS_H
@@ -0,0 +1,364 @@
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "libs/foundation.h"
+#include "transport.h"
+
+// The buffer is compacted once less than this many bytes are left at its tail,
+// so that every `read` can pull in a reasonably sized chunk.
+#define TRANSPORT_MIN_READ 4096
+
+bool lsp_transport_init(lsp_transport *transport, int fd, int output_fd,
+                        size_t capacity) {
+  transport->fd = fd;
+  transport->output_fd = output_fd;
+  transport->buffer = malloc(capacity);
+  transport->capacity = capacity;
+  transport->start = 0;
+  transport->end = 0;
+  transport->terminator = NULL;
+  transport->terminator_saved = '\0';
+
+  return transport->buffer != NULL;
+}
+
+void lsp_transport_free(lsp_transport *transport) {
+  free(transport->buffer);
+  transport->buffer = NULL;
+  transport->capacity = 0;
+}
+
+static char to_lower_ascii(char ch) {
+  return (ch >= 'A' && ch <= 'Z') ? (char)(ch - 'A' + 'a') : ch;
+}
+
+// Header field names are case-insensitive.
+static bool header_is_eq(fdn_string field, const char *expected) {
+  size_t expected_len = strlen(expected);
+  if (field.string_length != expected_len) {
+    return false;
+  }
+
+  for (size_t i = 0; i < expected_len; i++) {
+    if (to_lower_ascii(field.string_start[i]) != expected[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static fdn_string header_trim(fdn_string str) {
+  while (str.string_length > 0 &&
+         (str.string_start[0] == ' ' || str.string_start[0] == '\t')) {
+    str.string_start++;
+    str.string_length--;
+  }
+
+  while (str.string_length > 0 &&
+         (str.string_start[str.string_length - 1] == ' ' ||
+          str.string_start[str.string_length - 1] == '\t')) {
+    str.string_length--;
+  }
+
+  return str;
+}
+
+// header_find_end returns the length of the header part including the empty
+// line that terminates it ("\r\n\r\n"), or 0 if the header is incomplete.
+static size_t header_find_end(const char *data, size_t length) {
+  const char *cursor = data;
+  const char *end = data + length;
+
+  while (cursor < end) {
+    const char *cr = memchr(cursor, '\r', (size_t)(end - cursor));
+    if (cr == NULL || end - cr < 4) {
+      return 0;
+    }
+
+    if (cr[1] == '\n' && cr[2] == '\r' && cr[3] == '\n') {
+      return (size_t)(cr + 4 - data);
+    }
+
+    cursor = cr + 1;
+  }
+
+  return 0;
+}
+
+// The LSP only allows UTF-8 content. A missing charset means UTF-8 as well.
+static bool header_content_type_is_valid(fdn_string value) {
+  const char *charset = "charset=";
+  size_t charset_len = strlen(charset);
+
+  for (size_t i = 0; i + charset_len <= value.string_length; i++) {
+    fdn_string key = fdn_string_create_view(value.string_start + i, charset_len);
+    if (!header_is_eq(key, charset)) {
+      continue;
+    }
+
+    fdn_string encoding = fdn_string_create_view(
+        key.string_start + charset_len, value.string_length - i - charset_len);
+    const char *semicolon =
+        memchr(encoding.string_start, ';', encoding.string_length);
+    if (semicolon != NULL) {
+      encoding.string_length = (size_t)(semicolon - encoding.string_start);
+    }
+    encoding = header_trim(encoding);
+
+    // `utf8` is accepted for backwards compatibility, as per the spec.
+    return header_is_eq(encoding, "utf-8") || header_is_eq(encoding, "utf8");
+  }
+
+  return true;
+}
+
+// header_parse walks the header fields in place. `length` excludes the final
+// empty line. Returns `false` if the Content-Length is missing or invalid.
+static bool header_parse(const char *data, size_t length,
+                         size_t *content_length) {
+  const char *cursor = data;
+  const char *end = data + length;
+  bool has_content_length = false;
+
+  while (cursor < end) {
+    const char *line_end = memchr(cursor, '\r', (size_t)(end - cursor));
+    if (line_end == NULL) {
+      line_end = end;
+    }
+
+    const char *colon = memchr(cursor, ':', (size_t)(line_end - cursor));
+    if (colon == NULL) {
+      return false;
+    }
+
+    fdn_string field = fdn_string_create_view(cursor, (size_t)(colon - cursor));
+    fdn_string value = header_trim(
+        fdn_string_create_view(colon + 1, (size_t)(line_end - colon - 1)));
+
+    if (header_is_eq(field, "content-length")) {
+      if (value.string_length == 0) {
+        return false;
+      }
+
+      size_t parsed = 0;
+      for (size_t i = 0; i < value.string_length; i++) {
+        char ch = value.string_start[i];
+        if (ch < '0' || ch > '9' || parsed > (SIZE_MAX - 9) / 10) {
+          return false;
+        }
+        parsed = parsed * 10 + (size_t)(ch - '0');
+      }
+
+      *content_length = parsed;
+      has_content_length = true;
+    } else if (header_is_eq(field, "content-type")) {
+      if (!header_content_type_is_valid(value)) {
+        return false;
+      }
+    }
+
+    cursor = line_end + 2; // Move past the "\r\n".
+  }
+
+  return has_content_length;
+}
+
+// transport_fill reads more input so that at least `needed` bytes past
+// `start` fit in the buffer (plus one for the null terminator of the body).
+static lsp_transport_status transport_fill(lsp_transport *transport,
+                                           size_t needed) {
+  if (transport->start == transport->end) {
+    // Everything was consumed; start over at the front for free.
+    transport->start = 0;
+    transport->end = 0;
+  } else if (transport->start + needed + 1 > transport->capacity ||
+             transport->capacity - transport->end < TRANSPORT_MIN_READ) {
+    size_t unread = transport->end - transport->start;
+    memmove(transport->buffer, transport->buffer + transport->start, unread);
+    transport->start = 0;
+    transport->end = unread;
+  }
+
+  if (needed + 1 > transport->capacity) {
+    size_t capacity = transport->capacity * 2;
+    if (capacity < needed + 1) {
+      capacity = needed + 1;
+    }
+
+    char *buffer = realloc(transport->buffer, capacity);
+    if (buffer == NULL) {
+      return LSP_TRANSPORT_ERROR;
+    }
+
+    transport->buffer = buffer;
+    transport->capacity = capacity;
+  }
+
+  // One byte is always kept free for the null terminator of the body.
+  size_t room = transport->capacity - transport->end - 1;
+
+  ssize_t bytes_read;
+  do {
+    bytes_read = read(transport->fd, transport->buffer + transport->end, room);
+  } while (bytes_read < 0 && errno == EINTR);
+
+  if (bytes_read < 0) {
+    return LSP_TRANSPORT_ERROR;
+  }
+
+  if (bytes_read == 0) {
+    // A stream closed in the middle of a message is an error.
+    return transport->start == transport->end ? LSP_TRANSPORT_EOF
+                                              : LSP_TRANSPORT_ERROR;
+  }
+
+  transport->end += (size_t)bytes_read;
+  return LSP_TRANSPORT_OK;
+}
+
+// transport_restore hands the byte that terminates the body of the last
+// message back to the next one.
+static void transport_restore(lsp_transport *transport) {
+  if (transport->terminator != NULL) {
+    *transport->terminator = transport->terminator_saved;
+    transport->terminator = NULL;
+  }
+}
+
+// transport_frame measures the message at the front of the unread input.
+// `header_len` is 0 while the header is incomplete. Returns `false` if the
+// header is malformed.
+static bool transport_frame(const lsp_transport *transport, size_t *header_len,
+                            size_t *content_length) {
+  const char *data = transport->buffer + transport->start;
+  *header_len = header_find_end(data, transport->end - transport->start);
+  *content_length = 0;
+
+  // Skip the empty line at the end; it is not a header field.
+  return *header_len == 0 ||
+         header_parse(data, *header_len - 2, content_length);
+}
+
+// transport_needed returns how many unread bytes the message at the front
+// needs: either the header is incomplete and any amount of new bytes helps, or
+// we know exactly how big the whole message is.
+static size_t transport_needed(const lsp_transport *transport,
+                               size_t header_len, size_t content_length) {
+  size_t available = transport->end - transport->start;
+  return header_len == 0 ? available + 1 : header_len + content_length;
+}
+
+lsp_transport_status lsp_transport_read_message(lsp_transport *transport,
+                                                fdn_string *body) {
+  transport_restore(transport);
+
+  while (1) {
+    size_t header_len = 0;
+    size_t content_length = 0;
+    if (!transport_frame(transport, &header_len, &content_length)) {
+      return LSP_TRANSPORT_ERROR;
+    }
+
+    size_t needed = transport_needed(transport, header_len, content_length);
+    if (header_len != 0 && transport->end - transport->start >= needed) {
+      char *body_start = transport->buffer + transport->start + header_len;
+
+      transport->terminator = body_start + content_length;
+      transport->terminator_saved = *transport->terminator;
+      *transport->terminator = '\0';
+
+      transport->start += needed;
+
+      *body = fdn_string_create_view(body_start, content_length);
+      return LSP_TRANSPORT_OK;
+    }
+
+    lsp_transport_status status = transport_fill(transport, needed);
+    if (status != LSP_TRANSPORT_OK) {
+      return status;
+    }
+  }
+}
+
+bool lsp_transport_message_ready(lsp_transport *transport) {
+  transport_restore(transport);
+
+  while (1) {
+    size_t header_len = 0;
+    size_t content_length = 0;
+    if (!transport_frame(transport, &header_len, &content_length)) {
+      return true; // Reading it reports the error.
+    }
+
+    size_t needed = transport_needed(transport, header_len, content_length);
+    if (header_len != 0 && transport->end - transport->start >= needed) {
+      return true;
+    }
+
+    // Only read what the client has sent already.
+    struct pollfd input = {transport->fd, POLLIN, 0};
+    int ready;
+    do {
+      ready = poll(&input, 1, 0);
+    } while (ready < 0 && errno == EINTR);
+
+    if (ready == 0) {
+      return false;
+    }
+    if (ready < 0 || transport_fill(transport, needed) != LSP_TRANSPORT_OK) {
+      return true; // As above; also for the end of the stream.
+    }
+  }
+}
+
+lsp_transport_status lsp_transport_write_message(lsp_transport *transport,
+                                                 fdn_string body) {
+  char header[64];
+  int header_len = snprintf(header, sizeof(header),
+                            "Content-Length: %zu\r\n\r\n", body.string_length);
+  if (header_len < 0) {
+    return LSP_TRANSPORT_ERROR;
+  }
+
+  struct iovec parts[2];
+  parts[0].iov_base = header;
+  parts[0].iov_len = (size_t)header_len;
+  parts[1].iov_base = (void *)(uintptr_t)body.string_start;
+  parts[1].iov_len = body.string_length;
+
+  struct iovec *pending = parts;
+  int pending_count = 2;
+
+  while (pending_count > 0) {
+    ssize_t written = writev(transport->output_fd, pending, pending_count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return LSP_TRANSPORT_ERROR;
+    }
+
+    // Short write; skip what went out and retry with the rest.
+    size_t remaining = (size_t)written;
+    while (pending_count > 0 && remaining >= pending->iov_len) {
+      remaining -= pending->iov_len;
+      pending++;
+      pending_count--;
+    }
+
+    if (pending_count > 0) {
+      pending->iov_base = (char *)pending->iov_base + remaining;
+      pending->iov_len -= remaining;
+    }
+  }
+
+  return LSP_TRANSPORT_OK;
+}
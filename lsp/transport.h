@@ -0,0 +1,74 @@
+#ifndef LSP_TRANSPORT_H
+#define LSP_TRANSPORT_H
+
+#include <stddef.h>
+
+#include "libs/foundation.h"
+
+/**
+ * The transport frames the base protocol messages read from a file descriptor:
+ *
+ *   Content-Length: 52\r\n
+ *   Content-Type: application/vscode-jsonrpc; charset=utf-8\r\n
+ *   \r\n
+ *   {"jsonrpc":"2.0","id":1,"method":"initialize",...}
+ *
+ * Input is `read` in large chunks into a single buffer that is reused for the
+ * whole session. Headers are parsed in place and the message body is handed out
+ * as a view into that buffer, so a message is never copied on its way to the
+ * parser. Consumed bytes are reclaimed by moving the unread tail to the front
+ * of the buffer (instead of wrapping around) so that every body stays
+ * contiguous. The buffer only grows when a single message does not fit.
+ *
+ * Outgoing messages are written with a single `writev` of the header and the
+ * body, so the body (usually the output buffer of a `JsonWriter`) is never
+ * copied or formatted again on its way out.
+ */
+typedef struct {
+  int fd;          // The descriptor messages are read from (usually stdin).
+  int output_fd;   // The descriptor messages are written to (usually stdout).
+  char *buffer;    // Bytes read from `fd`.
+  size_t capacity; // Size of the `buffer`.
+  size_t start;    // Offset of the first byte that was not consumed yet.
+  size_t end;      // Offset one past the last byte read from `fd`.
+
+  // The body of the last returned message is null-terminated in place. The
+  // byte it overwrote belongs to the next message and is restored before the
+  // buffer is read again.
+  char *terminator;
+  char terminator_saved;
+} lsp_transport;
+
+typedef enum {
+  LSP_TRANSPORT_OK = 0,
+  LSP_TRANSPORT_EOF = 1,   // The client closed the stream between messages.
+  LSP_TRANSPORT_ERROR = 2, // Malformed headers, I/O or allocation failure.
+} lsp_transport_status;
+
+// lsp_transport_init prepares the transport to read from `fd` with a buffer of
+// `capacity` bytes and to write to `output_fd`. Returns `false` if the buffer
+// could not be allocated.
+bool lsp_transport_init(lsp_transport *transport, int fd, int output_fd,
+                        size_t capacity);
+
+void lsp_transport_free(lsp_transport *transport);
+
+// lsp_transport_read_message blocks until the next complete message is
+// available and stores a view of its body in `body`. The body is
+// null-terminated and stays valid until the next call.
+lsp_transport_status lsp_transport_read_message(lsp_transport *transport,
+                                                fdn_string *body);
+
+// lsp_transport_message_ready tells whether the next call to
+// `lsp_transport_read_message` returns without waiting for the client: a
+// whole message was received already, or the stream ended or failed. It reads
+// whatever input is available without blocking. The body of the last message
+// is no longer valid afterwards.
+bool lsp_transport_message_ready(lsp_transport *transport);
+
+// lsp_transport_write_message frames the `body` with its header and writes the
+// whole message out. Blocks until everything is written.
+lsp_transport_status lsp_transport_write_message(lsp_transport *transport,
+                                                 fdn_string body);
+
+#endif // LSP_TRANSPORT_H
@@ -0,0 +1,736 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libs/foundation.h"
+#include "solidity/parser.h"
+#include "workspace.h"
+
+#define WORKSPACE_INITIAL_FILES 256
+
+// Larger files are skipped; they are generated code rather than something to
+// navigate, and token offsets are 32-bit.
+#define WORKSPACE_MAX_FILE_SIZE (16u * 1024 * 1024)
+
+// No more threads than this are started, whatever the number of cores.
+#define WORKSPACE_MAX_THREADS 64
+
+/////////////////////////////////////////////////
+//                    URIS                     //
+/////////////////////////////////////////////////
+
+static int hex_value(char ch) {
+  if (ch >= '0' && ch <= '9') {
+    return ch - '0';
+  }
+  if (ch >= 'a' && ch <= 'f') {
+    return ch - 'a' + 10;
+  }
+  if (ch >= 'A' && ch <= 'F') {
+    return ch - 'A' + 10;
+  }
+  return -1;
+}
+
+bool lsp_uri_to_path(fdn_arena *arena, fdn_string uri, fdn_string *path) {
+  const char *scheme = "file://";
+  size_t scheme_length = strlen(scheme);
+  if (uri.string_length < scheme_length ||
+      memcmp(uri.string_start, scheme, scheme_length) != 0) {
+    return false;
+  }
+
+  // The authority (usually empty) comes before the path.
+  const char *cursor = uri.string_start + scheme_length;
+  const char *end = uri.string_start + uri.string_length;
+  cursor = memchr(cursor, '/', (size_t)(end - cursor));
+  if (cursor == NULL) {
+    return false;
+  }
+
+  char *output = fdn_arena_alloc(arena, (size_t)(end - cursor) + 1);
+  if (output == NULL) {
+    return false;
+  }
+
+  size_t length = 0;
+  while (cursor < end) {
+    if (*cursor != '%') {
+      output[length++] = *cursor++;
+      continue;
+    }
+
+    int high = end - cursor > 2 ? hex_value(cursor[1]) : -1;
+    int low = end - cursor > 2 ? hex_value(cursor[2]) : -1;
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    output[length++] = (char)(high * 16 + low);
+    cursor += 3;
+  }
+  output[length] = '\0';
+
+  *path = fdn_string_create_view(output, length);
+  return true;
+}
+
+// Characters that stand for themselves in the path of a URI.
+static bool uri_is_unreserved(char ch) {
+  return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+         (ch >= '0' && ch <= '9') || ch == '-' || ch == '.' || ch == '_' ||
+         ch == '~' || ch == '/';
+}
+
+bool lsp_path_to_uri(fdn_arena *arena, fdn_string path, fdn_string *uri) {
+  const char *scheme = "file://";
+  size_t scheme_length = strlen(scheme);
+  char *output =
+      fdn_arena_alloc(arena, scheme_length + path.string_length * 3 + 1);
+  if (output == NULL) {
+    return false;
+  }
+
+  memcpy(output, scheme, scheme_length);
+  size_t length = scheme_length;
+  for (size_t i = 0; i < path.string_length; i++) {
+    char ch = path.string_start[i];
+    if (uri_is_unreserved(ch)) {
+      output[length++] = ch;
+    } else {
+      output[length++] = '%';
+      output[length++] = "0123456789ABCDEF"[(unsigned char)ch >> 4];
+      output[length++] = "0123456789ABCDEF"[(unsigned char)ch & 0xF];
+    }
+  }
+  output[length] = '\0';
+
+  *uri = fdn_string_create_view(output, length);
+  return true;
+}
+
+/////////////////////////////////////////////////
+//                    WALK                     //
+/////////////////////////////////////////////////
+
+static bool workspace_is_stopped(lsp_workspace *workspace) {
+  return __atomic_load_n(&workspace->stop, __ATOMIC_ACQUIRE) != 0;
+}
+
+static char *path_join(const char *directory, const char *name) {
+  size_t directory_length = strlen(directory);
+  size_t name_length = strlen(name);
+  char *path = malloc(directory_length + 1 + name_length + 1);
+  if (path == NULL) {
+    return NULL;
+  }
+
+  memcpy(path, directory, directory_length);
+  path[directory_length] = '/';
+  memcpy(path + directory_length + 1, name, name_length + 1);
+  return path;
+}
+
+static bool path_is_solidity(const char *path) {
+  size_t length = strlen(path);
+  return length > 4 && memcmp(path + length - 4, ".sol", 4) == 0;
+}
+
+// workspace_add_file takes ownership of the `path`.
+static bool workspace_add_file(lsp_workspace *workspace, uint32_t *count,
+                               char *path) {
+  if (*count == workspace->file_capacity) {
+    uint32_t capacity = workspace->file_capacity > 0
+                            ? workspace->file_capacity * 2
+                            : WORKSPACE_INITIAL_FILES;
+    lsp_workspace_file *files =
+        realloc(workspace->files, capacity * sizeof(lsp_workspace_file));
+    if (files == NULL) {
+      free(path);
+      return false;
+    }
+    workspace->files = files;
+    workspace->file_capacity = capacity;
+  }
+
+  lsp_workspace_file *file = &workspace->files[(*count)++];
+  memset(file, 0, sizeof(*file));
+  file->path = path;
+  sol_syntax_init(&file->syntax);
+  return true;
+}
+
+// workspace_walk collects the Solidity files below `root`. Directories are
+// kept on an explicit stack rather than walked recursively. Hidden entries
+// (`.git`) are skipped, and so are links to directories, which could form a
+// cycle.
+static void workspace_walk(lsp_workspace *workspace, const char *root,
+                           uint32_t *count) {
+  char **stack = NULL;
+  uint32_t stack_count = 0;
+  uint32_t stack_capacity = 0;
+
+  char *directory = strdup(root);
+  while (directory != NULL && !workspace_is_stopped(workspace)) {
+    DIR *handle = opendir(directory);
+    struct dirent *entry;
+    while (handle != NULL && (entry = readdir(handle)) != NULL) {
+      if (entry->d_name[0] == '.') {
+        continue;
+      }
+
+      char *path = path_join(directory, entry->d_name);
+      struct stat info;
+      if (path == NULL || lstat(path, &info) != 0) {
+        free(path);
+        continue;
+      }
+      if (S_ISLNK(info.st_mode) && stat(path, &info) == 0 &&
+          S_ISDIR(info.st_mode)) {
+        free(path);
+        continue;
+      }
+
+      if (S_ISDIR(info.st_mode)) {
+        if (stack_count == stack_capacity) {
+          uint32_t capacity = stack_capacity > 0 ? stack_capacity * 2 : 16;
+          char **grown = realloc(stack, capacity * sizeof(char *));
+          if (grown == NULL) {
+            free(path);
+            continue;
+          }
+          stack = grown;
+          stack_capacity = capacity;
+        }
+        stack[stack_count++] = path;
+      } else if (S_ISREG(info.st_mode) && path_is_solidity(path) &&
+                 (uint64_t)info.st_size <= WORKSPACE_MAX_FILE_SIZE) {
+        workspace_add_file(workspace, count, path);
+      } else {
+        free(path);
+      }
+    }
+
+    if (handle != NULL) {
+      closedir(handle);
+    } else {
+      fdn_error("Failed to open the directory %s (errno %d).", directory,
+                errno);
+    }
+    free(directory);
+    directory = stack_count > 0 ? stack[--stack_count] : NULL;
+  }
+
+  free(directory);
+  while (stack_count > 0) {
+    free(stack[--stack_count]);
+  }
+  free(stack);
+}
+
+/////////////////////////////////////////////////
+//                   INDEXING                  //
+/////////////////////////////////////////////////
+
+// file_load maps the file into memory. The lexer needs the contents to be
+// null-terminated: a mapping is padded with zeros up to the end of its last
+// page, so only files that end on a page boundary are read into the heap.
+static bool file_load(lsp_workspace_file *file) {
+  int fd = open(file->path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) ||
+      (uint64_t)info.st_size > WORKSPACE_MAX_FILE_SIZE) {
+    close(fd);
+    return false;
+  }
+
+  file->mtime = (int64_t)info.st_mtim.tv_sec * 1000000000 +
+                info.st_mtim.tv_nsec;
+
+  size_t size = (size_t)info.st_size;
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  if (size > 0 && size % page_size != 0) {
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      close(fd);
+      file->source = fdn_string_create_view(mapping, size);
+      file->mapped = true;
+      return true;
+    }
+  }
+
+  char *data = malloc(size + 1);
+  size_t length = 0;
+  while (data != NULL && length < size) {
+    ssize_t bytes_read = read(fd, data + length, size - length);
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read <= 0) {
+      break; // The file shrank; index what was read.
+    }
+    length += (size_t)bytes_read;
+  }
+  close(fd);
+
+  if (data == NULL) {
+    return false;
+  }
+  data[length] = '\0';
+  file->source = fdn_string_create_view(data, length);
+  file->mapped = false;
+  return true;
+}
+
+static void file_free(lsp_workspace_file *file) {
+  if (file->mapped) {
+    munmap((void *)(uintptr_t)file->source.string_start,
+           file->source.string_length);
+  } else {
+    free((void *)(uintptr_t)file->source.string_start);
+  }
+  if (!file->cached) {
+    sol_syntax_free(&file->syntax);
+  }
+  free(file->symbols);
+  lsp_reference_list_free(&file->references);
+  free(file->path);
+}
+
+// file_reuse points the syntax of the file into the cache if the cache has it
+// for the same contents. The contents are only hashed if the size and
+// modification time do not match already, e.g. after a checkout.
+static bool file_reuse(lsp_workspace *workspace, lsp_workspace_file *file) {
+  const lsp_cache_entry *entry = lsp_cache_find(&workspace->cache, file->path);
+  bool unchanged = entry != NULL &&
+                   entry->size == file->source.string_length &&
+                   entry->mtime == file->mtime;
+  if (unchanged) {
+    file->hash = entry->hash;
+  } else {
+    file->hash = lsp_cache_hash(file->source.string_start,
+                                file->source.string_length);
+    unchanged = entry != NULL &&
+                entry->size == file->source.string_length &&
+                entry->hash == file->hash;
+  }
+
+  if (unchanged) {
+    lsp_cache_syntax(&workspace->cache, entry, &file->syntax);
+    file->cached = true;
+  }
+  return unchanged;
+}
+
+// file_collect_symbols collects the symbols of an indexed file, interning
+// their names, into `file->symbols`. The `declarations` are scratch space.
+static bool file_collect_symbols(lsp_workspace *workspace,
+                                 lsp_workspace_file *file, uint32_t index,
+                                 lsp_declaration_list *declarations) {
+  if (!lsp_declarations_collect(&file->syntax, file->source, declarations)) {
+    return false;
+  }
+
+  file->symbols = malloc((declarations->count > 0 ? declarations->count : 1) *
+                         sizeof(lsp_symbol));
+  if (file->symbols == NULL) {
+    return false;
+  }
+
+  fdn_interner *names = &workspace->names;
+  for (uint32_t i = 0; i < declarations->count; i++) {
+    const lsp_declaration *declaration = &declarations->items[i];
+    lsp_symbol *symbol = &file->symbols[i];
+    symbol->name = fdn_interner_intern(names, declaration->name);
+    symbol->container =
+        declaration->container.string_length > 0
+            ? fdn_interner_intern(names, declaration->container)
+            : FDN_INTERNER_NONE;
+    symbol->file = index;
+    symbol->line = declaration->line;
+    symbol->character = declaration->character;
+    symbol->kind = declaration->kind;
+    if (symbol->name == FDN_INTERNER_NONE) {
+      return false;
+    }
+  }
+  file->symbol_count = declarations->count;
+  return true;
+}
+
+// workspace_work indexes the files that are left until there are none.
+static void *workspace_work(void *argument) {
+  lsp_workspace *workspace = argument;
+  uint32_t count = __atomic_load_n(&workspace->file_count, __ATOMIC_ACQUIRE);
+  lsp_declaration_list declarations = {NULL, 0, 0};
+  lsp_reference_cache *cache = malloc(sizeof(lsp_reference_cache));
+  if (cache != NULL) {
+    lsp_reference_cache_init(cache);
+  }
+
+  while (!workspace_is_stopped(workspace)) {
+    uint32_t index =
+        __atomic_fetch_add(&workspace->next_file, 1, __ATOMIC_RELAXED);
+    if (index >= count) {
+      break;
+    }
+
+    lsp_workspace_file *file = &workspace->files[index];
+    if (!file_load(file)) {
+      fdn_error("Failed to read %s.", file->path);
+      continue;
+    }
+    if (file_reuse(workspace, file)) {
+      __atomic_fetch_add(&workspace->files_reused, 1, __ATOMIC_RELAXED);
+    } else if (!sol_syntax_build(&file->syntax, file->source.string_start)) {
+      fdn_error("Ran out of memory while parsing %s.", file->path);
+      continue;
+    }
+
+    file->path_id = fdn_interner_intern(&workspace->names,
+                                        fdn_string_create_view(
+                                            file->path, strlen(file->path)));
+    if (file->path_id == FDN_INTERNER_NONE) {
+      fdn_error("Ran out of memory while interning the path of %s.",
+                file->path);
+      continue;
+    }
+    if (!file_collect_symbols(workspace, file, index, &declarations)) {
+      fdn_error("Ran out of memory while collecting the symbols of %s.",
+                file->path);
+    }
+    if (cache == NULL ||
+        !lsp_references_collect(&file->syntax, file->source,
+                                &workspace->names, cache, &file->references)) {
+      fdn_error("Ran out of memory while collecting the references of %s.",
+                file->path);
+    }
+
+    __atomic_store_n(&file->indexed, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&workspace->files_indexed, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&workspace->bytes_indexed, file->source.string_length,
+                       __ATOMIC_RELAXED);
+  }
+
+  lsp_declaration_list_free(&declarations);
+  free(cache);
+  return NULL;
+}
+
+static double seconds_since(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) +
+         (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// workspace_index_symbols merges the symbols of the files into the symbol
+// index of the workspace.
+static void workspace_index_symbols(lsp_workspace *workspace, uint32_t count) {
+  uint32_t symbol_count = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    symbol_count += workspace->files[i].symbol_count;
+  }
+
+  lsp_symbol *symbols =
+      malloc((symbol_count > 0 ? symbol_count : 1) * sizeof(lsp_symbol));
+  uint32_t merged = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    lsp_workspace_file *file = &workspace->files[i];
+    if (symbols != NULL && file->symbol_count > 0) {
+      memcpy(symbols + merged, file->symbols,
+             file->symbol_count * sizeof(lsp_symbol));
+      merged += file->symbol_count;
+    }
+    free(file->symbols);
+    file->symbols = NULL;
+    file->symbol_count = 0;
+  }
+
+  if (symbols == NULL || !lsp_symbol_index_build(&workspace->symbols,
+                                                 &workspace->names, symbols,
+                                                 merged)) {
+    fdn_error("Ran out of memory while indexing %u symbols.", symbol_count);
+  }
+}
+
+// workspace_index_references merges the identifiers of the files into the
+// reference index of the workspace.
+static void workspace_index_references(lsp_workspace *workspace,
+                                       uint32_t count) {
+  lsp_reference_list *lists =
+      malloc((count > 0 ? count : 1) * sizeof(lsp_reference_list));
+  if (lists != NULL) {
+    for (uint32_t i = 0; i < count; i++) {
+      lists[i] = workspace->files[i].references;
+    }
+  }
+
+  if (lists == NULL ||
+      !lsp_reference_index_build(&workspace->references,
+                                 fdn_interner_count(&workspace->names), lists,
+                                 count)) {
+    fdn_error("Ran out of memory while indexing the references.");
+  }
+  free(lists);
+  for (uint32_t i = 0; i < count; i++) {
+    lsp_reference_list_free(&workspace->files[i].references);
+  }
+}
+
+// workspace_index_imports builds the import graph of the files.
+static void workspace_index_imports(lsp_workspace *workspace, uint32_t count) {
+  fdn_string *folders = malloc((workspace->folder_count > 0
+                                    ? workspace->folder_count
+                                    : 1) *
+                               sizeof(fdn_string));
+  lsp_import_file *files = malloc((count > 0 ? count : 1) * sizeof(*files));
+  if (folders != NULL && files != NULL) {
+    for (uint32_t i = 0; i < workspace->folder_count; i++) {
+      folders[i] = fdn_string_create_view(workspace->folders[i],
+                                          strlen(workspace->folders[i]));
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      const lsp_workspace_file *file = &workspace->files[i];
+      files[i].path = file->path;
+      files[i].source = file->source;
+      files[i].syntax = &file->syntax;
+    }
+  }
+
+  if (folders == NULL || files == NULL ||
+      !lsp_import_graph_build(&workspace->imports, folders,
+                              workspace->folder_count, files, count)) {
+    fdn_error("Ran out of memory while resolving the imports.");
+  }
+  free(folders);
+  free(files);
+}
+
+// workspace_save writes the cache again unless it has every file already.
+static void workspace_save(lsp_workspace *workspace, uint32_t count) {
+  if (workspace->files_reused == count &&
+      workspace->cache.file_count == count) {
+    return;
+  }
+
+  lsp_cache_file *files = malloc((count > 0 ? count : 1) * sizeof(*files));
+  if (files == NULL) {
+    return;
+  }
+
+  uint32_t saved = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const lsp_workspace_file *file = &workspace->files[i];
+    if (file->indexed) {
+      files[saved].path = file->path;
+      files[saved].hash = file->hash;
+      files[saved].mtime = file->mtime;
+      files[saved].size = file->source.string_length;
+      files[saved].syntax = &file->syntax;
+      saved++;
+    }
+  }
+
+  if (!lsp_cache_write(workspace->cache_path, files, saved)) {
+    fdn_error("Failed to write the index cache %s.", workspace->cache_path);
+  }
+  free(files);
+}
+
+// workspace_main walks the folders and then indexes the files on a pool of
+// threads, this one included.
+static void *workspace_main(void *argument) {
+  lsp_workspace *workspace = argument;
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (workspace->cache_path != NULL) {
+    lsp_cache_open(&workspace->cache, workspace->cache_path);
+  }
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < workspace->folder_count; i++) {
+    workspace_walk(workspace, workspace->folders[i], &count);
+  }
+  __atomic_store_n(&workspace->file_count, count, __ATOMIC_RELEASE);
+  double walk_time = seconds_since(&start);
+
+  pthread_t workers[WORKSPACE_MAX_THREADS];
+  uint32_t worker_count = 0;
+  while (worker_count + 1 < workspace->thread_count &&
+         pthread_create(&workers[worker_count], NULL, workspace_work,
+                        workspace) == 0) {
+    worker_count++;
+  }
+  workspace_work(workspace);
+  for (uint32_t i = 0; i < worker_count; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  bool stopped = workspace_is_stopped(workspace);
+  if (!stopped) {
+    workspace_index_symbols(workspace, count);
+    workspace_index_references(workspace, count);
+    workspace_index_imports(workspace, count);
+  }
+  if (!stopped && workspace->cache_path != NULL) {
+    workspace_save(workspace, count);
+  }
+
+  fdn_info("%s %u of %u Solidity files (%.1f MB, %u from the cache, %u "
+           "symbols, %" PRIu64 " references, %u imports on %u levels) in %.0f "
+           "ms on %u thread(s); the walk took %.0f ms.",
+           stopped ? "Stopped after indexing" : "Indexed",
+           __atomic_load_n(&workspace->files_indexed, __ATOMIC_RELAXED), count,
+           (double)__atomic_load_n(&workspace->bytes_indexed,
+                                   __ATOMIC_RELAXED) /
+               (1024.0 * 1024.0),
+           __atomic_load_n(&workspace->files_reused, __ATOMIC_RELAXED),
+           workspace->symbols.symbol_count,
+           workspace->references.reference_count, workspace->imports.edge_count,
+           workspace->imports.level_count, seconds_since(&start) * 1e3,
+           worker_count + 1, walk_time * 1e3);
+
+  __atomic_store_n(&workspace->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/////////////////////////////////////////////////
+//                  WORKSPACE                  //
+/////////////////////////////////////////////////
+
+void lsp_workspace_init(lsp_workspace *workspace) {
+  memset(workspace, 0, sizeof(*workspace));
+}
+
+// folder_contains tells whether `path` is the `folder` or below it.
+static bool folder_contains(fdn_string folder, fdn_string path) {
+  while (folder.string_length > 1 &&
+         folder.string_start[folder.string_length - 1] == '/') {
+    folder.string_length--;
+  }
+  return path.string_length >= folder.string_length &&
+         memcmp(path.string_start, folder.string_start,
+                folder.string_length) == 0 &&
+         (path.string_length == folder.string_length ||
+          path.string_start[folder.string_length] == '/' ||
+          folder.string_start[folder.string_length - 1] == '/');
+}
+
+bool lsp_workspace_start(lsp_workspace *workspace, const fdn_string *folders,
+                         uint32_t folder_count, uint32_t thread_count,
+                         const char *cache_path) {
+  if (workspace->started) {
+    return false;
+  }
+
+  if (!fdn_interner_init(&workspace->names)) {
+    return false;
+  }
+
+  if (cache_path != NULL) {
+    workspace->cache_path = strdup(cache_path);
+    if (workspace->cache_path == NULL) {
+      lsp_workspace_free(workspace);
+      return false;
+    }
+  }
+
+  workspace->folders = calloc(folder_count > 0 ? folder_count : 1,
+                              sizeof(char *));
+  if (workspace->folders == NULL) {
+    lsp_workspace_free(workspace);
+    return false;
+  }
+
+  for (uint32_t i = 0; i < folder_count; i++) {
+    bool nested = false;
+    for (uint32_t j = 0; j < folder_count && !nested; j++) {
+      // Of two equal folders, the first one is kept.
+      nested = j != i && folder_contains(folders[j], folders[i]) &&
+               (!folder_contains(folders[i], folders[j]) || j < i);
+    }
+    if (nested) {
+      continue;
+    }
+
+    char *folder = malloc(folders[i].string_length + 1);
+    if (folder == NULL) {
+      lsp_workspace_free(workspace);
+      return false;
+    }
+    memcpy(folder, folders[i].string_start, folders[i].string_length);
+    folder[folders[i].string_length] = '\0';
+    workspace->folders[workspace->folder_count++] = folder;
+  }
+
+  if (thread_count == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = cores > 0 ? (uint32_t)cores : 1;
+  }
+  workspace->thread_count = thread_count < WORKSPACE_MAX_THREADS
+                                ? thread_count
+                                : WORKSPACE_MAX_THREADS;
+
+  if (pthread_create(&workspace->thread, NULL, workspace_main, workspace) !=
+      0) {
+    lsp_workspace_free(workspace);
+    return false;
+  }
+  workspace->started = true;
+  return true;
+}
+
+bool lsp_workspace_is_done(const lsp_workspace *workspace) {
+  return __atomic_load_n(&workspace->done, __ATOMIC_ACQUIRE) != 0;
+}
+
+void lsp_workspace_wait(lsp_workspace *workspace) {
+  if (workspace->started) {
+    pthread_join(workspace->thread, NULL);
+    workspace->started = false;
+  }
+}
+
+void lsp_workspace_free(lsp_workspace *workspace) {
+  __atomic_store_n(&workspace->stop, 1, __ATOMIC_RELEASE);
+  lsp_workspace_wait(workspace);
+
+  // The walk may have been stopped before it published the files.
+  uint32_t count = __atomic_load_n(&workspace->file_count, __ATOMIC_ACQUIRE);
+  for (uint32_t i = 0; i < count; i++) {
+    file_free(&workspace->files[i]);
+  }
+  free(workspace->files);
+
+  // After the files, whose syntax may point into it.
+  lsp_cache_close(&workspace->cache);
+  free(workspace->cache_path);
+
+  lsp_symbol_index_free(&workspace->symbols);
+  lsp_reference_index_free(&workspace->references);
+  lsp_import_graph_free(&workspace->imports);
+  if (workspace->names.slots != NULL) {
+    fdn_interner_free(&workspace->names);
+  }
+
+  for (uint32_t i = 0; i < workspace->folder_count; i++) {
+    free(workspace->folders[i]);
+  }
+  free(workspace->folders);
+  lsp_workspace_init(workspace);
+}
@@ -0,0 +1,122 @@
+#ifndef LSP_WORKSPACE_H
+#define LSP_WORKSPACE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "imports.h"
+#include "libs/foundation.h"
+#include "references.h"
+#include "solidity/parser.h"
+#include "symbols.h"
+
+/**
+ * The Solidity files of the workspace folders, indexed in the background.
+ *
+ * Indexing runs on threads of its own, so the server keeps answering requests
+ * meanwhile. First the folders are walked, dependency trees such as `lib/` and
+ * `node_modules/` included, to collect the path of every `.sol` file. Then a
+ * pool of workers, one per core, claims the files one at a time through an
+ * atomic counter. A worker maps its file into memory and lexes and parses it
+ * straight from the mapping; the tokens are offsets into the mapping, which
+ * stays in place for as long as the workspace does.
+ *
+ * With a cache, a file whose size and modification time, or else whose
+ * contents, match its entry in the cache is not parsed at all: its syntax
+ * points into the mapped cache instead. Once every file is indexed, the cache
+ * is written again if anything changed.
+ *
+ * Workers also collect the symbols and the identifiers of their files, with
+ * names interned in the interner of the workspace. Once every file is indexed
+ * they are merged into one index for `workspace/symbol` and one for
+ * `textDocument/references`, and their imports are resolved into the import
+ * graph. The server keeps the graph up to date with the documents the client
+ * opens and edits afterwards (see dispatcher_sync).
+ *
+ * The table of files is published once the walk is complete and never moves
+ * afterwards. Each file is published on its own through its `indexed` flag,
+ * so other threads can use the files indexed so far.
+ */
+
+typedef struct {
+  char *path;        // Owned, null-terminated.
+  fdn_string source; // The contents, null-terminated.
+  bool mapped;       // Whether `source` is a mapping or a heap copy.
+  bool cached;       // Whether `syntax` points into the cache; read-only then.
+  uint64_t hash;     // Of `source`, see lsp_cache_hash.
+  int64_t mtime;     // Modification time in nanoseconds.
+  uint32_t path_id;  // The path, interned.
+  SolSyntax syntax;
+
+  // Until they are merged into the symbol index of the workspace.
+  lsp_symbol *symbols;
+  uint32_t symbol_count;
+  lsp_reference_list references;
+
+  uint32_t indexed; // Set once the file is indexed; read it atomically.
+} lsp_workspace_file;
+
+typedef struct {
+  char **folders;
+  uint32_t folder_count;
+
+  lsp_workspace_file *files;
+  uint32_t file_count; // Zero until the walk is complete; read it atomically.
+  uint32_t file_capacity;
+
+  // Shared by the indexing threads; accessed atomically.
+  uint32_t next_file; // The next file for a worker to claim.
+  uint32_t files_indexed;
+  uint32_t files_reused; // Indexed from the cache rather than parsed.
+  uint64_t bytes_indexed;
+  uint32_t done; // Set once every file is indexed.
+  uint32_t stop; // Asks the threads to finish early.
+
+  char *cache_path; // NULL without a cache.
+  lsp_cache cache;
+
+  fdn_interner names;       // Symbol names and file paths.
+  lsp_symbol_index symbols; // Complete once every file is indexed.
+  lsp_reference_index references; // Likewise.
+  lsp_import_graph imports;        // Likewise.
+
+  uint32_t thread_count;
+  pthread_t thread;
+  bool started;
+} lsp_workspace;
+
+void lsp_workspace_init(lsp_workspace *workspace);
+
+// lsp_workspace_start indexes the `folders` (paths, not URIs) in the
+// background with `thread_count` threads, or one per core if it is 0. Folders
+// inside of another folder are only indexed once. The index is cached at
+// `cache_path` unless it is NULL. Returns `false` if the indexing could not be
+// started.
+bool lsp_workspace_start(lsp_workspace *workspace, const fdn_string *folders,
+                         uint32_t folder_count, uint32_t thread_count,
+                         const char *cache_path);
+
+// lsp_workspace_is_done tells whether every file was indexed and the symbol
+// and reference indexes are complete.
+bool lsp_workspace_is_done(const lsp_workspace *workspace);
+
+// lsp_workspace_wait blocks until every file is indexed.
+void lsp_workspace_wait(lsp_workspace *workspace);
+
+// lsp_workspace_free stops the indexing, waits for the files being indexed and
+// releases every file.
+void lsp_workspace_free(lsp_workspace *workspace);
+
+// lsp_uri_to_path converts a `file://` URI to a null-terminated path allocated
+// in the `arena`, decoding its percent-escapes. Returns `false` for other
+// schemes and malformed escapes.
+bool lsp_uri_to_path(fdn_arena *arena, fdn_string uri, fdn_string *path);
+
+// lsp_path_to_uri converts an absolute `path` to a `file://` URI allocated in
+// the `arena`, percent-encoding the characters that need it. Returns `false`
+// if memory ran out.
+bool lsp_path_to_uri(fdn_arena *arena, fdn_string path, fdn_string *uri);
+
+#endif // LSP_WORKSPACE_H
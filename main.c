@@ -1,11 +1,16 @@
 // --- Standard Headers ---
 
+// POSIX APIs used by the foundation library (threads, localtime_r)
+// are hidden under strict -std=c99 unless requested explicitly.
+#define _POSIX_C_SOURCE 200809L
+
 #include <inttypes.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 // --- Project Headers ---
 // Ensure that all declarations are known before the implementation 'c' files
@@ -14,14 +19,38 @@
 #include "libs/foundation.h" // the "Base Layer"; custom standard library
 #define FDN_IMPLEMENTATION
 
+#include "lsp/cache.h"
+#include "lsp/completion.h"
 #include "lsp/dispatcher.h"
+#include "lsp/documents.h"
+#include "lsp/imports.h"
+#include "lsp/references.h"
+#include "lsp/server.h"
+#include "lsp/symbols.h"
+#include "lsp/transport.h"
+#include "lsp/workspace.h"
 #include "json/parser.h"
+#include "json/writer.h"
+#include "solidity/lexer.h"
+#include "solidity/parser.h"
 
 // --- Unity Build ---
 
+#include "lsp/cache.c"
+#include "lsp/completion.c"
 #include "lsp/dispatcher.c"
+#include "lsp/documents.c"
+#include "lsp/imports.c"
+#include "lsp/references.c"
+#include "lsp/server.c"
+#include "lsp/symbols.c"
+#include "lsp/transport.c"
+#include "lsp/workspace.c"
 #include "json/lexer.c"
 #include "json/parser.c"
+#include "json/writer.c"
+#include "solidity/lexer.c"
+#include "solidity/parser.c"
 
 /**
  * @brief Safely appends a single message to the persistent LSP log file.
@@ -61,77 +90,47 @@ int main(void) {
     return 1;
   }
 
-  fdn_log_init(log_file);
+  if (!fdn_log_init(log_file)) {
+    fdn_error("Failed to start the log writer; logging synchronously.");
+  }
+  // Flush the queued lines on every exit path.
+  atexit(fdn_log_shutdown);
 
   fdn_info("--- Solbot LSP Started ---");
 
-  char *separator = "\r\n";
-  char line_buffer[1024];
-
-  while (1) {
-    uint32_t content_length = 0; // Reset for each message
-
-    // --- Header Part ---
-
-    while (fgets(line_buffer, sizeof(line_buffer), stdin) != NULL) {
-      if (strncmp(line_buffer, "Content-Length: ", 16) == 0) {
-        sscanf(line_buffer + 16, "%" PRIu32, &content_length);
-        char content_len_log[70];
-        sprintf(content_len_log,
-                "[Info] Found content section length header; len: %" PRIu32,
-                content_length);
-      }
-
-      if (strcmp(line_buffer, separator) == 0) {
-        break;
-      }
-    }
-
-    if (content_length == 0) {
-      // TODO: Can client -> server notifications have 0 length?
-      return 1;
-    }
-
-    // --- Content Part
-
-    // Add +1 for null terminator.
-    char *content_buffer = malloc(content_length + 1);
-    if (content_buffer == NULL) {
-      return 1;
-    }
-
-    size_t bytes_read =
-        fread(content_buffer, sizeof(char), content_length, stdin);
-
-    if (bytes_read != content_length) {
-      free(content_buffer);
-      return 1;
-    }
-
-    content_buffer[content_length] = '\0'; // 'fread' does not null-terminate
-
-    fdn_info("Raw request message: %s", content_buffer);
+  // The server arena holds the state that lives for the whole session.
+  fdn_arena server_arena;
+  if (!fdn_arena_init(&server_arena, 64 * 1024)) {
+    return 1;
+  }
 
-    RequestMessage *request = parser_parse_request_message(content_buffer);
-    if (request == NULL) {
-      free(content_buffer);
-      return 1;
-    }
+  // Messages are framed straight out of a reusable input buffer; the body
+  // handed to the parser is a view into it.
+  lsp_transport transport;
+  if (!lsp_transport_init(&transport, STDIN_FILENO, STDOUT_FILENO,
+                          64 * 1024)) {
+    return 1;
+  }
 
-    fdn_info("Dispatching method: %.*s", (int)request->method.string_length,
-             request->method.string_start);
+  if (!dispatcher_init(&server_arena)) {
+    fdn_error("Failed to initialize the dispatcher.");
+    return 1;
+  }
 
-    lsp_status status = dispatch_message(request->method, request->has_id,
-                                         request->id, request->params);
+  // This thread reads the messages; the server starts the workers and the
+  // writer (see lsp/server.h).
+  lsp_server server;
+  if (!lsp_server_init(&server, &transport, 0)) {
+    fdn_error("Failed to start the server threads.");
+    return 1;
+  }
 
-    free(request);
-    free(content_buffer);
+  int status = lsp_server_run(&server);
 
-    if (status == LSP_STATUS_EXIT) {
-      fdn_info("Exit signal received. Shutting down.");
-      break;
-    }
-  }
+  lsp_server_free(&server);
+  dispatcher_free();
+  lsp_transport_free(&transport);
+  fdn_arena_free(&server_arena);
 
-  return 0;
+  return status;
 }
@@ -0,0 +1,573 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lexer.h"
+#include "libs/foundation.h"
+
+/////////////////////////////////////////////////
+//              CHARACTER CLASSES              //
+/////////////////////////////////////////////////
+
+// Every byte maps to a set of class bits. The hot loops (whitespace,
+// identifiers, digits) test a single bit per byte.
+#define SOL_CHAR_SPACE 0x01       // ' ', '\t', '\n', '\r', '\v', '\f'
+#define SOL_CHAR_IDENT_START 0x02 // Letters, '_' and '$'.
+#define SOL_CHAR_IDENT 0x04       // Letters, digits, '_' and '$'.
+#define SOL_CHAR_DIGIT 0x08       // '0' to '9'
+#define SOL_CHAR_HEX 0x10         // Hex digits.
+#define SOL_CHAR_QUOTE 0x20       // '"' and '\''
+#define SOL_CHAR_KEYWORD 0x40     // Lowercase letters; every keyword and
+                                  // elementary type starts with one.
+
+static uint8_t g_sol_chars[256];
+
+static inline bool sol_char_is(char ch, uint8_t class_bits) {
+  return (g_sol_chars[(unsigned char)ch] & class_bits) != 0;
+}
+
+/////////////////////////////////////////////////
+//                  KEYWORDS                   //
+/////////////////////////////////////////////////
+
+typedef struct {
+  fdn_string keyword;
+  SolTokenType type;
+} SolKeyword;
+
+static const SolKeyword g_sol_keywords[] = {
+    {FDN_STRING_LITERAL("abstract"), SOL_TOKEN_ABSTRACT},
+    {FDN_STRING_LITERAL("anonymous"), SOL_TOKEN_ANONYMOUS},
+    {FDN_STRING_LITERAL("as"), SOL_TOKEN_AS},
+    {FDN_STRING_LITERAL("assembly"), SOL_TOKEN_ASSEMBLY},
+    {FDN_STRING_LITERAL("break"), SOL_TOKEN_BREAK},
+    {FDN_STRING_LITERAL("calldata"), SOL_TOKEN_CALLDATA},
+    {FDN_STRING_LITERAL("catch"), SOL_TOKEN_CATCH},
+    {FDN_STRING_LITERAL("constant"), SOL_TOKEN_CONSTANT},
+    {FDN_STRING_LITERAL("constructor"), SOL_TOKEN_CONSTRUCTOR},
+    {FDN_STRING_LITERAL("continue"), SOL_TOKEN_CONTINUE},
+    {FDN_STRING_LITERAL("contract"), SOL_TOKEN_CONTRACT},
+    {FDN_STRING_LITERAL("delete"), SOL_TOKEN_DELETE},
+    {FDN_STRING_LITERAL("do"), SOL_TOKEN_DO},
+    {FDN_STRING_LITERAL("else"), SOL_TOKEN_ELSE},
+    {FDN_STRING_LITERAL("emit"), SOL_TOKEN_EMIT},
+    {FDN_STRING_LITERAL("enum"), SOL_TOKEN_ENUM},
+    {FDN_STRING_LITERAL("event"), SOL_TOKEN_EVENT},
+    {FDN_STRING_LITERAL("external"), SOL_TOKEN_EXTERNAL},
+    {FDN_STRING_LITERAL("fallback"), SOL_TOKEN_FALLBACK},
+    {FDN_STRING_LITERAL("false"), SOL_TOKEN_FALSE},
+    {FDN_STRING_LITERAL("for"), SOL_TOKEN_FOR},
+    {FDN_STRING_LITERAL("function"), SOL_TOKEN_FUNCTION},
+    {FDN_STRING_LITERAL("if"), SOL_TOKEN_IF},
+    {FDN_STRING_LITERAL("immutable"), SOL_TOKEN_IMMUTABLE},
+    {FDN_STRING_LITERAL("import"), SOL_TOKEN_IMPORT},
+    {FDN_STRING_LITERAL("indexed"), SOL_TOKEN_INDEXED},
+    {FDN_STRING_LITERAL("interface"), SOL_TOKEN_INTERFACE},
+    {FDN_STRING_LITERAL("internal"), SOL_TOKEN_INTERNAL},
+    {FDN_STRING_LITERAL("is"), SOL_TOKEN_IS},
+    {FDN_STRING_LITERAL("library"), SOL_TOKEN_LIBRARY},
+    {FDN_STRING_LITERAL("mapping"), SOL_TOKEN_MAPPING},
+    {FDN_STRING_LITERAL("memory"), SOL_TOKEN_MEMORY},
+    {FDN_STRING_LITERAL("modifier"), SOL_TOKEN_MODIFIER},
+    {FDN_STRING_LITERAL("new"), SOL_TOKEN_NEW},
+    {FDN_STRING_LITERAL("override"), SOL_TOKEN_OVERRIDE},
+    {FDN_STRING_LITERAL("payable"), SOL_TOKEN_PAYABLE},
+    {FDN_STRING_LITERAL("pragma"), SOL_TOKEN_PRAGMA},
+    {FDN_STRING_LITERAL("private"), SOL_TOKEN_PRIVATE},
+    {FDN_STRING_LITERAL("public"), SOL_TOKEN_PUBLIC},
+    {FDN_STRING_LITERAL("pure"), SOL_TOKEN_PURE},
+    {FDN_STRING_LITERAL("receive"), SOL_TOKEN_RECEIVE},
+    {FDN_STRING_LITERAL("return"), SOL_TOKEN_RETURN},
+    {FDN_STRING_LITERAL("returns"), SOL_TOKEN_RETURNS},
+    {FDN_STRING_LITERAL("storage"), SOL_TOKEN_STORAGE},
+    {FDN_STRING_LITERAL("struct"), SOL_TOKEN_STRUCT},
+    {FDN_STRING_LITERAL("true"), SOL_TOKEN_TRUE},
+    {FDN_STRING_LITERAL("try"), SOL_TOKEN_TRY},
+    {FDN_STRING_LITERAL("type"), SOL_TOKEN_TYPE},
+    {FDN_STRING_LITERAL("unchecked"), SOL_TOKEN_UNCHECKED},
+    {FDN_STRING_LITERAL("using"), SOL_TOKEN_USING},
+    {FDN_STRING_LITERAL("view"), SOL_TOKEN_VIEW},
+    {FDN_STRING_LITERAL("virtual"), SOL_TOKEN_VIRTUAL},
+    {FDN_STRING_LITERAL("while"), SOL_TOKEN_WHILE},
+
+    {FDN_STRING_LITERAL("wei"), SOL_TOKEN_UNIT},
+    {FDN_STRING_LITERAL("gwei"), SOL_TOKEN_UNIT},
+    {FDN_STRING_LITERAL("ether"), SOL_TOKEN_UNIT},
+    {FDN_STRING_LITERAL("seconds"), SOL_TOKEN_UNIT},
+    {FDN_STRING_LITERAL("minutes"), SOL_TOKEN_UNIT},
+    {FDN_STRING_LITERAL("hours"), SOL_TOKEN_UNIT},
+    {FDN_STRING_LITERAL("days"), SOL_TOKEN_UNIT},
+    {FDN_STRING_LITERAL("weeks"), SOL_TOKEN_UNIT},
+    {FDN_STRING_LITERAL("years"), SOL_TOKEN_UNIT},
+
+    {FDN_STRING_LITERAL("address"), SOL_TOKEN_ELEMENTARY_TYPE},
+    {FDN_STRING_LITERAL("bool"), SOL_TOKEN_ELEMENTARY_TYPE},
+    {FDN_STRING_LITERAL("string"), SOL_TOKEN_ELEMENTARY_TYPE},
+    {FDN_STRING_LITERAL("bytes"), SOL_TOKEN_ELEMENTARY_TYPE},
+    {FDN_STRING_LITERAL("int"), SOL_TOKEN_ELEMENTARY_TYPE},
+    {FDN_STRING_LITERAL("uint"), SOL_TOKEN_ELEMENTARY_TYPE},
+    {FDN_STRING_LITERAL("fixed"), SOL_TOKEN_ELEMENTARY_TYPE},
+    {FDN_STRING_LITERAL("ufixed"), SOL_TOKEN_ELEMENTARY_TYPE},
+};
+
+#define SOL_KEYWORD_COUNT (sizeof(g_sol_keywords) / sizeof(g_sol_keywords[0]))
+
+// The sized types are generated: int8..int256 and uint8..uint256 in steps of
+// 8, bytes1..bytes32.
+#define SOL_SIZED_TYPE_COUNT (32 + 32 + 32)
+#define SOL_SIZED_TYPE_MAX_LENGTH 8 // "uint256" and its null terminator.
+
+// Identifiers longer than the longest keyword ("constructor") are never looked
+// up.
+#define SOL_KEYWORD_MAX_LENGTH 11
+
+// The perfect hash needs plenty of free slots to find a seed quickly for this
+// many keys.
+#define SOL_KEYWORD_SLOTS 4096
+
+static char g_sol_sized_types[SOL_SIZED_TYPE_COUNT][SOL_SIZED_TYPE_MAX_LENGTH];
+static fdn_string g_sol_keyword_names[SOL_KEYWORD_COUNT + SOL_SIZED_TYPE_COUNT];
+static SolTokenType
+    g_sol_keyword_types[SOL_KEYWORD_COUNT + SOL_SIZED_TYPE_COUNT];
+static uint16_t g_sol_keyword_slots[SOL_KEYWORD_SLOTS];
+static fdn_perfect_hash g_sol_keyword_index;
+static bool g_sol_keyword_index_ready = false;
+
+static const char *g_sol_token_names[SOL_TOKEN_TYPE_COUNT] = {
+    [SOL_TOKEN_ILLEGAL] = "ILLEGAL",
+    [SOL_TOKEN_EOF] = "EOF",
+    [SOL_TOKEN_IDENTIFIER] = "IDENTIFIER",
+    [SOL_TOKEN_NUMBER] = "NUMBER",
+    [SOL_TOKEN_STRING] = "STRING",
+    [SOL_TOKEN_HEX_STRING] = "HEX_STRING",
+    [SOL_TOKEN_UNICODE_STRING] = "UNICODE_STRING",
+    [SOL_TOKEN_ELEMENTARY_TYPE] = "ELEMENTARY_TYPE",
+    [SOL_TOKEN_UNIT] = "UNIT",
+    [SOL_TOKEN_LPAREN] = "(",
+    [SOL_TOKEN_RPAREN] = ")",
+    [SOL_TOKEN_LBRACKET] = "[",
+    [SOL_TOKEN_RBRACKET] = "]",
+    [SOL_TOKEN_LBRACE] = "{",
+    [SOL_TOKEN_RBRACE] = "}",
+    [SOL_TOKEN_SEMICOLON] = ";",
+    [SOL_TOKEN_COMMA] = ",",
+    [SOL_TOKEN_DOT] = ".",
+    [SOL_TOKEN_QUESTION] = "?",
+    [SOL_TOKEN_COLON] = ":",
+    [SOL_TOKEN_ARROW] = "=>",
+    [SOL_TOKEN_RIGHT_ARROW] = "->",
+    [SOL_TOKEN_COLON_ASSIGN] = ":=",
+    [SOL_TOKEN_ASSIGN] = "=",
+    [SOL_TOKEN_ADD_ASSIGN] = "+=",
+    [SOL_TOKEN_SUB_ASSIGN] = "-=",
+    [SOL_TOKEN_MUL_ASSIGN] = "*=",
+    [SOL_TOKEN_DIV_ASSIGN] = "/=",
+    [SOL_TOKEN_MOD_ASSIGN] = "%=",
+    [SOL_TOKEN_OR_ASSIGN] = "|=",
+    [SOL_TOKEN_AND_ASSIGN] = "&=",
+    [SOL_TOKEN_XOR_ASSIGN] = "^=",
+    [SOL_TOKEN_SHL_ASSIGN] = "<<=",
+    [SOL_TOKEN_SAR_ASSIGN] = ">>=",
+    [SOL_TOKEN_SHR_ASSIGN] = ">>>=",
+    [SOL_TOKEN_OR] = "||",
+    [SOL_TOKEN_AND] = "&&",
+    [SOL_TOKEN_BIT_OR] = "|",
+    [SOL_TOKEN_BIT_XOR] = "^",
+    [SOL_TOKEN_BIT_AND] = "&",
+    [SOL_TOKEN_SHL] = "<<",
+    [SOL_TOKEN_SAR] = ">>",
+    [SOL_TOKEN_SHR] = ">>>",
+    [SOL_TOKEN_ADD] = "+",
+    [SOL_TOKEN_SUB] = "-",
+    [SOL_TOKEN_MUL] = "*",
+    [SOL_TOKEN_DIV] = "/",
+    [SOL_TOKEN_MOD] = "%",
+    [SOL_TOKEN_EXP] = "**",
+    [SOL_TOKEN_EQ] = "==",
+    [SOL_TOKEN_NOT_EQ] = "!=",
+    [SOL_TOKEN_LT] = "<",
+    [SOL_TOKEN_GT] = ">",
+    [SOL_TOKEN_LTE] = "<=",
+    [SOL_TOKEN_GTE] = ">=",
+    [SOL_TOKEN_NOT] = "!",
+    [SOL_TOKEN_BIT_NOT] = "~",
+    [SOL_TOKEN_INC] = "++",
+    [SOL_TOKEN_DEC] = "--",
+};
+
+static void sol_lexer_init_chars(void) {
+  const char *spaces = " \t\n\r\v\f";
+  for (const char *ch = spaces; *ch != '\0'; ch++) {
+    g_sol_chars[(unsigned char)*ch] |= SOL_CHAR_SPACE;
+  }
+
+  for (int ch = 'a'; ch <= 'z'; ch++) {
+    g_sol_chars[ch] |= SOL_CHAR_IDENT_START | SOL_CHAR_IDENT | SOL_CHAR_KEYWORD;
+    g_sol_chars[ch - 'a' + 'A'] |= SOL_CHAR_IDENT_START | SOL_CHAR_IDENT;
+  }
+  g_sol_chars['_'] |= SOL_CHAR_IDENT_START | SOL_CHAR_IDENT;
+  g_sol_chars['$'] |= SOL_CHAR_IDENT_START | SOL_CHAR_IDENT;
+
+  for (int ch = '0'; ch <= '9'; ch++) {
+    g_sol_chars[ch] |= SOL_CHAR_IDENT | SOL_CHAR_DIGIT | SOL_CHAR_HEX;
+  }
+  for (int ch = 'a'; ch <= 'f'; ch++) {
+    g_sol_chars[ch] |= SOL_CHAR_HEX;
+    g_sol_chars[ch - 'a' + 'A'] |= SOL_CHAR_HEX;
+  }
+
+  g_sol_chars['"'] |= SOL_CHAR_QUOTE;
+  g_sol_chars['\''] |= SOL_CHAR_QUOTE;
+}
+
+static void sol_lexer_init_keywords(void) {
+  uint32_t count = 0;
+  for (size_t i = 0; i < SOL_KEYWORD_COUNT; i++) {
+    g_sol_keyword_names[count] = g_sol_keywords[i].keyword;
+    g_sol_keyword_types[count] = g_sol_keywords[i].type;
+    if (g_sol_token_names[g_sol_keywords[i].type] == NULL) {
+      g_sol_token_names[g_sol_keywords[i].type] =
+          g_sol_keywords[i].keyword.string_start;
+    }
+    count++;
+  }
+
+  for (int size = 1; size <= 32; size++) {
+    char *names[3] = {g_sol_sized_types[size - 1],
+                      g_sol_sized_types[32 + size - 1],
+                      g_sol_sized_types[64 + size - 1]};
+    int lengths[3] = {
+        snprintf(names[0], SOL_SIZED_TYPE_MAX_LENGTH, "int%d", size * 8),
+        snprintf(names[1], SOL_SIZED_TYPE_MAX_LENGTH, "uint%d", size * 8),
+        snprintf(names[2], SOL_SIZED_TYPE_MAX_LENGTH, "bytes%d", size),
+    };
+
+    for (int i = 0; i < 3; i++) {
+      g_sol_keyword_names[count] =
+          fdn_string_create_view(names[i], (size_t)lengths[i]);
+      g_sol_keyword_types[count] = SOL_TOKEN_ELEMENTARY_TYPE;
+      count++;
+    }
+  }
+
+  g_sol_keyword_index_ready =
+      fdn_perfect_hash_build(&g_sol_keyword_index, g_sol_keyword_names, count,
+                             g_sol_keyword_slots, SOL_KEYWORD_SLOTS);
+}
+
+static pthread_once_t g_sol_lexer_once = PTHREAD_ONCE_INIT;
+
+// sol_lexer_init builds the tables once per process; lexers may be created
+// from several threads.
+static void sol_lexer_init(void) {
+  sol_lexer_init_chars();
+  sol_lexer_init_keywords();
+}
+
+// sol_keyword_lookup returns the token type of an identifier: its keyword
+// type, or SOL_TOKEN_IDENTIFIER.
+static SolTokenType sol_keyword_lookup(const char *start, size_t length) {
+  if (!g_sol_keyword_index_ready || length > SOL_KEYWORD_MAX_LENGTH ||
+      !sol_char_is(*start, SOL_CHAR_KEYWORD)) {
+    return SOL_TOKEN_IDENTIFIER;
+  }
+
+  fdn_string identifier = fdn_string_create_view(start, length);
+  uint32_t index = fdn_perfect_hash_find(&g_sol_keyword_index, identifier);
+  if (index == FDN_PERFECT_HASH_NOT_FOUND ||
+      !fdn_string_is_eq(g_sol_keyword_names[index], identifier)) {
+    return SOL_TOKEN_IDENTIFIER;
+  }
+
+  return g_sol_keyword_types[index];
+}
+
+/////////////////////////////////////////////////
+//                    LEXER                    //
+/////////////////////////////////////////////////
+
+SolLexer sol_lexer_new(const char *input_buffer) {
+  pthread_once(&g_sol_lexer_once, sol_lexer_init);
+
+  SolLexer lexer;
+  lexer.input = input_buffer;
+  lexer.position = input_buffer;
+  return lexer;
+}
+
+const char *sol_token_type_str(SolTokenType type) {
+  pthread_once(&g_sol_lexer_once, sol_lexer_init);
+
+  if ((unsigned)type >= SOL_TOKEN_TYPE_COUNT) {
+    return "UNKNOWN";
+  }
+  return g_sol_token_names[type];
+}
+
+// sol_skip_trivia moves past whitespace and comments. Returns `false` if a
+// block comment is not terminated; the lexer is then left at its start.
+static bool sol_skip_trivia(SolLexer *lexer) {
+  const char *cursor = lexer->position;
+
+  while (1) {
+    while (sol_char_is(*cursor, SOL_CHAR_SPACE)) {
+      cursor++;
+    }
+
+    if (cursor[0] != '/') {
+      break;
+    }
+
+    if (cursor[1] == '/') {
+      const char *line_end = strchr(cursor + 2, '\n');
+      cursor = line_end != NULL ? line_end + 1 : cursor + strlen(cursor);
+    } else if (cursor[1] == '*') {
+      const char *comment_end = strstr(cursor + 2, "*/");
+      if (comment_end == NULL) {
+        lexer->position = cursor;
+        return false;
+      }
+      cursor = comment_end + 2;
+    } else {
+      break;
+    }
+  }
+
+  lexer->position = cursor;
+  return true;
+}
+
+static SolToken sol_make_token(SolLexer *lexer, SolTokenType type,
+                               const char *start) {
+  SolToken token;
+  token.type = type;
+  token.literal_start = start;
+  token.literal_length = (size_t)(lexer->position - start);
+  return token;
+}
+
+// sol_lex_string lexes a quoted string starting at `quote`. A string must end
+// on the line it starts.
+static SolToken sol_lex_string(SolLexer *lexer, SolTokenType type,
+                               const char *start, const char *quote) {
+  char delimiter = *quote;
+  const char *cursor = quote + 1;
+
+  while (*cursor != delimiter) {
+    if (*cursor == '\0' || *cursor == '\n' || *cursor == '\r') {
+      lexer->position = cursor;
+      return sol_make_token(lexer, SOL_TOKEN_ILLEGAL, start);
+    }
+
+    if (*cursor == '\\' && cursor[1] != '\0') {
+      cursor++; // The escaped character, which may be the delimiter.
+    }
+    cursor++;
+  }
+
+  lexer->position = cursor + 1;
+  return sol_make_token(lexer, type, start);
+}
+
+static SolToken sol_lex_number(SolLexer *lexer) {
+  const char *start = lexer->position;
+  const char *cursor = start;
+
+  if (cursor[0] == '0' && (cursor[1] == 'x' || cursor[1] == 'X')) {
+    cursor += 2;
+    while (sol_char_is(*cursor, SOL_CHAR_HEX) || *cursor == '_') {
+      cursor++;
+    }
+  } else {
+    while (sol_char_is(*cursor, SOL_CHAR_DIGIT) || *cursor == '_') {
+      cursor++;
+    }
+
+    // A fraction needs a digit after the dot; `1.foo` is a member access.
+    if (cursor[0] == '.' && sol_char_is(cursor[1], SOL_CHAR_DIGIT)) {
+      cursor++;
+      while (sol_char_is(*cursor, SOL_CHAR_DIGIT) || *cursor == '_') {
+        cursor++;
+      }
+    }
+
+    if (cursor[0] == 'e' || cursor[0] == 'E') {
+      const char *exponent = cursor + 1;
+      if (*exponent == '-') {
+        exponent++;
+      }
+      if (sol_char_is(*exponent, SOL_CHAR_DIGIT)) {
+        cursor = exponent;
+        while (sol_char_is(*cursor, SOL_CHAR_DIGIT) || *cursor == '_') {
+          cursor++;
+        }
+      }
+    }
+  }
+
+  lexer->position = cursor;
+  return sol_make_token(lexer, SOL_TOKEN_NUMBER, start);
+}
+
+static SolToken sol_lex_identifier(SolLexer *lexer) {
+  const char *start = lexer->position;
+  const char *cursor = start + 1;
+  while (sol_char_is(*cursor, SOL_CHAR_IDENT)) {
+    cursor++;
+  }
+
+  size_t length = (size_t)(cursor - start);
+  lexer->position = cursor;
+
+  // hex"..." and unicode"..." are string literals with a prefix.
+  if (sol_char_is(*cursor, SOL_CHAR_QUOTE)) {
+    if (length == 3 && memcmp(start, "hex", 3) == 0) {
+      return sol_lex_string(lexer, SOL_TOKEN_HEX_STRING, start, cursor);
+    }
+    if (length == 7 && memcmp(start, "unicode", 7) == 0) {
+      return sol_lex_string(lexer, SOL_TOKEN_UNICODE_STRING, start, cursor);
+    }
+  }
+
+  return sol_make_token(lexer, sol_keyword_lookup(start, length), start);
+}
+
+// sol_lex_operator makes a token of the `type` out of the next `length`
+// characters, which the caller has matched already.
+static SolToken sol_lex_operator(SolLexer *lexer, SolTokenType type,
+                                 size_t length) {
+  const char *start = lexer->position;
+  lexer->position += length;
+  return sol_make_token(lexer, type, start);
+}
+
+SolToken sol_lexer_next_token(SolLexer *lexer) {
+  if (!sol_skip_trivia(lexer)) {
+    // An unterminated block comment swallows the rest of the input.
+    const char *start = lexer->position;
+    lexer->position += strlen(start);
+    return sol_make_token(lexer, SOL_TOKEN_ILLEGAL, start);
+  }
+
+  const char *p = lexer->position;
+  char ch = p[0];
+
+  if (sol_char_is(ch, SOL_CHAR_IDENT_START)) {
+    return sol_lex_identifier(lexer);
+  }
+
+  if (sol_char_is(ch, SOL_CHAR_DIGIT) ||
+      (ch == '.' && sol_char_is(p[1], SOL_CHAR_DIGIT))) {
+    return sol_lex_number(lexer);
+  }
+
+  switch (ch) {
+  case '\0':
+    return sol_make_token(lexer, SOL_TOKEN_EOF, p);
+  case '"':
+  case '\'':
+    return sol_lex_string(lexer, SOL_TOKEN_STRING, p, p);
+  case '(':
+    return sol_lex_operator(lexer, SOL_TOKEN_LPAREN, 1);
+  case ')':
+    return sol_lex_operator(lexer, SOL_TOKEN_RPAREN, 1);
+  case '[':
+    return sol_lex_operator(lexer, SOL_TOKEN_LBRACKET, 1);
+  case ']':
+    return sol_lex_operator(lexer, SOL_TOKEN_RBRACKET, 1);
+  case '{':
+    return sol_lex_operator(lexer, SOL_TOKEN_LBRACE, 1);
+  case '}':
+    return sol_lex_operator(lexer, SOL_TOKEN_RBRACE, 1);
+  case ';':
+    return sol_lex_operator(lexer, SOL_TOKEN_SEMICOLON, 1);
+  case ',':
+    return sol_lex_operator(lexer, SOL_TOKEN_COMMA, 1);
+  case '.':
+    return sol_lex_operator(lexer, SOL_TOKEN_DOT, 1);
+  case '?':
+    return sol_lex_operator(lexer, SOL_TOKEN_QUESTION, 1);
+  case '~':
+    return sol_lex_operator(lexer, SOL_TOKEN_BIT_NOT, 1);
+  case ':':
+    return p[1] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_COLON_ASSIGN, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_COLON, 1);
+  case '=':
+    if (p[1] == '=') {
+      return sol_lex_operator(lexer, SOL_TOKEN_EQ, 2);
+    }
+    return p[1] == '>' ? sol_lex_operator(lexer, SOL_TOKEN_ARROW, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_ASSIGN, 1);
+  case '!':
+    return p[1] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_NOT_EQ, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_NOT, 1);
+  case '+':
+    if (p[1] == '+') {
+      return sol_lex_operator(lexer, SOL_TOKEN_INC, 2);
+    }
+    return p[1] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_ADD_ASSIGN, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_ADD, 1);
+  case '-':
+    if (p[1] == '-') {
+      return sol_lex_operator(lexer, SOL_TOKEN_DEC, 2);
+    }
+    if (p[1] == '>') {
+      return sol_lex_operator(lexer, SOL_TOKEN_RIGHT_ARROW, 2);
+    }
+    return p[1] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_SUB_ASSIGN, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_SUB, 1);
+  case '*':
+    if (p[1] == '*') {
+      return sol_lex_operator(lexer, SOL_TOKEN_EXP, 2);
+    }
+    return p[1] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_MUL_ASSIGN, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_MUL, 1);
+  case '/':
+    return p[1] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_DIV_ASSIGN, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_DIV, 1);
+  case '%':
+    return p[1] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_MOD_ASSIGN, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_MOD, 1);
+  case '^':
+    return p[1] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_XOR_ASSIGN, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_BIT_XOR, 1);
+  case '|':
+    if (p[1] == '|') {
+      return sol_lex_operator(lexer, SOL_TOKEN_OR, 2);
+    }
+    return p[1] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_OR_ASSIGN, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_BIT_OR, 1);
+  case '&':
+    if (p[1] == '&') {
+      return sol_lex_operator(lexer, SOL_TOKEN_AND, 2);
+    }
+    return p[1] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_AND_ASSIGN, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_BIT_AND, 1);
+  case '<':
+    if (p[1] == '<') {
+      return p[2] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_SHL_ASSIGN, 3)
+                         : sol_lex_operator(lexer, SOL_TOKEN_SHL, 2);
+    }
+    return p[1] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_LTE, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_LT, 1);
+  case '>':
+    if (p[1] == '>') {
+      if (p[2] == '>') {
+        return p[3] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_SHR_ASSIGN, 4)
+                           : sol_lex_operator(lexer, SOL_TOKEN_SHR, 3);
+      }
+      return p[2] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_SAR_ASSIGN, 3)
+                         : sol_lex_operator(lexer, SOL_TOKEN_SAR, 2);
+    }
+    return p[1] == '=' ? sol_lex_operator(lexer, SOL_TOKEN_GTE, 2)
+                       : sol_lex_operator(lexer, SOL_TOKEN_GT, 1);
+  default: {
+    // Consume the whole (possibly multi-byte) character.
+    uint32_t code_point;
+    uint32_t width = fdn_utf8_decode(p, 4, &code_point);
+    return sol_lex_operator(lexer, SOL_TOKEN_ILLEGAL, width > 0 ? width : 1);
+  }
+  }
+}
@@ -0,0 +1,197 @@
+#ifndef SOLIDITY_LEXER_H
+#define SOLIDITY_LEXER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//////////// TOKENS /////////////
+
+/**
+ * @enum SolTokenType
+ * @brief The lexical units of Solidity source code.
+ *
+ * Keywords have a token type of their own. The elementary type names (`uint8`
+ * to `uint256`, `bytes1` to `bytes32`, `address`, ...) all share
+ * SOL_TOKEN_ELEMENTARY_TYPE; the literal tells them apart. Contextual keywords
+ * such as `error`, `from` or `global` are identifiers, as they are for solc.
+ */
+typedef enum {
+  SOL_TOKEN_ILLEGAL, // A character or sequence we don't recognize.
+  SOL_TOKEN_EOF,     // The end of the input.
+
+  // Literals
+  SOL_TOKEN_IDENTIFIER,
+  SOL_TOKEN_NUMBER,         // 42, 1_000, 1e18, 0.5, 0x1F
+  SOL_TOKEN_STRING,         // "text" or 'text'
+  SOL_TOKEN_HEX_STRING,     // hex"00ff"
+  SOL_TOKEN_UNICODE_STRING, // unicode"text"
+  SOL_TOKEN_ELEMENTARY_TYPE,
+
+  // Keywords
+  SOL_TOKEN_ABSTRACT,
+  SOL_TOKEN_ANONYMOUS,
+  SOL_TOKEN_AS,
+  SOL_TOKEN_ASSEMBLY,
+  SOL_TOKEN_BREAK,
+  SOL_TOKEN_CALLDATA,
+  SOL_TOKEN_CATCH,
+  SOL_TOKEN_CONSTANT,
+  SOL_TOKEN_CONSTRUCTOR,
+  SOL_TOKEN_CONTINUE,
+  SOL_TOKEN_CONTRACT,
+  SOL_TOKEN_DELETE,
+  SOL_TOKEN_DO,
+  SOL_TOKEN_ELSE,
+  SOL_TOKEN_EMIT,
+  SOL_TOKEN_ENUM,
+  SOL_TOKEN_EVENT,
+  SOL_TOKEN_EXTERNAL,
+  SOL_TOKEN_FALLBACK,
+  SOL_TOKEN_FALSE,
+  SOL_TOKEN_FOR,
+  SOL_TOKEN_FUNCTION,
+  SOL_TOKEN_IF,
+  SOL_TOKEN_IMMUTABLE,
+  SOL_TOKEN_IMPORT,
+  SOL_TOKEN_INDEXED,
+  SOL_TOKEN_INTERFACE,
+  SOL_TOKEN_INTERNAL,
+  SOL_TOKEN_IS,
+  SOL_TOKEN_LIBRARY,
+  SOL_TOKEN_MAPPING,
+  SOL_TOKEN_MEMORY,
+  SOL_TOKEN_MODIFIER,
+  SOL_TOKEN_NEW,
+  SOL_TOKEN_OVERRIDE,
+  SOL_TOKEN_PAYABLE,
+  SOL_TOKEN_PRAGMA,
+  SOL_TOKEN_PRIVATE,
+  SOL_TOKEN_PUBLIC,
+  SOL_TOKEN_PURE,
+  SOL_TOKEN_RECEIVE,
+  SOL_TOKEN_RETURN,
+  SOL_TOKEN_RETURNS,
+  SOL_TOKEN_STORAGE,
+  SOL_TOKEN_STRUCT,
+  SOL_TOKEN_TRUE,
+  SOL_TOKEN_TRY,
+  SOL_TOKEN_TYPE,
+  SOL_TOKEN_UNCHECKED,
+  SOL_TOKEN_USING,
+  SOL_TOKEN_VIEW,
+  SOL_TOKEN_VIRTUAL,
+  SOL_TOKEN_WHILE,
+  SOL_TOKEN_UNIT, // wei, gwei, ether, seconds, minutes, hours, days, weeks,
+                  // years
+
+  // Delimiters
+  SOL_TOKEN_LPAREN,       // (
+  SOL_TOKEN_RPAREN,       // )
+  SOL_TOKEN_LBRACKET,     // [
+  SOL_TOKEN_RBRACKET,     // ]
+  SOL_TOKEN_LBRACE,       // {
+  SOL_TOKEN_RBRACE,       // }
+  SOL_TOKEN_SEMICOLON,    // ;
+  SOL_TOKEN_COMMA,        // ,
+  SOL_TOKEN_DOT,          // .
+  SOL_TOKEN_QUESTION,     // ?
+  SOL_TOKEN_COLON,        // :
+  SOL_TOKEN_ARROW,        // =>
+  SOL_TOKEN_RIGHT_ARROW,  // -> (assembly)
+  SOL_TOKEN_COLON_ASSIGN, // := (assembly)
+
+  // Operators
+  SOL_TOKEN_ASSIGN,     // =
+  SOL_TOKEN_ADD_ASSIGN, // +=
+  SOL_TOKEN_SUB_ASSIGN, // -=
+  SOL_TOKEN_MUL_ASSIGN, // *=
+  SOL_TOKEN_DIV_ASSIGN, // /=
+  SOL_TOKEN_MOD_ASSIGN, // %=
+  SOL_TOKEN_OR_ASSIGN,  // |=
+  SOL_TOKEN_AND_ASSIGN, // &=
+  SOL_TOKEN_XOR_ASSIGN, // ^=
+  SOL_TOKEN_SHL_ASSIGN, // <<=
+  SOL_TOKEN_SAR_ASSIGN, // >>=
+  SOL_TOKEN_SHR_ASSIGN, // >>>=
+  SOL_TOKEN_OR,         // ||
+  SOL_TOKEN_AND,        // &&
+  SOL_TOKEN_BIT_OR,     // |
+  SOL_TOKEN_BIT_XOR,    // ^
+  SOL_TOKEN_BIT_AND,    // &
+  SOL_TOKEN_SHL,        // <<
+  SOL_TOKEN_SAR,        // >>
+  SOL_TOKEN_SHR,        // >>>
+  SOL_TOKEN_ADD,        // +
+  SOL_TOKEN_SUB,        // -
+  SOL_TOKEN_MUL,        // *
+  SOL_TOKEN_DIV,        // /
+  SOL_TOKEN_MOD,        // %
+  SOL_TOKEN_EXP,        // **
+  SOL_TOKEN_EQ,         // ==
+  SOL_TOKEN_NOT_EQ,     // !=
+  SOL_TOKEN_LT,         // <
+  SOL_TOKEN_GT,         // >
+  SOL_TOKEN_LTE,        // <=
+  SOL_TOKEN_GTE,        // >=
+  SOL_TOKEN_NOT,        // !
+  SOL_TOKEN_BIT_NOT,    // ~
+  SOL_TOKEN_INC,        // ++
+  SOL_TOKEN_DEC,        // --
+
+  SOL_TOKEN_TYPE_COUNT,
+} SolTokenType;
+
+/**
+ * @struct SolToken
+ * @brief A single lexical unit of Solidity source.
+ *
+ * Like the JSON `Token`, it is a view into the source buffer: the text is never
+ * copied.
+ */
+typedef struct {
+  SolTokenType type;
+  const char *literal_start;
+  size_t literal_length;
+} SolToken;
+
+//////////// LEXER /////////////
+
+/**
+ * The lexer walks a null-terminated source buffer. Whitespace and comments are
+ * skipped. Every byte is first mapped to a character class through a 256-entry
+ * table, so identifiers, numbers and whitespace are each consumed by a tight
+ * loop over the table, and keywords are recognized with a perfect hash lookup
+ * of the finished identifier.
+ */
+// The lexer never reads more than this many bytes past the end of a token to
+// decide where it ends (`1e-5`: after `1`, it checks `e`, `-` and `5`). An edit
+// further away than that cannot change the token.
+#define SOL_LEXER_LOOKAHEAD 3
+
+typedef struct {
+  const char *input;    // The source being lexed.
+  const char *position; // The next byte to be lexed.
+} SolLexer;
+
+/**
+ * @brief Creates a new lexer.
+ * @param input_buffer The null-terminated source to be tokenized.
+ * @return SolLexer Returns a new stack-allocated SolLexer.
+ */
+SolLexer sol_lexer_new(const char *input_buffer);
+
+/**
+ * @brief Scans the input and returns the next token.
+ * @param lexer A pointer to the SolLexer.
+ * @return Returns a SolToken by value. Returns a SOL_TOKEN_EOF token when the
+ * end is reached; an unterminated string or comment is a SOL_TOKEN_ILLEGAL
+ * token spanning the rest of the input.
+ */
+SolToken sol_lexer_next_token(SolLexer *lexer);
+
+/**
+ * @brief Returns a readable name of the token type, e.g. "contract" or "<=".
+ */
+const char *sol_token_type_str(SolTokenType type);
+
+#endif // SOLIDITY_LEXER_H
@@ -0,0 +1,1289 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lexer.h"
+#include "libs/foundation.h"
+#include "parser.h"
+
+#define SYNTAX_INITIAL_TOKENS 256
+#define SYNTAX_INITIAL_NODES 64
+
+// Bytes read from the document at once when re-lexing after an edit. The
+// window doubles until the lexer resynchronizes (a long comment was opened).
+#define SYNTAX_WINDOW 512
+
+// A rebuild reads the whole document into the window; don't keep a window
+// that large around for the small reads of the edits.
+#define SYNTAX_MAX_KEPT_WINDOW (64 * 1024)
+
+// Statements nested deeper than this are not parsed recursively, so that a
+// pathological input cannot overflow the stack.
+#define SOL_PARSER_MAX_DEPTH 128
+
+// The parser never looks further than this many tokens past the end of a
+// node to decide where the node ends (a block stops at `function name`).
+#define SOL_PARSER_LOOKAHEAD 2
+
+/////////////////////////////////////////////////
+//                    TEXT                     //
+/////////////////////////////////////////////////
+
+static void text_read_string(const void *context, uint32_t offset,
+                             uint32_t length, char *output) {
+  const fdn_string *string = context;
+  memcpy(output, string->string_start + offset, length);
+}
+
+SolText sol_text_from_string(const fdn_string *string) {
+  SolText text;
+  text.context = string;
+  text.length = (uint32_t)string->string_length;
+  text.read = text_read_string;
+  return text;
+}
+
+/////////////////////////////////////////////////
+//                   STORAGE                   //
+/////////////////////////////////////////////////
+
+static bool tokens_reserve(SolTokenList *tokens, uint32_t count) {
+  if (tokens->count + count <= tokens->capacity) {
+    return true;
+  }
+
+  uint32_t capacity =
+      tokens->capacity > 0 ? tokens->capacity : SYNTAX_INITIAL_TOKENS;
+  while (capacity < tokens->count + count) {
+    capacity *= 2;
+  }
+
+  uint8_t *types = realloc(tokens->types, capacity);
+  if (types == NULL) {
+    return false;
+  }
+  tokens->types = types;
+
+  uint32_t *starts = realloc(tokens->starts, capacity * sizeof(uint32_t));
+  if (starts == NULL) {
+    return false;
+  }
+  tokens->starts = starts;
+
+  uint32_t *lengths = realloc(tokens->lengths, capacity * sizeof(uint32_t));
+  if (lengths == NULL) {
+    return false;
+  }
+  tokens->lengths = lengths;
+
+  tokens->capacity = capacity;
+  return true;
+}
+
+static bool tokens_push(SolTokenList *tokens, SolTokenType type,
+                        uint32_t start, uint32_t length) {
+  if (!tokens_reserve(tokens, 1)) {
+    return false;
+  }
+
+  tokens->types[tokens->count] = (uint8_t)type;
+  tokens->starts[tokens->count] = start;
+  tokens->lengths[tokens->count] = length;
+  tokens->count++;
+  return true;
+}
+
+static void tokens_free(SolTokenList *tokens) {
+  free(tokens->types);
+  free(tokens->starts);
+  free(tokens->lengths);
+  memset(tokens, 0, sizeof(*tokens));
+}
+
+static inline uint32_t token_end(const SolTokenList *tokens, uint32_t token) {
+  return tokens->starts[token] + tokens->lengths[token];
+}
+
+// nodes_copy copies the `count` nodes at `from` in `source` to `to` in
+// `target`. The ranges may overlap.
+static void nodes_copy(SolNodeList *target, uint32_t to,
+                       const SolNodeList *source, uint32_t from,
+                       uint32_t count) {
+  memmove(target->token_starts + to, source->token_starts + from,
+          count * sizeof(uint32_t));
+  memmove(target->token_ends + to, source->token_ends + from,
+          count * sizeof(uint32_t));
+  memmove(target->descendants + to, source->descendants + from,
+          count * sizeof(uint32_t));
+  memmove(target->kinds + to, source->kinds + from, count);
+}
+
+static bool nodes_reserve(SolNodeList *nodes, uint32_t count) {
+  if (nodes->count + count <= nodes->capacity) {
+    return true;
+  }
+
+  uint32_t capacity =
+      nodes->capacity > 0 ? nodes->capacity : SYNTAX_INITIAL_NODES;
+  while (capacity < nodes->count + count) {
+    capacity *= 2;
+  }
+
+  // The 32-bit columns come first, so that each of them stays aligned.
+  uint32_t *block = malloc((size_t)capacity * (3 * sizeof(uint32_t) + 1));
+  if (block == NULL) {
+    return false;
+  }
+
+  SolNodeList grown;
+  grown.token_starts = block;
+  grown.token_ends = block + capacity;
+  grown.descendants = block + 2 * (size_t)capacity;
+  grown.kinds = (uint8_t *)(block + 3 * (size_t)capacity);
+  grown.count = nodes->count;
+  grown.capacity = capacity;
+  if (nodes->count > 0) {
+    nodes_copy(&grown, 0, nodes, 0, nodes->count);
+  }
+
+  free(nodes->token_starts);
+  *nodes = grown;
+  return true;
+}
+
+static void nodes_free(SolNodeList *nodes) {
+  free(nodes->token_starts);
+  memset(nodes, 0, sizeof(*nodes));
+}
+
+/////////////////////////////////////////////////
+//                   PARSER                    //
+/////////////////////////////////////////////////
+
+typedef struct {
+  const uint8_t *types;
+  uint32_t count;
+  uint32_t position;
+  uint32_t depth; // Number of open nodes.
+  SolNodeList *nodes;
+  bool out_of_memory;
+} SolParser;
+
+static SolParser parser_new(const SolTokenList *tokens, SolNodeList *nodes,
+                            uint32_t position, uint32_t depth) {
+  SolParser parser;
+  parser.types = tokens->types;
+  parser.count = tokens->count;
+  parser.position = position;
+  parser.depth = depth;
+  parser.nodes = nodes;
+  parser.out_of_memory = false;
+  return parser;
+}
+
+static SolTokenType parser_peek_at(const SolParser *parser, uint32_t ahead) {
+  uint32_t index = parser->position + ahead;
+  return index < parser->count ? (SolTokenType)parser->types[index]
+                               : SOL_TOKEN_EOF;
+}
+
+static SolTokenType parser_peek(const SolParser *parser) {
+  return parser_peek_at(parser, 0);
+}
+
+static void parser_advance(SolParser *parser) {
+  if (parser->position < parser->count) {
+    parser->position++;
+  }
+}
+
+// parser_open starts a node at the current token. Returns the index of the
+// node, to be passed to `parser_close` once its last token was consumed.
+static uint32_t parser_open(SolParser *parser, SolNodeKind kind) {
+  parser->depth++;
+
+  SolNodeList *nodes = parser->nodes;
+  if (parser->out_of_memory || !nodes_reserve(nodes, 1)) {
+    parser->out_of_memory = true;
+    return UINT32_MAX;
+  }
+
+  uint32_t index = nodes->count++;
+  nodes->kinds[index] = (uint8_t)kind;
+  nodes->token_starts[index] = parser->position;
+  nodes->token_ends[index] = parser->position;
+  nodes->descendants[index] = 0;
+  return index;
+}
+
+static void parser_close(SolParser *parser, uint32_t node) {
+  parser->depth--;
+  if (node == UINT32_MAX) {
+    return;
+  }
+
+  SolNodeList *nodes = parser->nodes;
+  nodes->token_ends[node] = parser->position;
+  nodes->descendants[node] = nodes->count - node - 1;
+}
+
+// parser_at_top_level_declaration tells whether the current token starts a
+// declaration that only appears at the top level of a file.
+static bool parser_at_top_level_declaration(const SolParser *parser) {
+  switch (parser_peek(parser)) {
+  case SOL_TOKEN_PRAGMA:
+  case SOL_TOKEN_IMPORT:
+  case SOL_TOKEN_ABSTRACT:
+  case SOL_TOKEN_CONTRACT:
+  case SOL_TOKEN_INTERFACE:
+  case SOL_TOKEN_LIBRARY:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// parser_at_declaration tells whether the current token can only start a
+// declaration. A block or a header that runs into one is missing its end,
+// which is what the code looks like most of the time while typing.
+static bool parser_at_declaration(const SolParser *parser) {
+  switch (parser_peek(parser)) {
+  case SOL_TOKEN_MODIFIER:
+  case SOL_TOKEN_EVENT:
+  case SOL_TOKEN_STRUCT:
+  case SOL_TOKEN_ENUM:
+  case SOL_TOKEN_CONSTRUCTOR:
+  case SOL_TOKEN_FALLBACK:
+  case SOL_TOKEN_RECEIVE:
+    return true;
+  case SOL_TOKEN_FUNCTION:
+    // `function (uint) external f` is a variable of a function type.
+    return parser_peek_at(parser, 1) == SOL_TOKEN_IDENTIFIER;
+  default:
+    return parser_at_top_level_declaration(parser);
+  }
+}
+
+// parser_skip_balanced skips the group opened by the current token, up to
+// the matching closing bracket. The three kinds of brackets are counted
+// together.
+static void parser_skip_balanced(SolParser *parser) {
+  uint32_t depth = 0;
+  do {
+    switch (parser_peek(parser)) {
+    case SOL_TOKEN_LPAREN:
+    case SOL_TOKEN_LBRACKET:
+    case SOL_TOKEN_LBRACE:
+      depth++;
+      break;
+    case SOL_TOKEN_RPAREN:
+    case SOL_TOKEN_RBRACKET:
+    case SOL_TOKEN_RBRACE:
+      depth--;
+      break;
+    case SOL_TOKEN_EOF:
+      return;
+    default:
+      break;
+    }
+    parser_advance(parser);
+  } while (depth > 0);
+}
+
+// parser_skip_parens skips a parenthesized list such as parameters or a
+// condition. It stops early at a brace that cannot be part of an expression,
+// so that a missing ")" doesn't swallow the following block.
+static void parser_skip_parens(SolParser *parser) {
+  if (parser_peek(parser) != SOL_TOKEN_LPAREN) {
+    return;
+  }
+
+  uint32_t depth = 0;
+  SolTokenType previous = SOL_TOKEN_EOF;
+  while (1) {
+    SolTokenType type = parser_peek(parser);
+    switch (type) {
+    case SOL_TOKEN_EOF:
+    case SOL_TOKEN_RBRACE:
+      return;
+    case SOL_TOKEN_LBRACE:
+      // Named arguments `f({a: 1})` and call options `f{value: 1}()`.
+      if (previous != SOL_TOKEN_LPAREN && previous != SOL_TOKEN_COMMA &&
+          previous != SOL_TOKEN_IDENTIFIER && previous != SOL_TOKEN_RBRACKET) {
+        return;
+      }
+      parser_skip_balanced(parser);
+      previous = SOL_TOKEN_RBRACE;
+      continue;
+    case SOL_TOKEN_LPAREN:
+      depth++;
+      break;
+    case SOL_TOKEN_RPAREN:
+      if (--depth == 0) {
+        parser_advance(parser);
+        return;
+      }
+      break;
+    default:
+      break;
+    }
+
+    previous = type;
+    parser_advance(parser);
+  }
+}
+
+// parser_skip_to_semicolon skips to the end of a simple statement or
+// declaration: past the next ";" outside of braces, or up to a "}" that closes
+// the enclosing block. A declaration keyword outside of braces ends it too:
+// the ";" has not been typed yet, and the declaration after it stays intact.
+static void parser_skip_to_semicolon(SolParser *parser) {
+  uint32_t start = parser->position;
+  uint32_t braces = 0;
+  while (1) {
+    switch (parser_peek(parser)) {
+    case SOL_TOKEN_EOF:
+      return;
+    case SOL_TOKEN_SEMICOLON:
+      parser_advance(parser);
+      if (braces == 0) {
+        return;
+      }
+      continue;
+    case SOL_TOKEN_LBRACE:
+      braces++;
+      break;
+    case SOL_TOKEN_RBRACE:
+      if (braces == 0) {
+        return;
+      }
+      braces--;
+      break;
+    default:
+      // The first token is the keyword of the declaration itself.
+      if (braces == 0 && parser->position > start &&
+          parser_at_declaration(parser)) {
+        return;
+      }
+      break;
+    }
+    parser_advance(parser);
+  }
+}
+
+// parser_is_variable_declaration looks ahead, without consuming anything, to
+// tell `Type name = ...;` from an expression statement.
+static bool parser_is_variable_declaration(const SolParser *parser) {
+  SolTokenType type = parser_peek(parser);
+  if (type == SOL_TOKEN_MAPPING || type == SOL_TOKEN_FUNCTION) {
+    return true;
+  }
+  if (type == SOL_TOKEN_ELEMENTARY_TYPE) {
+    // `uint256(x)` is a conversion and `bytes.concat(...)` a call.
+    SolTokenType next = parser_peek_at(parser, 1);
+    return next != SOL_TOKEN_LPAREN && next != SOL_TOKEN_DOT;
+  }
+  if (type != SOL_TOKEN_IDENTIFIER) {
+    return false;
+  }
+
+  // A user defined type name, `Library.Type`, with any array suffixes.
+  uint32_t ahead = 1;
+  while (parser_peek_at(parser, ahead) == SOL_TOKEN_DOT &&
+         parser_peek_at(parser, ahead + 1) == SOL_TOKEN_IDENTIFIER) {
+    ahead += 2;
+  }
+  while (parser_peek_at(parser, ahead) == SOL_TOKEN_LBRACKET) {
+    uint32_t depth = 0;
+    do {
+      switch (parser_peek_at(parser, ahead)) {
+      case SOL_TOKEN_LBRACKET:
+        depth++;
+        break;
+      case SOL_TOKEN_RBRACKET:
+        depth--;
+        break;
+      case SOL_TOKEN_EOF:
+      case SOL_TOKEN_SEMICOLON:
+      case SOL_TOKEN_LBRACE:
+      case SOL_TOKEN_RBRACE:
+        return false;
+      default:
+        break;
+      }
+      ahead++;
+    } while (depth > 0);
+  }
+
+  switch (parser_peek_at(parser, ahead)) {
+  case SOL_TOKEN_MEMORY:
+  case SOL_TOKEN_STORAGE:
+  case SOL_TOKEN_CALLDATA:
+    return true;
+  case SOL_TOKEN_IDENTIFIER: {
+    // `revert Unauthorized(msg.sender);` is not a declaration.
+    SolTokenType next = parser_peek_at(parser, ahead + 1);
+    return next == SOL_TOKEN_ASSIGN || next == SOL_TOKEN_SEMICOLON;
+  }
+  default:
+    return false;
+  }
+}
+
+// parse_simple parses a node that ends at the next ";".
+static void parse_simple(SolParser *parser, SolNodeKind kind) {
+  uint32_t node = parser_open(parser, kind);
+  parser_skip_to_semicolon(parser);
+  parser_close(parser, node);
+}
+
+static void parse_statement(SolParser *parser);
+static void parse_declaration(SolParser *parser);
+
+// parse_list_item parses the next item of a list: a statement of a block, a
+// member of a contract or a declaration of the source unit. Returns `false`
+// at the end of the list, after consuming its "}".
+static bool parse_list_item(SolParser *parser, SolNodeKind list) {
+  SolTokenType type = parser_peek(parser);
+  if (type == SOL_TOKEN_EOF) {
+    return false;
+  }
+
+  if (list == SOL_NODE_SOURCE_UNIT) {
+    if (type == SOL_TOKEN_RBRACE) {
+      parser_advance(parser); // A stray "}".
+    } else {
+      parse_declaration(parser);
+    }
+    return true;
+  }
+
+  if (type == SOL_TOKEN_RBRACE) {
+    parser_advance(parser);
+    return false;
+  }
+
+  if (list == SOL_NODE_BLOCK) {
+    if (parser_at_declaration(parser)) {
+      return false;
+    }
+    parse_statement(parser);
+  } else {
+    if (parser_at_top_level_declaration(parser)) {
+      return false;
+    }
+    parse_declaration(parser);
+  }
+  return true;
+}
+
+// parse_block parses the statements between the braces starting at the
+// current token.
+static void parse_block(SolParser *parser) {
+  uint32_t node = parser_open(parser, SOL_NODE_BLOCK);
+  parser_advance(parser); // {
+  while (parse_list_item(parser, SOL_NODE_BLOCK)) {
+  }
+  parser_close(parser, node);
+}
+
+static void parse_try(SolParser *parser) {
+  uint32_t node = parser_open(parser, SOL_NODE_TRY);
+  parser_advance(parser); // try
+
+  // The call, up to the block of the success case.
+  SolTokenType previous = SOL_TOKEN_TRY;
+  while (1) {
+    SolTokenType type = parser_peek(parser);
+    if (type == SOL_TOKEN_LPAREN) {
+      parser_skip_parens(parser);
+      previous = SOL_TOKEN_RPAREN;
+      continue;
+    }
+    if (type == SOL_TOKEN_LBRACE &&
+        (previous == SOL_TOKEN_IDENTIFIER || previous == SOL_TOKEN_RBRACKET)) {
+      parser_skip_balanced(parser); // Call options.
+      previous = SOL_TOKEN_RBRACE;
+      continue;
+    }
+    if (type == SOL_TOKEN_LBRACE || type == SOL_TOKEN_RBRACE ||
+        type == SOL_TOKEN_SEMICOLON || type == SOL_TOKEN_EOF) {
+      break;
+    }
+    previous = type;
+    parser_advance(parser);
+  }
+  if (parser_peek(parser) == SOL_TOKEN_LBRACE) {
+    parse_block(parser);
+  }
+
+  while (parser_peek(parser) == SOL_TOKEN_CATCH) {
+    uint32_t clause = parser_open(parser, SOL_NODE_CATCH);
+    parser_advance(parser); // catch
+    parser_skip_parens(parser);
+    while (parser_peek(parser) == SOL_TOKEN_IDENTIFIER) {
+      parser_advance(parser); // catch Error(string memory reason)
+      parser_skip_parens(parser);
+    }
+    if (parser_peek(parser) == SOL_TOKEN_LBRACE) {
+      parse_block(parser);
+    }
+    parser_close(parser, clause);
+  }
+
+  parser_close(parser, node);
+}
+
+static void parse_statement(SolParser *parser) {
+  SolTokenType type = parser_peek(parser);
+  if (type == SOL_TOKEN_RBRACE || type == SOL_TOKEN_EOF) {
+    return; // A missing statement, as in `if (x) }`.
+  }
+  if (type == SOL_TOKEN_SEMICOLON) {
+    parser_advance(parser);
+    return;
+  }
+  if (parser->depth >= SOL_PARSER_MAX_DEPTH) {
+    parse_simple(parser, SOL_NODE_EXPRESSION);
+    return;
+  }
+
+  uint32_t node;
+  switch (type) {
+  case SOL_TOKEN_LBRACE:
+    parse_block(parser);
+    return;
+  case SOL_TOKEN_IF:
+    node = parser_open(parser, SOL_NODE_IF);
+    parser_advance(parser);
+    parser_skip_parens(parser);
+    parse_statement(parser);
+    if (parser_peek(parser) == SOL_TOKEN_ELSE) {
+      parser_advance(parser);
+      parse_statement(parser);
+    }
+    parser_close(parser, node);
+    return;
+  case SOL_TOKEN_FOR:
+  case SOL_TOKEN_WHILE:
+    node = parser_open(parser, type == SOL_TOKEN_FOR ? SOL_NODE_FOR
+                                                     : SOL_NODE_WHILE);
+    parser_advance(parser);
+    parser_skip_parens(parser);
+    parse_statement(parser);
+    parser_close(parser, node);
+    return;
+  case SOL_TOKEN_DO:
+    node = parser_open(parser, SOL_NODE_DO_WHILE);
+    parser_advance(parser);
+    parse_statement(parser);
+    if (parser_peek(parser) == SOL_TOKEN_WHILE) {
+      parser_advance(parser);
+      parser_skip_parens(parser);
+      if (parser_peek(parser) == SOL_TOKEN_SEMICOLON) {
+        parser_advance(parser);
+      }
+    }
+    parser_close(parser, node);
+    return;
+  case SOL_TOKEN_UNCHECKED:
+    node = parser_open(parser, SOL_NODE_UNCHECKED);
+    parser_advance(parser);
+    if (parser_peek(parser) == SOL_TOKEN_LBRACE) {
+      parse_block(parser);
+    }
+    parser_close(parser, node);
+    return;
+  case SOL_TOKEN_ASSEMBLY:
+    // Yul is not parsed; the block is kept as a token range.
+    node = parser_open(parser, SOL_NODE_ASSEMBLY);
+    parser_advance(parser);
+    while ((type = parser_peek(parser)) != SOL_TOKEN_LBRACE &&
+           type != SOL_TOKEN_RBRACE && type != SOL_TOKEN_SEMICOLON &&
+           type != SOL_TOKEN_EOF) {
+      if (type == SOL_TOKEN_LPAREN) {
+        parser_skip_parens(parser); // ("memory-safe")
+      } else {
+        parser_advance(parser);
+      }
+    }
+    if (type == SOL_TOKEN_LBRACE) {
+      parser_skip_balanced(parser);
+    }
+    parser_close(parser, node);
+    return;
+  case SOL_TOKEN_TRY:
+    parse_try(parser);
+    return;
+  case SOL_TOKEN_RETURN:
+    parse_simple(parser, SOL_NODE_RETURN);
+    return;
+  case SOL_TOKEN_EMIT:
+    parse_simple(parser, SOL_NODE_EMIT);
+    return;
+  case SOL_TOKEN_BREAK:
+    parse_simple(parser, SOL_NODE_BREAK);
+    return;
+  case SOL_TOKEN_CONTINUE:
+    parse_simple(parser, SOL_NODE_CONTINUE);
+    return;
+  default:
+    parse_simple(parser, parser_is_variable_declaration(parser)
+                             ? SOL_NODE_LOCAL_VARIABLE
+                             : SOL_NODE_EXPRESSION);
+    return;
+  }
+}
+
+// parse_function parses a function, constructor, fallback, receive or
+// modifier: the header up to the body, then the body if there is one.
+static void parse_function(SolParser *parser) {
+  SolNodeKind kind = parser_peek(parser) == SOL_TOKEN_MODIFIER
+                         ? SOL_NODE_MODIFIER
+                         : SOL_NODE_FUNCTION;
+  uint32_t node = parser_open(parser, kind);
+  parser_advance(parser);
+
+  while (1) {
+    SolTokenType type = parser_peek(parser);
+    if (type == SOL_TOKEN_LPAREN) {
+      parser_skip_parens(parser);
+      continue;
+    }
+    if (type == SOL_TOKEN_LBRACE) {
+      parse_block(parser);
+      break;
+    }
+    if (type == SOL_TOKEN_SEMICOLON) {
+      parser_advance(parser);
+      break;
+    }
+    if (type == SOL_TOKEN_RBRACE || type == SOL_TOKEN_EOF ||
+        parser_at_declaration(parser)) {
+      break;
+    }
+    parser_advance(parser);
+  }
+
+  parser_close(parser, node);
+}
+
+// parse_contract parses a contract, interface or library with its members.
+static void parse_contract(SolParser *parser) {
+  SolTokenType keyword = parser_peek(parser) == SOL_TOKEN_ABSTRACT
+                             ? parser_peek_at(parser, 1)
+                             : parser_peek(parser);
+  SolNodeKind kind = keyword == SOL_TOKEN_INTERFACE ? SOL_NODE_INTERFACE
+                     : keyword == SOL_TOKEN_LIBRARY ? SOL_NODE_LIBRARY
+                                                    : SOL_NODE_CONTRACT;
+  uint32_t node = parser_open(parser, kind);
+  if (parser_peek(parser) == SOL_TOKEN_ABSTRACT) {
+    parser_advance(parser);
+  }
+  parser_advance(parser);
+
+  // The name and the inheritance list: `Token is ERC20("N", "S"), Ownable`.
+  while (1) {
+    SolTokenType type = parser_peek(parser);
+    if (type == SOL_TOKEN_LPAREN) {
+      parser_skip_parens(parser);
+      continue;
+    }
+    if (type == SOL_TOKEN_LBRACE || type == SOL_TOKEN_RBRACE ||
+        type == SOL_TOKEN_SEMICOLON || type == SOL_TOKEN_EOF ||
+        parser_at_declaration(parser)) {
+      break;
+    }
+    parser_advance(parser);
+  }
+
+  if (parser_peek(parser) == SOL_TOKEN_LBRACE) {
+    parser_advance(parser);
+    while (parse_list_item(parser, kind)) {
+    }
+  }
+
+  parser_close(parser, node);
+}
+
+// parse_declaration parses a declaration at the top level of a file or inside
+// of a contract. It consumes at least one token unless it is at a "}".
+static void parse_declaration(SolParser *parser) {
+  uint32_t node;
+  switch (parser_peek(parser)) {
+  case SOL_TOKEN_RBRACE:
+  case SOL_TOKEN_EOF:
+    return;
+  case SOL_TOKEN_SEMICOLON:
+    parser_advance(parser);
+    return;
+  case SOL_TOKEN_PRAGMA:
+    parse_simple(parser, SOL_NODE_PRAGMA);
+    return;
+  case SOL_TOKEN_IMPORT:
+    parse_simple(parser, SOL_NODE_IMPORT);
+    return;
+  case SOL_TOKEN_USING:
+    parse_simple(parser, SOL_NODE_USING);
+    return;
+  case SOL_TOKEN_EVENT:
+    parse_simple(parser, SOL_NODE_EVENT);
+    return;
+  case SOL_TOKEN_TYPE:
+    parse_simple(parser, SOL_NODE_USER_TYPE);
+    return;
+  case SOL_TOKEN_ABSTRACT:
+  case SOL_TOKEN_CONTRACT:
+  case SOL_TOKEN_INTERFACE:
+  case SOL_TOKEN_LIBRARY:
+    parse_contract(parser);
+    return;
+  case SOL_TOKEN_FUNCTION:
+    if (parser_peek_at(parser, 1) == SOL_TOKEN_LPAREN) {
+      parse_simple(parser, SOL_NODE_VARIABLE); // Of a function type.
+      return;
+    }
+    parse_function(parser);
+    return;
+  case SOL_TOKEN_MODIFIER:
+  case SOL_TOKEN_CONSTRUCTOR:
+  case SOL_TOKEN_FALLBACK:
+  case SOL_TOKEN_RECEIVE:
+    parse_function(parser);
+    return;
+  case SOL_TOKEN_STRUCT:
+  case SOL_TOKEN_ENUM: {
+    SolTokenType type = parser_peek(parser);
+    node = parser_open(parser, type == SOL_TOKEN_STRUCT ? SOL_NODE_STRUCT
+                                                        : SOL_NODE_ENUM);
+    parser_advance(parser);
+    while ((type = parser_peek(parser)) != SOL_TOKEN_LBRACE &&
+           type != SOL_TOKEN_RBRACE && type != SOL_TOKEN_SEMICOLON &&
+           type != SOL_TOKEN_EOF) {
+      parser_advance(parser);
+    }
+    if (type == SOL_TOKEN_LBRACE) {
+      parser_skip_balanced(parser);
+    }
+    parser_close(parser, node);
+    return;
+  }
+  case SOL_TOKEN_IDENTIFIER:
+    // `error` is not a keyword; `error Unauthorized(...)` is the only
+    // declaration with two identifiers followed by a "(".
+    if (parser_peek_at(parser, 1) == SOL_TOKEN_IDENTIFIER &&
+        parser_peek_at(parser, 2) == SOL_TOKEN_LPAREN) {
+      parse_simple(parser, SOL_NODE_ERROR);
+      return;
+    }
+    parse_simple(parser, SOL_NODE_VARIABLE);
+    return;
+  default:
+    parse_simple(parser, SOL_NODE_VARIABLE);
+    return;
+  }
+}
+
+static void parse_source_unit(SolParser *parser) {
+  uint32_t node = parser_open(parser, SOL_NODE_SOURCE_UNIT);
+  while (parse_list_item(parser, SOL_NODE_SOURCE_UNIT)) {
+  }
+  parser_close(parser, node);
+}
+
+/////////////////////////////////////////////////
+//                   SYNTAX                    //
+/////////////////////////////////////////////////
+
+void sol_syntax_init(SolSyntax *syntax) { memset(syntax, 0, sizeof(*syntax)); }
+
+void sol_syntax_free(SolSyntax *syntax) {
+  tokens_free(&syntax->tokens);
+  tokens_free(&syntax->relexed);
+  nodes_free(&syntax->nodes);
+  nodes_free(&syntax->reparsed);
+  free(syntax->window);
+  memset(syntax, 0, sizeof(*syntax));
+}
+
+// syntax_clear leaves an empty syntax behind; the next edit rebuilds it.
+static void syntax_clear(SolSyntax *syntax) {
+  syntax->tokens.count = 0;
+  syntax->nodes.count = 0;
+}
+
+static bool syntax_reserve_window(SolSyntax *syntax, uint32_t size) {
+  if (size <= syntax->window_capacity) {
+    return true;
+  }
+
+  char *window = realloc(syntax->window, size);
+  if (window == NULL) {
+    return false;
+  }
+
+  syntax->window = window;
+  syntax->window_capacity = size;
+  return true;
+}
+
+static bool syntax_parse_all(SolSyntax *syntax) {
+  syntax->nodes.count = 0;
+  SolParser parser = parser_new(&syntax->tokens, &syntax->nodes, 0, 0);
+  parse_source_unit(&parser);
+
+  syntax->nodes_parsed = syntax->nodes.count;
+  if (parser.out_of_memory) {
+    syntax_clear(syntax);
+    return false;
+  }
+  return true;
+}
+
+bool sol_syntax_build(SolSyntax *syntax, const char *source) {
+  syntax_clear(syntax);
+
+  SolLexer lexer = sol_lexer_new(source);
+  SolToken token;
+  while ((token = sol_lexer_next_token(&lexer)).type != SOL_TOKEN_EOF) {
+    if (!tokens_push(&syntax->tokens, token.type,
+                     (uint32_t)(token.literal_start - source),
+                     (uint32_t)token.literal_length)) {
+      syntax_clear(syntax);
+      return false;
+    }
+  }
+  syntax->tokens_lexed = syntax->tokens.count;
+
+  return syntax_parse_all(syntax);
+}
+
+bool sol_syntax_rebuild(SolSyntax *syntax, const SolText *text) {
+  syntax_clear(syntax);
+  if (!syntax_reserve_window(syntax, text->length + 1)) {
+    return false;
+  }
+
+  char *source = syntax->window;
+  text->read(text->context, 0, text->length, source);
+  source[text->length] = '\0';
+
+  bool built = sol_syntax_build(syntax, source);
+  if (syntax->window_capacity > SYNTAX_MAX_KEPT_WINDOW) {
+    free(syntax->window);
+    syntax->window = NULL;
+    syntax->window_capacity = 0;
+  }
+  return built;
+}
+
+// tokens_first_affected returns the first token the edit at `offset` can
+// change: the lexer may have looked at the edited text to find its end.
+static uint32_t tokens_first_affected(const SolTokenList *tokens,
+                                      uint32_t offset) {
+  uint32_t low = 0;
+  uint32_t high = tokens->count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if ((uint64_t)token_end(tokens, middle) + SOL_LEXER_LOOKAHEAD > offset) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return low;
+}
+
+// tokens_first_at returns the first token starting at or after `offset`.
+static uint32_t tokens_first_at(const SolTokenList *tokens, uint32_t offset) {
+  uint32_t low = 0;
+  uint32_t high = tokens->count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (tokens->starts[middle] >= offset) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return low;
+}
+
+// syntax_relex re-lexes the text around an edit and splices the new tokens
+// in. The tokens `[first, old_end)` were replaced by `[first, new_end)`.
+static bool syntax_relex(SolSyntax *syntax, const SolText *text,
+                         uint32_t offset, uint32_t removed, uint32_t inserted,
+                         uint32_t *first, uint32_t *old_end,
+                         uint32_t *new_end) {
+  SolTokenList *tokens = &syntax->tokens;
+  SolTokenList *relexed = &syntax->relexed;
+  relexed->count = 0;
+
+  // Lexing restarts right after the last token the edit cannot have changed.
+  // Old tokens that start after the edit are candidates for resynchronizing;
+  // `shift` moves them to their new offsets (wrapping around for deletions).
+  uint32_t first_token = tokens_first_affected(tokens, offset);
+  uint32_t resume = first_token > 0 ? token_end(tokens, first_token - 1) : 0;
+  uint32_t reused = tokens_first_at(tokens, offset + removed);
+  uint32_t shift = inserted - removed;
+  uint32_t edit_end = offset + inserted;
+
+  uint32_t window_size = SYNTAX_WINDOW;
+  bool done = false;
+  while (!done) {
+    uint32_t window_start = resume;
+    uint32_t window_length = text->length - window_start;
+    if (window_length > window_size) {
+      window_length = window_size;
+    }
+    uint32_t window_end = window_start + window_length;
+    bool complete = window_end == text->length;
+
+    if (!syntax_reserve_window(syntax, window_length + 1)) {
+      return false;
+    }
+    char *window = syntax->window;
+    text->read(text->context, window_start, window_length, window);
+    window[window_length] = '\0';
+
+    SolLexer lexer = sol_lexer_new(window);
+    while (1) {
+      SolToken token = sol_lexer_next_token(&lexer);
+      uint32_t start = window_start + (uint32_t)(token.literal_start - window);
+      uint32_t length = (uint32_t)token.literal_length;
+
+      // A token close to the end of the window may continue past it; read a
+      // larger window from the last token that is certain.
+      if (!complete &&
+          (token.type == SOL_TOKEN_EOF ||
+           (uint64_t)start + length + SOL_LEXER_LOOKAHEAD > window_end)) {
+        break;
+      }
+      if (token.type == SOL_TOKEN_EOF) {
+        reused = tokens->count;
+        done = true;
+        break;
+      }
+
+      // Past the edit, the lexer is back in sync once a token starts where
+      // an old one did: the text from there on is the same.
+      if (start >= edit_end) {
+        while (reused < tokens->count &&
+               tokens->starts[reused] + shift < start) {
+          reused++;
+        }
+        if (reused < tokens->count && tokens->starts[reused] + shift == start) {
+          done = true;
+          break;
+        }
+      }
+
+      if (!tokens_push(relexed, token.type, start, length)) {
+        return false;
+      }
+      resume = start + length;
+    }
+
+    if (window_size < text->length) {
+      window_size *= 2;
+    }
+  }
+
+  // Lexing restarted a little early; the tokens in front of the edit that
+  // came out the same are not part of the change.
+  uint32_t same = 0;
+  while (same < relexed->count && first_token + same < reused &&
+         relexed->types[same] == tokens->types[first_token + same] &&
+         relexed->starts[same] == tokens->starts[first_token + same] &&
+         relexed->lengths[same] == tokens->lengths[first_token + same] &&
+         token_end(relexed, same) <= offset) {
+    same++;
+  }
+
+  uint32_t start = first_token + same;
+  uint32_t count = relexed->count - same;
+  uint32_t tail = tokens->count - reused;
+  if (count > reused - start &&
+      !tokens_reserve(tokens, count - (reused - start))) {
+    return false;
+  }
+
+  uint32_t moved = start + count;
+  memmove(tokens->types + moved, tokens->types + reused, tail);
+  memmove(tokens->starts + moved, tokens->starts + reused,
+          tail * sizeof(uint32_t));
+  memmove(tokens->lengths + moved, tokens->lengths + reused,
+          tail * sizeof(uint32_t));
+  for (uint32_t i = moved; i < moved + tail; i++) {
+    tokens->starts[i] += shift;
+  }
+
+  memcpy(tokens->types + start, relexed->types + same, count);
+  memcpy(tokens->starts + start, relexed->starts + same,
+         count * sizeof(uint32_t));
+  memcpy(tokens->lengths + start, relexed->lengths + same,
+         count * sizeof(uint32_t));
+  tokens->count = moved + tail;
+
+  syntax->tokens_lexed = relexed->count;
+  *first = start;
+  *old_end = reused;
+  *new_end = moved;
+  return true;
+}
+
+// syntax_splice_nodes replaces the nodes `[from, to)` with the reparsed
+// nodes. The nodes after them move by `shift` tokens, and the ancestors on the
+// `path` up to `level` grow by the difference.
+static bool syntax_splice_nodes(SolSyntax *syntax, const uint32_t *path,
+                                uint32_t level, uint32_t from, uint32_t to,
+                                uint32_t shift) {
+  SolNodeList *nodes = &syntax->nodes;
+  const SolNodeList *reparsed = &syntax->reparsed;
+
+  uint32_t old_size = to - from;
+  uint32_t new_size = reparsed->count;
+  if (new_size > old_size && !nodes_reserve(nodes, new_size - old_size)) {
+    return false;
+  }
+
+  uint32_t tail = nodes->count - to;
+  nodes_copy(nodes, from + new_size, nodes, to, tail);
+  nodes_copy(nodes, from, reparsed, 0, new_size);
+  nodes->count = from + new_size + tail;
+
+  for (uint32_t i = from + new_size; i < nodes->count; i++) {
+    nodes->token_starts[i] += shift;
+    nodes->token_ends[i] += shift;
+  }
+
+  uint32_t growth = new_size - old_size; // Wraps around when shrinking.
+  for (uint32_t i = 0; i <= level; i++) {
+    nodes->descendants[path[i]] += growth;
+    nodes->token_ends[path[i]] += shift;
+  }
+
+  syntax->nodes_parsed = new_size;
+  return true;
+}
+
+typedef enum {
+  SYNTAX_REPARSED,
+  SYNTAX_REPARSE_ESCALATE, // The list changed its extent; try its parent.
+  SYNTAX_REPARSE_FAILED,   // Out of memory.
+} SyntaxReparseResult;
+
+// syntax_reparse_list reparses the items of the list `path[level]` (a block,
+// a contract or the source unit) around the tokens that changed. Parsing
+// restarts after the last item the change cannot have affected, and stops
+// once an item ends where an old item started, after the change: the loop
+// over the items is in the same state there, in front of the same tokens.
+static SyntaxReparseResult
+syntax_reparse_list(SolSyntax *syntax, const uint32_t *path, uint32_t level,
+                    uint32_t first, uint32_t old_end, uint32_t new_end) {
+  const SolNodeList *nodes = &syntax->nodes;
+  uint32_t list = path[level];
+  SolNodeKind kind = (SolNodeKind)nodes->kinds[list];
+  uint32_t list_end = sol_node_next_sibling(nodes, list);
+
+  // The parser looks at most SOL_PARSER_LOOKAHEAD tokens past the end of a
+  // node to decide where it ends.
+  uint32_t restart_node = list + 1;
+  uint32_t restart_token = 0;
+  bool restart_found = false;
+  for (uint32_t child = list + 1; child < list_end;
+       child = sol_node_next_sibling(nodes, child)) {
+    if (nodes->token_ends[child] + SOL_PARSER_LOOKAHEAD > first) {
+      break;
+    }
+    restart_node = sol_node_next_sibling(nodes, child);
+    restart_token = nodes->token_ends[child];
+    restart_found = true;
+  }
+
+  if (!restart_found) {
+    if (kind == SOL_NODE_BLOCK) {
+      restart_token = nodes->token_starts[list] + 1; // After the "{".
+    } else if (kind != SOL_NODE_SOURCE_UNIT) {
+      return SYNTAX_REPARSE_ESCALATE; // The change may be in the header.
+    }
+  }
+
+  syntax->reparsed.count = 0;
+  SolParser parser = parser_new(&syntax->tokens, &syntax->reparsed,
+                                restart_token, level + 1);
+  uint32_t shift = new_end - old_end;
+  uint32_t resync = restart_node;
+  bool resynced = false;
+  while (!resynced && parse_list_item(&parser, kind)) {
+    if (parser.position < new_end) {
+      continue;
+    }
+
+    // Old items that start after the change move by `shift` tokens.
+    while (resync < list_end && (nodes->token_starts[resync] < old_end ||
+                                 nodes->token_starts[resync] + shift <
+                                     parser.position)) {
+      resync = sol_node_next_sibling(nodes, resync);
+    }
+    resynced = resync < list_end &&
+               nodes->token_starts[resync] + shift == parser.position;
+  }
+
+  if (parser.out_of_memory) {
+    return SYNTAX_REPARSE_FAILED;
+  }
+  if (!resynced) {
+    // Every item after the change was parsed again. The list itself is only
+    // the same if it still ends where it did.
+    if (parser.position != nodes->token_ends[list] + shift) {
+      return SYNTAX_REPARSE_ESCALATE;
+    }
+    resync = list_end;
+  }
+
+  if (!syntax_splice_nodes(syntax, path, level, restart_node, resync, shift)) {
+    return SYNTAX_REPARSE_FAILED;
+  }
+  return SYNTAX_REPARSED;
+}
+
+// syntax_reparse updates the tree after the tokens `[first, old_end)` were
+// replaced by `[first, new_end)`.
+static bool syntax_reparse(SolSyntax *syntax, uint32_t first, uint32_t old_end,
+                           uint32_t new_end) {
+  const SolNodeList *nodes = &syntax->nodes;
+
+  // The chain of nodes that hold the changed tokens strictly inside: their
+  // first and last tokens are unchanged.
+  uint32_t path[SOL_PARSER_MAX_DEPTH + 1];
+  uint32_t depth = 0;
+  uint32_t node = 0;
+  path[depth++] = node;
+
+  bool descended = true;
+  while (descended && depth < SOL_PARSER_MAX_DEPTH + 1) {
+    descended = false;
+    uint32_t end = sol_node_next_sibling(nodes, node);
+    for (uint32_t child = node + 1; child < end;
+         child = sol_node_next_sibling(nodes, child)) {
+      if (nodes->token_starts[child] >= first) {
+        break;
+      }
+      if (old_end < nodes->token_ends[child]) {
+        node = child;
+        path[depth++] = node;
+        descended = true;
+        break;
+      }
+    }
+  }
+
+  // Try the innermost list first. The source unit always succeeds, as it
+  // ends with the tokens.
+  for (uint32_t level = depth; level-- > 0;) {
+    switch (nodes->kinds[path[level]]) {
+    case SOL_NODE_SOURCE_UNIT:
+    case SOL_NODE_CONTRACT:
+    case SOL_NODE_INTERFACE:
+    case SOL_NODE_LIBRARY:
+    case SOL_NODE_BLOCK:
+      break;
+    default:
+      continue;
+    }
+
+    switch (syntax_reparse_list(syntax, path, level, first, old_end,
+                                new_end)) {
+    case SYNTAX_REPARSED:
+      return true;
+    case SYNTAX_REPARSE_FAILED:
+      return false;
+    case SYNTAX_REPARSE_ESCALATE:
+      break;
+    }
+  }
+
+  return syntax_parse_all(syntax);
+}
+
+bool sol_syntax_edit(SolSyntax *syntax, const SolText *text, uint32_t offset,
+                     uint32_t removed, uint32_t inserted) {
+  if (syntax->nodes.count == 0) {
+    return sol_syntax_rebuild(syntax, text); // An earlier update failed.
+  }
+
+  uint32_t first;
+  uint32_t old_end;
+  uint32_t new_end;
+  if (!syntax_relex(syntax, text, offset, removed, inserted, &first, &old_end,
+                    &new_end)) {
+    syntax_clear(syntax);
+    return false;
+  }
+
+  syntax->nodes_parsed = 0;
+  if (first == old_end && first == new_end) {
+    return true; // Only whitespace or comments changed.
+  }
+
+  if (!syntax_reparse(syntax, first, old_end, new_end)) {
+    syntax_clear(syntax);
+    return false;
+  }
+  return true;
+}
+
+fdn_string sol_token_text(const SolTokenList *tokens, const fdn_string *source,
+                          uint32_t token) {
+  return fdn_string_create_view(source->string_start + tokens->starts[token],
+                                tokens->lengths[token]);
+}
+
+size_t sol_syntax_memory(const SolSyntax *syntax) {
+  size_t token_size = sizeof(uint8_t) + 2 * sizeof(uint32_t);
+  size_t node_size = sizeof(uint8_t) + 3 * sizeof(uint32_t);
+  return syntax->tokens.capacity * token_size +
+         syntax->nodes.capacity * node_size;
+}
+
+const char *sol_node_kind_str(SolNodeKind kind) {
+  static const char *names[SOL_NODE_KIND_COUNT] = {
+      [SOL_NODE_SOURCE_UNIT] = "SOURCE_UNIT",
+      [SOL_NODE_PRAGMA] = "PRAGMA",
+      [SOL_NODE_IMPORT] = "IMPORT",
+      [SOL_NODE_USING] = "USING",
+      [SOL_NODE_CONTRACT] = "CONTRACT",
+      [SOL_NODE_INTERFACE] = "INTERFACE",
+      [SOL_NODE_LIBRARY] = "LIBRARY",
+      [SOL_NODE_FUNCTION] = "FUNCTION",
+      [SOL_NODE_MODIFIER] = "MODIFIER",
+      [SOL_NODE_EVENT] = "EVENT",
+      [SOL_NODE_ERROR] = "ERROR",
+      [SOL_NODE_STRUCT] = "STRUCT",
+      [SOL_NODE_ENUM] = "ENUM",
+      [SOL_NODE_USER_TYPE] = "USER_TYPE",
+      [SOL_NODE_VARIABLE] = "VARIABLE",
+      [SOL_NODE_BLOCK] = "BLOCK",
+      [SOL_NODE_IF] = "IF",
+      [SOL_NODE_FOR] = "FOR",
+      [SOL_NODE_WHILE] = "WHILE",
+      [SOL_NODE_DO_WHILE] = "DO_WHILE",
+      [SOL_NODE_TRY] = "TRY",
+      [SOL_NODE_CATCH] = "CATCH",
+      [SOL_NODE_UNCHECKED] = "UNCHECKED",
+      [SOL_NODE_ASSEMBLY] = "ASSEMBLY",
+      [SOL_NODE_RETURN] = "RETURN",
+      [SOL_NODE_EMIT] = "EMIT",
+      [SOL_NODE_BREAK] = "BREAK",
+      [SOL_NODE_CONTINUE] = "CONTINUE",
+      [SOL_NODE_LOCAL_VARIABLE] = "LOCAL_VARIABLE",
+      [SOL_NODE_EXPRESSION] = "EXPRESSION",
+  };
+
+  if ((unsigned)kind >= SOL_NODE_KIND_COUNT) {
+    return "UNKNOWN";
+  }
+  return names[kind];
+}
@@ -0,0 +1,171 @@
+#ifndef SOLIDITY_PARSER_H
+#define SOLIDITY_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libs/foundation.h"
+#include "lexer.h"
+
+/**
+ * The syntax of a Solidity document: its tokens and a structural parse tree,
+ * kept up to date as the document is edited.
+ *
+ * Tokens are stored as byte offsets rather than pointers, so they stay valid
+ * while the text moves. An edit re-lexes from the last token the edit cannot
+ * have changed until a token starts where an old token started, after the
+ * edit; every token from there on is reused with a shifted offset.
+ *
+ * The parse tree is a set of parallel arrays indexed by node, in preorder: the
+ * kinds, the token ranges and the subtree sizes. A node covers a range of
+ * tokens and knows the size of its subtree, so a subtree can be cut out and
+ * replaced without touching the rest. Nodes refer to tokens and to each other
+ * by 32-bit index only; the text itself stays in the document.
+ *
+ * After an edit, the statements (or members, or declarations) of the
+ * innermost block (or contract, or file) enclosing the changed tokens are
+ * parsed again from the last one the change cannot affect, until one ends
+ * where an old one started. If the block changed its extent instead (an
+ * unbalanced brace was typed), the enclosing list is tried.
+ *
+ * The parser works on token types alone and never fails: it recovers from
+ * syntax errors by skipping to the next `;` or `}`. Declarations and
+ * statements are recognized; expressions are left as token ranges.
+ */
+
+//////////// TEXT /////////////
+
+/**
+ * @struct SolText
+ * @brief Read access to text that may not be stored contiguously, such as the
+ * piece table of an open document.
+ */
+typedef struct {
+  const void *context;
+  uint32_t length;
+  // Copies the `length` bytes at `offset` to `output`.
+  void (*read)(const void *context, uint32_t offset, uint32_t length,
+               char *output);
+} SolText;
+
+// sol_text_from_string reads from a contiguous `string`, which must outlive
+// the returned SolText.
+SolText sol_text_from_string(const fdn_string *string);
+
+//////////// TREE /////////////
+
+typedef enum {
+  SOL_NODE_SOURCE_UNIT,
+
+  // Declarations
+  SOL_NODE_PRAGMA,
+  SOL_NODE_IMPORT,
+  SOL_NODE_USING,
+  SOL_NODE_CONTRACT, // Also abstract contracts.
+  SOL_NODE_INTERFACE,
+  SOL_NODE_LIBRARY,
+  SOL_NODE_FUNCTION, // Also constructor, fallback and receive.
+  SOL_NODE_MODIFIER,
+  SOL_NODE_EVENT,
+  SOL_NODE_ERROR,
+  SOL_NODE_STRUCT,
+  SOL_NODE_ENUM,
+  SOL_NODE_USER_TYPE, // type Price is uint256;
+  SOL_NODE_VARIABLE,  // State and file level constant variables.
+
+  // Statements
+  SOL_NODE_BLOCK,
+  SOL_NODE_IF,
+  SOL_NODE_FOR,
+  SOL_NODE_WHILE,
+  SOL_NODE_DO_WHILE,
+  SOL_NODE_TRY,
+  SOL_NODE_CATCH,
+  SOL_NODE_UNCHECKED,
+  SOL_NODE_ASSEMBLY,
+  SOL_NODE_RETURN,
+  SOL_NODE_EMIT,
+  SOL_NODE_BREAK,
+  SOL_NODE_CONTINUE,
+  SOL_NODE_LOCAL_VARIABLE,
+  SOL_NODE_EXPRESSION,
+
+  SOL_NODE_KIND_COUNT,
+} SolNodeKind;
+
+/**
+ * @struct SolNodeList
+ * @brief The nodes of a parse tree as one array per field. The four arrays
+ * share a single allocation, owned by `token_starts`.
+ */
+typedef struct {
+  uint32_t *token_starts; // Index of the first token of every node.
+  uint32_t *token_ends;   // Index past the last token of every node.
+  uint32_t *descendants;  // Number of nodes in the subtree below every node.
+  uint8_t *kinds;         // SolNodeKind of every node.
+  uint32_t count;
+  uint32_t capacity;
+} SolNodeList;
+
+// The first child of a node is the node right after it; the next sibling of a
+// node comes right after its subtree.
+static inline uint32_t sol_node_next_sibling(const SolNodeList *nodes,
+                                             uint32_t node) {
+  return node + 1 + nodes->descendants[node];
+}
+
+//////////// SYNTAX /////////////
+
+typedef struct {
+  uint8_t *types;   // SolTokenType of every token.
+  uint32_t *starts; // Byte offset of every token.
+  uint32_t *lengths;
+  uint32_t count;
+  uint32_t capacity;
+} SolTokenList;
+
+typedef struct {
+  SolTokenList tokens; // Without the EOF token.
+  SolNodeList nodes;   // In preorder; node 0 is the source unit.
+
+  // What the last update did, for tests and benchmarks.
+  uint32_t tokens_lexed;
+  uint32_t nodes_parsed;
+
+  // Scratch space of the updates.
+  SolTokenList relexed;
+  SolNodeList reparsed;
+  char *window;
+  uint32_t window_capacity;
+} SolSyntax;
+
+void sol_syntax_init(SolSyntax *syntax);
+void sol_syntax_free(SolSyntax *syntax);
+
+// sol_syntax_build lexes and parses the null-terminated `source` in place.
+// Returns `false` if memory ran out; the syntax is empty then.
+bool sol_syntax_build(SolSyntax *syntax, const char *source);
+
+// sol_syntax_rebuild lexes and parses the whole `text`. Returns `false` if
+// memory ran out; the syntax is empty then.
+bool sol_syntax_rebuild(SolSyntax *syntax, const SolText *text);
+
+// sol_syntax_edit updates the syntax after the `removed` bytes at `offset` were
+// replaced with `inserted` bytes; `text` is the text after the edit. Returns
+// `false` if memory ran out; the syntax is empty then.
+bool sol_syntax_edit(SolSyntax *syntax, const SolText *text, uint32_t offset,
+                     uint32_t removed, uint32_t inserted);
+
+// sol_token_text returns a view of the text of `token` in `source`, the
+// contiguous text the tokens were lexed from.
+fdn_string sol_token_text(const SolTokenList *tokens, const fdn_string *source,
+                          uint32_t token);
+
+// sol_syntax_memory returns the number of bytes held by the tokens and the
+// tree of `syntax`, without its scratch space.
+size_t sol_syntax_memory(const SolSyntax *syntax);
+
+// sol_node_kind_str returns a readable name of the node kind, e.g. "FUNCTION".
+const char *sol_node_kind_str(SolNodeKind kind);
+
+#endif // SOLIDITY_PARSER_H
@@ -1,12 +1,31 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <foundation.h>
+#define FDN_IMPLEMENTATION
+#include <dirent.h>
 #include <json/parser.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // --- Project Includes (Unity Build Style) ---
 // We include the .c files directly so we can test static functions if needed
 #include "json/lexer.c"
 #include "json/parser.c"
+#include "json/writer.c"
+#include "lsp/cache.c"
+#include "lsp/completion.c"
+#include "lsp/dispatcher.c"
+#include "lsp/documents.c"
+#include "lsp/imports.c"
+#include "lsp/references.c"
+#include "lsp/server.c"
+#include "lsp/symbols.c"
+#include "lsp/transport.c"
+#include "lsp/workspace.c"
+#include "solidity/lexer.c"
+#include "solidity/parser.c"
 
 // ==============================================================================
 // 1. THE TESTING FRAMEWORK (The Engine)
@@ -17,6 +36,9 @@ typedef struct {
     int failed;
 } TestStats;
 
+// A scratch arena shared by the test cases; reset before each test runs.
+static fdn_arena test_arena;
+
 // Helper to convert TokenType to string
 const char *token_type_str(TokenType type) {
     switch (type) {
@@ -52,6 +74,13 @@ const char *token_type_str(TokenType type) {
         return 0; \
     }
 
+#define ASSERT_SOL_TOKEN(expected, actual) \
+    if ((expected) != (actual)) { \
+        fprintf(stderr, "    [ASSERT FAILED] %s:%d: Expected %s, got %s\n", \
+                __FILE__, __LINE__, sol_token_type_str(expected), sol_token_type_str(actual)); \
+        return 0; \
+    }
+
 #define ASSERT_NOT_NULL(ptr, msg) \
     if ((ptr) == NULL) { \
         fprintf(stderr, "    [ASSERT FAILED] %s:%d: %s\n", __FILE__, __LINE__, msg); \
@@ -69,6 +98,7 @@ const char *token_type_str(TokenType type) {
 // The internal runner function
 void run_test_internal(int (*test_func)(void), const char *name, TestStats *stats) {
     printf("--- Running: %s ---\n", name);
+    fdn_arena_reset(&test_arena);
     
     if (test_func()) {
         printf("--- \033[38;2;50;255;50mPassed\033[0m: %s ---\n\n", name); // Green
@@ -87,6 +117,177 @@ void run_test_internal(int (*test_func)(void), const char *name, TestStats *stat
 // 2. THE TEST CASES
 // ==============================================================================
 
+int test_arena_reset_coalesces_blocks(void) {
+    fdn_arena arena;
+    ASSERT_TRUE(fdn_arena_init(&arena, 64), "Arena init failed");
+
+    char *small = fdn_arena_alloc(&arena, 10);
+    char *big = fdn_arena_alloc(&arena, 1000); // Does not fit the first block.
+    ASSERT_NOT_NULL(small, "Small allocation failed");
+    ASSERT_NOT_NULL(big, "Big allocation failed");
+    ASSERT_TRUE(((uintptr_t)big % FDN_ARENA_ALIGNMENT) == 0, "Allocation is not aligned");
+    ASSERT_NOT_NULL(arena.current->prev, "Big allocation should chain a new block");
+
+    fdn_arena_reset(&arena);
+    ASSERT_NULL(arena.current->prev, "Reset should merge the chain into one block");
+    ASSERT_TRUE(arena.current->capacity >= 1000 + 64, "Merged block is too small");
+
+    fdn_arena_block *block = arena.current;
+    fdn_arena_alloc(&arena, 10);
+    fdn_arena_alloc(&arena, 1000);
+    ASSERT_TRUE(arena.current == block, "Same workload should fit without new blocks");
+
+    fdn_arena_free(&arena);
+    return 1;
+}
+
+int test_interner_gives_equal_strings_one_id(void) {
+    fdn_interner interner;
+    ASSERT_TRUE(fdn_interner_init(&interner), "Interner init failed");
+
+    // Views into different buffers intern to the same id.
+    char name[] = "balanceOf balanceOf";
+    uint32_t first = fdn_interner_intern(&interner, fdn_string_create_view(name, 9));
+    uint32_t second = fdn_interner_intern(&interner, fdn_string_create_view(name + 10, 9));
+    uint32_t other = fdn_interner_intern(&interner, fdn_string_create_view("balance", 7));
+    uint32_t empty = fdn_interner_intern(&interner, fdn_string_create_view("", 0));
+    ASSERT_TRUE(first == second, "Equal strings should get the same id");
+    ASSERT_TRUE(first != other && other != empty && first != empty, "Different strings should get different ids");
+    ASSERT_TRUE(fdn_interner_count(&interner) == 3, "Each string should be stored once");
+
+    fdn_string stored = fdn_interner_string(&interner, first);
+    ASSERT_TRUE(fdn_string_is_eq_c_str(stored, "balanceOf"), "The string of an id should round-trip");
+    ASSERT_TRUE(stored.string_start != name && stored.string_start[9] == '\0', "Strings should be null-terminated copies");
+    ASSERT_TRUE(fdn_interner_string(&interner, 1000).string_length == 0, "Unknown ids have no string");
+    ASSERT_TRUE(fdn_interner_find(&interner, fdn_string_create_view("totalSupply", 11)) == FDN_INTERNER_NONE,
+                "Finding should not intern");
+    ASSERT_TRUE(fdn_interner_find(&interner, fdn_string_create_view("balance", 7)) == other, "Find failed");
+
+    // Ids and strings stay put as the table grows past several chunks.
+    char key[32];
+    for (uint32_t i = 0; i < 20000; i++) {
+        snprintf(key, sizeof(key), "identifier%u", i);
+        ASSERT_TRUE(fdn_interner_intern(&interner, fdn_string_create_view(key, strlen(key))) == i + 3, key);
+    }
+    for (uint32_t i = 0; i < 20000; i += 997) {
+        snprintf(key, sizeof(key), "identifier%u", i);
+        ASSERT_TRUE(fdn_string_is_eq_c_str(fdn_interner_string(&interner, i + 3), key), key);
+        ASSERT_TRUE(fdn_interner_intern(&interner, fdn_string_create_view(key, strlen(key))) == i + 3, key);
+    }
+    ASSERT_TRUE(fdn_string_is_eq_c_str(fdn_interner_string(&interner, first), "balanceOf"), "Strings should not move");
+
+    fdn_interner_free(&interner);
+    return 1;
+}
+
+typedef struct {
+    fdn_interner *interner;
+    uint32_t offset;
+    uint32_t ids[4000];
+} InternerWorker;
+
+// Interns the same names as the other workers, in an order of its own.
+static void *interner_worker_main(void *argument) {
+    InternerWorker *worker = argument;
+    char key[32];
+    for (uint32_t i = 0; i < 4000; i++) {
+        uint32_t name = (i + worker->offset) % 4000;
+        snprintf(key, sizeof(key), "name%u", name);
+        worker->ids[name] = fdn_interner_intern(worker->interner, fdn_string_create_view(key, strlen(key)));
+    }
+    return NULL;
+}
+
+int test_interner_is_shared_by_threads(void) {
+    fdn_interner interner;
+    ASSERT_TRUE(fdn_interner_init(&interner), "Interner init failed");
+
+    static InternerWorker workers[4];
+    pthread_t threads[4];
+    for (uint32_t i = 0; i < 4; i++) {
+        workers[i].interner = &interner;
+        workers[i].offset = i * 1000;
+        ASSERT_TRUE(pthread_create(&threads[i], NULL, interner_worker_main, &workers[i]) == 0, "Thread failed");
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    ASSERT_TRUE(fdn_interner_count(&interner) == 4000, "Every name should be stored once");
+    char key[32];
+    for (uint32_t name = 0; name < 4000; name++) {
+        snprintf(key, sizeof(key), "name%u", name);
+        for (uint32_t i = 1; i < 4; i++) {
+            ASSERT_TRUE(workers[i].ids[name] == workers[0].ids[name], "Threads should agree on the ids");
+        }
+        ASSERT_TRUE(fdn_string_is_eq_c_str(fdn_interner_string(&interner, workers[0].ids[name]), key), key);
+    }
+
+    fdn_interner_free(&interner);
+    return 1;
+}
+
+typedef struct {
+    fdn_queue *queue;
+    uint64_t sum;
+} QueueWorker;
+
+// Pushes the numbers 1 to 20000, tagged with nothing but their value.
+static void *queue_producer_main(void *argument) {
+    QueueWorker *worker = argument;
+    for (uintptr_t i = 1; i <= 20000; i++) {
+        fdn_queue_push(worker->queue, (void *)i);
+    }
+    return NULL;
+}
+
+static void *queue_consumer_main(void *argument) {
+    QueueWorker *worker = argument;
+    void *item;
+    while (fdn_queue_pop(worker->queue, &item)) {
+        worker->sum += (uintptr_t)item;
+    }
+    return NULL;
+}
+
+int test_queue_passes_items_between_threads(void) {
+    fdn_queue queue;
+    ASSERT_TRUE(!fdn_queue_init(&queue, 48), "The capacity should be a power of two");
+    ASSERT_TRUE(fdn_queue_init(&queue, 64), "Queue init failed");
+
+    // A small ring, so the producers keep running into a full queue and the
+    // consumers into an empty one.
+    QueueWorker producers[4];
+    QueueWorker consumers[4];
+    pthread_t producer_threads[4];
+    pthread_t consumer_threads[4];
+    for (uint32_t i = 0; i < 4; i++) {
+        producers[i] = (QueueWorker){&queue, 0};
+        consumers[i] = (QueueWorker){&queue, 0};
+        ASSERT_TRUE(pthread_create(&consumer_threads[i], NULL, queue_consumer_main, &consumers[i]) == 0,
+                    "Thread failed");
+        ASSERT_TRUE(pthread_create(&producer_threads[i], NULL, queue_producer_main, &producers[i]) == 0,
+                    "Thread failed");
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        pthread_join(producer_threads[i], NULL);
+    }
+    fdn_queue_close(&queue);
+    ASSERT_TRUE(!fdn_queue_push(&queue, &queue), "A closed queue should take no more items");
+
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < 4; i++) {
+        pthread_join(consumer_threads[i], NULL);
+        sum += consumers[i].sum;
+    }
+    ASSERT_TRUE(sum == 4 * (20000ULL * 20001ULL / 2), "Every item should be popped exactly once");
+
+    void *item;
+    ASSERT_TRUE(!fdn_queue_try_pop(&queue, &item), "The queue should be empty");
+    fdn_queue_free(&queue);
+    return 1;
+}
+
 int test_lexer_simple_tokens(void) {
     // Note the double backslash to actually put a backslash in the C-string
     const char *input = "{} \"hello\" \"hello with quote \\\"mark \"";
@@ -106,9 +307,71 @@ int test_lexer_simple_tokens(void) {
     return 1; // Success
 }
 
+int test_lexer_bulk_scanning_matches_scalar(void) {
+    // Runs long enough to exercise the aligned SIMD loops, with every kind of
+    // stop char placed at each possible offset within a 32 byte window.
+    const char stops[] = {'"', '\\', '\n', '\x01', '\0'};
+    char *buffer = fdn_arena_alloc(&test_arena, 256);
+    lexer_select_kernels();
+
+    for (size_t s = 0; s < sizeof(stops); s++) {
+        for (size_t start = 0; start < 32; start++) {
+            for (size_t len = 0; len < 100; len += 7) {
+                memset(buffer, 'a', 256);
+                buffer[start + len] = stops[s];
+                buffer[200] = '\0';
+                const char *expected = scan_string_scalar(buffer + start);
+                ASSERT_TRUE(expected == buffer + start + len, "Scalar string scan mismatch");
+                ASSERT_TRUE(g_scan_string(buffer + start) == expected, "String scan mismatch");
+#ifdef LEXER_X86_KERNELS
+                ASSERT_TRUE(scan_string_sse2(buffer + start) == expected, "SSE2 string scan mismatch");
+#endif
+
+                memset(buffer, ' ', 256);
+                buffer[start + len] = stops[s] == '\n' ? 'x' : stops[s];
+                buffer[200] = '\0';
+                expected = skip_whitespace_scalar(buffer + start);
+                ASSERT_TRUE(expected == buffer + start + len, "Scalar whitespace skip mismatch");
+                ASSERT_TRUE(g_skip_whitespace(buffer + start) == expected, "Whitespace skip mismatch");
+#ifdef LEXER_X86_KERNELS
+                ASSERT_TRUE(skip_whitespace_sse2(buffer + start) == expected, "SSE2 whitespace skip mismatch");
+#endif
+            }
+        }
+    }
+
+    return 1;
+}
+
+int test_lexer_long_strings_and_whitespace(void) {
+    const char *input =
+        "{\n\t\t                                          \"key\" :"
+        "\"a long string value that spans more than thirty two bytes \\\" "
+        "with an escaped quote and \\\\ a backslash in the middle of it\""
+        "                                                          }";
+
+    Lexer lexer = lexer_new(input);
+    ASSERT_TOKEN(TOKEN_LBRACE, lexer_next_token(&lexer).type);
+
+    Token key = lexer_next_token(&lexer);
+    ASSERT_TOKEN(TOKEN_STRING, key.type);
+    ASSERT_TRUE(key.literal_length == 5, "Key length mismatch");
+
+    ASSERT_TOKEN(TOKEN_COLON, lexer_next_token(&lexer).type);
+
+    Token value = lexer_next_token(&lexer);
+    ASSERT_TOKEN(TOKEN_STRING, value.type);
+    ASSERT_TRUE(value.literal_start[value.literal_length - 1] == '"', "String should end at the closing quote");
+    ASSERT_TRUE(value.literal_start[value.literal_length] == ' ', "String ended too late");
+
+    ASSERT_TOKEN(TOKEN_RBRACE, lexer_next_token(&lexer).type);
+    ASSERT_TOKEN(TOKEN_EOF, lexer_next_token(&lexer).type);
+    return 1;
+}
+
 int test_parser_returns_null_on_empty_input(void) {
     const char *input = " "; // Whitespace only
-    RequestMessage *req = parser_parse_request_message(input);
+    RequestMessage *req = parser_parse_request_message(&test_arena, input);
     
     // Check Result
     ASSERT_NULL(req, "Parser should return NULL on empty/whitespace input");
@@ -118,7 +381,7 @@ int test_parser_returns_null_on_empty_input(void) {
 
 int test_parser_handles_method_parsing(void) {
     const char *input = "{\"method\": \"initialize\"}";
-    RequestMessage *req = parser_parse_request_message(input);
+    RequestMessage *req = parser_parse_request_message(&test_arena, input);
 
     ASSERT_NOT_NULL(req, "Parser returned NULL on valid input");
     ASSERT_TRUE(req->method.string_length > 0, "Method should be parsed");
@@ -127,18 +390,1755 @@ int test_parser_handles_method_parsing(void) {
 
     ASSERT_TRUE(fdn_string_is_eq(req->method, expected_method_name), "Method name mismatch.");
     
-    free(req);
     return 1;
 }
 
 int test_parser_handles_id_parsing(void) {
     const char *input = "{\"id\": 10 }";
-    RequestMessage *req = parser_parse_request_message(input);
+    RequestMessage *req = parser_parse_request_message(&test_arena, input);
     ASSERT_NOT_NULL(req, "Parser returned NULL on valid input");
 
     ASSERT_TRUE(req->id == 10, "Request message ID mismatch.");
 
-    free(req);
+    return 1;
+}
+
+int test_transport_frames_messages(void) {
+    int fds[2];
+    ASSERT_TRUE(pipe(fds) == 0, "pipe() failed");
+
+    // Two messages in one chunk; the second one is bigger than the initial
+    // buffer and uses lower case header names.
+    const char *input =
+        "Content-Length: 2\r\n\r\n{}"
+        "content-type: application/vscode-jsonrpc; charset=utf-8\r\n"
+        "content-length: 39\r\n\r\n"
+        "{\"method\":\"initialized\",\"params\":[1,2]}";
+    ssize_t input_len = (ssize_t)strlen(input);
+    ASSERT_TRUE(write(fds[1], input, (size_t)input_len) == input_len, "write() failed");
+    close(fds[1]);
+
+    lsp_transport transport;
+    ASSERT_TRUE(lsp_transport_init(&transport, fds[0], -1, 16), "Transport init failed");
+
+    fdn_string body;
+    ASSERT_TRUE(lsp_transport_read_message(&transport, &body) == LSP_TRANSPORT_OK, "First message");
+    ASSERT_TRUE(fdn_string_is_eq_c_str(body, "{}"), "First body mismatch");
+    ASSERT_TRUE(body.string_start[body.string_length] == '\0', "Body should be null-terminated");
+
+    ASSERT_TRUE(lsp_transport_read_message(&transport, &body) == LSP_TRANSPORT_OK, "Second message");
+    ASSERT_TRUE(fdn_string_is_eq_c_str(body, "{\"method\":\"initialized\",\"params\":[1,2]}"),
+                "Second body mismatch");
+
+    ASSERT_TRUE(lsp_transport_read_message(&transport, &body) == LSP_TRANSPORT_EOF, "Expected EOF");
+
+    lsp_transport_free(&transport);
+    close(fds[0]);
+    return 1;
+}
+
+int test_transport_reports_queued_messages(void) {
+    int fds[2];
+    ASSERT_TRUE(pipe(fds) == 0, "pipe() failed");
+
+    const char *first = "Content-Length: 2\r\n\r\n{}Content-Length: 5\r\n\r\n[";
+    ASSERT_TRUE(write(fds[1], first, strlen(first)) == (ssize_t)strlen(first), "write() failed");
+
+    lsp_transport transport;
+    ASSERT_TRUE(lsp_transport_init(&transport, fds[0], -1, 64), "Transport init failed");
+
+    fdn_string body;
+    ASSERT_TRUE(lsp_transport_message_ready(&transport), "A whole message was sent");
+    ASSERT_TRUE(lsp_transport_read_message(&transport, &body) == LSP_TRANSPORT_OK, "First message");
+    ASSERT_TRUE(!lsp_transport_message_ready(&transport), "The second message is incomplete");
+
+    ASSERT_TRUE(write(fds[1], "1,2]", 4) == 4, "write() failed");
+    ASSERT_TRUE(lsp_transport_message_ready(&transport), "The second message was completed");
+    ASSERT_TRUE(lsp_transport_read_message(&transport, &body) == LSP_TRANSPORT_OK, "Second message");
+    ASSERT_TRUE(fdn_string_is_eq_c_str(body, "[1,2]"), "Second body mismatch");
+    ASSERT_TRUE(!lsp_transport_message_ready(&transport), "Nothing is queued");
+
+    // The end of the stream does not block either.
+    close(fds[1]);
+    ASSERT_TRUE(lsp_transport_message_ready(&transport), "The end of the stream should be ready");
+    ASSERT_TRUE(lsp_transport_read_message(&transport, &body) == LSP_TRANSPORT_EOF, "Expected EOF");
+
+    lsp_transport_free(&transport);
+    close(fds[0]);
+    return 1;
+}
+
+int test_parser_tape_walks_nested_params(void) {
+    const char *input =
+        "{\"textDocument\":{\"uri\":\"file:///a.sol\",\"version\":7},"
+        "\"contentChanges\":[{\"range\":{\"start\":{\"line\":3,\"character\":1},"
+        "\"end\":{\"line\":3,\"character\":2}},\"text\":\"x\"},"
+        "{\"text\":\"full\",\"flags\":[true,false,null]}]}";
+
+    JsonTape tape;
+    ASSERT_TRUE(parser_parse_tape(&test_arena, fdn_string_create_view(input, strlen(input)), &tape),
+                "Tape parsing failed");
+    ASSERT_TRUE(json_tape_type(&tape, 0) == JSON_OBJECT, "Root should be an object");
+    ASSERT_TRUE(tape.entries[0].next == tape.count, "Root should span the whole tape");
+
+    uint32_t text_document = json_tape_object_get(&tape, 0, "textDocument");
+    uint32_t uri = json_tape_object_get(&tape, text_document, "uri");
+    ASSERT_TRUE(fdn_string_is_eq_c_str(json_tape_get_string(&tape, uri), "file:///a.sol"), "URI mismatch");
+
+    int64_t version = 0;
+    ASSERT_TRUE(json_tape_get_int64(&tape, json_tape_object_get(&tape, text_document, "version"), &version),
+                "Version should be an integer");
+    ASSERT_TRUE(version == 7, "Version mismatch");
+
+    uint32_t changes = json_tape_object_get(&tape, 0, "contentChanges");
+    ASSERT_TRUE(tape.entries[changes].size == 2, "Expected two content changes");
+
+    uint32_t range = json_tape_object_get(&tape, json_tape_array_get(&tape, changes, 0), "range");
+    uint32_t line = json_tape_object_get(&tape, json_tape_object_get(&tape, range, "end"), "line");
+    int64_t line_value = 0;
+    ASSERT_TRUE(json_tape_get_int64(&tape, line, &line_value) && line_value == 3, "Line mismatch");
+
+    uint32_t second = json_tape_array_get(&tape, changes, 1);
+    ASSERT_TRUE(json_tape_object_get(&tape, second, "range") == JSON_TAPE_NONE, "Second change has no range");
+    uint32_t flags = json_tape_object_get(&tape, second, "flags");
+    ASSERT_TRUE(json_tape_type(&tape, json_tape_array_get(&tape, flags, 2)) == JSON_NULL, "Expected null");
+    ASSERT_TRUE(json_tape_array_get(&tape, changes, 2) == JSON_TAPE_NONE, "Out of bounds element");
+
+    // A dense array has far more values than the initial tape guess.
+    char *dense = fdn_arena_alloc(&test_arena, 2 * 500 + 2);
+    dense[0] = '[';
+    for (int i = 0; i < 500; i++) {
+        dense[1 + 2 * i] = '1';
+        dense[2 + 2 * i] = i == 499 ? ']' : ',';
+    }
+    dense[1001] = '\0';
+    ASSERT_TRUE(parser_parse_tape(&test_arena, fdn_string_create_view(dense, 1001), &tape), "Dense array");
+    ASSERT_TRUE(tape.count == 501 && tape.entries[0].size == 500, "Dense array size mismatch");
+
+    return 1;
+}
+
+int test_parser_tape_rejects_invalid_json(void) {
+    const char *inputs[] = {
+        "{\"a\":1,}", "[1 2]", "{\"a\" 1}", "{\"a\":\"unterminated}", "[tru]", "{1:2}",
+    };
+
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        JsonTape tape;
+        fdn_string json = fdn_string_create_view(inputs[i], strlen(inputs[i]));
+        ASSERT_TRUE(!parser_parse_tape(&test_arena, json, &tape), inputs[i]);
+    }
+
+    return 1;
+}
+
+int test_parser_find_paths_in_one_pass(void) {
+    const char *input =
+        "{\"skipped\":{\"nested\":[\"}]\\\"\",{\"a\":[1,2,{}]}]},"
+        "\"textDocument\":{\"uri\":\"file:///a.sol\"},"
+        "\"position\":{\"line\":12,\"character\":4},"
+        "\"contentChanges\":[{\"text\":\"a\"},{\"text\":\"b\"}]}";
+
+    const char *path_strings[] = {
+        "textDocument.uri", "position.line", "position", "contentChanges.1.text", "missing.key",
+    };
+    enum { PATH_COUNT = sizeof(path_strings) / sizeof(path_strings[0]) };
+
+    JsonPath paths[PATH_COUNT];
+    for (int i = 0; i < PATH_COUNT; i++) {
+        ASSERT_TRUE(json_path_compile(path_strings[i], &paths[i]), "Path compilation failed");
+    }
+
+    JsonValue values[PATH_COUNT];
+    ASSERT_TRUE(parser_find_paths(fdn_string_create_view(input, strlen(input)), paths, PATH_COUNT, values),
+                "Path lookup failed");
+
+    ASSERT_TRUE(values[0].found && values[0].type == JSON_STRING, "URI not found");
+    ASSERT_TRUE(fdn_string_is_eq_c_str(values[0].literal, "file:///a.sol"), "URI mismatch");
+    ASSERT_TRUE(values[1].found && fdn_string_is_eq_c_str(values[1].literal, "12"), "Line mismatch");
+    ASSERT_TRUE(values[2].type == JSON_OBJECT &&
+                fdn_string_is_eq_c_str(values[2].literal, "{\"line\":12,\"character\":4}"),
+                "Position object mismatch");
+    ASSERT_TRUE(values[3].found && fdn_string_is_eq_c_str(values[3].literal, "b"), "Array index mismatch");
+    ASSERT_TRUE(!values[4].found, "Missing path should not be found");
+
+    int64_t line = 0;
+    ASSERT_TRUE(json_value_get_int64(&values[1], &line) && line == 12, "Line should read as an integer");
+    ASSERT_TRUE(!json_value_get_int64(&values[0], &line), "A string is not an integer");
+    ASSERT_TRUE(!json_value_get_int64(&values[4], &line), "A missing value is not an integer");
+
+    JsonPath bad;
+    ASSERT_TRUE(!json_path_compile("a..b", &bad), "Empty segment should be rejected");
+
+    return 1;
+}
+
+int test_parser_skips_params_of_request(void) {
+    const char *input =
+        "{\"jsonrpc\":\"2.0\",\"params\":{\"text\":\"{[\\\"\",\"list\":[true,null]},"
+        "\"id\":3,\"method\":\"textDocument/hover\"}";
+    RequestMessage *req = parser_parse_request_message(&test_arena, input);
+    ASSERT_NOT_NULL(req, "Parser returned NULL on valid input");
+    ASSERT_TRUE(req->id == 3, "Request message ID mismatch.");
+    ASSERT_TRUE(fdn_string_is_eq_c_str(req->params, "{\"text\":\"{[\\\"\",\"list\":[true,null]}"),
+                "Params view mismatch");
+    ASSERT_TRUE(fdn_string_is_eq_c_str(req->method, "textDocument/hover"), "Method mismatch");
+
+    return 1;
+}
+
+int test_writer_builds_nested_json(void) {
+    JsonWriter writer;
+    ASSERT_TRUE(json_writer_init(&writer, 8), "Writer init failed"); // Forces growth.
+
+    json_writer_begin_object(&writer);
+    json_writer_key(&writer, "id");
+    json_writer_int(&writer, -42);
+    json_writer_key(&writer, "items");
+    json_writer_begin_array(&writer);
+    json_writer_string_c(&writer, "quote\" slash\\ nl\n ctl\x01");
+    json_writer_begin_object(&writer);
+    json_writer_end_object(&writer);
+    json_writer_bool(&writer, true);
+    json_writer_null(&writer);
+    json_writer_raw(&writer, fdn_string_create_view("[1]", 3));
+    json_writer_end_array(&writer);
+    json_writer_key(&writer, "max");
+    json_writer_int(&writer, INT64_MIN);
+    json_writer_end_object(&writer);
+
+    const char *expected =
+        "{\"id\":-42,\"items\":[\"quote\\\" slash\\\\ nl\\n ctl\\u0001\",{},true,null,[1]],"
+        "\"max\":-9223372036854775808}";
+    ASSERT_TRUE(!json_writer_failed(&writer), "Writer failed");
+    ASSERT_TRUE(fdn_string_is_eq_c_str(json_writer_output(&writer), expected), "Writer output mismatch");
+
+    // The buffer is reused after a reset.
+    json_writer_reset(&writer);
+    json_writer_null(&writer);
+    ASSERT_TRUE(fdn_string_is_eq_c_str(json_writer_output(&writer), "null"), "Output after reset mismatch");
+
+    json_writer_free(&writer);
+    return 1;
+}
+
+int test_transport_writes_framed_messages(void) {
+    int fds[2];
+    ASSERT_TRUE(pipe(fds) == 0, "pipe() failed");
+
+    lsp_transport writer;
+    lsp_transport reader;
+    ASSERT_TRUE(lsp_transport_init(&writer, -1, fds[1], 16), "Writer init failed");
+    ASSERT_TRUE(lsp_transport_init(&reader, fds[0], -1, 64), "Reader init failed");
+
+    const char *body = "{\"jsonrpc\":\"2.0\",\"id\":1,\"result\":null}";
+    ASSERT_TRUE(lsp_transport_write_message(&writer, fdn_string_create_view(body, strlen(body))) ==
+                LSP_TRANSPORT_OK, "Write failed");
+    close(fds[1]);
+
+    fdn_string read_body;
+    ASSERT_TRUE(lsp_transport_read_message(&reader, &read_body) == LSP_TRANSPORT_OK, "Read failed");
+    ASSERT_TRUE(fdn_string_is_eq_c_str(read_body, body), "Round trip mismatch");
+
+    lsp_transport_free(&writer);
+    lsp_transport_free(&reader);
+    close(fds[0]);
+    return 1;
+}
+
+int test_logger_writes_queued_lines_in_order(void) {
+    FILE *file = tmpfile();
+    ASSERT_NOT_NULL(file, "tmpfile() failed");
+    ASSERT_TRUE(fdn_log_init(file), "Log writer did not start");
+
+    // Once idle, the writer parks; a line wakes it up without the shutdown.
+    struct timespec pause = {0, 20 * 1000 * 1000};
+    nanosleep(&pause, NULL);
+    fdn_info("line %d", 0);
+    struct stat info = {0};
+    for (int wait = 0; wait < 1000 && info.st_size == 0; wait++) {
+        pause.tv_nsec = 1000 * 1000;
+        nanosleep(&pause, NULL);
+        ASSERT_TRUE(fstat(fileno(file), &info) == 0, "fstat() failed");
+    }
+    ASSERT_TRUE(info.st_size > 0, "The parked writer should wake up for a line");
+
+    for (int i = 1; i < 100; i++) {
+        fdn_info("line %d", i);
+    }
+
+    // A payload much bigger than a slot is cut, not written in full.
+    char *payload = fdn_arena_alloc(&test_arena, 10000);
+    memset(payload, 'x', 9999);
+    payload[9999] = '\0';
+    fdn_error("payload: %s", payload);
+
+    fdn_log_shutdown();
+
+    char line[FDN_LOG_SLOT_SIZE + 16];
+    int count = 0;
+    rewind(file);
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (count < 100) {
+            char expected[32];
+            snprintf(expected, sizeof(expected), "line %d\n", count);
+            ASSERT_TRUE(strstr(line, expected) != NULL, "Lines out of order");
+            ASSERT_TRUE(strncmp(line, "[INFO]", 6) == 0, "Missing level");
+        } else {
+            ASSERT_TRUE(strlen(line) < FDN_LOG_SLOT_SIZE, "Payload was not truncated");
+            ASSERT_TRUE(strstr(line, "[truncated]") != NULL, "Missing truncation marker");
+        }
+        count++;
+    }
+
+    ASSERT_TRUE(count == 101, "Expected 101 lines");
+    ASSERT_TRUE(fdn_log_dropped() == 0, "No line should have been dropped");
+    return 1;
+}
+
+int test_dispatcher_lookup_uses_exact_methods(void) {
+    ASSERT_TRUE(dispatcher_init(&test_arena), "Dispatcher init failed");
+
+    for (int i = 0; dispatch_table[i].handler != NULL; i++) {
+        ASSERT_TRUE(dispatch_lookup(dispatch_table[i].method) == &dispatch_table[i], "Method not found");
+    }
+
+    // Misses, including prefixes of registered methods.
+    const char *unknown[] = {"", "initialized", "init", "exit2", "textDocument/hover"};
+    for (size_t i = 0; i < sizeof(unknown) / sizeof(unknown[0]); i++) {
+        ASSERT_NULL(dispatch_lookup(fdn_string_create_view(unknown[i], strlen(unknown[i]))), unknown[i]);
+    }
+
+    return 1;
+}
+
+int test_lexer_decodes_utf8(void) {
+    // A snowman outside of a string is one illegal token three bytes wide.
+    const char *input = "[\"\xC3\xA9\", \xE2\x98\x83]";
+    Lexer lexer = lexer_new(input);
+
+    ASSERT_TOKEN(TOKEN_LBRACKET, lexer_next_token(&lexer).type);
+    Token string = lexer_next_token(&lexer);
+    ASSERT_TOKEN(TOKEN_STRING, string.type);
+    ASSERT_TRUE(string.literal_length == 4, "String should span the two byte character");
+    ASSERT_TOKEN(TOKEN_COMMA, lexer_next_token(&lexer).type);
+
+    Token illegal = lexer_next_token(&lexer);
+    ASSERT_TOKEN(TOKEN_ILLEGAL, illegal.type);
+    ASSERT_TRUE(illegal.literal_length == 3, "Illegal token should cover the whole character");
+    ASSERT_TOKEN(TOKEN_RBRACKET, lexer_next_token(&lexer).type);
+    ASSERT_TOKEN(TOKEN_EOF, lexer_next_token(&lexer).type);
+    return 1;
+}
+
+static bool unescape_c_str(const char *escaped, char *output, size_t *length) {
+    return json_string_unescape(fdn_string_create_view(escaped, strlen(escaped)), output, length);
+}
+
+int test_json_string_unescape_decodes_escapes(void) {
+    char output[64];
+    size_t length = 0;
+
+    ASSERT_TRUE(unescape_c_str("a\\\"b\\n\\t\\\\\\/\\u0041\\u00e9", output, &length), "Valid escapes rejected");
+    ASSERT_TRUE(length == 10 && memcmp(output, "a\"b\n\t\\/A\xC3\xA9", 10) == 0, "Wrong decoding");
+
+    ASSERT_TRUE(unescape_c_str("\\ud83d\\ude00", output, &length), "Surrogate pair rejected");
+    ASSERT_TRUE(length == 4 && memcmp(output, "\xF0\x9F\x98\x80", 4) == 0, "Wrong surrogate pair decoding");
+
+    const char *invalid[] = {"\\ud83d", "\\ude00", "\\x", "\\u12", "tail\\", "\xC3\x28", "\xC0\xAF", "\xED\xA0\x80"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        ASSERT_TRUE(!unescape_c_str(invalid[i], output, &length), invalid[i]);
+    }
+
+    // Round trip a long string through the writer, unescaping it in place.
+    // Escapes and multi-byte characters land at every offset of the blocks.
+    char original[1000];
+    const char *pieces[] = {"abcdefg", "\"", "\\", "\n", "\xC3\xA9", "\xF0\x9F\x98\x80", "\x01"};
+    size_t original_length = 0;
+    for (size_t i = 0; original_length < sizeof(original) - 8; i++) {
+        const char *piece = pieces[(i * 7 + i / 3) % 7];
+        memcpy(original + original_length, piece, strlen(piece));
+        original_length += strlen(piece);
+    }
+
+    JsonWriter writer;
+    ASSERT_TRUE(json_writer_init(&writer, 64), "Writer init failed");
+    json_writer_string(&writer, fdn_string_create_view(original, original_length));
+    ASSERT_TRUE(writer.length > original_length, "Nothing was escaped");
+
+    // Strip the quotation marks and decode over the escaped text itself.
+    fdn_string escaped = fdn_string_create_view(writer.buffer + 1, writer.length - 2);
+    ASSERT_TRUE(json_string_unescape(escaped, writer.buffer + 1, &length), "Round trip rejected");
+    ASSERT_TRUE(length == original_length && memcmp(writer.buffer + 1, original, length) == 0, "Round trip mismatch");
+
+    json_writer_free(&writer);
+    return 1;
+}
+
+// position_of converts a byte offset of a UTF-8 `text` to a position.
+static lsp_position position_of(const char *text, size_t offset) {
+    lsp_position position = {0, 0};
+    for (size_t i = 0; i < offset; i++) {
+        unsigned char ch = (unsigned char)text[i];
+        if (ch == '\n') {
+            position.line++;
+            position.character = 0;
+        } else if ((ch & 0xC0) != 0x80) {
+            position.character += ch >= 0xF0 ? 2 : 1; // Continuation bytes don't count.
+        }
+    }
+    return position;
+}
+
+// boundary_before moves `offset` back to a place an editor can point at: the
+// start of a character, and not between "\r" and "\n".
+static size_t boundary_before(const char *text, size_t offset) {
+    while (offset > 0 && ((unsigned char)text[offset] & 0xC0) == 0x80) {
+        offset--;
+    }
+    if (offset > 0 && text[offset] == '\n' && text[offset - 1] == '\r') {
+        offset--;
+    }
+    return offset;
+}
+
+// document_matches_text checks the text and every line of the line index.
+static bool document_matches_text(lsp_document *document, const char *expected, size_t length) {
+    fdn_string text = lsp_document_text(document, &test_arena);
+    if (text.string_length != length || memcmp(text.string_start, expected, length) != 0) {
+        return false;
+    }
+
+    uint32_t line = 0;
+    bool non_ascii = false;
+    for (size_t i = 0; i <= length; i++) {
+        if (i == length || expected[i] == '\n') {
+            uint8_t flags = line_flags(document, line);
+            if (non_ascii != ((flags & LSP_LINE_NON_ASCII) != 0) ||
+                (i < length && (i > 0 && expected[i - 1] == '\r') != ((flags & LSP_LINE_CRLF) != 0))) {
+                return false;
+            }
+            line++;
+            non_ascii = false;
+            if (i < length && line_start(document, line) != i + 1) {
+                return false;
+            }
+        } else if ((unsigned char)expected[i] >= 0x80) {
+            non_ascii = true;
+        }
+    }
+
+    return lsp_document_line_count(document) == line;
+}
+
+int test_documents_apply_incremental_edits(void) {
+    lsp_document_store store;
+    ASSERT_TRUE(lsp_document_store_init(&store), "Store init failed");
+
+    fdn_string uri = FDN_STRING_LITERAL("file:///a.sol");
+    const char *initial = "contract A {\n  uint x;\n}\n";
+    lsp_document *document = lsp_document_open(&store, uri, 1, fdn_string_create_view(initial, strlen(initial)));
+    ASSERT_NOT_NULL(document, "Open failed");
+    ASSERT_TRUE(lsp_document_find(&store, uri) == document, "Document not found");
+
+    // Replay random edits against a plain string and compare.
+    char *expected = malloc(1 << 16);
+    size_t expected_length = strlen(initial);
+    memcpy(expected, initial, expected_length);
+
+    const char *inserts[] = {"", "a", "\n", "foo\nbar", "function f() {}\n", "\r\n", "\xC3\xA9", "\xF0\x9F\x98\x80x\n"};
+    const size_t insert_count = sizeof(inserts) / sizeof(inserts[0]);
+    uint32_t seed = 12345;
+    for (int i = 0; i < 3000; i++) {
+        expected[expected_length] = '\0';
+
+        seed = seed * 1103515245u + 12345u;
+        size_t from = boundary_before(expected, (seed >> 8) % (expected_length + 1));
+        seed = seed * 1103515245u + 12345u;
+        size_t to = from + (seed >> 8) % 4;
+        to = boundary_before(expected, to > expected_length ? expected_length : to);
+        if (to < from) {
+            to = from;
+        }
+        const char *insert = inserts[(seed >> 4) % insert_count];
+        size_t insert_length = strlen(insert);
+        if (expected_length + insert_length >= (1 << 16) - 1) {
+            insert_length = 0;
+        }
+
+        lsp_position start = position_of(expected, from);
+        lsp_position end = position_of(expected, to);
+        ASSERT_TRUE(lsp_document_offset_at(document, start) == from, "Position to offset mismatch");
+        lsp_position back = lsp_document_position_at(document, (uint32_t)from);
+        ASSERT_TRUE(back.line == start.line && back.character == start.character, "Offset to position mismatch");
+
+        ASSERT_TRUE(lsp_document_replace_range(document, start, end, fdn_string_create_view(insert, insert_length)),
+                    "Edit failed");
+
+        memmove(expected + from + insert_length, expected + to, expected_length - to);
+        memcpy(expected + from, insert, insert_length);
+        expected_length += insert_length - (to - from);
+
+        if (i % 100 == 0 || i == 2999) {
+            ASSERT_TRUE(document_matches_text(document, expected, expected_length), "Document diverged from the reference");
+        }
+    }
+    free(expected);
+
+    lsp_document_close(&store, uri);
+    ASSERT_NULL(lsp_document_find(&store, uri), "Document still open");
+
+    // Empty texts may come without any bytes behind them.
+    document = lsp_document_open(&store, uri, 2, (fdn_string){NULL, 0});
+    ASSERT_NOT_NULL(document, "Opening an empty document failed");
+    ASSERT_TRUE(lsp_document_length(document) == 0, "The document should be empty");
+    ASSERT_TRUE(lsp_document_replace_all(document, (fdn_string){NULL, 0}), "Clearing the document failed");
+
+    lsp_document_store_free(&store);
+    return 1;
+}
+
+int test_documents_map_utf16_positions(void) {
+    lsp_document_store store;
+    ASSERT_TRUE(lsp_document_store_init(&store), "Store init failed");
+
+    // Characters are UTF-16 code units: "é" is one, "😀" two.
+    const char *text = "ascii\r\n"
+                       "a\xC3\xA9\xF0\x9F\x98\x80" "b\n"
+                       "last";
+    lsp_document *document = lsp_document_open(&store, fdn_string_create_view("file:///u.sol", 13), 1,
+                                               fdn_string_create_view(text, strlen(text)));
+    ASSERT_NOT_NULL(document, "Open failed");
+    ASSERT_TRUE(lsp_document_line_count(document) == 3, "Wrong line count");
+
+    ASSERT_TRUE(line_flags(document, 0) == LSP_LINE_CRLF, "First line should be ASCII with CRLF");
+    ASSERT_TRUE(line_flags(document, 1) == LSP_LINE_NON_ASCII, "Second line should be non-ASCII");
+    ASSERT_TRUE(lsp_document_offset_at(document, (lsp_position){0, 99}) == 5, "Not clamped before the CRLF");
+
+    ASSERT_TRUE(lsp_document_offset_at(document, (lsp_position){1, 2}) == 10, "Wrong offset after two byte character");
+    ASSERT_TRUE(lsp_document_offset_at(document, (lsp_position){1, 4}) == 14, "Wrong offset after surrogate pair");
+    ASSERT_TRUE(lsp_document_offset_at(document, (lsp_position){1, 99}) == 15, "Not clamped to the line");
+    ASSERT_TRUE(lsp_document_offset_at(document, (lsp_position){2, 2}) == 18, "Wrong offset on the last line");
+    ASSERT_TRUE(lsp_document_offset_at(document, (lsp_position){7, 0}) == strlen(text), "Not clamped to the end");
+
+    lsp_position position = lsp_document_position_at(document, 14);
+    ASSERT_TRUE(position.line == 1 && position.character == 4, "Wrong position after surrogate pair");
+    position = lsp_document_position_at(document, 12);
+    ASSERT_TRUE(position.line == 1 && position.character == 2, "Inside a character should round down");
+
+    // Removing the only non-ASCII characters makes the line ASCII again.
+    ASSERT_TRUE(lsp_document_replace_range(document, (lsp_position){1, 1}, (lsp_position){1, 4}, fdn_string_create_view("", 0)),
+                "Edit failed");
+    ASSERT_TRUE(line_flags(document, 1) == 0, "Line flags were not updated");
+    ASSERT_TRUE(lsp_document_offset_at(document, (lsp_position){2, 0}) == 10, "Following lines not shifted");
+
+    lsp_document_store_free(&store);
+    return 1;
+}
+
+int test_dispatcher_syncs_documents(void) {
+    ASSERT_TRUE(dispatcher_init(&test_arena), "Dispatcher init failed");
+    lsp_context context;
+    ASSERT_TRUE(lsp_context_init(&context, &test_arena, NULL, NULL), "Context init failed");
+
+    const char *open_params =
+        "{\"textDocument\":{\"uri\":\"file:///b.sol\",\"languageId\":\"solidity\",\"version\":1,"
+        "\"text\":\"contract B {\\n}\\n\"}}";
+    const char *change_params =
+        "{\"textDocument\":{\"uri\":\"file:///b.sol\",\"version\":2},\"contentChanges\":["
+        "{\"range\":{\"start\":{\"line\":0,\"character\":12},\"end\":{\"line\":0,\"character\":12}},"
+        "\"text\":\"\\n  uint \\\"x\\\";\"},"
+        "{\"range\":{\"start\":{\"line\":1,\"character\":2},\"end\":{\"line\":1,\"character\":6}},"
+        "\"text\":\"int\"}]}";
+    const char *close_params = "{\"textDocument\":{\"uri\":\"file:///b.sol\"}}";
+
+    dispatch_message(&context, fdn_string_create_view("textDocument/didOpen", 20), false, 0,
+                     fdn_string_create_view(open_params, strlen(open_params)));
+    dispatch_message(&context, fdn_string_create_view("textDocument/didChange", 22), false, 0,
+                     fdn_string_create_view(change_params, strlen(change_params)));
+
+    fdn_string uri = fdn_string_create_view("file:///b.sol", 13);
+    lsp_document *document = lsp_document_find(&g_documents, uri);
+    ASSERT_NOT_NULL(document, "Document was not opened");
+    ASSERT_TRUE(document->version == 2, "Version not updated");
+    ASSERT_TRUE(fdn_string_is_eq_c_str(lsp_document_text(document, &test_arena), "contract B {\n  int \"x\";\n}\n"),
+                "Edits not applied");
+
+    // Both changes, and the open before them, are parsed in a single update
+    // once the server is idle.
+    dispatch_stats before = *dispatcher_stats();
+    ASSERT_TRUE(document->syntax_pending == 3, "The syntax should wait for the server to be idle");
+    dispatcher_sync();
+    ASSERT_TRUE(document->syntax_pending == 0, "The syntax should be up to date");
+    ASSERT_TRUE(dispatcher_stats()->syntax_updates == before.syntax_updates + 1, "Edits should be coalesced");
+    ASSERT_TRUE(document->syntax.nodes.count == 3, "Expected a contract with a variable");
+
+    dispatch_message(&context, fdn_string_create_view("textDocument/didClose", 21), false, 0,
+                     fdn_string_create_view(close_params, strlen(close_params)));
+    ASSERT_NULL(lsp_document_find(&g_documents, uri), "Document not closed");
+    lsp_context_free(&context);
+    return 1;
+}
+
+// The last message a context sent, and how many it sent.
+typedef struct {
+    char body[512];
+    int count;
+} SentMessages;
+
+static bool test_send(void *sender, fdn_string body) {
+    SentMessages *sent = sender;
+    snprintf(sent->body, sizeof(sent->body), "%.*s", (int)body.string_length, body.string_start);
+    sent->count++;
+    return true;
+}
+
+// A handler that gives up without an answer.
+static lsp_status test_failing_handler(lsp_context *context, int32_t id, fdn_string params) {
+    (void)context;
+    (void)id;
+    (void)params;
+    return LSP_STATUS_CONTINUE;
+}
+
+int test_dispatcher_answers_unknown_and_cancelled_requests(void) {
+    ASSERT_TRUE(dispatcher_init(&test_arena), "Dispatcher init failed");
+    SentMessages sent = {{0}, 0};
+    lsp_context context;
+    ASSERT_TRUE(lsp_context_init(&context, &test_arena, test_send, &sent), "Context init failed");
+
+    // Unknown notifications are ignored; unknown requests are errors.
+    dispatch_message(&context, fdn_string_create_view("$/setTrace", 10), false, 0, fdn_string_create_view("{}", 2));
+    ASSERT_TRUE(sent.count == 0, "A notification should not be answered");
+    dispatch_message(&context, fdn_string_create_view("textDocument/hover", 18), true, 4,
+                     fdn_string_create_view("{}", 2));
+    ASSERT_TRUE(sent.count == 1, "The request should be answered");
+    ASSERT_TRUE(strstr(sent.body, "\"id\":4,\"error\":{\"code\":-32601,") != NULL, "Expected MethodNotFound");
+
+    // So are requests whose params make no sense.
+    dispatch_message(&context, fdn_string_create_view("textDocument/completion", 23), true, 7,
+                     fdn_string_create_view("{\"bogus\":1}", 11));
+    ASSERT_TRUE(sent.count == 2, "Invalid params should be answered");
+    ASSERT_TRUE(strstr(sent.body, "\"id\":7,\"error\":{\"code\":-32602,") != NULL, "Expected InvalidParams");
+    dispatch_message(&context, fdn_string_create_view("workspace/symbol", 16), true, 8,
+                     fdn_string_create_view("{\"query\":1}", 11));
+    ASSERT_TRUE(sent.count == 3 && strstr(sent.body, "\"id\":8,\"error\":{\"code\":-32602,") != NULL,
+                "Expected InvalidParams for the query");
+    dispatch_message(&context, fdn_string_create_view("textDocument/references", 23), true, 9,
+                     fdn_string_create_view("{\"textDocument\":", 16));
+    ASSERT_TRUE(sent.count == 4 && strstr(sent.body, "\"id\":9,\"error\":{\"code\":-32602,") != NULL,
+                "Expected InvalidParams for broken JSON");
+
+    // A request cancelled before it runs is answered with the reason, and the
+    // handler never sees it.
+    int32_t cancelled = LSP_ERROR_CONTENT_MODIFIED;
+    context.cancelled = &cancelled;
+    const char *params = "{\"textDocument\":{\"uri\":\"file:///none.sol\"},\"position\":{\"line\":0,\"character\":0}}";
+    dispatch_message(&context, fdn_string_create_view("textDocument/completion", 23), true, 5,
+                     fdn_string_create_view(params, strlen(params)));
+    ASSERT_TRUE(sent.count == 5, "The cancelled request should be answered once");
+    ASSERT_TRUE(strstr(sent.body, "\"id\":5,\"error\":{\"code\":-32801,") != NULL, "Expected ContentModified");
+
+    // Once answered, a late cancellation changes nothing.
+    context.cancelled = NULL;
+    dispatch_message(&context, fdn_string_create_view("textDocument/completion", 23), true, 6,
+                     fdn_string_create_view(params, strlen(params)));
+    ASSERT_TRUE(sent.count == 6 && strstr(sent.body, "\"id\":6,\"result\":") != NULL, "Expected a result");
+
+    // A request its handler left unanswered still gets an error.
+    const dispatch_entry *entry = dispatch_lookup(fdn_string_create_view("textDocument/completion", 23));
+    lsp_handler_fn handler = entry->handler;
+    dispatch_table[entry - dispatch_table].handler = test_failing_handler;
+    dispatch_message(&context, entry->method, true, 10, fdn_string_create_view(params, strlen(params)));
+    dispatch_table[entry - dispatch_table].handler = handler;
+    ASSERT_TRUE(sent.count == 7 && strstr(sent.body, "\"id\":10,\"error\":{\"code\":-32603,") != NULL,
+                "Expected InternalError");
+
+    lsp_context_free(&context);
+    return 1;
+}
+
+// Frames the `body` of a message into the file `fd`.
+static bool server_test_write(int fd, const char *body) {
+    char header[64];
+    int length = snprintf(header, sizeof(header), "Content-Length: %zu\r\n\r\n", strlen(body));
+    return write(fd, header, (size_t)length) == length && write(fd, body, strlen(body)) == (ssize_t)strlen(body);
+}
+
+int test_server_answers_requests_from_workers(void) {
+    ASSERT_TRUE(dispatcher_init(&test_arena), "Dispatcher init failed");
+
+    int input[2];
+    int output[2];
+    ASSERT_TRUE(pipe(input) == 0 && pipe(output) == 0, "pipe() failed");
+
+    // The whole session is written up front; the requests reach the workers
+    // while the reader goes on.
+    const char *open_message =
+        "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"textDocument\":"
+        "{\"uri\":\"file:///s.sol\",\"languageId\":\"solidity\",\"version\":1,"
+        "\"text\":\"contract S {\\n  uint total;\\n  function f() public { total = 1; }\\n}\\n\"}}}";
+    ASSERT_TRUE(server_test_write(input[1], open_message), "Write failed");
+    for (int id = 1; id <= 8; id++) {
+        char body[256];
+        snprintf(body, sizeof(body),
+                 "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"%s\",\"params\":{\"textDocument\":"
+                 "{\"uri\":\"file:///s.sol\"},\"position\":{\"line\":2,\"character\":26}}}",
+                 id, id % 2 == 0 ? "textDocument/references" : "textDocument/completion");
+        ASSERT_TRUE(server_test_write(input[1], body), "Write failed");
+        if (id == 4) {
+            // Cancelled or superseded, whether they are still queued, running or
+            // answered already.
+            ASSERT_TRUE(server_test_write(input[1], "{\"jsonrpc\":\"2.0\",\"method\":\"$/cancelRequest\","
+                                                    "\"params\":{\"id\":3}}"),
+                        "Write failed");
+            ASSERT_TRUE(server_test_write(input[1], "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\","
+                                                    "\"params\":{\"textDocument\":{\"uri\":\"file:///s.sol\","
+                                                    "\"version\":2},\"contentChanges\":[{\"text\":\"contract S {}\"}]}}"),
+                        "Write failed");
+        }
+    }
+    ASSERT_TRUE(server_test_write(input[1], "{\"jsonrpc\":\"2.0\",\"id\":9,\"method\":\"shutdown\"}"),
+                "Write failed");
+    ASSERT_TRUE(server_test_write(input[1], "{\"jsonrpc\":\"2.0\",\"method\":\"exit\"}"), "Write failed");
+    close(input[1]);
+
+    lsp_transport transport;
+    ASSERT_TRUE(lsp_transport_init(&transport, input[0], output[1], 4096), "Transport init failed");
+    lsp_server server;
+    ASSERT_TRUE(lsp_server_init(&server, &transport, 4), "Server init failed");
+    ASSERT_TRUE(server.worker_count == 4, "Expected four workers");
+    ASSERT_TRUE(lsp_server_run(&server) == 0, "The exit notification should end the run");
+    lsp_server_free(&server);
+    lsp_transport_free(&transport);
+    close(output[1]);
+
+    // Every request is answered once, whole, in whatever order the workers
+    // finished them, with a result or with the reason it was cancelled.
+    lsp_transport reader;
+    ASSERT_TRUE(lsp_transport_init(&reader, output[0], -1, 4096), "Reader init failed");
+    int answered[10] = {0};
+    fdn_string body;
+    while (lsp_transport_read_message(&reader, &body) == LSP_TRANSPORT_OK) {
+        RequestMessage *response = parser_parse_request_message(&test_arena, body.string_start);
+        ASSERT_NOT_NULL(response, "A response should be valid JSON");
+        ASSERT_TRUE(response->has_id && response->id >= 1 && response->id <= 9, "Unexpected response");
+        answered[response->id]++;
+    }
+    for (int id = 1; id <= 9; id++) {
+        ASSERT_TRUE(answered[id] == 1, "Every request should be answered once");
+    }
+
+    lsp_transport_free(&reader);
+    close(input[0]);
+    close(output[0]);
+    dispatcher_free();
+    return 1;
+}
+
+int test_server_cancels_jobs_by_decoded_uri(void) {
+    lsp_server server;
+    memset(&server, 0, sizeof(server));
+    pthread_mutex_init(&server.jobs_lock, NULL);
+    ASSERT_TRUE(fdn_queue_init(&server.jobs, 4), "Queue init failed");
+
+    const char *body = "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"textDocument/references\",\"params\":"
+                       "{\"textDocument\":{\"uri\":\"file:\\/\\/\\/a\\u0040b.sol\"}}}";
+    RequestMessage *request = parser_parse_request_message(&test_arena, body);
+    ASSERT_NOT_NULL(request, "Parse failed");
+    ASSERT_TRUE(server_queue_job(&server, fdn_string_create_view(body, strlen(body)), request), "Queue failed");
+    lsp_server_job *job = server.jobs_in_flight;
+    ASSERT_TRUE(fdn_string_is_eq_c_str(job->uri, "file:///a@b.sol"), "The URI of the job should be decoded");
+
+    // The edit escapes the URI differently, or not at all.
+    server_cancel(&server, true, 0, fdn_string_create_view("file:///a@c.sol", 15), LSP_ERROR_CONTENT_MODIFIED);
+    ASSERT_TRUE(job->cancelled == 0, "Another document should not cancel the job");
+    server_cancel(&server, true, 0, fdn_string_create_view("file:///a@b.sol", 15), LSP_ERROR_CONTENT_MODIFIED);
+    ASSERT_TRUE(job->cancelled == LSP_ERROR_CONTENT_MODIFIED, "The same document should cancel the job");
+
+    void *item;
+    ASSERT_TRUE(fdn_queue_try_pop(&server.jobs, &item) && item == job, "The job should be queued");
+    server_unlist(&server, job);
+    free(job);
+    fdn_queue_free(&server.jobs);
+    pthread_mutex_destroy(&server.jobs_lock);
+    return 1;
+}
+
+int test_solidity_lexer_tokens(void) {
+    const char *input =
+        "// SPDX-License-Identifier: MIT\n"
+        "pragma solidity ^0.8.20;\n"
+        "/* Block\n comment */\n"
+        "contract Vault is Ownable {\n"
+        "    mapping(address => uint256) public balances;\n"
+        "    function f(bytes32 h) external { x >>= 2 ** 8; y >>>= 1e18; emit E(.5, 1_000 ether); }\n"
+        "}\n";
+    SolTokenType expected[] = {
+        // "0.8.20" is the number 0.8 followed by .20, as for solc.
+        SOL_TOKEN_PRAGMA, SOL_TOKEN_IDENTIFIER, SOL_TOKEN_BIT_XOR, SOL_TOKEN_NUMBER, SOL_TOKEN_NUMBER,
+        SOL_TOKEN_SEMICOLON,
+        SOL_TOKEN_CONTRACT, SOL_TOKEN_IDENTIFIER, SOL_TOKEN_IS, SOL_TOKEN_IDENTIFIER, SOL_TOKEN_LBRACE,
+        SOL_TOKEN_MAPPING, SOL_TOKEN_LPAREN, SOL_TOKEN_ELEMENTARY_TYPE, SOL_TOKEN_ARROW,
+        SOL_TOKEN_ELEMENTARY_TYPE, SOL_TOKEN_RPAREN, SOL_TOKEN_PUBLIC, SOL_TOKEN_IDENTIFIER, SOL_TOKEN_SEMICOLON,
+        SOL_TOKEN_FUNCTION, SOL_TOKEN_IDENTIFIER, SOL_TOKEN_LPAREN, SOL_TOKEN_ELEMENTARY_TYPE,
+        SOL_TOKEN_IDENTIFIER, SOL_TOKEN_RPAREN, SOL_TOKEN_EXTERNAL, SOL_TOKEN_LBRACE,
+        SOL_TOKEN_IDENTIFIER, SOL_TOKEN_SAR_ASSIGN, SOL_TOKEN_NUMBER, SOL_TOKEN_EXP, SOL_TOKEN_NUMBER, SOL_TOKEN_SEMICOLON,
+        SOL_TOKEN_IDENTIFIER, SOL_TOKEN_SHR_ASSIGN, SOL_TOKEN_NUMBER, SOL_TOKEN_SEMICOLON,
+        SOL_TOKEN_EMIT, SOL_TOKEN_IDENTIFIER, SOL_TOKEN_LPAREN, SOL_TOKEN_NUMBER, SOL_TOKEN_COMMA,
+        SOL_TOKEN_NUMBER, SOL_TOKEN_UNIT, SOL_TOKEN_RPAREN, SOL_TOKEN_SEMICOLON, SOL_TOKEN_RBRACE,
+        SOL_TOKEN_RBRACE, SOL_TOKEN_EOF,
+    };
+
+    SolLexer lexer = sol_lexer_new(input);
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        ASSERT_SOL_TOKEN(expected[i], sol_lexer_next_token(&lexer).type);
+    }
+
+    // Literals are views into the source.
+    lexer = sol_lexer_new("1e18 0x1F_ff 2.5e-3 'it\\'s' hex\"00ff\" unicode\"\xE2\x98\x83\"");
+    const char *literals[] = {"1e18", "0x1F_ff", "2.5e-3", "'it\\'s'", "hex\"00ff\"", "unicode\"\xE2\x98\x83\""};
+    SolTokenType types[] = {SOL_TOKEN_NUMBER, SOL_TOKEN_NUMBER, SOL_TOKEN_NUMBER, SOL_TOKEN_STRING,
+                            SOL_TOKEN_HEX_STRING, SOL_TOKEN_UNICODE_STRING};
+    for (size_t i = 0; i < sizeof(literals) / sizeof(literals[0]); i++) {
+        SolToken token = sol_lexer_next_token(&lexer);
+        ASSERT_SOL_TOKEN(types[i], token.type);
+        ASSERT_TRUE(token.literal_length == strlen(literals[i]) &&
+                        memcmp(token.literal_start, literals[i], token.literal_length) == 0,
+                    literals[i]);
+    }
+
+    // Unterminated strings and comments are illegal up to the end.
+    lexer = sol_lexer_new("x \"open\ny");
+    ASSERT_SOL_TOKEN(SOL_TOKEN_IDENTIFIER, sol_lexer_next_token(&lexer).type);
+    ASSERT_SOL_TOKEN(SOL_TOKEN_ILLEGAL, sol_lexer_next_token(&lexer).type);
+    ASSERT_SOL_TOKEN(SOL_TOKEN_IDENTIFIER, sol_lexer_next_token(&lexer).type);
+    lexer = sol_lexer_new("x /* open");
+    ASSERT_SOL_TOKEN(SOL_TOKEN_IDENTIFIER, sol_lexer_next_token(&lexer).type);
+    SolToken comment = sol_lexer_next_token(&lexer);
+    ASSERT_SOL_TOKEN(SOL_TOKEN_ILLEGAL, comment.type);
+    ASSERT_TRUE(comment.literal_length == 7, "Illegal token should span the rest of the input");
+    ASSERT_SOL_TOKEN(SOL_TOKEN_EOF, sol_lexer_next_token(&lexer).type);
+    return 1;
+}
+
+int test_solidity_lexer_recognizes_keywords(void) {
+    const char *types[] = {"uint", "uint8", "uint256", "int128", "bytes", "bytes1", "bytes32", "address", "bool", "string"};
+    const char *identifiers[] = {"uint7", "uint257", "int0", "bytes0", "bytes33", "Uint8", "error", "from",
+                                 "contracts", "constructor_", "_contract", "$", "unchecked1"};
+
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        SolLexer lexer = sol_lexer_new(types[i]);
+        SolToken token = sol_lexer_next_token(&lexer);
+        ASSERT_SOL_TOKEN(SOL_TOKEN_ELEMENTARY_TYPE, token.type);
+        ASSERT_TRUE(token.literal_length == strlen(types[i]), types[i]);
+    }
+    for (size_t i = 0; i < sizeof(identifiers) / sizeof(identifiers[0]); i++) {
+        SolLexer lexer = sol_lexer_new(identifiers[i]);
+        ASSERT_SOL_TOKEN(SOL_TOKEN_IDENTIFIER, sol_lexer_next_token(&lexer).type);
+    }
+
+    // Every keyword maps to its own token type.
+    for (int type = SOL_TOKEN_ABSTRACT; type <= SOL_TOKEN_WHILE; type++) {
+        const char *keyword = sol_token_type_str((SolTokenType)type);
+        SolLexer lexer = sol_lexer_new(keyword);
+        ASSERT_SOL_TOKEN((SolTokenType)type, sol_lexer_next_token(&lexer).type);
+    }
+    return 1;
+}
+
+int test_solidity_parser_builds_tree(void) {
+    const char *source =
+        "pragma solidity ^0.8.20;\n"
+        "import {IERC20} from \"./IERC20.sol\";\n"
+        "error Unauthorized(address caller);\n"
+        "abstract contract Vault is Ownable(msg.sender) {\n"
+        "    using SafeERC20 for IERC20;\n"
+        "    struct Position { uint256 shares; }\n"
+        "    mapping(address => Position) public positions;\n"
+        "    event Deposit(address indexed owner, uint256 assets);\n"
+        "    modifier onlyOwner() { _; }\n"
+        "    function deposit(uint256 assets) external onlyOwner returns (uint256) {\n"
+        "        Position storage position = positions[msg.sender];\n"
+        "        if (assets == 0) revert Unauthorized(msg.sender); else { position.shares += assets; }\n"
+        "        for (uint256 i = 0; i < 3; i++) { unchecked { ++i; } }\n"
+        "        try token.transfer{value: 1}(Params({to: a})) returns (bool ok) { emit Deposit(msg.sender, assets); } catch Error(string memory) { }\n"
+        "        assembly (\"memory-safe\") { let x := mload(0x40) }\n"
+        "        return assets;\n"
+        "    }\n"
+        "    function total() external view returns (uint256);\n"
+        "}\n";
+    SolNodeKind expected[] = {
+        SOL_NODE_SOURCE_UNIT, SOL_NODE_PRAGMA, SOL_NODE_IMPORT, SOL_NODE_ERROR, SOL_NODE_CONTRACT,
+        SOL_NODE_USING, SOL_NODE_STRUCT, SOL_NODE_VARIABLE, SOL_NODE_EVENT,
+        SOL_NODE_MODIFIER, SOL_NODE_BLOCK, SOL_NODE_EXPRESSION,
+        SOL_NODE_FUNCTION, SOL_NODE_BLOCK, SOL_NODE_LOCAL_VARIABLE,
+        SOL_NODE_IF, SOL_NODE_EXPRESSION, SOL_NODE_BLOCK, SOL_NODE_EXPRESSION,
+        SOL_NODE_FOR, SOL_NODE_BLOCK, SOL_NODE_UNCHECKED, SOL_NODE_BLOCK, SOL_NODE_EXPRESSION,
+        SOL_NODE_TRY, SOL_NODE_BLOCK, SOL_NODE_EMIT, SOL_NODE_CATCH, SOL_NODE_BLOCK,
+        SOL_NODE_ASSEMBLY, SOL_NODE_RETURN,
+        SOL_NODE_FUNCTION,
+    };
+    const size_t expected_count = sizeof(expected) / sizeof(expected[0]);
+
+    fdn_string string = fdn_string_create_view(source, strlen(source));
+    SolText text = sol_text_from_string(&string);
+    SolSyntax syntax;
+    sol_syntax_init(&syntax);
+    ASSERT_TRUE(sol_syntax_rebuild(&syntax, &text), "Rebuild failed");
+
+    ASSERT_TRUE(syntax.nodes.count == expected_count, "Wrong number of nodes");
+    for (size_t i = 0; i < expected_count; i++) {
+        ASSERT_TRUE(syntax.nodes.kinds[i] == expected[i], sol_node_kind_str(expected[i]));
+    }
+
+    // The contract's children are its members, and it ends at its "}".
+    const SolNodeList *nodes = &syntax.nodes;
+    ASSERT_TRUE(nodes->token_ends[0] == syntax.tokens.count, "Source unit should cover every token");
+    ASSERT_TRUE(nodes->token_ends[4] == syntax.tokens.count, "Contract should end at its brace");
+    uint32_t members = 0;
+    for (uint32_t child = 5; child < sol_node_next_sibling(nodes, 4); child = sol_node_next_sibling(nodes, child)) {
+        members++;
+    }
+    ASSERT_TRUE(members == 7, "Contract should have seven members");
+
+    // Tokens are views into the source.
+    fdn_string name = sol_token_text(&syntax.tokens, &string, nodes->token_starts[12] + 1);
+    ASSERT_TRUE(fdn_string_is_eq_c_str(name, "deposit"), "Function name should be a view of the source");
+    ASSERT_TRUE(name.string_start == strstr(source, "deposit("), "Token text should not be copied");
+
+    sol_syntax_free(&syntax);
+    return 1;
+}
+
+static bool syntax_is_eq(const SolSyntax *a, const SolSyntax *b) {
+    const SolTokenList *x = &a->tokens;
+    const SolTokenList *y = &b->tokens;
+    return x->count == y->count && a->nodes.count == b->nodes.count &&
+           memcmp(x->types, y->types, x->count) == 0 &&
+           memcmp(x->starts, y->starts, x->count * sizeof(uint32_t)) == 0 &&
+           memcmp(x->lengths, y->lengths, x->count * sizeof(uint32_t)) == 0 &&
+           memcmp(a->nodes.kinds, b->nodes.kinds, a->nodes.count) == 0 &&
+           memcmp(a->nodes.token_starts, b->nodes.token_starts, a->nodes.count * sizeof(uint32_t)) == 0 &&
+           memcmp(a->nodes.token_ends, b->nodes.token_ends, a->nodes.count * sizeof(uint32_t)) == 0 &&
+           memcmp(a->nodes.descendants, b->nodes.descendants, a->nodes.count * sizeof(uint32_t)) == 0;
+}
+
+int test_solidity_syntax_follows_edits(void) {
+    lsp_document_store store;
+    ASSERT_TRUE(lsp_document_store_init(&store), "Store init failed");
+
+    fdn_string uri = FDN_STRING_LITERAL("file:///Token.sol");
+    const char *initial =
+        "// SPDX-License-Identifier: MIT\n"
+        "pragma solidity ^0.8.20;\n"
+        "contract Token {\n"
+        "    uint256 private _totalSupply; /* supply */\n"
+        "    mapping(address => uint256) private _balances;\n"
+        "    function totalSupply() external view returns (uint256) {\n"
+        "        return _totalSupply;\n"
+        "    }\n"
+        "    function transfer(address to, uint256 amount) external returns (bool) {\n"
+        "        uint256 balance = _balances[msg.sender];\n"
+        "        if (balance < amount) { revert(\"balance\"); }\n"
+        "        unchecked { _balances[msg.sender] = balance - amount; }\n"
+        "        _balances[to] += amount * 1e18;\n"
+        "        return true;\n"
+        "    }\n"
+        "}\n";
+    lsp_document *document = lsp_document_open(&store, uri, 1, fdn_string_create_view(initial, strlen(initial)));
+    ASSERT_NOT_NULL(document, "Open failed");
+    ASSERT_TRUE(lsp_document_syntax(document)->nodes.count > 0, "The syntax should be built when first needed");
+
+    // Typing inside of a function body re-lexes the token and reparses the
+    // statement alone.
+    const char *body = strstr(initial, "return _totalSupply");
+    lsp_position position = position_of(initial, (size_t)(body - initial) + 8);
+    ASSERT_TRUE(lsp_document_replace_range(document, position, position, fdn_string_create_view("x", 1)), "Edit failed");
+    const SolSyntax *syntax = lsp_document_syntax(document);
+    ASSERT_TRUE(syntax->tokens_lexed <= 2, "Only the tokens around the edit should be lexed");
+    ASSERT_TRUE(syntax->nodes_parsed == 1, "Only the statement should be parsed");
+
+    // Replay random edits and compare with a syntax built from scratch, after
+    // one to four edits merged into a single update.
+    char *expected = malloc(1 << 16);
+    fdn_string text = lsp_document_text(document, &test_arena);
+    size_t expected_length = text.string_length;
+    memcpy(expected, text.string_start, expected_length);
+
+    const char *inserts[] = {"", "x", " ", "\n", "{", "}", "(", ")", ";", "/*", "*/", "//", "\"", "'", "1e", "-5",
+                             ".", "function g() {", "if (a) { b; } else c;", "contract C {", "uint256 y = 1;"};
+    const size_t insert_count = sizeof(inserts) / sizeof(inserts[0]);
+    SolSyntax reference;
+    sol_syntax_init(&reference);
+    uint32_t seed = 4242;
+    for (int i = 0; i < 2000; i++) {
+        expected[expected_length] = '\0';
+
+        seed = seed * 1103515245u + 12345u;
+        size_t from = (seed >> 8) % (expected_length + 1);
+        seed = seed * 1103515245u + 12345u;
+        size_t to = from + (seed >> 8) % 5;
+        to = to > expected_length ? expected_length : to;
+        const char *insert = inserts[(seed >> 4) % insert_count];
+        size_t insert_length = strlen(insert);
+        if (expected_length + insert_length >= (1 << 16) - 1) {
+            insert_length = 0;
+        }
+
+        ASSERT_TRUE(lsp_document_replace_range(document, position_of(expected, from), position_of(expected, to),
+                                               fdn_string_create_view(insert, insert_length)),
+                    "Edit failed");
+        memmove(expected + from + insert_length, expected + to, expected_length - to);
+        memcpy(expected + from, insert, insert_length);
+        expected_length += insert_length - (to - from);
+        if ((seed >> 12) % 4 != 0) {
+            continue;
+        }
+
+        fdn_string current = fdn_string_create_view(expected, expected_length);
+        SolText current_text = sol_text_from_string(&current);
+        ASSERT_TRUE(sol_syntax_rebuild(&reference, &current_text), "Rebuild failed");
+        ASSERT_TRUE(syntax_is_eq(lsp_document_syntax(document), &reference),
+                    "Incremental syntax diverged from a rebuild");
+    }
+
+    sol_syntax_free(&reference);
+    free(expected);
+    lsp_document_store_free(&store);
+    return 1;
+}
+
+int test_workspace_converts_uris_to_paths(void) {
+    fdn_string path;
+    ASSERT_TRUE(lsp_uri_to_path(&test_arena, fdn_string_create_view("file:///home/dev/My%20Vault/src", 31), &path),
+                "Conversion failed");
+    ASSERT_TRUE(fdn_string_is_eq_c_str(path, "/home/dev/My Vault/src"), "Escapes should be decoded");
+    ASSERT_TRUE(path.string_start[path.string_length] == '\0', "Path should be null-terminated");
+
+    ASSERT_TRUE(!lsp_uri_to_path(&test_arena, fdn_string_create_view("https://x/y", 11), &path),
+                "Only file URIs are paths");
+    ASSERT_TRUE(!lsp_uri_to_path(&test_arena, fdn_string_create_view("file:///a%2", 11), &path),
+                "Truncated escapes are malformed");
+    return 1;
+}
+
+static bool write_file(const char *directory, const char *name, const char *contents, size_t length) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool written = fwrite(contents, 1, length, file) == length;
+    return fclose(file) == 0 && written;
+}
+
+// Removes the `path` and, when it is a directory, everything below it.
+static void remove_tree(const char *path) {
+    DIR *handle = opendir(path);
+    if (handle != NULL) {
+        struct dirent *entry;
+        char child[512];
+        while ((entry = readdir(handle)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+                remove_tree(child);
+            }
+        }
+        closedir(handle);
+    }
+    remove(path);
+}
+
+static int workspace_indexes_solidity_files_in(const char *root) {
+    const char *directories[] = {"src", "lib", "lib/forge-std", "node_modules", "node_modules/oz", ".git"};
+    char path[512];
+    for (size_t i = 0; i < sizeof(directories) / sizeof(directories[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, directories[i]);
+        ASSERT_TRUE(mkdir(path, 0700) == 0, "mkdir() failed");
+    }
+
+    // A file that fills whole pages cannot be null-terminated by its mapping.
+    const char *contract = "contract Vault { function f() external {} }\n";
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    char *page = malloc(page_size);
+    memset(page, ' ', page_size);
+    memcpy(page, contract, strlen(contract));
+
+    ASSERT_TRUE(write_file(root, "src/Vault.sol", contract, strlen(contract)), "Write failed");
+    ASSERT_TRUE(write_file(root, "src/Page.sol", page, page_size), "Write failed");
+    ASSERT_TRUE(write_file(root, "src/Empty.sol", "", 0), "Write failed");
+    ASSERT_TRUE(write_file(root, "src/notes.md", contract, strlen(contract)), "Write failed");
+    ASSERT_TRUE(write_file(root, "lib/forge-std/Test.sol", contract, strlen(contract)), "Write failed");
+    ASSERT_TRUE(write_file(root, "node_modules/oz/ERC20.sol", contract, strlen(contract)), "Write failed");
+    ASSERT_TRUE(write_file(root, ".git/Hidden.sol", contract, strlen(contract)), "Write failed");
+    free(page);
+
+    // The nested folder is only indexed once.
+    snprintf(path, sizeof(path), "%s/src", root);
+    fdn_string folders[] = {fdn_string_create_view(path, strlen(path)), fdn_string_create_view(root, strlen(root))};
+    lsp_workspace workspace;
+    lsp_workspace_init(&workspace);
+    ASSERT_TRUE(lsp_workspace_start(&workspace, folders, 2, 3, NULL), "Start failed");
+    lsp_workspace_wait(&workspace);
+    ASSERT_TRUE(lsp_workspace_is_done(&workspace), "Indexing should be done");
+
+    ASSERT_TRUE(workspace.file_count == 5, "Expected the five Solidity files outside of .git");
+    ASSERT_TRUE(workspace.files_indexed == 5, "Every file should be indexed");
+    for (uint32_t i = 0; i < workspace.file_count; i++) {
+        const lsp_workspace_file *file = &workspace.files[i];
+        ASSERT_TRUE(file->indexed, file->path);
+        bool empty = strstr(file->path, "Empty.sol") != NULL;
+        ASSERT_TRUE(file->syntax.nodes.count == (empty ? 1u : 4u), file->path);
+        ASSERT_TRUE(empty || file->syntax.nodes.kinds[1] == SOL_NODE_CONTRACT, file->path);
+    }
+    lsp_workspace_free(&workspace);
+    return 1;
+}
+
+int test_workspace_indexes_solidity_files(void) {
+    char root[] = "/tmp/solbot-workspace-XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(root), "mkdtemp() failed");
+    int passed = workspace_indexes_solidity_files_in(root);
+    remove_tree(root);
+    return passed;
+}
+
+// Indexes the `root` with the cache at `cache_path` and returns how many files
+// came from the cache.
+static uint32_t index_with_cache(lsp_workspace *workspace, const char *root, const char *cache_path) {
+    fdn_string folder = fdn_string_create_view(root, strlen(root));
+    lsp_workspace_init(workspace);
+    if (!lsp_workspace_start(workspace, &folder, 1, 2, cache_path)) {
+        return UINT32_MAX;
+    }
+    lsp_workspace_wait(workspace);
+    return workspace->files_reused;
+}
+
+// Tells whether the syntax of the `file` is the one a parse of it produces.
+static bool syntax_matches_build(const lsp_workspace_file *file) {
+    SolSyntax expected;
+    sol_syntax_init(&expected);
+    bool matches = sol_syntax_build(&expected, file->source.string_start);
+
+    const SolTokenList *tokens = &file->syntax.tokens;
+    const SolNodeList *nodes = &file->syntax.nodes;
+    matches = matches && tokens->count == expected.tokens.count && nodes->count == expected.nodes.count;
+    for (uint32_t i = 0; matches && i < tokens->count; i++) {
+        matches = tokens->types[i] == expected.tokens.types[i] && tokens->starts[i] == expected.tokens.starts[i] &&
+                  tokens->lengths[i] == expected.tokens.lengths[i];
+    }
+    for (uint32_t i = 0; matches && i < nodes->count; i++) {
+        matches = nodes->kinds[i] == expected.nodes.kinds[i] &&
+                  nodes->token_starts[i] == expected.nodes.token_starts[i] &&
+                  nodes->token_ends[i] == expected.nodes.token_ends[i] &&
+                  nodes->descendants[i] == expected.nodes.descendants[i];
+    }
+
+    sol_syntax_free(&expected);
+    return matches;
+}
+
+static int workspace_reuses_the_index_cache_in(const char *root) {
+    const char *vault = "contract Vault {\n  uint256 total;\n  function f() external { total += 1; }\n}\n";
+    const char *math = "library Math { function min(uint a, uint b) internal pure returns (uint) {} }\n";
+    ASSERT_TRUE(write_file(root, "Vault.sol", vault, strlen(vault)), "Write failed");
+    ASSERT_TRUE(write_file(root, "Math.sol", math, strlen(math)), "Write failed");
+    ASSERT_TRUE(write_file(root, "Empty.sol", "", 0), "Write failed");
+
+    // The directories of the cache are created as needed.
+    char cache_path[512];
+    char path[512];
+    snprintf(cache_path, sizeof(cache_path), "%s/.cache/solbot/index.bin", root);
+
+    lsp_workspace workspace;
+    ASSERT_TRUE(index_with_cache(&workspace, root, cache_path) == 0, "Nothing should be cached yet");
+    ASSERT_TRUE(workspace.files_indexed == 3, "Every file should be indexed");
+    lsp_workspace_free(&workspace);
+    struct stat info;
+    ASSERT_TRUE(stat(cache_path, &info) == 0, "The cache should be written");
+
+    // The cached syntax is the one a parse produces.
+    ASSERT_TRUE(index_with_cache(&workspace, root, cache_path) == 3, "Every file should come from the cache");
+    for (uint32_t i = 0; i < workspace.file_count; i++) {
+        ASSERT_TRUE(workspace.files[i].cached, workspace.files[i].path);
+        ASSERT_TRUE(syntax_matches_build(&workspace.files[i]), workspace.files[i].path);
+    }
+    lsp_workspace_free(&workspace);
+
+    // An edited file is parsed again.
+    const char *edited = "library Math { function max(uint a, uint b) internal pure returns (uint) {} }\n"
+                         "library More {}\n";
+    ASSERT_TRUE(write_file(root, "Math.sol", edited, strlen(edited)), "Write failed");
+    ASSERT_TRUE(index_with_cache(&workspace, root, cache_path) == 2, "Only the edited file should be parsed");
+    lsp_workspace_free(&workspace);
+
+    // A touched file whose contents are the same is not.
+    snprintf(path, sizeof(path), "%s/Vault.sol", root);
+    struct timespec times[2] = {{1000000000, 0}, {1000000000, 0}};
+    ASSERT_TRUE(utimensat(AT_FDCWD, path, times, 0) == 0, "utimensat() failed");
+    ASSERT_TRUE(index_with_cache(&workspace, root, cache_path) == 3, "The contents should be matched by hash");
+    for (uint32_t i = 0; i < workspace.file_count; i++) {
+        ASSERT_TRUE(syntax_matches_build(&workspace.files[i]), workspace.files[i].path);
+    }
+    lsp_workspace_free(&workspace);
+
+    // A damaged cache is ignored and replaced.
+    ASSERT_TRUE(truncate(cache_path, 40) == 0, "truncate() failed");
+    ASSERT_TRUE(index_with_cache(&workspace, root, cache_path) == 0, "A truncated cache should be ignored");
+    lsp_workspace_free(&workspace);
+    ASSERT_TRUE(index_with_cache(&workspace, root, cache_path) == 3, "The cache should be rewritten");
+    lsp_workspace_free(&workspace);
+
+    // An entry whose tree points past its tokens is dropped, and the rest kept.
+    lsp_cache cache;
+    snprintf(path, sizeof(path), "%s/Vault.sol", root);
+    ASSERT_TRUE(lsp_cache_open(&cache, cache_path), "Open failed");
+    const lsp_cache_entry *entry = lsp_cache_find(&cache, path);
+    ASSERT_NOT_NULL(entry, "Vault.sol should be cached");
+    off_t token_end = (off_t)(entry->nodes + entry->node_count * sizeof(uint32_t));
+    lsp_cache_close(&cache);
+    int fd = open(cache_path, O_WRONLY);
+    uint32_t damaged = UINT32_MAX;
+    bool written = fd >= 0 && pwrite(fd, &damaged, sizeof(damaged), token_end) == sizeof(damaged);
+    ASSERT_TRUE(fd >= 0 && close(fd) == 0 && written, "Damaging the cache failed");
+    ASSERT_TRUE(lsp_cache_open(&cache, cache_path), "A damaged entry should not drop the cache");
+    ASSERT_TRUE(cache.file_count == 2 && lsp_cache_find(&cache, path) == NULL, "Only Vault.sol should be dropped");
+    lsp_cache_close(&cache);
+    ASSERT_TRUE(index_with_cache(&workspace, root, cache_path) == 2, "Vault.sol should be parsed again");
+    lsp_workspace_free(&workspace);
+    ASSERT_TRUE(index_with_cache(&workspace, root, cache_path) == 3, "The cache should be rewritten");
+    lsp_workspace_free(&workspace);
+    return 1;
+}
+
+int test_workspace_reuses_the_index_cache(void) {
+    char root[] = "/tmp/solbot-cache-XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(root), "mkdtemp() failed");
+    int passed = workspace_reuses_the_index_cache_in(root);
+    remove_tree(root);
+    return passed;
+}
+
+int test_symbols_collects_declarations(void) {
+    const char *source =
+        "error Unauthorized();\n"
+        "library Math { function max(uint a) internal pure returns (uint) {} }\n"
+        "contract Vault {\n"
+        "    struct Position { uint256 shares; }\n"
+        "    event Deposit(address owner);\n"
+        "    /* \xc3\xa9 */ modifier onlyOwner() { _; }\n"
+        "    constructor() {}\n"
+        "    function deposit(uint256 assets) external { uint256 local = assets; }\n"
+        "}\n";
+    SolSyntax syntax;
+    sol_syntax_init(&syntax);
+    ASSERT_TRUE(sol_syntax_build(&syntax, source), "Build failed");
+    lsp_declaration_list list = {0};
+    ASSERT_TRUE(lsp_declarations_collect(&syntax, fdn_string_create_view(source, strlen(source)), &list),
+                "Collect failed");
+
+    struct {
+        const char *name;
+        const char *container;
+        uint32_t line;
+        uint32_t character;
+        uint8_t kind;
+    } expected[] = {
+        {"Unauthorized", "", 0, 6, LSP_SYMBOL_OBJECT},
+        {"Math", "", 1, 8, LSP_SYMBOL_MODULE},
+        {"max", "Math", 1, 24, LSP_SYMBOL_METHOD},
+        {"Vault", "", 2, 9, LSP_SYMBOL_CLASS},
+        {"Position", "Vault", 3, 11, LSP_SYMBOL_STRUCT},
+        {"Deposit", "Vault", 4, 10, LSP_SYMBOL_EVENT},
+        {"onlyOwner", "Vault", 5, 21, LSP_SYMBOL_METHOD}, // The "é" is one UTF-16 unit.
+        {"constructor", "Vault", 6, 4, LSP_SYMBOL_CONSTRUCTOR},
+        {"deposit", "Vault", 7, 13, LSP_SYMBOL_METHOD},
+    };
+    ASSERT_TRUE(list.count == sizeof(expected) / sizeof(expected[0]), "Wrong number of declarations");
+    for (uint32_t i = 0; i < list.count; i++) {
+        const lsp_declaration *declaration = &list.items[i];
+        ASSERT_TRUE(fdn_string_is_eq_c_str(declaration->name, expected[i].name), expected[i].name);
+        ASSERT_TRUE(fdn_string_is_eq_c_str(declaration->container, expected[i].container), expected[i].name);
+        ASSERT_TRUE(declaration->line == expected[i].line && declaration->character == expected[i].character,
+                    expected[i].name);
+        ASSERT_TRUE(declaration->kind == expected[i].kind, expected[i].name);
+    }
+
+    lsp_declaration_list_free(&list);
+    sol_syntax_free(&syntax);
+    return 1;
+}
+
+static int32_t score_of(const char *query, const char *name) {
+    return lsp_symbol_score(fdn_string_create_view(query, strlen(query)), fdn_string_create_view(name, strlen(name)));
+}
+
+int test_symbol_index_ranks_fuzzy_matches(void) {
+    // Whole names, then prefixes, substrings at a word, any substrings and
+    // subsequences; case is ignored.
+    ASSERT_TRUE(score_of("owner", "Owner") > score_of("owner", "ownerOf"), "Exact should beat prefix");
+    ASSERT_TRUE(score_of("owner", "ownerOf") > score_of("owner", "getOwner"), "Prefix should beat a word");
+    ASSERT_TRUE(score_of("owner", "max_owner") > score_of("owner", "coowner"), "A word should beat a substring");
+    ASSERT_TRUE(score_of("owner", "coowner") > score_of("owner", "onWanderer"), "A substring should beat a subsequence");
+    ASSERT_TRUE(score_of("tf", "transferFrom") > score_of("tf", "statefulCall"),
+                "Subsequences at word starts should rank first");
+    ASSERT_TRUE(score_of("owner", "own") < 0 && score_of("xyz", "transfer") < 0, "Non-matches should be negative");
+
+    // Enough names that each trigram has a long posting list.
+    fdn_interner names;
+    ASSERT_TRUE(fdn_interner_init(&names), "Interner init failed");
+    const char *words[] = {"transfer", "approve", "owner", "balance", "mint", "burn", "deposit", "withdraw"};
+    uint32_t count = 4096;
+    lsp_symbol *symbols = malloc((count + 2) * sizeof(lsp_symbol));
+    char name[64];
+    for (uint32_t i = 0; i < count; i++) {
+        const char *second = words[(i / 8) % 8];
+        snprintf(name, sizeof(name), "%s%c%sV%u", words[i % 8], second[0] - 'a' + 'A', second + 1, i / 64);
+        lsp_symbol symbol = {fdn_interner_intern(&names, fdn_string_create_view(name, strlen(name))),
+                             FDN_INTERNER_NONE, i, 1, 4, LSP_SYMBOL_FUNCTION};
+        symbols[i] = symbol;
+    }
+    // The same name declared twice is one name with two symbols.
+    for (uint32_t i = 0; i < 2; i++) {
+        lsp_symbol symbol = {fdn_interner_intern(&names, fdn_string_create_view("transferFrom", 12)),
+                             FDN_INTERNER_NONE, count + i, 2, 4, LSP_SYMBOL_FUNCTION};
+        symbols[count + i] = symbol;
+    }
+    lsp_symbol_index index;
+    ASSERT_TRUE(lsp_symbol_index_build(&index, &names, symbols, count + 2), "Build failed");
+    ASSERT_TRUE(index.symbol_count == count + 2 && index.name_count == count + 1, "Names should be grouped");
+
+    fdn_arena arena;
+    ASSERT_TRUE(fdn_arena_init(&arena, 4096), "Arena init failed");
+    lsp_symbol_match matches[16];
+
+    // Found through the trigrams; subsequences only fill the rest of the page.
+    uint32_t found = lsp_symbol_index_search(&index, &arena, fdn_string_create_view("TRANSFERF", 9),
+                                             matches, 16);
+    ASSERT_TRUE(found == 16, "Expected a full page");
+    uint32_t first = matches[0].name;
+    ASSERT_TRUE(fdn_string_is_eq_c_str(fdn_interner_string(&names, index.names[first]), "transferFrom"),
+                "Expected transferFrom");
+    ASSERT_TRUE(matches[1].score < matches[0].score, "The prefix should rank first");
+    ASSERT_TRUE(index.name_starts[first + 1] - index.name_starts[first] == 2, "Both declarations should be kept");
+
+    // Prefixes fill the page, the shortest first and then alphabetically.
+    found = lsp_symbol_index_search(&index, &arena, fdn_string_create_view("ownerbal", 8), matches, 16);
+    ASSERT_TRUE(found == 16, "Expected a full page");
+    for (uint32_t i = 0; i < found; i++) {
+        fdn_string match = fdn_interner_string(&names, index.names[matches[i].name]);
+        ASSERT_TRUE(strncmp(match.string_start, "ownerBalanceV", 13) == 0, match.string_start);
+        ASSERT_TRUE(i == 0 || matches[i].score < matches[i - 1].score ||
+                    (matches[i].score == matches[i - 1].score && matches[i].name > matches[i - 1].name),
+                    "Matches should be sorted");
+    }
+    ASSERT_TRUE(fdn_string_is_eq_c_str(fdn_interner_string(&names, index.names[matches[0].name]), "ownerBalanceV0"),
+                "Expected the shortest name first");
+
+    // Queries that are no substring are found by the scan.
+    found = lsp_symbol_index_search(&index, &arena, fdn_string_create_view("trfrm", 5), matches, 16);
+    ASSERT_TRUE(found > 1 && matches[0].name == first, "The scan should rank transferFrom first");
+    found = lsp_symbol_index_search(&index, &arena, fdn_string_create_view("xyz", 3), matches, 16);
+    ASSERT_TRUE(found == 0, "Nothing should match");
+
+    fdn_arena_free(&arena);
+    lsp_symbol_index_free(&index);
+    fdn_interner_free(&names);
+    return 1;
+}
+
+int test_reference_index_finds_identifiers_across_files(void) {
+    const char *sources[] = {
+        "interface IERC20 { function transfer(address to, uint amount) external; }\n",
+        "contract Vault {\n"
+        "    /* \xc3\xa9 */ IERC20 token;\n"
+        "    function pay(address to) external { token.transfer(to, 1); token.transfer(to, 2); }\n"
+        "}\n",
+    };
+    // Most files in between have no identifiers at all, so the second file is
+    // far from the first.
+    const uint32_t file_count = 300;
+    lsp_reference_list *lists = calloc(file_count, sizeof(lsp_reference_list));
+    fdn_interner names;
+    ASSERT_TRUE(lists != NULL && fdn_interner_init(&names), "Init failed");
+    lsp_reference_cache cache;
+    lsp_reference_cache_init(&cache);
+    SolSyntax syntax[2];
+    for (uint32_t i = 0; i < 2; i++) {
+        sol_syntax_init(&syntax[i]);
+        ASSERT_TRUE(sol_syntax_build(&syntax[i], sources[i]), "Build failed");
+        ASSERT_TRUE(lsp_references_collect(&syntax[i], fdn_string_create_view(sources[i], strlen(sources[i])),
+                                           &names, &cache, &lists[i * (file_count - 1)]),
+                    "Collect failed");
+    }
+    ASSERT_TRUE(lists[0].count == 4 && lists[file_count - 1].count == 11, "Wrong number of identifiers");
+
+    lsp_reference_index index;
+    ASSERT_TRUE(lsp_reference_index_build(&index, fdn_interner_count(&names), lists, file_count), "Build failed");
+    ASSERT_TRUE(index.reference_count == 15, "Every identifier should be indexed");
+
+    uint32_t transfer = fdn_interner_find(&names, fdn_string_create_view("transfer", 8));
+    lsp_reference references[8];
+    ASSERT_TRUE(lsp_reference_index_count(&index, transfer) == 3, "Expected three occurrences");
+    ASSERT_TRUE(lsp_reference_index_find(&index, transfer, references) == 3, "Expected three occurrences");
+    ASSERT_TRUE(references[0].file == 0 && references[0].position.line == 0 &&
+                references[0].position.character == 28, "Wrong declaration");
+    ASSERT_TRUE(references[1].file == file_count - 1 && references[1].position.line == 2 &&
+                references[1].position.character == 46, "Wrong first call");
+    ASSERT_TRUE(references[2].file == file_count - 1 && references[2].position.line == 2 &&
+                references[2].position.character == 69, "Wrong second call");
+    uint32_t token_name = fdn_interner_find(&names, fdn_string_create_view("token", 5));
+    ASSERT_TRUE(lsp_reference_index_find(&index, token_name, references) == 3 &&
+                references[0].position.line == 1 && references[0].position.character == 19,
+                "The accent should be one UTF-16 unit");
+
+    // The skip of 299 files takes two bytes; everything else one.
+    ASSERT_TRUE(index.starts[transfer + 1] - index.starts[transfer] == (1 + 1 + 1) + (2 + 1 + 1) + 1,
+                "The occurrences should be delta-encoded");
+    ASSERT_TRUE(lsp_reference_index_count(&index, FDN_INTERNER_NONE) == 0, "Unknown names have no occurrences");
+
+    // The identifier under the cursor, which may be right after it.
+    uint32_t first_call = (uint32_t)(strstr(sources[1], "transfer") - sources[1]);
+    const SolTokenList *tokens = &syntax[1].tokens;
+    uint32_t token = lsp_identifier_at(&syntax[1], first_call + 3);
+    ASSERT_TRUE(token != LSP_REFERENCE_NONE && tokens->starts[token] == first_call, "Expected transfer");
+    ASSERT_TRUE(lsp_identifier_at(&syntax[1], first_call + 8) == token, "The end should count");
+    ASSERT_TRUE(lsp_identifier_at(&syntax[1], first_call) == token, "The start should count");
+    ASSERT_TRUE(lsp_identifier_at(&syntax[1], 1) == LSP_REFERENCE_NONE, "Keywords are no identifiers");
+
+    lsp_reference_index_free(&index);
+    for (uint32_t i = 0; i < 2; i++) {
+        lsp_reference_list_free(&lists[i * (file_count - 1)]);
+        sol_syntax_free(&syntax[i]);
+    }
+    free(lists);
+    fdn_interner_free(&names);
+    return 1;
+}
+
+static int import_graph_orders_dependents_by_level_in(const char *root) {
+    const char *remappings = "# Foundry\noz/=lib/openzeppelin/contracts/\n";
+    ASSERT_TRUE(write_file(root, "remappings.txt", remappings, strlen(remappings)), "Write failed");
+
+    // Vault and Token import each other; the test imports Vault twice.
+    const char *names[] = {"src/Vault.sol", "src//Token.sol", "lib/openzeppelin/contracts/ERC20.sol",
+                           "lib/forge-std/src/Test.sol", "lib/forge-std/src/Vm.sol",
+                           "node_modules/@scope/pkg/A.sol", "test/Vault.t.sol"};
+    const char *sources[] = {
+        "import \"./Token.sol\";\nimport {Test} from \"forge-std/Test.sol\";\nimport \"oz/ERC20.sol\";\nimport \"../lib/Missing.sol\";\ncontract Vault {}\n",
+        "import * as oz from 'oz/ERC20.sol';\nimport \"src/Vault.sol\";\nimport \"@scope/pkg/A.sol\";\n",
+        "contract ERC20 {}\n",
+        "import \"./Vm.sol\";\n",
+        "interface Vm {}\n",
+        "",
+        "import \"../src/Vault.sol\";\nimport \"../src/Vault.sol\" as V;\n",
+    };
+    enum { FILE_COUNT = 7 };
+    char paths[FILE_COUNT][512];
+    SolSyntax syntax[FILE_COUNT];
+    lsp_import_file files[FILE_COUNT];
+    for (uint32_t i = 0; i < FILE_COUNT; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%s", root, names[i]);
+        sol_syntax_init(&syntax[i]);
+        ASSERT_TRUE(sol_syntax_build(&syntax[i], sources[i]), "Build failed");
+        files[i].path = paths[i];
+        files[i].source = fdn_string_create_view(sources[i], strlen(sources[i]));
+        files[i].syntax = &syntax[i];
+    }
+
+    fdn_string folder = fdn_string_create_view(root, strlen(root));
+    lsp_import_graph graph;
+    ASSERT_TRUE(lsp_import_graph_build(&graph, &folder, 1, files, FILE_COUNT), "Build failed");
+    ASSERT_TRUE(graph.edge_count == 8, "Expected 8 distinct imports");
+    ASSERT_TRUE(graph.unresolved == 1, "Only Missing.sol is outside of the workspace");
+    ASSERT_TRUE(graph.import_starts[1] == 3 && graph.imports[0] == 1 && graph.imports[1] == 3 && graph.imports[2] == 2,
+                "Vault imports Token, then Test through lib/, then ERC20 through the remapping");
+    ASSERT_TRUE(graph.imports[5] == 5, "Token imports A from node_modules");
+
+    // ERC20, Vm and A; Test; the cycle of Vault and Token; the test.
+    uint32_t expected_levels[FILE_COUNT] = {2, 2, 0, 1, 0, 0, 3};
+    ASSERT_TRUE(graph.level_count == 4, "Expected four levels");
+    for (uint32_t i = 0; i < FILE_COUNT; i++) {
+        ASSERT_TRUE(graph.levels[i] == expected_levels[i], names[i]);
+    }
+    ASSERT_TRUE(graph.level_starts[1] == 3 && graph.level_starts[2] == 4 && graph.order[4] == 0 && graph.order[5] == 1,
+                "Files should be ordered by level");
+
+    fdn_arena arena;
+    ASSERT_TRUE(fdn_arena_init(&arena, 4096), "Arena init failed");
+    uint32_t *invalid;
+    uint32_t count = lsp_import_graph_invalidate(&graph, &arena, 4, &invalid);
+    uint32_t expected[] = {4, 3, 0, 1, 6};
+    ASSERT_TRUE(count == 5, "An edit to Vm invalidates everything depending on it");
+    for (uint32_t i = 0; i < count; i++) {
+        ASSERT_TRUE(invalid[i] == expected[i], "Invalidated files should be sorted by level");
+    }
+    ASSERT_TRUE(lsp_import_graph_invalidate(&graph, &arena, 6, &invalid) == 1 && invalid[0] == 6,
+                "Nothing imports the test");
+
+    fdn_string importer = fdn_string_create_view(paths[6], strlen(paths[6]));
+    ASSERT_TRUE(lsp_import_graph_resolve(&graph, &arena, importer, (fdn_string)FDN_STRING_LITERAL("oz/ERC20.sol")) == 2,
+                "Remappings apply to every file of the folder");
+    uint32_t token = lsp_import_at(&syntax[0], 45);
+    ASSERT_TRUE(token != LSP_IMPORT_NONE &&
+                    fdn_string_is_eq_c_str(lsp_import_unquote(sol_token_text(&syntax[0].tokens, &files[0].source, token)),
+                                           "forge-std/Test.sol"),
+                "The cursor is on the second import");
+    ASSERT_TRUE(lsp_import_at(&syntax[0], 64) == LSP_IMPORT_NONE, "The cursor is on the keyword of the third import");
+
+    // The test is edited to import ERC20 instead of Vault.
+    const char *edited = "import \"oz/ERC20.sol\";\n";
+    SolSyntax edited_syntax;
+    sol_syntax_init(&edited_syntax);
+    bool built = sol_syntax_build(&edited_syntax, edited);
+    lsp_import_file edit = {paths[6], fdn_string_create_view(edited, strlen(edited)), &edited_syntax};
+    uint32_t index;
+    bool updated = built && lsp_import_graph_update(&graph, &arena, &edit, &index);
+    sol_syntax_free(&edited_syntax);
+    ASSERT_TRUE(updated && index == 6, "Update failed");
+    ASSERT_TRUE(graph.import_starts[7] - graph.import_starts[6] == 1 && graph.imports[graph.import_starts[6]] == 2,
+                "The test should only import ERC20");
+    ASSERT_TRUE(graph.levels[6] == 1, "The test should move down to the level above ERC20");
+    ASSERT_TRUE(lsp_import_graph_invalidate(&graph, &arena, 4, &invalid) == 4,
+                "An edit to Vm no longer invalidates the test");
+
+    // A file added later is found, and the imports that did not resolve are
+    // tried against it.
+    char missing[512];
+    snprintf(missing, sizeof(missing), "%s/lib/Missing.sol", root);
+    lsp_import_file added = {missing, fdn_string_create_view("", 0), &syntax[5]};
+    ASSERT_TRUE(lsp_import_graph_update(&graph, &arena, &added, &index) && index == FILE_COUNT, "Add failed");
+    ASSERT_TRUE(graph.file_count == FILE_COUNT + 1 && graph.unresolved == 0, "Vault's import should resolve now");
+    count = lsp_import_graph_invalidate(&graph, &arena, FILE_COUNT, &invalid);
+    ASSERT_TRUE(count == 3 && invalid[0] == FILE_COUNT, "An edit to it invalidates Vault and Token");
+    ASSERT_TRUE(lsp_import_graph_resolve(&graph, &arena, fdn_string_create_view(paths[0], strlen(paths[0])),
+                                         (fdn_string)FDN_STRING_LITERAL("../lib/Missing.sol")) == FILE_COUNT,
+                "The new file should resolve");
+
+    // Files outside of the folders, and files that are not Solidity, are not.
+    char notes[512];
+    snprintf(notes, sizeof(notes), "%s/src/notes.md", root);
+    lsp_import_file outside = {"/elsewhere/X.sol", fdn_string_create_view("", 0), &syntax[5]};
+    lsp_import_file other = {notes, fdn_string_create_view("", 0), &syntax[5]};
+    ASSERT_TRUE(lsp_import_graph_update(&graph, &arena, &outside, &index) && index == LSP_IMPORT_NONE &&
+                    lsp_import_graph_update(&graph, &arena, &other, &index) && index == LSP_IMPORT_NONE &&
+                    graph.file_count == FILE_COUNT + 1,
+                "Only Solidity files of the folders should be added");
+
+    fdn_arena_free(&arena);
+    lsp_import_graph_free(&graph);
+    for (uint32_t i = 0; i < FILE_COUNT; i++) {
+        sol_syntax_free(&syntax[i]);
+    }
+    return 1;
+}
+
+int test_import_graph_orders_dependents_by_level(void) {
+    char root[] = "/tmp/solbot-imports-XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(root), "mkdtemp() failed");
+    int passed = import_graph_orders_dependents_by_level_in(root);
+    remove_tree(root);
+    return passed;
+}
+
+static int import_graph_applies_file_remappings_in(const char *root) {
+    const char *remappings = "src/A.sol:@x/=lib/x/\n";
+    ASSERT_TRUE(write_file(root, "remappings.txt", remappings, strlen(remappings)), "Write failed");
+
+    // A and B import the same path from the same directory; only A is remapped.
+    const char *names[] = {"src/A.sol", "src/B.sol", "lib/x/X.sol", "node_modules/@x/X.sol", "src/C.sol"};
+    const char *sources[] = {"import \"@x/X.sol\";\n", "import \"@x/X.sol\";\n", "", "",
+                             "import \"@x/X.sol\";\n"};
+    enum { FILE_COUNT = 5 };
+    char paths[FILE_COUNT][512];
+    SolSyntax syntax[FILE_COUNT];
+    lsp_import_file files[FILE_COUNT];
+    for (uint32_t i = 0; i < FILE_COUNT; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%s", root, names[i]);
+        sol_syntax_init(&syntax[i]);
+        files[i].path = paths[i];
+        files[i].source = fdn_string_create_view(sources[i], strlen(sources[i]));
+        files[i].syntax = &syntax[i];
+    }
+    for (uint32_t i = 0; i < FILE_COUNT; i++) {
+        ASSERT_TRUE(sol_syntax_build(&syntax[i], sources[i]), "Build failed");
+    }
+
+    fdn_string folder = fdn_string_create_view(root, strlen(root));
+    lsp_import_graph graph;
+    ASSERT_TRUE(lsp_import_graph_build(&graph, &folder, 1, files, FILE_COUNT), "Build failed");
+    bool resolved = graph.imports[graph.import_starts[0]] == 2 && graph.imports[graph.import_starts[1]] == 3 &&
+                    graph.imports[graph.import_starts[4]] == 3;
+    lsp_import_graph_free(&graph);
+    for (uint32_t i = 0; i < FILE_COUNT; i++) {
+        sol_syntax_free(&syntax[i]);
+    }
+    ASSERT_TRUE(resolved, "Only A should be remapped to lib/, its siblings should use node_modules/");
+    return 1;
+}
+
+int test_import_graph_applies_file_remappings(void) {
+    char root[] = "/tmp/solbot-remappings-XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(root), "mkdtemp() failed");
+    int passed = import_graph_applies_file_remappings_in(root);
+    remove_tree(root);
+    return passed;
+}
+
+static int dispatcher_syncs_imports_in(const char *root) {
+    ASSERT_TRUE(dispatcher_init(&test_arena), "Dispatcher init failed");
+    lsp_context context;
+    ASSERT_TRUE(lsp_context_init(&context, &test_arena, NULL, NULL), "Context init failed");
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/src", root);
+    ASSERT_TRUE(mkdir(path, 0700) == 0, "mkdir() failed");
+    const char *vault = "import \"./New.sol\";\ncontract Vault {}\n";
+    ASSERT_TRUE(write_file(root, "src/Vault.sol", vault, strlen(vault)), "Write failed");
+    fdn_string folder = fdn_string_create_view(root, strlen(root));
+    ASSERT_TRUE(lsp_workspace_start(&g_workspace, &folder, 1, 1, NULL), "Start failed");
+    lsp_workspace_wait(&g_workspace);
+    const lsp_import_graph *graph = &g_workspace.imports;
+    ASSERT_TRUE(graph->file_count == 1 && graph->unresolved == 1, "New.sol does not exist yet");
+
+    // A file created in the editor enters the graph once the server is idle.
+    char params[1024];
+    snprintf(params, sizeof(params),
+             "{\"textDocument\":{\"uri\":\"file://%s/src/New.sol\",\"languageId\":\"solidity\",\"version\":1,"
+             "\"text\":\"import \\\"./Vault.sol\\\";\\n\"}}",
+             root);
+    dispatch_stats before = *dispatcher_stats();
+    dispatch_message(&context, fdn_string_create_view("textDocument/didOpen", 20), false, 0,
+                     fdn_string_create_view(params, strlen(params)));
+    dispatcher_sync();
+    ASSERT_TRUE(graph->file_count == 2 && graph->unresolved == 0 && graph->edge_count == 2,
+                "Vault and New.sol should import each other");
+    ASSERT_TRUE(dispatcher_stats()->import_updates == before.import_updates + 1 &&
+                    dispatcher_stats()->files_invalidated == before.files_invalidated + 2,
+                "An edit to New.sol invalidates Vault as well");
+
+    // An edit that drops the import drops the edge.
+    snprintf(params, sizeof(params),
+             "{\"textDocument\":{\"uri\":\"file://%s/src/New.sol\",\"version\":2},"
+             "\"contentChanges\":[{\"text\":\"contract New {}\"}]}",
+             root);
+    dispatch_message(&context, fdn_string_create_view("textDocument/didChange", 22), false, 0,
+                     fdn_string_create_view(params, strlen(params)));
+    dispatcher_sync();
+    ASSERT_TRUE(graph->edge_count == 1 && graph->imports[0] == 1, "Only Vault should import New.sol");
+    dispatcher_sync();
+    ASSERT_TRUE(dispatcher_stats()->import_updates == before.import_updates + 2, "Nothing changed since");
+
+    snprintf(params, sizeof(params), "{\"textDocument\":{\"uri\":\"file://%s/src/New.sol\"}}", root);
+    dispatch_message(&context, fdn_string_create_view("textDocument/didClose", 21), false, 0,
+                     fdn_string_create_view(params, strlen(params)));
+    lsp_context_free(&context);
+    return 1;
+}
+
+int test_dispatcher_syncs_imports(void) {
+    char root[] = "/tmp/solbot-sync-XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(root), "mkdtemp() failed");
+    int passed = dispatcher_syncs_imports_in(root);
+    lsp_workspace_free(&g_workspace);
+    remove_tree(root);
+    return passed;
+}
+
+// Completes at the `|` in `source` and returns the labels, comma-separated.
+static const char *complete_at(lsp_document_store *store, fdn_arena *arena, const char *source, uint32_t limit,
+                               lsp_completion_list *list) {
+    static char text[1024];
+    static char labels[4096];
+    const char *cursor = strchr(source, '|');
+    size_t before = (size_t)(cursor - source);
+    snprintf(text, sizeof(text), "%.*s%s", (int)before, source, cursor + 1);
+
+    lsp_position position = {0, 0};
+    for (size_t i = 0; i < before; i++) {
+        position.character++;
+        if (source[i] == '\n') {
+            position.line++;
+            position.character = 0;
+        }
+    }
+    lsp_document *document = lsp_document_open(store, fdn_string_create_view("file:///Vault.sol", 17), 1,
+                                               fdn_string_create_view(text, strlen(text)));
+    labels[0] = '\0';
+    if (document == NULL || !lsp_completion_collect(document, position, arena, limit, list)) {
+        return "<failed>";
+    }
+    size_t length = 0;
+    for (uint32_t i = 0; i < list->count && length < sizeof(labels); i++) {
+        length += (size_t)snprintf(labels + length, sizeof(labels) - length, "%s%.*s", i > 0 ? "," : "",
+                                   (int)list->items[i].label.string_length, list->items[i].label.string_start);
+    }
+    return labels;
+}
+
+// A contract with `statement` typed into a function body.
+#define COMPLETION_VAULT(statement)                                                 \
+    "uint256 constant MAX_FEE = 1;\n"                                                \
+    "contract Other { uint256 otherTotal; function otherThing() external {} }\n"     \
+    "contract Vault {\n"                                                             \
+    "    mapping(address => uint256) private _balances;\n"                           \
+    "    event Deposited(address owner);\n"                                          \
+    "    function deposit(uint256 amount, address to) external {\n"                  \
+    "        uint256 fee = amount / 100;\n"                                          \
+    "        " statement "\n"                                                        \
+    "        uint256 later = 1;\n"                                                   \
+    "    }\n"                                                                        \
+    "}\n"
+
+int test_completion_offers_scope_and_builtins(void) {
+    lsp_document_store store;
+    ASSERT_TRUE(lsp_document_store_init(&store), "Store init failed");
+    fdn_arena arena;
+    ASSERT_TRUE(fdn_arena_init(&arena, 4096), "Arena init failed");
+    lsp_completion_list list;
+
+
+    // Parameters, locals, members and built-ins, but nothing declared later
+    // or in another contract.
+    const char *labels = complete_at(&store, &arena, COMPLETION_VAULT("|"), 500, &list);
+    ASSERT_TRUE(strstr(labels, "amount,") && strstr(labels, ",fee,") && strstr(labels, ",to,"), labels);
+    ASSERT_TRUE(strstr(labels, "_balances,") && strstr(labels, "Deposited,") && strstr(labels, "deposit,"), labels);
+    ASSERT_TRUE(strstr(labels, "MAX_FEE,") && strstr(labels, "Other,") && strstr(labels, "Vault,"), labels);
+    ASSERT_TRUE(strstr(labels, "keccak256,") && strstr(labels, "msg,") && strstr(labels, "uint256,"), labels);
+    ASSERT_TRUE(!strstr(labels, "later") && !strstr(labels, "otherThing") && !strstr(labels, "otherTotal"), labels);
+    ASSERT_TRUE(!list.incomplete, "Every candidate should fit");
+
+    // The prefix matches ignoring case, and the runs are merged in order.
+    labels = complete_at(&store, &arena, COMPLETION_VAULT("uint256 x = D|"), 500, &list);
+    ASSERT_TRUE(strcmp(labels, "days,delete,deposit,Deposited,do") == 0, labels);
+    labels = complete_at(&store, &arena, COMPLETION_VAULT("return _b|"), 500, &list);
+    ASSERT_TRUE(strcmp(labels, "_balances") == 0, labels);
+
+    // Members of the globals after a dot; other objects have unknown types.
+    labels = complete_at(&store, &arena, COMPLETION_VAULT("address who = msg.s|"), 500, &list);
+    ASSERT_TRUE(strcmp(labels, "sender,sig") == 0, labels);
+    ASSERT_TRUE(list.items[0].kind == LSP_COMPLETION_PROPERTY, "Members should be properties");
+    labels = complete_at(&store, &arena, COMPLETION_VAULT("bytes memory b = abi.|"), 500, &list);
+    ASSERT_TRUE(strncmp(labels, "decode,encode,encodeCall,", 25) == 0, labels);
+    labels = complete_at(&store, &arena, COMPLETION_VAULT("uint256 y = fee.|"), 500, &list);
+    ASSERT_TRUE(strcmp(labels, "") == 0, labels);
+
+    // The limit marks the list incomplete.
+    labels = complete_at(&store, &arena, COMPLETION_VAULT("u|"), 3, &list);
+    ASSERT_TRUE(strcmp(labels, "uint,uint128,uint16") == 0, labels);
+    ASSERT_TRUE(list.incomplete, "The list should be incomplete");
+
+    // The built-in table is searched by binary search, so it must stay sorted.
+    for (size_t i = 1; i < sizeof(builtin_items) / sizeof(builtin_items[0]); i++) {
+        ASSERT_TRUE(compare_labels(builtin_items[i - 1].label, builtin_items[i].label) < 0,
+                    builtin_items[i].label.string_start);
+    }
+
+    fdn_arena_free(&arena);
+    lsp_document_store_free(&store);
     return 1;
 }
 
@@ -149,16 +2149,59 @@ int test_parser_handles_id_parsing(void) {
 int main(void) {
     TestStats stats = {0, 0};
 
+    if (!fdn_arena_init(&test_arena, 64 * 1024)) {
+        return 1;
+    }
+
     printf("========= Starting Tests =========\n\n");
 
+    RUN_TEST(test_arena_reset_coalesces_blocks);
+    RUN_TEST(test_interner_gives_equal_strings_one_id);
+    RUN_TEST(test_interner_is_shared_by_threads);
+    RUN_TEST(test_queue_passes_items_between_threads);
     RUN_TEST(test_lexer_simple_tokens);
+    RUN_TEST(test_lexer_bulk_scanning_matches_scalar);
+    RUN_TEST(test_lexer_long_strings_and_whitespace);
     RUN_TEST(test_parser_returns_null_on_empty_input);
     RUN_TEST(test_parser_handles_method_parsing);
     RUN_TEST(test_parser_handles_id_parsing);
+    RUN_TEST(test_parser_tape_walks_nested_params);
+    RUN_TEST(test_parser_tape_rejects_invalid_json);
+    RUN_TEST(test_parser_find_paths_in_one_pass);
+    RUN_TEST(test_parser_skips_params_of_request);
+    RUN_TEST(test_transport_frames_messages);
+    RUN_TEST(test_transport_reports_queued_messages);
+    RUN_TEST(test_writer_builds_nested_json);
+    RUN_TEST(test_transport_writes_framed_messages);
+    RUN_TEST(test_dispatcher_lookup_uses_exact_methods);
+    RUN_TEST(test_logger_writes_queued_lines_in_order);
+    RUN_TEST(test_lexer_decodes_utf8);
+    RUN_TEST(test_json_string_unescape_decodes_escapes);
+    RUN_TEST(test_documents_apply_incremental_edits);
+    RUN_TEST(test_documents_map_utf16_positions);
+    RUN_TEST(test_dispatcher_syncs_documents);
+    RUN_TEST(test_dispatcher_syncs_imports);
+    RUN_TEST(test_dispatcher_answers_unknown_and_cancelled_requests);
+    RUN_TEST(test_server_answers_requests_from_workers);
+    RUN_TEST(test_server_cancels_jobs_by_decoded_uri);
+    RUN_TEST(test_solidity_lexer_tokens);
+    RUN_TEST(test_solidity_lexer_recognizes_keywords);
+    RUN_TEST(test_solidity_parser_builds_tree);
+    RUN_TEST(test_solidity_syntax_follows_edits);
+    RUN_TEST(test_workspace_converts_uris_to_paths);
+    RUN_TEST(test_workspace_indexes_solidity_files);
+    RUN_TEST(test_workspace_reuses_the_index_cache);
+    RUN_TEST(test_symbols_collects_declarations);
+    RUN_TEST(test_symbol_index_ranks_fuzzy_matches);
+    RUN_TEST(test_completion_offers_scope_and_builtins);
+    RUN_TEST(test_reference_index_finds_identifiers_across_files);
+    RUN_TEST(test_import_graph_orders_dependents_by_level);
+    RUN_TEST(test_import_graph_applies_file_remappings);
 
     printf("========== Test Summary ==========\n");
     printf("Passed: %d, Failed: %d\n", stats.passed, stats.failed);
     printf("==================================\n");
 
+    fdn_arena_free(&test_arena);
     return stats.failed > 0 ? 1 : 0;
 }